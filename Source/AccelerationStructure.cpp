@@ -28,7 +28,7 @@ void AccelerationStructure::AddBottomLevel(std::vector<VkAccelerationStructureGe
 
 	VmaAllocationCreateInfo allocation_create_info = {};
 	allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-	VK(vmaCreateBuffer(Vk.Allocator, &buffer_create_info, &allocation_create_info, &acceleration_structure.Buffer, &acceleration_structure.Allocation, NULL));
+	VkCreateBuffer(buffer_create_info, allocation_create_info, VK_MEMORY_CATEGORY_ACCELERATION_STRUCTURES, acceleration_structure.Buffer, acceleration_structure.Allocation);
 
 	VkAccelerationStructureCreateInfoKHR acceleration_structure_info = {};
 	acceleration_structure_info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
@@ -173,7 +173,7 @@ void AccelerationStructure::Create(const RenderContext& rc, uint32_t model_count
 		VmaAllocationCreateInfo allocation_create_info = {};
 		allocation_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
 		allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-		VK(vmaCreateBuffer(Vk.Allocator, &buffer_create_info, &allocation_create_info, &m_InstanceBuffer, &m_InstanceBufferAllocation, NULL));
+		VkCreateBuffer(buffer_create_info, allocation_create_info, VK_MEMORY_CATEGORY_ACCELERATION_STRUCTURES, m_InstanceBuffer, m_InstanceBufferAllocation);
 
 		VkAllocation buffer_allocation = VkAllocateUploadBuffer(buffer_create_info.size);
 		memcpy(buffer_allocation.Data, m_Instances.data(), sizeof(VkAccelerationStructureInstanceKHR)* m_Instances.size());
@@ -242,7 +242,7 @@ void AccelerationStructure::Create(const RenderContext& rc, uint32_t model_count
 
 		VmaAllocationCreateInfo allocation_create_info = {};
 		allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-		VK(vmaCreateBuffer(Vk.Allocator, &buffer_create_info, &allocation_create_info, &m_TopLevel.Buffer, &m_TopLevel.Allocation, NULL));
+		VkCreateBuffer(buffer_create_info, allocation_create_info, VK_MEMORY_CATEGORY_ACCELERATION_STRUCTURES, m_TopLevel.Buffer, m_TopLevel.Allocation);
 
 		VkAccelerationStructureCreateInfoKHR acceleration_structure_info = {};
 		acceleration_structure_info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
@@ -270,7 +270,7 @@ void AccelerationStructure::Create(const RenderContext& rc, uint32_t model_count
 
 		VmaAllocationCreateInfo allocation_create_info = {};
 		allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-		VK(vmaCreateBuffer(Vk.Allocator, &buffer_create_info, &allocation_create_info, &m_ScratchBuffer, &m_ScratchBufferAllocation, NULL));
+		VkCreateBuffer(buffer_create_info, allocation_create_info, VK_MEMORY_CATEGORY_ACCELERATION_STRUCTURES, m_ScratchBuffer, m_ScratchBufferAllocation);
 
 		VkDeviceAddress scratch_buffer_address = VkUtilGetDeviceAddress(m_ScratchBuffer);
 
@@ -292,7 +292,7 @@ void AccelerationStructure::Create(const RenderContext& rc, uint32_t model_count
 		VmaAllocationCreateInfo allocation_create_info = {};
 		allocation_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
 		allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-		VK(vmaCreateBuffer(Vk.Allocator, &buffer_create_info, &allocation_create_info, &m_TransparentInstanceBuffer, &m_TransparentInstanceBufferAllocation, NULL));
+		VkCreateBuffer(buffer_create_info, allocation_create_info, VK_MEMORY_CATEGORY_ACCELERATION_STRUCTURES, m_TransparentInstanceBuffer, m_TransparentInstanceBufferAllocation);
 
 		VkAllocation buffer_allocation = VkAllocateUploadBuffer(buffer_create_info.size);
 		memcpy(buffer_allocation.Data, transparent_instances.data(), buffer_create_info.size);
@@ -363,6 +363,51 @@ void AccelerationStructure::Create(const RenderContext& rc, uint32_t model_count
 		});
 }
 
+void AccelerationStructure::OnMoved(const std::vector<VkMove>& moves)
+{
+    if (!Vk.IsRayTracingSupported)
+    {
+        return;
+    }
+
+	for (const VkMove& move : moves)
+	{
+		if (move.OldBuffer != VK_NULL_HANDLE)
+		{
+			for (VkDescriptorBufferInfo& buffer_info : m_IndexBufferInfo)
+			{
+				buffer_info.buffer = buffer_info.buffer == move.OldBuffer ? move.NewBuffer : buffer_info.buffer;
+			}
+			for (VkDescriptorBufferInfo& buffer_info : m_VertexBufferInfo)
+			{
+				buffer_info.buffer = buffer_info.buffer == move.OldBuffer ? move.NewBuffer : buffer_info.buffer;
+			}
+
+			// Built bottom levels keep their own copy of the triangles, the geometries only matter to later builds
+			if (move.OldAddress == 0)
+			{
+				continue;
+			}
+			for (AccelerationStructureBottomLevel& acceleration_structure : m_BottomLevels)
+			{
+				for (VkAccelerationStructureGeometryKHR& geometry : acceleration_structure.Geometries)
+				{
+					VkAccelerationStructureGeometryTrianglesDataKHR& triangles = geometry.geometry.triangles;
+					triangles.vertexData.deviceAddress = triangles.vertexData.deviceAddress == move.OldAddress ? move.NewAddress : triangles.vertexData.deviceAddress;
+					triangles.indexData.deviceAddress = triangles.indexData.deviceAddress == move.OldAddress ? move.NewAddress : triangles.indexData.deviceAddress;
+				}
+			}
+		}
+		else
+		{
+			for (VkDescriptorImageInfo& image_info : m_BaseColorImageInfo)
+			{
+				image_info.imageView = image_info.imageView == move.OldImageView ? move.NewImageView : image_info.imageView;
+			}
+		}
+	}
+}
+
 void AccelerationStructure::Destroy()
 {
     if (!Vk.IsRayTracingSupported)
@@ -370,16 +415,16 @@ void AccelerationStructure::Destroy()
         return;
     }
 
-	vmaDestroyBuffer(Vk.Allocator, m_TransparentInstanceBuffer, m_TransparentInstanceBufferAllocation);
-	vmaDestroyBuffer(Vk.Allocator, m_InstanceBuffer, m_InstanceBufferAllocation);
-	vmaDestroyBuffer(Vk.Allocator, m_ScratchBuffer, m_ScratchBufferAllocation);
+	VkDestroyBuffer(m_TransparentInstanceBuffer, m_TransparentInstanceBufferAllocation);
+	VkDestroyBuffer(m_InstanceBuffer, m_InstanceBufferAllocation);
+	VkDestroyBuffer(m_ScratchBuffer, m_ScratchBufferAllocation);
 
 	vkDestroyAccelerationStructureKHR(Vk.Device, m_TopLevel.AccelerationStructure, nullptr);
-	vmaDestroyBuffer(Vk.Allocator, m_TopLevel.Buffer, m_TopLevel.Allocation);
+	VkDestroyBuffer(m_TopLevel.Buffer, m_TopLevel.Allocation);
 
 	for (const AccelerationStructureBottomLevel& acceleration_structure : m_BottomLevels)
 	{
 		vkDestroyAccelerationStructureKHR(Vk.Device, acceleration_structure.AccelerationStructure, nullptr);
-		vmaDestroyBuffer(Vk.Allocator, acceleration_structure.Buffer, acceleration_structure.Allocation);
+		VkDestroyBuffer(acceleration_structure.Buffer, acceleration_structure.Allocation);
 	}
 }
@@ -54,6 +54,9 @@ public:
 	void													Create(const RenderContext& rc, uint32_t model_count, const GltfModel* models);
 	void													Destroy();
 
+	// Points the descriptors and geometries at the model buffers and textures defragmentation moved
+	void													OnMoved(const std::vector<VkMove>& moves);
+
 private:
 	void													AddBottomLevel(std::vector<VkAccelerationStructureGeometryKHR>&& geometries, std::vector<VkAccelerationStructureBuildRangeInfoKHR>&& build_range_infos, const std::vector<uint32_t>& primitive_counts, const glm::mat4& transform, uint32_t instance_index = 0xffffffffu);
 };
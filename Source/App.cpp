@@ -1,4 +1,5 @@
 #include "App.h"
+#include "Trace.h"
 #include "VkUtil.h"
 
 #ifdef _WIN32
@@ -9,6 +10,211 @@
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+static double GetTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Render targets are allocated in steps of this, and rendered into at the window size, so that dragging a window
+// edge only reallocates them when the size crosses a step
+static const uint32_t RENDER_TARGET_SIZE_BUCKET = 256;
+
+static uint32_t GetRenderTargetSize(uint32_t size)
+{
+	return VkAlignUp(size, RENDER_TARGET_SIZE_BUCKET);
+}
+
+// Range of the sizes a resize stress test renders at
+static const uint32_t STRESS_RESIZE_MIN_WIDTH = 320;
+static const uint32_t STRESS_RESIZE_MAX_WIDTH = 3840;
+static const uint32_t STRESS_RESIZE_MIN_HEIGHT = 180;
+static const uint32_t STRESS_RESIZE_MAX_HEIGHT = 2160;
+
+static void PrintMemoryPoolStats(const char* name, const VkMemoryPoolStats& stats)
+{
+	const float mib = 1.0f / (1024.0f * 1024.0f);
+	printf("Information:   %-12s %6u %9.1f %9.1f %6u %11.1f %8.1f%%\n", name, stats.BlockCount, static_cast<float>(stats.BlockBytes) * mib, static_cast<float>(stats.UsedBytes) * mib,
+		stats.FreeRangeCount, static_cast<float>(stats.LargestFreeRange) * mib, VkGetMemoryFragmentation(stats) * 100.0f);
+}
+
+enum AppSettingType
+{
+	APP_SETTING_TYPE_BOOL = 0,
+	APP_SETTING_TYPE_INT,
+	APP_SETTING_TYPE_FLOAT,
+	APP_SETTING_TYPE_FLOAT3,
+};
+struct AppSetting
+{
+	const char*		Name;
+	AppSettingType	Type;
+	void*			Value;
+};
+static uint64_t HashSettings(const std::vector<AppSetting>& settings)
+{
+	// FNV-1a over the values
+	uint64_t hash = 14695981039346656037ULL;
+	for (const AppSetting& setting : settings)
+	{
+		size_t size = 0;
+		switch (setting.Type)
+		{
+		case APP_SETTING_TYPE_BOOL:		size = sizeof(bool); break;
+		case APP_SETTING_TYPE_INT:		size = sizeof(int32_t); break;
+		case APP_SETTING_TYPE_FLOAT:	size = sizeof(float); break;
+		case APP_SETTING_TYPE_FLOAT3:	size = sizeof(float) * 3; break;
+		}
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash = (hash ^ static_cast<const uint8_t*>(setting.Value)[i]) * 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+static std::vector<AppSetting> GetSettings(App& app)
+{
+	return
+	{
+		{ "Lighting.SunDirection",						APP_SETTING_TYPE_FLOAT3,	&app.m_RenderContext.SunDirection },
+		{ "Lighting.AmbientLightIntensity",				APP_SETTING_TYPE_FLOAT,		&app.m_RenderModel.m_AmbientLightIntensity },
+		{ "Lighting.DirectionalLightIntensity",			APP_SETTING_TYPE_FLOAT,		&app.m_RenderModel.m_DirectionalLightIntensity },
+		{ "Lighting.SkyLightIntensity",					APP_SETTING_TYPE_FLOAT,		&app.m_RenderAtmosphere.m_SkyLightIntensity },
+
+		{ "SSAO.Enable",								APP_SETTING_TYPE_BOOL,		&app.m_RenderContext.EnableScreenSpaceAmbientOcclusion },
+		{ "SSAO.Radius",								APP_SETTING_TYPE_FLOAT,		&app.m_RenderSSAO.m_Radius },
+		{ "SSAO.Bias",									APP_SETTING_TYPE_FLOAT,		&app.m_RenderSSAO.m_Bias },
+		{ "SSAO.Intensity",								APP_SETTING_TYPE_FLOAT,		&app.m_RenderSSAO.m_Intensity },
+		{ "SSAO.Blur",									APP_SETTING_TYPE_BOOL,		&app.m_RenderSSAO.m_Blur },
+
+		{ "AO.Enable",									APP_SETTING_TYPE_BOOL,		&app.m_RenderContext.EnableRayTracedAmbientOcclusion },
+		{ "AO.Radius",									APP_SETTING_TYPE_FLOAT,		&app.m_RenderAO.m_Radius },
+		{ "AO.Falloff",									APP_SETTING_TYPE_FLOAT,		&app.m_RenderAO.m_Falloff },
+		{ "AO.Filter",									APP_SETTING_TYPE_BOOL,		&app.m_RenderAO.m_Filter },
+		{ "AO.FilterIterations",						APP_SETTING_TYPE_INT,		&app.m_RenderAO.m_FilterIterations },
+		{ "AO.FilterKernelSigma",						APP_SETTING_TYPE_FLOAT,		&app.m_RenderAO.m_FilterKernelSigma },
+		{ "AO.FilterDepthSigma",						APP_SETTING_TYPE_FLOAT,		&app.m_RenderAO.m_FilterDepthSigma },
+
+		{ "Shadows.Enable",								APP_SETTING_TYPE_BOOL,		&app.m_RenderContext.EnableRayTracedShadows },
+		{ "Shadows.AlphaTest",							APP_SETTING_TYPE_BOOL,		&app.m_RenderShadows.m_AlphaTest },
+		{ "Shadows.ConeAngle",							APP_SETTING_TYPE_FLOAT,		&app.m_RenderShadows.m_ConeAngle },
+		{ "Shadows.Reproject",							APP_SETTING_TYPE_BOOL,		&app.m_RenderShadows.m_Reproject },
+		{ "Shadows.ReprojectAlphaShadow",				APP_SETTING_TYPE_FLOAT,		&app.m_RenderShadows.m_ReprojectAlphaShadow },
+		{ "Shadows.ReprojectAlphaMoments",				APP_SETTING_TYPE_FLOAT,		&app.m_RenderShadows.m_ReprojectAlphaMoments },
+		{ "Shadows.Filter",								APP_SETTING_TYPE_BOOL,		&app.m_RenderShadows.m_Filter },
+		{ "Shadows.FilterIterations",					APP_SETTING_TYPE_INT,		&app.m_RenderShadows.m_FilterIterations },
+		{ "Shadows.FilterPhiVariance",					APP_SETTING_TYPE_FLOAT,		&app.m_RenderShadows.m_FilterPhiVariance },
+
+		{ "PostProcess.TemporalAA",						APP_SETTING_TYPE_BOOL,		&app.m_RenderPostProcess.m_TemporalAAEnable },
+		{ "PostProcess.Exposure",						APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_Exposure },
+		{ "PostProcess.Saturation",						APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_Saturation },
+		{ "PostProcess.Contrast",						APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_Contrast },
+		{ "PostProcess.Gamma",							APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_Gamma },
+		{ "PostProcess.GamutExpansion",					APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_GamutExpansion },
+		{ "PostProcess.ViewLuxoDoubleChecker",			APP_SETTING_TYPE_BOOL,		&app.m_RenderPostProcess.m_ViewLuxoDoubleChecker },
+		{ "PostProcess.DisplayMapping",					APP_SETTING_TYPE_INT,		&app.m_RenderPostProcess.m_DisplayMapping },
+		{ "PostProcess.DisplayMappingAux",				APP_SETTING_TYPE_INT,		&app.m_RenderPostProcess.m_DisplayMappingAux },
+		{ "PostProcess.DisplayMappingSplitScreen",		APP_SETTING_TYPE_BOOL,		&app.m_RenderPostProcess.m_DisplayMappingSplitScreen },
+		{ "PostProcess.DisplayMappingSplitScreenOffset",	APP_SETTING_TYPE_FLOAT,	&app.m_RenderPostProcess.m_DisplayMappingSplitScreenOffset },
+		{ "PostProcess.HdrDisplayLuminanceMin",			APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_HdrDisplayLuminanceMin },
+		{ "PostProcess.HdrDisplayLuminanceMax",			APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_HdrDisplayLuminanceMax },
+		{ "PostProcess.SdrWhiteLevel",					APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_SdrWhiteLevel },
+		{ "PostProcess.ACESMidPoint",					APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_ACESMidPoint },
+		{ "PostProcess.BT2390MidPoint",					APP_SETTING_TYPE_FLOAT,		&app.m_RenderPostProcess.m_BT2390MidPoint },
+
+		{ "Display.PresentMode",						APP_SETTING_TYPE_INT,		&app.m_PresentMode },
+		{ "Display.LowLatency",							APP_SETTING_TYPE_BOOL,		&app.m_LowLatency },
+		{ "Display.FramesInFlight",						APP_SETTING_TYPE_INT,		&app.m_FramesInFlight },
+		{ "Display.UnfocusedFrameRate",					APP_SETTING_TYPE_INT,		&app.m_UnfocusedFrameRate },
+		{ "Display.RenderOnChange",						APP_SETTING_TYPE_BOOL,		&app.m_RenderOnChange },
+
+		{ "Debug.Enable",								APP_SETTING_TYPE_BOOL,		&app.m_RenderContext.DebugEnable },
+		{ "Debug.Index",								APP_SETTING_TYPE_INT,		&app.m_RenderContext.DebugIndex },
+	};
+}
+
+void App::LoadSettings(const char* filepath)
+{
+	std::ifstream file(filepath);
+	if (!file.is_open())
+	{
+		VkError("Failed to open settings " + std::string(filepath));
+	}
+
+	const std::vector<AppSetting> settings = GetSettings(*this);
+
+	// One setting per line: Name = Value
+	std::string line;
+	while (std::getline(file, line))
+	{
+		const size_t separator = line.find('=');
+		if (line.empty() || line[0] == '#' || separator == std::string::npos)
+			continue;
+
+		std::string name = line.substr(0, separator);
+		name.erase(name.find_last_not_of(" \t") + 1);
+		std::istringstream value(line.substr(separator + 1));
+
+		auto setting = std::find_if(settings.begin(), settings.end(), [&](const AppSetting& s) { return name == s.Name; });
+		if (setting == settings.end())
+		{
+			VkError("Unknown setting " + name + " in " + std::string(filepath));
+		}
+
+		switch (setting->Type)
+		{
+		case APP_SETTING_TYPE_BOOL:		value >> *static_cast<bool*>(setting->Value); break;
+		case APP_SETTING_TYPE_INT:		value >> *static_cast<int32_t*>(setting->Value); break;
+		case APP_SETTING_TYPE_FLOAT:	value >> *static_cast<float*>(setting->Value); break;
+		case APP_SETTING_TYPE_FLOAT3:	value >> static_cast<float*>(setting->Value)[0] >> static_cast<float*>(setting->Value)[1] >> static_cast<float*>(setting->Value)[2]; break;
+		}
+		if (value.fail())
+		{
+			VkError("Malformed value for setting " + name + " in " + std::string(filepath));
+		}
+	}
+
+	if (static_cast<uint32_t>(m_PresentMode) >= VK_PRESENT_MODE_COUNT)
+	{
+		VkError("Malformed value for setting Display.PresentMode in " + std::string(filepath));
+	}
+	if (m_FramesInFlight < 1 || m_FramesInFlight > static_cast<int32_t>(VK_MAX_FRAMES_IN_FLIGHT))
+	{
+		VkError("Malformed value for setting Display.FramesInFlight in " + std::string(filepath));
+	}
+
+	m_RenderContext.SunDirection = glm::normalize(m_RenderContext.SunDirection);
+	m_RenderContext.EnableRayTracedAmbientOcclusion &= Vk.IsRayTracingSupported;
+	m_RenderContext.EnableRayTracedShadows &= Vk.IsRayTracingSupported;
+}
+void App::SaveSettings(const char* filepath)
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+	{
+		VkError("Failed to create settings " + std::string(filepath));
+	}
+
+	for (const AppSetting& setting : GetSettings(*this))
+	{
+		file << setting.Name << " = ";
+		switch (setting.Type)
+		{
+		case APP_SETTING_TYPE_BOOL:		file << *static_cast<const bool*>(setting.Value); break;
+		case APP_SETTING_TYPE_INT:		file << *static_cast<const int32_t*>(setting.Value); break;
+		case APP_SETTING_TYPE_FLOAT:	file << *static_cast<const float*>(setting.Value); break;
+		case APP_SETTING_TYPE_FLOAT3:	file << static_cast<const float*>(setting.Value)[0] << ' ' << static_cast<const float*>(setting.Value)[1] << ' ' << static_cast<const float*>(setting.Value)[2]; break;
+		}
+		file << '\n';
+	}
+}
+
 void App::ResizeCallback(GLFWwindow* window, int width, int height)
 {
 	App* app = static_cast<App*>(glfwGetWindowUserPointer(window));
@@ -20,35 +226,100 @@ void App::MinimizeCallback(GLFWwindow* window, int minimized)
 	App* app = static_cast<App*>(glfwGetWindowUserPointer(window));
 	app->m_Minimized = minimized == GLFW_TRUE;
 }
+void App::FocusCallback(GLFWwindow* window, int focused)
+{
+	App* app = static_cast<App*>(glfwGetWindowUserPointer(window));
+	app->m_Focused = focused == GLFW_TRUE;
+}
 
-void App::Initialize(uint32_t width, uint32_t height, const char* title)
+void App::Initialize(const AppInitializeParams& params)
 {
-	glfwInit();
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	m_Window = glfwCreateWindow(width, height, title, NULL, NULL);
+	const double startup_begin_time = GetTime();
 
+	const uint32_t width = params.Width;
+	const uint32_t height = params.Height;
+
+	m_Window = NULL;
 	m_Width = width;
 	m_Height = height;
 	m_Minimized = false;
 	m_DisplayMode = VK_DISPLAY_MODE_SDR;
+	m_PresentMode = VK_PRESENT_MODE_FIFO;
+	m_LowLatency = false;
+	m_Focused = true;
+	m_UnfocusedFrameRate = 30;
+	m_RenderOnChange = false;
+	m_FramesInFlight = static_cast<int32_t>(VkMin(VkMax(params.FramesInFlight, 1U), VK_MAX_FRAMES_IN_FLIGHT));
+
+	m_Headless = params.Headless;
+	m_FrameCount = params.FrameCount;
+	m_WarmUpFrameCount = params.WarmUpFrameCount;
+	m_FixedDeltaTime = params.FixedDeltaTime;
+
+	m_SaveSettingsPath = params.SaveSettingsPath;
+	m_RecordCameraPath = params.RecordCameraPath;
+	m_BenchmarkPath = params.BenchmarkPath;
+	m_TracePath = params.TracePath;
+	m_MemoryStatsPath = params.MemoryStatsPath;
+	m_StressResizeCount = params.StressResizeCount;
+	m_DefragmentBytesPerFrame = static_cast<VkDeviceSize>(params.DefragmentBudget) * 1024 * 1024;
+	m_AssertZeroAllocations = params.AssertZeroAllocations;
+
+	if (!m_BenchmarkPath.empty())
+	{
+		if (m_FrameCount == 0)
+		{
+			VkError("A benchmark needs a number of frames to measure");
+		}
+		m_Benchmark.Reserve(m_FrameCount);
+		if (m_FixedDeltaTime <= 0.0f)
+		{
+			m_FixedDeltaTime = 1.0f / 60.0f;
+		}
+	}
 
-	glfwSetWindowUserPointer(m_Window, this);
-	glfwSetWindowSizeCallback(m_Window, ResizeCallback);
-	glfwSetWindowIconifyCallback(m_Window, MinimizeCallback);
+	// Only offscreen back buffers can take any size, and the frames after the resizes let the old targets retire
+	if (m_StressResizeCount > 0 && (!m_Headless || m_WarmUpFrameCount + m_FrameCount <= m_StressResizeCount))
+	{
+		VkError("A resize stress test needs --headless and more frames than resizes");
+	}
 
 	VkInitializeParams vk_params;
+	vk_params.WindowHandle = NULL;
+	vk_params.DisplayHandle = NULL;
+	if (!m_Headless)
+	{
+		glfwInit();
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		m_Window = glfwCreateWindow(width, height, params.Title, NULL, NULL);
+
+		glfwSetWindowUserPointer(m_Window, this);
+		glfwSetWindowSizeCallback(m_Window, ResizeCallback);
+		glfwSetWindowIconifyCallback(m_Window, MinimizeCallback);
+		glfwSetWindowFocusCallback(m_Window, FocusCallback);
+
 #ifdef _WIN32
-	vk_params.WindowHandle = glfwGetWin32Window(m_Window);
-	vk_params.DisplayHandle = GetModuleHandle(NULL);
+		vk_params.WindowHandle = glfwGetWin32Window(m_Window);
+		vk_params.DisplayHandle = GetModuleHandle(NULL);
 #else
-	vk_params.WindowHandle = reinterpret_cast<void*>(glfwGetX11Window(m_Window));
-	vk_params.DisplayHandle = glfwGetX11Display();
+		vk_params.WindowHandle = reinterpret_cast<void*>(glfwGetX11Window(m_Window));
+		vk_params.DisplayHandle = glfwGetX11Display();
 #endif
+	}
 	vk_params.BackBufferWidth = width;
 	vk_params.BackBufferHeight = height;
 	vk_params.DesiredBackBufferCount = 2;
+	vk_params.FramesInFlight = static_cast<uint32_t>(m_FramesInFlight);
 	vk_params.DisplayMode = m_DisplayMode;
+	vk_params.PresentMode = m_PresentMode;
 	vk_params.EnableValidationLayer = false;
+	vk_params.Headless = m_Headless;
+	vk_params.PipelineCachePath = params.PipelineCachePath.empty() ? NULL : params.PipelineCachePath.c_str();
+	vk_params.SerializeBarriers = params.SerializeBarriers;
+	vk_params.UseMemoryPools = params.UseMemoryPools;
+	vk_params.UseDeviceLocalUpload = params.UseDeviceLocalUpload;
+	vk_params.UseAsyncCompute = params.UseAsyncCompute;
+	JobInitialize(params.WorkerThreadCount);
 	VkInitialize(vk_params);
 
 	VkUtilCreateRenderPassParams color_render_pass_params;
@@ -151,7 +422,7 @@ void App::Initialize(uint32_t width, uint32_t height, const char* title)
 	for (size_t i = 0; i < m_RenderContext.BlueNoiseTextures.size(); ++i)
 	{
 		std::string filepath = "../Assets/Textures/BlueNoise_" + std::to_string(i) + ".png";
-		m_RenderContext.BlueNoiseTextures[i] = VkTextureLoad(filepath.c_str(), false);
+		m_RenderContext.BlueNoiseTextures[i] = VkTextureLoad(filepath.c_str(), false, true);	// SSAO samples them on the compute queue
 	}
 
 	m_RenderContext.CameraCurr.LookAt(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
@@ -181,15 +452,41 @@ void App::Initialize(uint32_t width, uint32_t height, const char* title)
 	m_RenderAtmosphere.Create(m_RenderContext);
 	m_RenderPostProcess.Create(m_RenderContext);
 	m_RenderImGui.Create(m_RenderContext, m_Window);
+	CreatePipelines(true);
 
 	m_RenderModel.SetAmbientLightLUT(m_RenderAtmosphere.m_AmbientLightLUT.ImageView);
 	m_RenderModel.SetDirectionalLightLUT(m_RenderAtmosphere.m_DirectionalLightLUT.ImageView);
+
+	if (!params.SettingsPath.empty())
+	{
+		LoadSettings(params.SettingsPath.c_str());
+	}
+	m_PlayCameraPath = !params.CameraPath.empty();
+	if (m_PlayCameraPath)
+	{
+		m_CameraPath.Load(params.CameraPath.c_str());
+	}
+
+	// Warm and cold starts differ mostly in pipeline compilation, so they are told apart
+	const float startup_time = static_cast<float>((GetTime() - startup_begin_time) * 1000.0);
+	printf("Startup took %.1f ms with a %s pipeline cache\n", startup_time, Vk.IsPipelineCacheWarm ? "warm" : "cold");
+	m_Benchmark.m_StartupTime = startup_time;
+	m_Benchmark.m_IsPipelineCacheWarm = Vk.IsPipelineCacheWarm;
 }
 
 void App::Terminate()
 {
 	vkDeviceWaitIdle(Vk.Device);
 
+	if (!m_SaveSettingsPath.empty())
+	{
+		SaveSettings(m_SaveSettingsPath.c_str());
+	}
+	if (!m_RecordCameraPath.empty() && !m_PlayCameraPath)
+	{
+		m_CameraPath.Save(m_RecordCameraPath.c_str());
+	}
+
 	m_RenderModel.Destroy();
 	m_RenderMotion.Destroy();
 	m_RenderSSAO.Destroy();
@@ -199,6 +496,8 @@ void App::Terminate()
 	m_RenderPostProcess.Destroy();
 	m_RenderImGui.Destroy();
 
+	m_RenderGraph.Destroy();
+
 	m_AccelerationStructure.Destroy();
 
 	for (uint32_t i = 0; i < MODEL_COUNT; ++i)
@@ -225,12 +524,16 @@ void App::Terminate()
 	vkDestroyRenderPass(Vk.Device, m_RenderContext.UiRenderPass, NULL);
 
 	VkTerminate();
+	JobTerminate();
 
-	glfwDestroyWindow(m_Window);
-	glfwTerminate();
+	if (!m_Headless)
+	{
+		glfwDestroyWindow(m_Window);
+		glfwTerminate();
+	}
 }
 
-void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
+void App::CreateRenderTargets(uint32_t width, uint32_t height)
 {
     VkTextureCreateParams color_texture_params;
     color_texture_params.Type = VK_IMAGE_TYPE_2D;
@@ -240,6 +543,8 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
     color_texture_params.Format = VK_FORMAT_B10G11R11_UFLOAT_PACK32;
     color_texture_params.Usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     color_texture_params.InitialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+    color_texture_params.IsSharedWithCompute = true;
 	m_RenderContext.ColorTexture = VkTextureCreate(color_texture_params);
 
     VkTextureCreateParams depth_texture_params;
@@ -250,6 +555,8 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
     depth_texture_params.Format = VK_FORMAT_D32_SFLOAT;
     depth_texture_params.Usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     depth_texture_params.InitialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depth_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+    depth_texture_params.IsSharedWithCompute = true;
 	m_RenderContext.DepthTexture = VkTextureCreate(depth_texture_params);
 
 	VkTextureCreateParams ui_texture_params;
@@ -260,6 +567,7 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
 	ui_texture_params.Format = VK_FORMAT_R8G8B8A8_UNORM;
 	ui_texture_params.Usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	ui_texture_params.InitialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	ui_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
 	m_RenderContext.UiTexture = VkTextureCreate(ui_texture_params);
 
 	VkTextureCreateParams normal_texture_params;
@@ -270,6 +578,8 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
 	normal_texture_params.Format = VK_FORMAT_R8G8B8A8_UNORM;
 	normal_texture_params.Usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	normal_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	normal_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+	normal_texture_params.IsSharedWithCompute = true;
 	m_RenderContext.NormalTexture = VkTextureCreate(normal_texture_params);
 
 	VkTextureCreateParams motion_texture_params;
@@ -280,6 +590,8 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
 	motion_texture_params.Format = VK_FORMAT_R16G16B16A16_SFLOAT;
 	motion_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	motion_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	motion_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+	motion_texture_params.IsSharedWithCompute = true;
 	m_RenderContext.MotionTexture = VkTextureCreate(motion_texture_params);
 
 	VkTextureCreateParams screen_space_ambient_occlusion_texture_params;
@@ -290,6 +602,8 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
 	screen_space_ambient_occlusion_texture_params.Format = VK_FORMAT_R8_UNORM;
 	screen_space_ambient_occlusion_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	screen_space_ambient_occlusion_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	screen_space_ambient_occlusion_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+	screen_space_ambient_occlusion_texture_params.IsSharedWithCompute = true;
 	m_RenderContext.ScreenSpaceAmbientOcclusionTexture = VkTextureCreate(screen_space_ambient_occlusion_texture_params);
 
 	VkTextureCreateParams ray_traced_ambient_occlusion_texture_params;
@@ -300,6 +614,8 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
 	ray_traced_ambient_occlusion_texture_params.Format = VK_FORMAT_R8_UNORM;
 	ray_traced_ambient_occlusion_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	ray_traced_ambient_occlusion_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	ray_traced_ambient_occlusion_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+	ray_traced_ambient_occlusion_texture_params.IsSharedWithCompute = true;
 	m_RenderContext.RayTracedAmbientOcclusionTexture = VkTextureCreate(ray_traced_ambient_occlusion_texture_params);
 
 	VkTextureCreateParams shadow_texture_params;
@@ -310,6 +626,8 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
 	shadow_texture_params.Format = VK_FORMAT_R16_UNORM;
 	shadow_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	shadow_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	shadow_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+	shadow_texture_params.IsSharedWithCompute = true;
 	m_RenderContext.ShadowTexture = VkTextureCreate(shadow_texture_params);
 
 	VkTextureCreateParams linear_depth_texture_params;
@@ -320,6 +638,8 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
 	linear_depth_texture_params.Format = VK_FORMAT_R16G16_UNORM;
 	linear_depth_texture_params.Usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	linear_depth_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	linear_depth_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+	linear_depth_texture_params.IsSharedWithCompute = true;
 	m_RenderContext.LinearDepthTextures[0] = VkTextureCreate(linear_depth_texture_params);
 	m_RenderContext.LinearDepthTextures[1] = VkTextureCreate(linear_depth_texture_params);
 
@@ -348,22 +668,106 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
 	ui_framebuffer_params.Width = width;
 	ui_framebuffer_params.Height = height;
 	m_RenderContext.UiFramebuffer = VkUtilCreateFramebuffer(ui_framebuffer_params);
+}
 
-	VkUtilCreateRenderPassParams back_buffer_render_pass_params;
-	back_buffer_render_pass_params.ColorAttachmentFormats = { Vk.SwapchainSurfaceFormat.format };
-	m_RenderContext.BackBufferRenderPass = VkUtilCreateRenderPass(back_buffer_render_pass_params);
+static void DestroyRenderTargets(const RenderContext& rc)
+{
+	vkDestroyFramebuffer(Vk.Device, rc.ColorFramebuffer, NULL);
+	vkDestroyFramebuffer(Vk.Device, rc.DepthFramebuffers[0], NULL);
+	vkDestroyFramebuffer(Vk.Device, rc.DepthFramebuffers[1], NULL);
+	vkDestroyFramebuffer(Vk.Device, rc.UiFramebuffer, NULL);
+
+	VkTextureDestroy(rc.ColorTexture);
+	VkTextureDestroy(rc.DepthTexture);
+	VkTextureDestroy(rc.UiTexture);
+	VkTextureDestroy(rc.NormalTexture);
+	VkTextureDestroy(rc.MotionTexture);
+	VkTextureDestroy(rc.ScreenSpaceAmbientOcclusionTexture);
+	VkTextureDestroy(rc.RayTracedAmbientOcclusionTexture);
+	VkTextureDestroy(rc.ShadowTexture);
+	VkTextureDestroy(rc.LinearDepthTextures[0]);
+	VkTextureDestroy(rc.LinearDepthTextures[1]);
+}
 
+static void DestroyFramebuffers(const std::vector<VkFramebuffer>& framebuffers)
+{
+	for (VkFramebuffer framebuffer : framebuffers)
+	{
+		vkDestroyFramebuffer(Vk.Device, framebuffer, NULL);
+	}
+}
+
+void App::CreateBackBufferFramebuffers()
+{
 	m_RenderContext.BackBufferFramebuffers.resize(Vk.SwapchainImageCount);
     for (uint32_t i = 0; i < Vk.SwapchainImageCount; ++i)
     {
         VkUtilCreateFramebufferParams back_buffer_framebuffer_params;
         back_buffer_framebuffer_params.RenderPass = m_RenderContext.BackBufferRenderPass;
         back_buffer_framebuffer_params.ColorAttachments = { Vk.SwapchainImageViews[i] };
-        back_buffer_framebuffer_params.Width = width;
-        back_buffer_framebuffer_params.Height = height;
+        back_buffer_framebuffer_params.Width = Vk.SwapchainImageExtent.width;
+        back_buffer_framebuffer_params.Height = Vk.SwapchainImageExtent.height;
 		m_RenderContext.BackBufferFramebuffers[i] = VkUtilCreateFramebuffer(back_buffer_framebuffer_params);
     }
 
+	m_SwapchainGeneration = Vk.SwapchainGeneration;
+}
+
+void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
+{
+	m_RenderContext.TargetWidth = GetRenderTargetSize(width);
+	m_RenderContext.TargetHeight = GetRenderTargetSize(height);
+	CreateRenderTargets(m_RenderContext.TargetWidth, m_RenderContext.TargetHeight);
+
+	VkUtilCreateRenderPassParams back_buffer_render_pass_params;
+	back_buffer_render_pass_params.ColorAttachmentFormats = { Vk.SwapchainSurfaceFormat.format };
+	m_RenderContext.BackBufferRenderPass = VkUtilCreateRenderPass(back_buffer_render_pass_params);
+
+	CreateBackBufferFramebuffers();
+
+	SetRenderSize(width, height);
+}
+
+void App::DestroyResolutionDependentResources()
+{
+	DestroyRenderTargets(m_RenderContext);
+	DestroyFramebuffers(m_RenderContext.BackBufferFramebuffers);
+
+	vkDestroyRenderPass(Vk.Device, m_RenderContext.BackBufferRenderPass, NULL);
+}
+
+void App::ResizeResolutionDependentResources(uint32_t width, uint32_t height)
+{
+	const uint32_t target_width = GetRenderTargetSize(width);
+	const uint32_t target_height = GetRenderTargetSize(height);
+	if (target_width != m_RenderContext.TargetWidth || target_height != m_RenderContext.TargetHeight)
+	{
+		// Frames in flight may still use the old targets
+		const RenderContext old_render_context = m_RenderContext;
+		VkDestroyDeferred([old_render_context]() { DestroyRenderTargets(old_render_context); });
+
+		m_RenderContext.TargetWidth = target_width;
+		m_RenderContext.TargetHeight = target_height;
+		CreateRenderTargets(target_width, target_height);
+
+		m_RenderShadows.RecreateResolutionDependentResources(m_RenderContext);
+		m_RenderPostProcess.RecreateResolutionDependentResources(m_RenderContext);
+	}
+
+	SetRenderSize(width, height);
+}
+
+void App::RecreateBackBufferFramebuffers()
+{
+	// Frames in flight may still render into the old back buffers
+	const std::vector<VkFramebuffer> old_framebuffers = m_RenderContext.BackBufferFramebuffers;
+	VkDestroyDeferred([old_framebuffers]() { DestroyFramebuffers(old_framebuffers); });
+
+	CreateBackBufferFramebuffers();
+}
+
+void App::SetRenderSize(uint32_t width, uint32_t height)
+{
 	m_RenderContext.Width = width;
 	m_RenderContext.Height = height;
 
@@ -373,60 +777,174 @@ void App::CreateResolutionDependentResources(uint32_t width, uint32_t height)
 	m_RenderContext.CameraPrev = m_RenderContext.CameraCurr;
 }
 
-void App::DestroyResolutionDependentResources()
+void App::CreatePipelines(bool initialize)
 {
-	vkDestroyFramebuffer(Vk.Device, m_RenderContext.ColorFramebuffer, NULL);
-	vkDestroyFramebuffer(Vk.Device, m_RenderContext.DepthFramebuffers[0], NULL);
-	vkDestroyFramebuffer(Vk.Device, m_RenderContext.DepthFramebuffers[1], NULL);
-	vkDestroyFramebuffer(Vk.Device, m_RenderContext.UiFramebuffer, NULL);
-	for (VkFramebuffer framebuffer : m_RenderContext.BackBufferFramebuffers)
+	// The ray tracing pipelines take the longest, so their jobs go first. Atmosphere and ImGui are not reloaded.
+	std::vector<std::function<void()>> create_pipelines =
 	{
-		vkDestroyFramebuffer(Vk.Device, framebuffer, NULL);
+		[this]() { m_RenderAO.CreatePipelines(m_RenderContext); },
+		[this]() { m_RenderShadows.CreatePipelines(m_RenderContext); },
+		[this]() { m_RenderModel.CreatePipelines(m_RenderContext); },
+		[this]() { m_RenderMotion.CreatePipelines(m_RenderContext); },
+		[this]() { m_RenderSSAO.CreatePipelines(m_RenderContext); },
+		[this]() { m_RenderPostProcess.CreatePipelines(m_RenderContext); },
+	};
+	if (initialize)
+	{
+		create_pipelines.push_back([this]() { m_RenderAtmosphere.CreatePipelines(m_RenderContext); });
+		create_pipelines.push_back([this]() { m_RenderImGui.CreatePipelines(m_RenderContext); });
 	}
 
-	vkDestroyRenderPass(Vk.Device, m_RenderContext.BackBufferRenderPass, NULL);
+	double start_time = GetTime();
+	JobParallelFor(static_cast<uint32_t>(create_pipelines.size()), [&](uint32_t i) { create_pipelines[i](); });
+	printf("Information: Created pipelines in %.1f ms on %u workers\n", (GetTime() - start_time) * 1000.0, JobGetWorkerCount());
 
-	VkTextureDestroy(m_RenderContext.ColorTexture);
-	VkTextureDestroy(m_RenderContext.DepthTexture);
-	VkTextureDestroy(m_RenderContext.UiTexture);
-	VkTextureDestroy(m_RenderContext.NormalTexture);
-	VkTextureDestroy(m_RenderContext.MotionTexture);
-	VkTextureDestroy(m_RenderContext.ScreenSpaceAmbientOcclusionTexture);
-	VkTextureDestroy(m_RenderContext.RayTracedAmbientOcclusionTexture);
-	VkTextureDestroy(m_RenderContext.ShadowTexture);
-	VkTextureDestroy(m_RenderContext.LinearDepthTextures[0]);
-	VkTextureDestroy(m_RenderContext.LinearDepthTextures[1]);
+	// These record commands, which only the main thread may do
+	m_RenderAO.UploadShaderBindingTable();
+	m_RenderShadows.UploadShaderBindingTable();
+	if (initialize)
+	{
+		m_RenderAtmosphere.PrecomputeLUTs();
+	}
 }
 
 void App::Run()
 {
 	CameraController controller;
 
-	while (!glfwWindowShouldClose(m_Window))
+	const uint32_t total_frame_count = m_FrameCount == 0 ? 0 : m_WarmUpFrameCount + m_FrameCount;
+	float camera_time = 0.0f;
+
+	bool trace_key_down = false;
+
+	uint64_t allocation_count_last_frame = 0;
+
+	// Temporal effects need a few frames to converge after the last change
+	const uint32_t render_on_change_settle_frame_count = 16;
+	const std::vector<AppSetting> settings = GetSettings(*this);
+	uint64_t settings_hash = HashSettings(settings);
+	uint32_t frames_since_change = 0;
+
+	double last_time = GetTime();
+
+	const uint32_t stress_resize_width = m_Width;
+	const uint32_t stress_resize_height = m_Height;
+	uint32_t stress_resize_random = 1;
+
+	uint32_t frame_count = 0;
+	while (total_frame_count == 0 || frame_count < total_frame_count)
 	{
-		glfwPollEvents();
+		// Each frame of a resize stress test renders at another size, and the frames after it at the initial one again
+		if (frame_count < m_StressResizeCount)
+		{
+			stress_resize_random = stress_resize_random * 1664525U + 1013904223U;
+			m_Width = STRESS_RESIZE_MIN_WIDTH + (stress_resize_random >> 8) % (STRESS_RESIZE_MAX_WIDTH - STRESS_RESIZE_MIN_WIDTH + 1);
+			stress_resize_random = stress_resize_random * 1664525U + 1013904223U;
+			m_Height = STRESS_RESIZE_MIN_HEIGHT + (stress_resize_random >> 8) % (STRESS_RESIZE_MAX_HEIGHT - STRESS_RESIZE_MIN_HEIGHT + 1);
+		}
+		else if (frame_count == m_StressResizeCount)
+		{
+			m_Width = stress_resize_width;
+			m_Height = stress_resize_height;
+		}
+
+		const double frame_begin_time = GetTime();
+		const uint64_t frame_begin_allocation_count = BenchmarkGetAllocationCount();
+
+		// Traces requested on the command line cover the measured frames
+		if (!m_TracePath.empty() && frame_count == m_WarmUpFrameCount && !TraceIsCapturing())
+		{
+			VkCalibrateTimestamps();
+			TraceBeginCapture(m_TracePath.c_str());
+		}
+		if (!m_Headless)
+		{
+			const bool key_down = glfwGetKey(m_Window, GLFW_KEY_F6) == GLFW_PRESS;
+			if (key_down && !trace_key_down)
+			{
+				if (TraceIsCapturing())
+				{
+					TraceEndCapture();
+				}
+				else
+				{
+					VkCalibrateTimestamps();
+					TraceBeginCapture("trace.json");
+				}
+			}
+			trace_key_down = key_down;
+		}
+
+		TRACE_ZONE("Frame");
+
+		// The frame that starts now shows the input sampled below, so the wait has to come first
+		if (m_LowLatency)
+		{
+			VkWaitForFrameLatency(0);
+		}
+
+		if (!m_Headless)
+		{
+			if (glfwWindowShouldClose(m_Window))
+				break;
+
+			// Nothing is drawn while minimized or once the image has settled, so sleep until something happens
+			const bool is_idle = m_Minimized || m_Width == 0 || m_Height == 0 || (m_RenderOnChange && frames_since_change >= render_on_change_settle_frame_count);
+			if (is_idle)
+			{
+				TRACE_ZONE("Wait For Events");
+				glfwWaitEvents();
+
+				// Time spent asleep does not move the camera
+				last_time = GetTime();
+			}
+			else
+			{
+				glfwPollEvents();
+			}
+		}
 
 		if (m_Minimized || m_Width == 0 || m_Height == 0)
 			continue;
 
-		if (m_Width != m_RenderContext.Width || m_Height != m_RenderContext.Height || m_DisplayMode != Vk.DisplayMode)
+		if (m_Width != m_RenderContext.Width || m_Height != m_RenderContext.Height || m_DisplayMode != Vk.DisplayMode || m_PresentMode != Vk.PresentMode || Vk.IsSwapchainOutOfDate)
 		{
-			vkDeviceWaitIdle(Vk.Device);
+			// A new display mode changes the back buffer format, which the post process pipelines are created for.
+			// That is the only change that drains the GPU, resizing the window does not.
+			const bool recreate_back_buffer_render_pass = m_DisplayMode != Vk.DisplayMode;
+			if (recreate_back_buffer_render_pass)
+			{
+				vkDeviceWaitIdle(Vk.Device);
+			}
+
+			VkResize(m_Width, m_Height, m_DisplayMode, m_PresentMode);
+			m_PresentMode = Vk.PresentMode;
+
+			if (recreate_back_buffer_render_pass)
+			{
+				vkDestroyRenderPass(Vk.Device, m_RenderContext.BackBufferRenderPass, NULL);
 
-			VkResize(m_Width, m_Height, m_DisplayMode);
+				VkUtilCreateRenderPassParams back_buffer_render_pass_params;
+				back_buffer_render_pass_params.ColorAttachmentFormats = { Vk.SwapchainSurfaceFormat.format };
+				m_RenderContext.BackBufferRenderPass = VkUtilCreateRenderPass(back_buffer_render_pass_params);
 
-			DestroyResolutionDependentResources();
-			CreateResolutionDependentResources(m_Width, m_Height);
+				m_RenderPostProcess.RecreatePipelines(m_RenderContext);
+			}
+
+			ResizeResolutionDependentResources(m_Width, m_Height);
+
+			frames_since_change = 0;
+		}
 
-			m_RenderSSAO.RecreateResolutionDependentResources(m_RenderContext);
-			m_RenderAO.RecreateResolutionDependentResources(m_RenderContext);
-			m_RenderShadows.RecreateResolutionDependentResources(m_RenderContext);
-			m_RenderPostProcess.RecreateResolutionDependentResources(m_RenderContext);
+		if (static_cast<uint32_t>(m_FramesInFlight) != Vk.FramesInFlight)
+		{
+			vkDeviceWaitIdle(Vk.Device);
 
-			m_RenderPostProcess.RecreatePipelines(m_RenderContext);
+			VkSetFramesInFlight(static_cast<uint32_t>(m_FramesInFlight));
+			m_FramesInFlight = static_cast<int32_t>(Vk.FramesInFlight);
 		}
 
-		if (glfwGetKey(m_Window, GLFW_KEY_F5) == GLFW_PRESS)
+		if (!m_Headless && glfwGetKey(m_Window, GLFW_KEY_F5) == GLFW_PRESS)
 		{
 			vkDeviceWaitIdle(Vk.Device);
 
@@ -436,23 +954,43 @@ void App::Run()
 			system("../Tools/ShaderCompiler/Bin/ShaderCompiler ../Source/Shaders/ ../Assets/Shaders/");
 #endif
 
-			m_RenderModel.RecreatePipelines(m_RenderContext);
-			m_RenderMotion.RecreatePipelines(m_RenderContext);
-			m_RenderSSAO.RecreatePipelines(m_RenderContext);
-			m_RenderAO.RecreatePipelines(m_RenderContext);
-			m_RenderShadows.RecreatePipelines(m_RenderContext);
-			//m_RenderAtmosphere.RecreatePipelines(m_RenderContext);
-			m_RenderPostProcess.RecreatePipelines(m_RenderContext);
+			m_RenderModel.DestroyPipelines();
+			m_RenderMotion.DestroyPipelines();
+			m_RenderSSAO.DestroyPipelines();
+			m_RenderAO.DestroyPipelines();
+			m_RenderShadows.DestroyPipelines();
+			m_RenderPostProcess.DestroyPipelines();
+			CreatePipelines(false);
+
+			frames_since_change = 0;
 		}
 
 		{
-			static double last_time = glfwGetTime();
-			double time = glfwGetTime();
-			float dt = static_cast<float>(time - last_time);
+			double time = GetTime();
+			float dt = m_FixedDeltaTime > 0.0f ? m_FixedDeltaTime : static_cast<float>(time - last_time);
 			last_time = time;
 
 			m_RenderContext.CameraPrev = m_RenderContext.CameraCurr;
-			controller.Update(m_RenderContext.CameraCurr, m_Window, dt);
+			if (m_PlayCameraPath)
+			{
+				m_CameraPath.Evaluate(camera_time, m_RenderContext.CameraCurr);
+
+				// The path starts once warm-up is done so that measured frames always see the same camera
+				if (frame_count >= m_WarmUpFrameCount)
+				{
+					camera_time += dt;
+				}
+			}
+			else if (!m_Headless)
+			{
+				controller.Update(m_RenderContext.CameraCurr, m_Window, dt);
+
+				if (!m_RecordCameraPath.empty())
+				{
+					m_CameraPath.Record(camera_time, m_RenderContext.CameraCurr);
+					camera_time += dt;
+				}
+			}
 
 			m_RenderPostProcess.Jitter(m_RenderContext);
 
@@ -460,6 +998,8 @@ void App::Run()
 		}
 
 		{
+			TRACE_ZONE("ImGui Build");
+
 			ImGui::StyleColorsDark();
 			ImGui::NewFrame();
 
@@ -536,6 +1076,28 @@ void App::Run()
 					ImGui::EndCombo();
 				}
 
+				const char* present_mode_names[] = { "FIFO", "FIFO Relaxed", "Mailbox", "Immediate" };
+				if (ImGui::BeginCombo("Present Mode", present_mode_names[m_PresentMode]))
+				{
+					for (uint32_t present_mode = 0; present_mode < VK_PRESENT_MODE_COUNT; ++present_mode)
+					{
+						if (Vk.IsPresentModeSupported[present_mode])
+						{
+							bool is_selected = m_PresentMode == present_mode;
+							if (ImGui::Selectable(present_mode_names[present_mode], is_selected))
+								m_PresentMode = static_cast<VkPresentMode>(present_mode);
+							if (is_selected)
+								ImGui::SetItemDefaultFocus();
+						}
+					}
+					ImGui::EndCombo();
+				}
+
+				ImGui::Checkbox("Low Latency", &m_LowLatency);
+				ImGui::SliderInt("Frames In Flight", &m_FramesInFlight, 1, static_cast<int>(VK_MAX_FRAMES_IN_FLIGHT));
+				ImGui::SliderInt("Unfocused Frame Cap", &m_UnfocusedFrameRate, 0, 144);
+				ImGui::Checkbox("Render On Change", &m_RenderOnChange);
+
 				if (Vk.DisplayMode == VK_DISPLAY_MODE_HDR10 || Vk.DisplayMode == VK_DISPLAY_MODE_SCRGB)
 				{
 					const char* display_mapping_names[] = { "ACES ODT", "BT2390 EETF", "SDR Emulation", "Luminance Visualization Scene", "Luminance Visualization Display" };
@@ -600,59 +1162,237 @@ void App::Run()
 
 			ImGui::Begin("Performance (ms)");
 			{
-				ImGui::Text("Models Depth:              %.3f", VkGetLabel("Models Depth"));
-				ImGui::Text("Motion Generate:           %.3f", VkGetLabel("Motion Generate"));
-				ImGui::Text("SSAO Generate:             %.3f", VkGetLabel("SSAO Generate"));
-				ImGui::Text("SSAO Blur:                 %.3f", VkGetLabel("SSAO Blur"));
-				ImGui::Text("AO Trace Rays:             %.3f", VkGetLabel("AO Trace Rays"));
-				ImGui::Text("AO Filter:                 %.3f", VkGetLabel("AO Filter"));
-				ImGui::Text("Shadows Trace Rays:        %.3f", VkGetLabel("Shadows Trace Rays"));
-				ImGui::Text("Shadows Reproject:         %.3f", VkGetLabel("Shadows Reproject"));
-				ImGui::Text("Shadows Filter:            %.3f", VkGetLabel("Shadows Filter"));
-				ImGui::Text("Models Color:              %.3f", VkGetLabel("Models Color"));
-				ImGui::Text("Atmosphere Sky:            %.3f", VkGetLabel("Atmosphere Sky"));
-				ImGui::Text("Post Process TAA:          %.3f", VkGetLabel("Post Process TAA"));
-				ImGui::Text("Post Process Tone Mapping: %.3f", VkGetLabel("Post Process Tone Mapping"));
-				ImGui::Text("ImGui:                     %.3f", VkGetLabel("ImGui"));
+				ImGui::Text("%-32s %7s %7s %7s %7s", "", "p50", "p95", "p99", "max");
+				for (uint32_t label : Vk.TimestampLabelsOrder)
+				{
+					const VkLabelStats stats = VkGetLabelStats(label);
+					const VkTimestampLabelHistory& history = Vk.TimestampLabelsResult[label];
+					const int indent = static_cast<int>(history.Depth) * 2;
+					ImGui::Text("%*s%-*s %7.3f %7.3f %7.3f %7.3f", indent, "", 32 - indent, history.Name.c_str(), stats.P50, stats.P95, stats.P99, stats.Max);
+				}
+
+				const float mib = 1.0f / (1024.0f * 1024.0f);
+				ImGui::Separator();
+				ImGui::Text("Upload Last Frame:         %.3f MiB", static_cast<float>(Vk.UploadStats.BytesLastFrame) * mib);
+				ImGui::Text("Upload Occupancy:          %.1f MiB (peak %.1f MiB)", static_cast<float>(Vk.UploadStats.Occupancy) * mib, static_cast<float>(Vk.UploadStats.PeakOccupancy) * mib);
+				ImGui::Text("Upload Capacity:           %.1f MiB in %u chunks", static_cast<float>(Vk.UploadStats.Capacity) * mib, Vk.UploadStats.ChunkCount);
+				ImGui::Text("Upload Stall:              %.3f (total %.3f)", Vk.UploadStats.StallTimeLastFrame, Vk.UploadStats.StallTimeTotal);
+				if (Vk.IsUploadDeviceLocal)
+				{
+					ImGui::Text("Upload Direct:             %.3f MiB (copies saved)", static_cast<float>(Vk.UploadStats.DirectBytesLastFrame) * mib);
+				}
+				ImGui::Text("CPU Wait:                  %.3f", Vk.FrameStats.CpuWaitTimeLastFrame);
+				ImGui::Text("Present Interval:          %.3f", Vk.FrameStats.PresentIntervalLastFrame);
+				ImGui::Text("Heap Allocations:          %llu", static_cast<unsigned long long>(allocation_count_last_frame));
+				ImGui::Text("Descriptor Sets:           %u (peak %u, capacity %u)", Vk.DescriptorPoolUsage[Vk.FrameIndexCurr].SetCount, Vk.DescriptorPoolUsagePeak.SetCount, Vk.DescriptorPoolCapacity.SetCount);
+			}
+			ImGui::End();
+
+			ImGui::Begin("Memory (MiB)");
+			{
+				const float mib = 1.0f / (1024.0f * 1024.0f);
+
+				const VkPhysicalDeviceMemoryProperties* memory_properties = NULL;
+				vmaGetMemoryProperties(Vk.Allocator, &memory_properties);
+				VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+				vmaGetBudget(Vk.Allocator, budgets);
+
+				ImGui::Text("%-24s %9s %9s %9s %9s", "Heap", "Usage", "Budget", "Allocated", "Blocks");
+				for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i)
+				{
+					const VmaBudget& budget = budgets[i];
+					const bool device_local = (memory_properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+					ImGui::Text("%u %-22s %9.1f %9.1f %9.1f %9.1f", i, device_local ? "Device Local" : "Host", static_cast<float>(budget.usage) * mib, static_cast<float>(budget.budget) * mib,
+						static_cast<float>(budget.allocationBytes) * mib, static_cast<float>(budget.blockBytes) * mib);
+				}
+				if (!Vk.IsMemoryBudgetSupported)
+				{
+					ImGui::Text("VK_EXT_memory_budget is not supported, budgets are estimated");
+				}
+
+				ImGui::Separator();
+				ImGui::Text("%-24s %9s %9s", "Category", "Allocated", "Count");
+				for (uint32_t i = 0; i < VK_MEMORY_CATEGORY_COUNT; ++i)
+				{
+					const VkMemoryCategoryStats& stats = Vk.MemoryCategoryStats[i];
+					ImGui::Text("%-24s %9.1f %9u", VkGetMemoryCategoryName(static_cast<VkMemoryCategory>(i)), static_cast<float>(stats.Bytes) * mib, stats.AllocationCount);
+				}
+
+				if (Vk.UseMemoryPools)
+				{
+					ImGui::Separator();
+					ImGui::Text("%-24s %9s %9s %9s %9s", "Pool", "Size", "Used", "Largest", "Fragment");
+					for (uint32_t i = 0; i < VK_MEMORY_POOL_COUNT; ++i)
+					{
+						const VkMemoryPoolStats stats = VkGetMemoryPoolStats(static_cast<VkMemoryPool>(i));
+						ImGui::Text("%-24s %9.1f %9.1f %9.1f %8.1f%%", VkGetMemoryPoolName(static_cast<VkMemoryPool>(i)), static_cast<float>(stats.BlockBytes) * mib,
+							static_cast<float>(stats.UsedBytes) * mib, static_cast<float>(stats.LargestFreeRange) * mib, VkGetMemoryFragmentation(stats) * 100.0f);
+					}
+
+					const VkDefragmentationStats& defragmentation_stats = Vk.DefragmentationStats;
+					ImGui::Text("Defragmented %.1f in %u allocations over %u passes%s", static_cast<float>(defragmentation_stats.BytesMoved) * mib, defragmentation_stats.AllocationsMoved,
+						defragmentation_stats.PassCount, Vk.IsDefragmented ? ", done" : "");
+				}
 			}
 			ImGui::End();
 
 			ImGui::Render();
 		}
 
+		if (!m_Headless && m_RenderOnChange)
 		{
+			const uint64_t settings_hash_curr = HashSettings(settings);
+			const bool is_ui_active = ImGui::IsAnyItemActive() || ImGui::IsWindowHovered(ImGuiHoveredFlags_AnyWindow);
+			if (settings_hash_curr != settings_hash || m_RenderContext.CameraCurr.m_View != m_RenderContext.CameraPrev.m_View || is_ui_active || !Vk.RecordedCommands.empty())
+			{
+				frames_since_change = 0;
+			}
+			settings_hash = settings_hash_curr;
+
+			if (frames_since_change >= render_on_change_settle_frame_count)
+				continue;
+			++frames_since_change;
+		}
+
+		{
+			TRACE_ZONE("Record Commands");
+
 			VkCommandBuffer cmd = VkBeginFrame();
 
+			// Before anything of the frame refers to what moves
+			const std::vector<VkMove>& moves = VkDefragment(cmd, m_DefragmentBytesPerFrame);
+			if (!moves.empty())
+			{
+				for (GltfModel& model : m_Models)
+				{
+					model.OnMoved(cmd, moves);
+				}
+				m_AccelerationStructure.OnMoved(moves);
+			}
+
+			m_RenderModel.BeginFrame(m_RenderContext);
+
+			// Render targets, their layouts and last accesses carry over from the previous frame
+			m_RenderGraph.ImportTexture(m_RenderContext.ColorTexture);
+			m_RenderGraph.ImportTexture(m_RenderContext.DepthTexture, VK_IMAGE_ASPECT_DEPTH_BIT);
+			m_RenderGraph.ImportTexture(m_RenderContext.UiTexture);
+			m_RenderGraph.ImportTexture(m_RenderContext.NormalTexture);
+			m_RenderGraph.ImportTexture(m_RenderContext.MotionTexture);
+			m_RenderGraph.ImportTexture(m_RenderContext.ScreenSpaceAmbientOcclusionTexture);
+			m_RenderGraph.ImportTexture(m_RenderContext.RayTracedAmbientOcclusionTexture);
+			m_RenderGraph.ImportTexture(m_RenderContext.ShadowTexture);
+			// Linear depth is history for the next frame
+			m_RenderGraph.ImportTexture(m_RenderContext.LinearDepthTextures[0], VK_IMAGE_ASPECT_COLOR_BIT, true);
+			m_RenderGraph.ImportTexture(m_RenderContext.LinearDepthTextures[1], VK_IMAGE_ASPECT_COLOR_BIT, true);
+
 			// Depth pass
-			m_RenderModel.DrawDepth(m_RenderContext, cmd, MODEL_COUNT, m_Models);
+			m_RenderModel.DrawDepth(m_RenderContext, m_RenderGraph, MODEL_COUNT, m_Models);
 
 			// Generate motion vectors and linear depth
-			m_RenderMotion.Generate(m_RenderContext, cmd);
+			m_RenderMotion.Generate(m_RenderContext, m_RenderGraph);
 
 			// Generate SSAO
-			m_RenderSSAO.Generate(m_RenderContext, cmd);
+			m_RenderSSAO.Generate(m_RenderContext, m_RenderGraph);
 
 			// Ray trace AO
-			m_RenderAO.RayTrace(m_RenderContext, cmd, m_AccelerationStructure);
+			m_RenderAO.RayTrace(m_RenderContext, m_RenderGraph, m_AccelerationStructure);
 
 			// Ray trace shadows
-			m_RenderShadows.RayTrace(m_RenderContext, cmd, m_AccelerationStructure);
+			m_RenderShadows.RayTrace(m_RenderContext, m_RenderGraph, m_AccelerationStructure);
 
 			// Color pass
-			m_RenderModel.DrawColor(m_RenderContext, cmd, MODEL_COUNT, m_Models);
+			m_RenderModel.DrawColor(m_RenderContext, m_RenderGraph, MODEL_COUNT, m_Models);
 
 			// Draw sky
-			m_RenderAtmosphere.DrawSky(m_RenderContext, cmd);
+			m_RenderAtmosphere.DrawSky(m_RenderContext, m_RenderGraph);
+
+			// Temporal AA, on the compute queue next to the UI with async compute
+			m_RenderPostProcess.Resolve(m_RenderContext, m_RenderGraph);
 
 			// Draw ImGui
-			m_RenderImGui.Draw(m_RenderContext, cmd);
+			m_RenderImGui.Draw(m_RenderContext, m_RenderGraph);
 
-			// Post effects
-			m_RenderPostProcess.Draw(m_RenderContext, cmd);
+			// Post effects, the tone mapping writes the back buffer
+			m_RenderPostProcess.Draw(m_RenderContext, m_RenderGraph);
+
+			m_RenderGraph.Execute(cmd, [this]()
+			{
+				VkCommandBuffer back_buffer_cmd = VkAcquireBackBuffer();
+
+				// Either resized above or replaced while acquiring
+				if (Vk.SwapchainGeneration != m_SwapchainGeneration)
+				{
+					RecreateBackBufferFramebuffers();
+				}
+
+				return back_buffer_cmd;
+			});
 
 			VkEndFrame();
 		}
 
+		allocation_count_last_frame = BenchmarkGetAllocationCount() - frame_begin_allocation_count;
+
+		// Trace captures allocate for every zone, so frames being traced are not checked
+		if (m_AssertZeroAllocations && frame_count >= m_WarmUpFrameCount && allocation_count_last_frame != 0 && !TraceIsCapturing())
+		{
+			VkError("Frame " + std::to_string(frame_count) + " made " + std::to_string(allocation_count_last_frame) + " heap allocations");
+		}
+
+		if (!m_BenchmarkPath.empty() && frame_count >= m_WarmUpFrameCount)
+		{
+			m_Benchmark.AddFrame(static_cast<float>((GetTime() - frame_begin_time) * 1000.0), allocation_count_last_frame);
+		}
+
 		++m_RenderContext.FrameCounter;
+		++frame_count;
+
+		if (!m_Headless && !m_Focused && m_UnfocusedFrameRate > 0)
+		{
+			const double remaining_time = frame_begin_time + 1.0 / static_cast<double>(m_UnfocusedFrameRate) - GetTime();
+			if (remaining_time > 0.0)
+			{
+				TRACE_ZONE("Unfocused Frame Cap");
+				glfwWaitEventsTimeout(remaining_time);
+			}
+		}
+	}
+
+	if (TraceIsCapturing())
+	{
+		// Let the GPU finish so that the last frames' labels make it into the trace
+		vkDeviceWaitIdle(Vk.Device);
+		VkFlushTimestampLabels();
+		TraceEndCapture();
+	}
+	if (!m_BenchmarkPath.empty())
+	{
+		m_Benchmark.Write(m_BenchmarkPath.c_str(), m_WarmUpFrameCount, m_FixedDeltaTime);
+	}
+	if (!m_MemoryStatsPath.empty())
+	{
+		VkWriteMemoryStats(m_MemoryStatsPath.c_str());
+	}
+	if (m_StressResizeCount > 0)
+	{
+		printf("Information: Memory after %u resizes%s\n", m_StressResizeCount, Vk.UseMemoryPools ? "" : ", without memory pools");
+		printf("Information:   %-12s %6s %9s %9s %6s %11s %9s\n", "Pool", "Blocks", "Size MiB", "Used MiB", "Holes", "Largest MiB", "Fragment");
+		for (uint32_t i = 0; i < VK_MEMORY_POOL_COUNT && Vk.UseMemoryPools; ++i)
+		{
+			PrintMemoryPoolStats(VkGetMemoryPoolName(static_cast<VkMemoryPool>(i)), VkGetMemoryPoolStats(static_cast<VkMemoryPool>(i)));
+		}
+		PrintMemoryPoolStats("All", VkGetMemoryTotalStats());
+	}
+	if (Vk.DefragmentationStats.PassCount > 0)
+	{
+		const VkDefragmentationStats& stats = Vk.DefragmentationStats;
+		printf("Information: Defragmentation moved %.1f MiB in %u allocations over %u passes, static pool fragmentation %.1f%% -> %.1f%%\n",
+			static_cast<float>(stats.BytesMoved) / (1024.0f * 1024.0f), stats.AllocationsMoved, stats.PassCount, stats.FragmentationBefore * 100.0f,
+			VkGetMemoryFragmentation(VkGetMemoryPoolStats(VK_MEMORY_POOL_STATIC)) * 100.0f);
+	}
+	if (Vk.IsUploadDeviceLocal && frame_count > 0)
+	{
+		printf("Information: Uploads read in place from device-local memory, %.3f MiB per frame not copied\n",
+			static_cast<float>(Vk.UploadStats.DirectBytesTotal) / (1024.0f * 1024.0f) / static_cast<float>(frame_count));
 	}
 }
@@ -15,8 +15,38 @@
 
 #include "AccelerationStructure.h"
 
+#include "Benchmark.h"
+
 struct GLFWwindow;
 
+struct AppInitializeParams
+{
+	uint32_t				Width					= 1366;
+	uint32_t				Height					= 768;
+	const char*				Title					= "Vulkan Testbed";
+	bool					Headless				= false;	// No window, render into offscreen images
+	uint32_t				FramesInFlight			= 2;		// Frames the CPU may record ahead of the GPU
+	uint32_t				WorkerThreadCount		= UINT32_MAX;	// Job workers besides the main thread, UINT32_MAX for one per remaining core
+	uint32_t				FrameCount				= 0;		// Number of frames to run, zero runs until the window is closed
+	uint32_t				WarmUpFrameCount		= 0;		// Frames to run before FrameCount starts counting
+	float					FixedDeltaTime			= 0.0f;		// Zero uses the measured frame time
+	std::string				SettingsPath			= {};		// Settings to load at startup
+	std::string				SaveSettingsPath		= {};		// Settings are written here at exit
+	std::string				CameraPath				= {};		// Camera path to play back instead of reading input
+	std::string				RecordCameraPath		= {};		// Camera movement is recorded and written here at exit
+	std::string				BenchmarkPath			= {};		// Pass timings of the measured frames are written here as JSON or CSV
+	std::string				TracePath				= {};		// CPU and GPU timeline of the measured frames is written here as Chrome trace JSON
+	bool					AssertZeroAllocations	= false;	// Fail if a measured frame allocates from the heap
+	std::string				MemoryStatsPath			= {};		// Statistics of every memory block and allocation are written here as JSON at exit
+	bool					UseMemoryPools			= true;		// Allocations of each lifetime come from pools of their own
+	bool					UseDeviceLocalUpload	= true;		// Upload memory is device local where the host can write it, ReBAR or UMA
+	bool					UseAsyncCompute			= true;		// Screen-space and filter passes run on a compute queue, where there is one
+	uint32_t				StressResizeCount		= 0;		// Frames to render at random sizes before the memory pools are reported, headless only
+	uint32_t				DefragmentBudget		= 4;		// MiB of static memory each frame moves to close holes, zero never moves any
+	std::string				PipelineCachePath		= "PipelineCache.bin";	// Loaded at startup and saved at exit, empty to start cold and not save
+	bool					SerializeBarriers		= false;	// Barriers wait on all prior commands instead of the tracked ones
+};
+
 class App
 {
 public:
@@ -25,8 +55,33 @@ public:
 	uint32_t				m_Height;
 	bool					m_Minimized;
 	VkDisplayMode			m_DisplayMode;
+	VkPresentMode			m_PresentMode;
+	bool					m_LowLatency;			// Wait for the GPU before sampling input
+	int32_t					m_FramesInFlight;
+	bool					m_Focused;
+	int32_t					m_UnfocusedFrameRate;	// Frame cap while the window does not have focus, zero for none
+	bool					m_RenderOnChange;		// Only render while the camera, settings or scene change
+
+	bool					m_Headless;
+	uint32_t				m_FrameCount;
+	uint32_t				m_WarmUpFrameCount;
+	float					m_FixedDeltaTime;
+
+	std::string				m_SaveSettingsPath;
+	std::string				m_RecordCameraPath;
+	std::string				m_BenchmarkPath;
+	std::string				m_TracePath;
+	std::string				m_MemoryStatsPath;
+	uint32_t				m_StressResizeCount;
+	VkDeviceSize			m_DefragmentBytesPerFrame;
+	bool					m_AssertZeroAllocations;
+
+	CameraPath				m_CameraPath;
+	bool					m_PlayCameraPath;
+	Benchmark				m_Benchmark;
 
 	RenderContext			m_RenderContext;
+	uint32_t				m_SwapchainGeneration;	// Of the swapchain the back buffer framebuffers were created for
 
 	RenderModel				m_RenderModel;
 	RenderMotion			m_RenderMotion;
@@ -37,6 +92,8 @@ public:
 	RenderPostProcess		m_RenderPostProcess;
 	RenderImGui				m_RenderImGui;
 
+	RenderGraph				m_RenderGraph;
+
 	enum : uint32_t
 	{
 		MODEL_SPONZA = 0,
@@ -47,15 +104,25 @@ public:
 
 	AccelerationStructure	m_AccelerationStructure;
 
-	void                    Initialize(uint32_t width, uint32_t height, const char* title);
+	void                    Initialize(const AppInitializeParams& params);
 	void                    Terminate();
 
 	void					Run();
 
 	static void				ResizeCallback(GLFWwindow* window, int width, int height);
 	static void				MinimizeCallback(GLFWwindow* window, int minimized);
+	static void				FocusCallback(GLFWwindow* window, int focused);
+
+	void					LoadSettings(const char* filepath);
+	void					SaveSettings(const char* filepath);
 
 private:
+	void					CreateRenderTargets(uint32_t width, uint32_t height);
+	void					CreateBackBufferFramebuffers();
 	void					CreateResolutionDependentResources(uint32_t width, uint32_t height);
 	void					DestroyResolutionDependentResources();
+	void					ResizeResolutionDependentResources(uint32_t width, uint32_t height);	// Does not wait for the GPU
+	void					RecreateBackBufferFramebuffers();
+	void					SetRenderSize(uint32_t width, uint32_t height);
+	void					CreatePipelines(bool initialize);	// Of all renderers at once as jobs, a reload skips the ones that never change
 };
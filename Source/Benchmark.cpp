@@ -0,0 +1,416 @@
+#include "Benchmark.h"
+#include "Job.h"
+#include "Trace.h"
+#include "Vk.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <thread>
+
+static const uint32_t JOB_BENCHMARK_REPEAT_COUNT = 5;			// Best of, to filter out preemption
+static const uint32_t JOB_BENCHMARK_QUEUED_BATCH_SIZE = 4000;		// Fits in one worker queue
+static const uint32_t JOB_BENCHMARK_QUEUED_BATCH_COUNT = 64;
+static const uint32_t JOB_BENCHMARK_SPAWNER_COUNT = 256;
+static const uint32_t JOB_BENCHMARK_SPAWNED_COUNT = 1024;			// Per spawner
+static const uint32_t JOB_BENCHMARK_WORK_JOB_COUNT = 4096;
+static const uint32_t JOB_BENCHMARK_WORK_ITERATION_COUNT = 20000;	// Roughly tens of microseconds per job
+
+// The global allocation functions are replaced to count allocations, which lets the frame loop be checked for
+// heap allocations. Allocations made through malloc directly, such as by ImGui and the driver, are not counted.
+static std::atomic<uint64_t> s_AllocationCount(0);
+
+void* operator new(size_t size)
+{
+	s_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+	void* memory = malloc(size == 0 ? 1 : size);
+	if (memory == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	s_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+	return malloc(size == 0 ? 1 : size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return operator new(size, std::nothrow);
+}
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+void operator delete[](void* memory, size_t) noexcept
+{
+	free(memory);
+}
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	free(memory);
+}
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	free(memory);
+}
+
+uint64_t BenchmarkGetAllocationCount()
+{
+	return s_AllocationCount.load(std::memory_order_relaxed);
+}
+
+void CameraPath::Load(const char* filepath)
+{
+	std::ifstream file(filepath);
+	if (!file.is_open())
+	{
+		VkError("Failed to open camera path " + std::string(filepath));
+	}
+
+	// One key per line: time position.xyz look.xyz
+	m_Keys.clear();
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream stream(line);
+		CameraPathKey key;
+		stream >> key.Time >> key.Position.x >> key.Position.y >> key.Position.z >> key.Look.x >> key.Look.y >> key.Look.z;
+		if (stream.fail())
+		{
+			VkError("Malformed camera path key in " + std::string(filepath) + ": " + line);
+		}
+		m_Keys.push_back(key);
+	}
+	if (m_Keys.empty())
+	{
+		VkError("Camera path " + std::string(filepath) + " has no keys");
+	}
+}
+void CameraPath::Save(const char* filepath) const
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+	{
+		VkError("Failed to create camera path " + std::string(filepath));
+	}
+
+	file << "# time position.x position.y position.z look.x look.y look.z\n";
+	for (const CameraPathKey& key : m_Keys)
+	{
+		file << key.Time << ' ' << key.Position.x << ' ' << key.Position.y << ' ' << key.Position.z << ' ' << key.Look.x << ' ' << key.Look.y << ' ' << key.Look.z << '\n';
+	}
+}
+
+void CameraPath::Record(float time, const Camera& camera)
+{
+	CameraPathKey key;
+	key.Time = time;
+	key.Position = camera.m_Position;
+	key.Look = camera.m_Look;
+	m_Keys.push_back(key);
+}
+void CameraPath::Evaluate(float time, Camera& camera) const
+{
+	assert(!m_Keys.empty());
+
+	// Keys are sorted by time, clamp outside of the recorded range
+	size_t next = 0;
+	while (next < m_Keys.size() && m_Keys[next].Time <= time)
+	{
+		++next;
+	}
+	const CameraPathKey& key0 = m_Keys[next == 0 ? 0 : next - 1];
+	const CameraPathKey& key1 = m_Keys[next == m_Keys.size() ? next - 1 : next];
+
+	const float duration = key1.Time - key0.Time;
+	const float t = duration > 0.0f ? glm::clamp((time - key0.Time) / duration, 0.0f, 1.0f) : 0.0f;
+
+	const glm::vec3 position = glm::mix(key0.Position, key1.Position, t);
+	const glm::vec3 look = glm::normalize(glm::mix(key0.Look, key1.Look, t));
+	camera.LookAt(position, position + look, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void Benchmark::Reserve(size_t frame_count)
+{
+	m_FrameCapacity = frame_count;
+	m_CpuFrameTimes.reserve(frame_count);
+	m_UploadBytes.reserve(frame_count);
+	m_UploadStallTimes.reserve(frame_count);
+	m_AllocationCounts.reserve(frame_count);
+	for (std::vector<float>& times : m_LabelTimes)
+	{
+		times.reserve(frame_count);
+	}
+}
+
+void Benchmark::AddFrame(float cpu_frame_time, uint64_t allocation_count)
+{
+	const size_t frame = m_CpuFrameTimes.size();
+	m_CpuFrameTimes.push_back(cpu_frame_time);
+	m_UploadBytes.push_back(static_cast<float>(Vk.UploadStats.BytesLastFrame));
+	m_UploadStallTimes.push_back(Vk.UploadStats.StallTimeLastFrame);
+	m_AllocationCounts.push_back(static_cast<float>(allocation_count));
+
+	for (uint32_t label : Vk.TimestampLabelsOrder)
+	{
+		const VkTimestampLabelHistory& history = Vk.TimestampLabelsResult[label];
+
+		size_t index = std::find(m_Labels.begin(), m_Labels.end(), label) - m_Labels.begin();
+		if (index == m_Labels.size())
+		{
+			// Labels that show up late are zero for the frames before
+			m_Labels.push_back(label);
+			m_LabelTimes.emplace_back(frame, 0.0f);
+			m_LabelTimes.back().reserve(m_FrameCapacity);
+			m_LabelSampleCounts.push_back(0);
+		}
+
+		// Labels that were not recorded since the last frame are zero
+		const bool has_new_sample = history.SampleCount != m_LabelSampleCounts[index];
+		m_LabelTimes[index].push_back(has_new_sample ? VkGetLabelStats(label).Last : 0.0f);
+		m_LabelSampleCounts[index] = history.SampleCount;
+	}
+	for (std::vector<float>& times : m_LabelTimes)
+	{
+		times.resize(frame + 1, 0.0f);
+	}
+}
+
+static void WriteSummary(std::ofstream& file, const std::vector<float>& times)
+{
+	std::vector<float> sorted = times;
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (float time : times)
+	{
+		sum += time;
+	}
+	const double mean = times.empty() ? 0.0 : sum / static_cast<double>(times.size());
+
+	// Nearest rank percentiles
+	auto percentile = [&](float p) { return sorted.empty() ? 0.0f : sorted[VkMin(static_cast<size_t>(p * static_cast<float>(sorted.size())), sorted.size() - 1)]; };
+
+	file << "{ \"mean\": " << mean << ", \"min\": " << percentile(0.0f) << ", \"max\": " << percentile(1.0f);
+	file << ", \"p50\": " << percentile(0.50f) << ", \"p95\": " << percentile(0.95f) << ", \"p99\": " << percentile(0.99f) << ", \"samples\": [";
+	for (size_t i = 0; i < times.size(); ++i)
+	{
+		file << (i == 0 ? "" : ", ") << times[i];
+	}
+	file << "] }";
+}
+
+void Benchmark::Write(const char* filepath, uint32_t warm_up_frame_count, float dt) const
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+	{
+		VkError("Failed to create benchmark output " + std::string(filepath));
+	}
+
+	const std::string path = filepath;
+	const bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+	if (csv)
+	{
+		file << "Frame,CPU Frame,Upload Bytes,Upload Stall,Heap Allocations";
+		for (uint32_t label : m_Labels)
+		{
+			file << ',' << Vk.TimestampLabelsResult[label].Name;
+		}
+		file << '\n';
+
+		for (size_t i = 0; i < m_CpuFrameTimes.size(); ++i)
+		{
+			file << i << ',' << m_CpuFrameTimes[i] << ',' << m_UploadBytes[i] << ',' << m_UploadStallTimes[i] << ',' << m_AllocationCounts[i];
+			for (const std::vector<float>& times : m_LabelTimes)
+			{
+				file << ',' << times[i];
+			}
+			file << '\n';
+		}
+	}
+	else
+	{
+		file << "{\n";
+		file << "  \"device\": \"" << Vk.PhysicalDeviceProperties.deviceName << "\",\n";
+		file << "  \"width\": " << Vk.SwapchainImageExtent.width << ",\n";
+		file << "  \"height\": " << Vk.SwapchainImageExtent.height << ",\n";
+		file << "  \"warm_up_frames\": " << warm_up_frame_count << ",\n";
+		file << "  \"measured_frames\": " << m_CpuFrameTimes.size() << ",\n";
+		file << "  \"dt\": " << dt << ",\n";
+		file << "  \"startup_ms\": " << m_StartupTime << ",\n";
+		file << "  \"pipeline_cache\": \"" << (m_IsPipelineCacheWarm ? "warm" : "cold") << "\",\n";
+		file << "  \"barriers\": \"" << (Vk.SerializeBarriers ? "serialized" : "tracked") << "\",\n";
+		file << "  \"cpu_frame_ms\": ";
+		WriteSummary(file, m_CpuFrameTimes);
+		file << ",\n";
+		file << "  \"upload_bytes\": ";
+		WriteSummary(file, m_UploadBytes);
+		file << ",\n";
+		file << "  \"upload_stall_ms\": ";
+		WriteSummary(file, m_UploadStallTimes);
+		file << ",\n";
+		file << "  \"heap_allocations\": ";
+		WriteSummary(file, m_AllocationCounts);
+		file << ",\n";
+		file << "  \"upload_peak_occupancy\": " << Vk.UploadStats.PeakOccupancy << ",\n";
+		file << "  \"upload_capacity\": " << Vk.UploadStats.Capacity << ",\n";
+		file << "  \"gpu_ms\": {\n";
+		for (size_t i = 0; i < m_Labels.size(); ++i)
+		{
+			file << "    \"" << Vk.TimestampLabelsResult[m_Labels[i]].Name << "\": ";
+			WriteSummary(file, m_LabelTimes[i]);
+			file << (i + 1 < m_Labels.size() ? ",\n" : "\n");
+		}
+		file << "  }\n";
+		file << "}\n";
+	}
+}
+
+static std::atomic<uint32_t> s_JobBenchmarkSink(0);
+
+// Keeps a core busy for a fixed amount of work the compiler can not remove
+static void RunJobBenchmarkWork(void*, uint32_t index)
+{
+	uint32_t x = index + 1;
+	for (uint32_t i = 0; i < JOB_BENCHMARK_WORK_ITERATION_COUNT; ++i)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	}
+	s_JobBenchmarkSink.fetch_add(x, std::memory_order_relaxed);
+}
+
+static void RunJobBenchmarkSpawner(void*, uint32_t)
+{
+	JobCounter counter;
+	JobRun([](void*, uint32_t) {}, NULL, JOB_BENCHMARK_SPAWNED_COUNT, &counter);
+	JobWait(counter);
+}
+
+static double GetSecondsSince(uint64_t time)
+{
+	return static_cast<double>(TraceGetTime() - time) * 1e-9;
+}
+
+void BenchmarkJobs(const char* filepath, uint32_t max_thread_count)
+{
+	struct JobBenchmarkResult
+	{
+		uint32_t	ThreadCount;
+		double		QueuedJobsPerSecond;	// Empty jobs queued by the main thread, spread over the others by stealing
+		double		SpawnedJobsPerSecond;	// Empty jobs queued by jobs, while their threads wait on them
+		double		WorkSeconds;			// Fixed amount of work split into jobs
+	};
+	std::vector<JobBenchmarkResult> results;
+
+	max_thread_count = VkMin(VkMax(max_thread_count, 1U), JOB_MAX_THREAD_COUNT);
+
+	std::vector<uint32_t> thread_counts;
+	for (uint32_t thread_count = 1; thread_count < max_thread_count; thread_count *= 2)
+	{
+		thread_counts.push_back(thread_count);
+	}
+	thread_counts.push_back(max_thread_count);
+
+	for (uint32_t thread_count : thread_counts)
+	{
+		JobInitialize(thread_count - 1);
+
+		JobBenchmarkResult result = {};
+		result.ThreadCount = thread_count;
+		result.WorkSeconds = 1e30;
+		for (uint32_t repeat = 0; repeat < JOB_BENCHMARK_REPEAT_COUNT; ++repeat)
+		{
+			uint64_t begin = TraceGetTime();
+			for (uint32_t i = 0; i < JOB_BENCHMARK_QUEUED_BATCH_COUNT; ++i)
+			{
+				JobCounter counter;
+				JobRun([](void*, uint32_t) {}, NULL, JOB_BENCHMARK_QUEUED_BATCH_SIZE, &counter);
+				JobWait(counter);
+			}
+			const double queued_job_count = static_cast<double>(JOB_BENCHMARK_QUEUED_BATCH_COUNT * JOB_BENCHMARK_QUEUED_BATCH_SIZE);
+			result.QueuedJobsPerSecond = VkMax(result.QueuedJobsPerSecond, queued_job_count / GetSecondsSince(begin));
+
+			begin = TraceGetTime();
+			{
+				JobCounter counter;
+				JobRun(RunJobBenchmarkSpawner, NULL, JOB_BENCHMARK_SPAWNER_COUNT, &counter);
+				JobWait(counter);
+			}
+			const double spawned_job_count = static_cast<double>(JOB_BENCHMARK_SPAWNER_COUNT * (JOB_BENCHMARK_SPAWNED_COUNT + 1));
+			result.SpawnedJobsPerSecond = VkMax(result.SpawnedJobsPerSecond, spawned_job_count / GetSecondsSince(begin));
+
+			begin = TraceGetTime();
+			{
+				JobCounter counter;
+				JobRun(RunJobBenchmarkWork, NULL, JOB_BENCHMARK_WORK_JOB_COUNT, &counter);
+				JobWait(counter);
+			}
+			result.WorkSeconds = VkMin(result.WorkSeconds, GetSecondsSince(begin));
+		}
+		results.push_back(result);
+
+		JobTerminate();
+	}
+
+	std::ofstream file(filepath);
+	if (!file.is_open())
+	{
+		VkError("Failed to create job benchmark output " + std::string(filepath));
+	}
+
+	// Speedup is over the single thread run, efficiency is speedup per thread
+	const uint32_t hardware_thread_count = std::thread::hardware_concurrency();
+	const std::string path = filepath;
+	const bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+	if (csv)
+	{
+		file << "Threads,Oversubscribed,Queued Jobs/s,Spawned Jobs/s,Work ms,Speedup,Efficiency\n";
+		for (const JobBenchmarkResult& result : results)
+		{
+			const double speedup = results[0].WorkSeconds / result.WorkSeconds;
+			file << result.ThreadCount << ',' << (result.ThreadCount > hardware_thread_count ? 1 : 0) << ',' << result.QueuedJobsPerSecond << ',' << result.SpawnedJobsPerSecond;
+			file << ',' << result.WorkSeconds * 1000.0 << ',' << speedup << ',' << speedup / result.ThreadCount << '\n';
+		}
+	}
+	else
+	{
+		file << "{\n";
+		file << "  \"hardware_threads\": " << hardware_thread_count << ",\n";
+		file << "  \"work_jobs\": " << JOB_BENCHMARK_WORK_JOB_COUNT << ",\n";
+		file << "  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const JobBenchmarkResult& result = results[i];
+			const double speedup = results[0].WorkSeconds / result.WorkSeconds;
+			file << "    { \"threads\": " << result.ThreadCount << ", \"oversubscribed\": " << (result.ThreadCount > hardware_thread_count ? "true" : "false");
+			file << ", \"queued_jobs_per_second\": " << result.QueuedJobsPerSecond << ", \"spawned_jobs_per_second\": " << result.SpawnedJobsPerSecond;
+			file << ", \"work_ms\": " << result.WorkSeconds * 1000.0 << ", \"speedup\": " << speedup << ", \"efficiency\": " << speedup / result.ThreadCount << " }";
+			file << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		file << "  ]\n";
+		file << "}\n";
+	}
+}
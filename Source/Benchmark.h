@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Camera.h"
+
+#include <string>
+#include <vector>
+
+struct CameraPathKey
+{
+	float						Time;
+	glm::vec3					Position;
+	glm::vec3					Look;
+};
+
+class CameraPath
+{
+public:
+	std::vector<CameraPathKey>	m_Keys						= {};
+
+	void						Load(const char* filepath);
+	void						Save(const char* filepath) const;
+
+	void						Record(float time, const Camera& camera);
+	void						Evaluate(float time, Camera& camera) const;
+};
+
+uint64_t						BenchmarkGetAllocationCount();	// Allocations made through operator new since startup
+
+// Measures job throughput and scaling with 1, 2, 4 ... up to max_thread_count threads, and writes the results as JSON,
+// or CSV if filepath ends in .csv. Thread counts past the hardware threads are oversubscribed and reported as such.
+void							BenchmarkJobs(const char* filepath, uint32_t max_thread_count);
+
+class Benchmark
+{
+public:
+	size_t						m_FrameCapacity				= 0;
+	std::vector<float>			m_CpuFrameTimes				= {};
+	std::vector<float>			m_UploadBytes				= {};
+	std::vector<float>			m_UploadStallTimes			= {};
+	std::vector<float>			m_AllocationCounts			= {};
+	std::vector<uint32_t>		m_Labels					= {};	// Interned timestamp labels
+	std::vector<std::vector<float>>	m_LabelTimes				= {};	// Indexed by label, then by measured frame
+	std::vector<uint64_t>		m_LabelSampleCounts			= {};
+	float						m_StartupTime				= 0.0f;	// Milliseconds
+	bool						m_IsPipelineCacheWarm		= false;
+
+	void						Reserve(size_t frame_count);	// So that adding frames does not allocate
+	void						AddFrame(float cpu_frame_time, uint64_t allocation_count);
+	void						Write(const char* filepath, uint32_t warm_up_frame_count, float dt) const;
+};
@@ -1,4 +1,5 @@
 #include "Camera.h"
+#include "Trace.h"
 
 void Camera::LookAt(const glm::vec3& position, const glm::vec3& target, const glm::vec3& up)
 {
@@ -77,6 +78,8 @@ static void SmoothSpeed(float& prev_speed, float& curr_speed, float dt)
 }
 void CameraController::Update(Camera& camera, GLFWwindow* window, float dt)
 {
+	TRACE_ZONE("CameraController::Update");
+
     double cursor_x, cursor_y;
     glfwGetCursorPos(window, &cursor_x, &cursor_y);
     float cursor_dx = static_cast<float>(cursor_x - m_LastCursorX);
@@ -1,4 +1,5 @@
 #include "GltfModel.h"
+#include "VkUtil.h"
 
 #define CGLTF_IMPLEMENTATION
 #include <cgltf.h>
@@ -7,6 +8,20 @@
 #include <unordered_map>
 #include <assert.h>
 
+// Matches the std430 layout of Material in ModelColor.frag
+struct MaterialConstants
+{
+    glm::vec4   BaseColorFactor;
+    glm::vec2   MetallicRoughnessFactor;
+    uint32_t    BaseColorTexture;
+    uint32_t    NormalTexture;
+    uint32_t    MetallicRoughnessTexture;
+    uint32_t    HasBaseColorTexture;
+    uint32_t    HasNormalTexture;
+    uint32_t    HasMetallicRoughnessTexture;
+};
+static_assert(sizeof(MaterialConstants) % 16 == 0, "MaterialConstants must match the std430 array stride");
+
 static void TraverseNodeHierarchy(const cgltf_data* data, const cgltf_node* node, const glm::mat4& parent_transform, std::vector<GltfInstance>& instances)
 {
 	glm::mat4					transform = glm::identity<glm::mat4>();
@@ -120,24 +135,26 @@ bool GltfModel::Load(const std::string& filepath)
     VkBufferCreateInfo vertex_buffer_info = {};
     vertex_buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     vertex_buffer_info.size = vertex_buffer_size;
-    vertex_buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | (Vk.IsRayTracingSupported ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
+    vertex_buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | (Vk.IsRayTracingSupported ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
     vertex_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VmaAllocationCreateInfo vertex_buffer_allocation_info = {};
     vertex_buffer_allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-    VK(vmaCreateBuffer(Vk.Allocator, &vertex_buffer_info, &vertex_buffer_allocation_info, &m_VertexBuffer, &m_VertexBufferAllocation, NULL));
+    VkCreateBuffer(vertex_buffer_info, vertex_buffer_allocation_info, VK_MEMORY_CATEGORY_GEOMETRY, m_VertexBuffer, m_VertexBufferAllocation);
+    VkAddMovableBuffer(m_VertexBuffer, m_VertexBufferAllocation, vertex_buffer_info);
 
     VkDeviceSize index_buffer_size = sizeof(uint16_t) * total_index_count;
 
     VkBufferCreateInfo index_buffer_info = {};
     index_buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     index_buffer_info.size = index_buffer_size;
-    index_buffer_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | (Vk.IsRayTracingSupported ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
+    index_buffer_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | (Vk.IsRayTracingSupported ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
     index_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VmaAllocationCreateInfo index_buffer_allocation_info = {};
     index_buffer_allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-    VK(vmaCreateBuffer(Vk.Allocator, &index_buffer_info, &index_buffer_allocation_info, &m_IndexBuffer, &m_IndexBufferAllocation, NULL));
+    VkCreateBuffer(index_buffer_info, index_buffer_allocation_info, VK_MEMORY_CATEGORY_GEOMETRY, m_IndexBuffer, m_IndexBufferAllocation);
+    VkAddMovableBuffer(m_IndexBuffer, m_IndexBufferAllocation, index_buffer_info);
 
     VkDeviceSize buffer_size = vertex_buffer_size + index_buffer_size;
     VkAllocation buffer_allocation = VkAllocateUploadBuffer(buffer_size);
@@ -199,7 +216,7 @@ bool GltfModel::Load(const std::string& filepath)
         }
     }
 
-    VkRecordCommands(
+    VkRecordTransferCommands(buffer_size,
         [=](VkCommandBuffer cmd)
         {
             VkBufferMemoryBarrier pre_transfer_barriers[2] = {};
@@ -235,26 +252,13 @@ bool GltfModel::Load(const std::string& filepath)
             index_buffer_copy_region.size = index_buffer_size;
             vkCmdCopyBuffer(cmd, buffer_allocation.Buffer, m_IndexBuffer, 1, &index_buffer_copy_region);
 
-            VkBufferMemoryBarrier post_transfer_barriers[2] = {};
-            // Vertex buffer
-            post_transfer_barriers[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-            post_transfer_barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            post_transfer_barriers[0].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
-            post_transfer_barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            post_transfer_barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            post_transfer_barriers[0].buffer = m_VertexBuffer;
-            post_transfer_barriers[0].offset = 0;
-            post_transfer_barriers[0].size = vertex_buffer_size;
-            // Index buffer
-            post_transfer_barriers[1].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-            post_transfer_barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            post_transfer_barriers[1].dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
-            post_transfer_barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            post_transfer_barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            post_transfer_barriers[1].buffer = m_IndexBuffer;
-            post_transfer_barriers[1].offset = 0;
-            post_transfer_barriers[1].size = index_buffer_size;
-            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 2, post_transfer_barriers, 0, NULL);
+            VkUtilTransferBufferOwnership(cmd, false, m_VertexBuffer, vertex_buffer_size, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+            VkUtilTransferBufferOwnership(cmd, false, m_IndexBuffer, index_buffer_size, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        },
+        [=](VkCommandBuffer cmd)
+        {
+            VkUtilTransferBufferOwnership(cmd, true, m_VertexBuffer, vertex_buffer_size, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+            VkUtilTransferBufferOwnership(cmd, true, m_IndexBuffer, index_buffer_size, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
         });
 
     size_t last_slash = filepath.find_last_of("/\\");
@@ -358,6 +362,63 @@ bool GltfModel::Load(const std::string& filepath)
         m_Materials[i].MetallicRoughnessFactor = glm::vec2(pbr_material.metallic_factor, pbr_material.roughness_factor);
     }
 
+    m_BindlessTextureIndices.resize(m_Textures.size());
+    for (size_t i = 0; i < m_Textures.size(); ++i)
+    {
+        m_BindlessTextureIndices[i] = VkAddBindlessTexture(m_Textures[i].ImageView);
+        VkAddMovableTexture(m_Textures[i]);
+    }
+
+    // Materials never change, so they are uploaded once and shaders look them up by index
+    if (material_count > 0)
+    {
+        const VkDeviceSize material_buffer_size = sizeof(MaterialConstants) * material_count;
+
+        VkBufferCreateInfo material_buffer_info = {};
+        material_buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        material_buffer_info.size = material_buffer_size;
+        material_buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        material_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VmaAllocationCreateInfo material_buffer_allocation_info = {};
+        material_buffer_allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        VkCreateBuffer(material_buffer_info, material_buffer_allocation_info, VK_MEMORY_CATEGORY_GEOMETRY, m_MaterialBuffer, m_MaterialBufferAllocation);
+        VkAddMovableBuffer(m_MaterialBuffer, m_MaterialBufferAllocation, material_buffer_info);
+
+        VkAllocation material_allocation = VkAllocateUploadBuffer(material_buffer_size);
+        WriteMaterials(material_allocation.Data);
+
+        const VkBuffer material_buffer = m_MaterialBuffer;
+        VkRecordTransferCommands(material_buffer_size,
+            [=](VkCommandBuffer cmd)
+            {
+                VkBufferMemoryBarrier pre_transfer_barrier = {};
+                pre_transfer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                pre_transfer_barrier.srcAccessMask = 0;
+                pre_transfer_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                pre_transfer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                pre_transfer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                pre_transfer_barrier.buffer = material_buffer;
+                pre_transfer_barrier.offset = 0;
+                pre_transfer_barrier.size = material_buffer_size;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &pre_transfer_barrier, 0, NULL);
+
+                VkBufferCopy material_buffer_copy_region;
+                material_buffer_copy_region.srcOffset = material_allocation.Offset;
+                material_buffer_copy_region.dstOffset = 0;
+                material_buffer_copy_region.size = material_buffer_size;
+                vkCmdCopyBuffer(cmd, material_allocation.Buffer, material_buffer, 1, &material_buffer_copy_region);
+
+                VkUtilTransferBufferOwnership(cmd, false, material_buffer, material_buffer_size, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+            },
+            [=](VkCommandBuffer cmd)
+            {
+                VkUtilTransferBufferOwnership(cmd, true, material_buffer, material_buffer_size, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+            });
+
+        m_BindlessMaterialBufferIndex = VkAddBindlessBuffer(m_MaterialBuffer);
+    }
+
 	const cgltf_size scene_count = data->scenes_count;
 	for (cgltf_size i = 0; i < scene_count; ++i)
 	{
@@ -374,13 +435,104 @@ bool GltfModel::Load(const std::string& filepath)
 }
 void GltfModel::Destroy()
 {
+    for (uint32_t bindless_texture_index : m_BindlessTextureIndices)
+    {
+        VkRemoveBindlessTexture(bindless_texture_index);
+    }
     for (const VkTexture& texture : m_Textures)
     {
+        VkRemoveMovable(texture.ImageAllocation);
 		VkTextureDestroy(texture);
     }
 
-    vmaDestroyBuffer(Vk.Allocator, m_VertexBuffer, m_VertexBufferAllocation);
-    vmaDestroyBuffer(Vk.Allocator, m_IndexBuffer, m_IndexBufferAllocation);
+    VkRemoveMovable(m_VertexBufferAllocation);
+    VkRemoveMovable(m_IndexBufferAllocation);
+    VkDestroyBuffer(m_VertexBuffer, m_VertexBufferAllocation);
+    VkDestroyBuffer(m_IndexBuffer, m_IndexBufferAllocation);
+
+    if (m_MaterialBuffer != VK_NULL_HANDLE)
+    {
+        VkRemoveBindlessBuffer(m_BindlessMaterialBufferIndex);
+        VkRemoveMovable(m_MaterialBufferAllocation);
+        VkDestroyBuffer(m_MaterialBuffer, m_MaterialBufferAllocation);
+    }
+}
+
+void GltfModel::OnMoved(VkCommandBuffer cmd, const std::vector<VkMove>& moves)
+{
+    // Frames in flight still read the old slots, so they are only given back once those frames have retired
+    bool are_textures_moved = false;
+    for (const VkMove& move : moves)
+    {
+        for (size_t i = 0; i < m_Textures.size(); ++i)
+        {
+            if (move.NewImageView != VK_NULL_HANDLE && m_Textures[i].ImageView == move.NewImageView)
+            {
+                const uint32_t old_index = m_BindlessTextureIndices[i];
+                VkDestroyDeferred([=]() { VkRemoveBindlessTexture(old_index); });
+                m_BindlessTextureIndices[i] = VkAddBindlessTexture(move.NewImageView);
+                are_textures_moved = true;
+            }
+        }
+
+        if (move.NewBuffer != VK_NULL_HANDLE && m_MaterialBuffer == move.NewBuffer)
+        {
+            const uint32_t old_index = m_BindlessMaterialBufferIndex;
+            VkDestroyDeferred([=]() { VkRemoveBindlessBuffer(old_index); });
+            m_BindlessMaterialBufferIndex = VkAddBindlessBuffer(m_MaterialBuffer);
+        }
+    }
+
+    if (!are_textures_moved || m_MaterialBuffer == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    // The materials refer to textures by their slots
+    const VkDeviceSize material_buffer_size = sizeof(MaterialConstants) * m_Materials.size();
+    VkAllocation material_allocation = VkAllocateUploadBuffer(material_buffer_size);
+    WriteMaterials(material_allocation.Data);
+
+    VkMemoryBarrier2KHR barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+    barrier.srcAccessMask = 0;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+
+    VkDependencyInfoKHR dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+    dependency_info.memoryBarrierCount = 1;
+    dependency_info.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2KHR(cmd, &dependency_info);
+
+    VkBufferCopy material_buffer_copy_region;
+    material_buffer_copy_region.srcOffset = material_allocation.Offset;
+    material_buffer_copy_region.dstOffset = 0;
+    material_buffer_copy_region.size = material_buffer_size;
+    vkCmdCopyBuffer(cmd, material_allocation.Buffer, m_MaterialBuffer, 1, &material_buffer_copy_region);
+
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR;
+    vkCmdPipelineBarrier2KHR(cmd, &dependency_info);
+}
+
+void GltfModel::WriteMaterials(void* data) const
+{
+    for (size_t i = 0; i < m_Materials.size(); ++i)
+    {
+        MaterialConstants* constants = static_cast<MaterialConstants*>(data) + i;
+        constants->BaseColorFactor = m_Materials[i].BaseColorFactor;
+        constants->MetallicRoughnessFactor = m_Materials[i].MetallicRoughnessFactor;
+        constants->BaseColorTexture = m_BindlessTextureIndices[m_Materials[i].BaseColorTextureIndex];
+        constants->NormalTexture = m_BindlessTextureIndices[m_Materials[i].NormalTextureIndex];
+        constants->MetallicRoughnessTexture = m_BindlessTextureIndices[m_Materials[i].MetallicRoughnessTextureIndex];
+        constants->HasBaseColorTexture = m_Materials[i].HasBaseColorTexture;
+        constants->HasNormalTexture = m_Materials[i].HasNormalTexture;
+        constants->HasMetallicRoughnessTexture = m_Materials[i].HasMetallicRoughnessTexture;
+    }
 }
 
 void GltfModel::Transform(const glm::mat4& transform)
@@ -59,6 +59,7 @@ public:
     std::vector<GltfMesh>		m_Meshes										= {};
     std::vector<GltfMaterial>	m_Materials										= {};
 	std::vector<VkTexture>		m_Textures										= {};
+	std::vector<uint32_t>		m_BindlessTextureIndices						= {};	// Slots of m_Textures in the bindless set
 
     VkBuffer					m_VertexBuffer									= VK_NULL_HANDLE;
     VmaAllocation				m_VertexBufferAllocation						= VK_NULL_HANDLE;
@@ -68,12 +69,22 @@ public:
 
     VkDeviceSize				m_VertexBufferOffsets[VERTEX_ATTRIBUTE_COUNT]	= {};
 
+    VkBuffer					m_MaterialBuffer								= VK_NULL_HANDLE;
+    VmaAllocation				m_MaterialBufferAllocation						= VK_NULL_HANDLE;
+    uint32_t					m_BindlessMaterialBufferIndex					= UINT32_MAX;
+
     bool						Load(const std::string& filepath);
     void						Destroy();
 
+	// Takes new bindless slots for what defragmentation moved, and rewrites the materials in cmd if textures moved
+	void						OnMoved(VkCommandBuffer cmd, const std::vector<VkMove>& moves);
+
 	void						Transform(const glm::mat4& transform);
 
     void						BindVertexBuffer(VkCommandBuffer cmd, uint32_t binding, GltfVertexAttribute attribute) const;
     void						BindIndexBuffer(VkCommandBuffer cmd) const;
     void						Draw(VkCommandBuffer cmd, uint32_t mesh_index, uint32_t instance_count = 1) const;
+
+private:
+	void						WriteMaterials(void* data) const;
 };
@@ -0,0 +1,316 @@
+#include "Job.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const uint32_t JOB_QUEUE_CAPACITY = 4096;	// Per worker, jobs past it run right away on the thread queuing them
+static const uint32_t JOB_SPIN_COUNT = 64;			// Rounds of failed steals before a worker goes to sleep
+
+struct Job
+{
+	JobFunction				Function;
+	void*					Data;
+	uint32_t				Index;
+	JobCounter*				Counter;
+};
+
+// Ring buffer, the owner pushes and pops at the back, other workers steal from the front
+struct alignas(64) JobQueue
+{
+	std::mutex				Mutex;
+	Job						Jobs[JOB_QUEUE_CAPACITY];
+	uint32_t				Front						= 0;
+	uint32_t				Count						= 0;
+};
+
+struct ParkedJobs
+{
+	JobFunction				Function;
+	void*					Data;
+	uint32_t				Count;
+	JobCounter*				Counter;
+	JobCounter*				Dependency;
+};
+
+static uint32_t						s_WorkerCount = 1;
+static std::unique_ptr<JobQueue[]>	s_Queues;
+static std::vector<std::thread>		s_Workers;
+static thread_local uint32_t		s_WorkerIndex = 0;
+
+static std::atomic<uint32_t>		s_QueuedJobCount(0);	// Over all queues
+static std::atomic<uint32_t>		s_SleepingWorkerCount(0);
+static std::mutex					s_SleepMutex;
+static std::condition_variable		s_Wake;
+static bool							s_Exit = false;			// Guarded by s_SleepMutex
+
+static std::mutex					s_ParkedMutex;
+static std::vector<ParkedJobs>		s_Parked;				// Guarded by s_ParkedMutex
+static std::atomic<uint32_t>		s_ParkedCount(0);
+
+static void WakeWorkers(uint32_t job_count)
+{
+	if (s_SleepingWorkerCount.load() == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(s_SleepMutex);
+	if (job_count == 1)
+	{
+		s_Wake.notify_one();
+	}
+	else
+	{
+		s_Wake.notify_all();
+	}
+}
+
+static void RunJob(const Job& job);
+
+static void PushJobs(JobFunction function, void* data, uint32_t count, JobCounter* counter)
+{
+	JobQueue& queue = s_Queues[s_WorkerIndex];
+
+	uint32_t pushed = 0;
+	{
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		for (; pushed < count && queue.Count < JOB_QUEUE_CAPACITY; ++pushed)
+		{
+			Job& job = queue.Jobs[(queue.Front + queue.Count) % JOB_QUEUE_CAPACITY];
+			job.Function = function;
+			job.Data = data;
+			job.Index = pushed;
+			job.Counter = counter;
+			++queue.Count;
+		}
+	}
+	if (pushed > 0)
+	{
+		s_QueuedJobCount.fetch_add(pushed);
+		WakeWorkers(pushed);
+	}
+
+	// The queue is full, so the thread is better off running the rest itself
+	for (uint32_t i = pushed; i < count; ++i)
+	{
+		Job job;
+		job.Function = function;
+		job.Data = data;
+		job.Index = i;
+		job.Counter = counter;
+		RunJob(job);
+	}
+}
+
+// Called once counter has dropped to zero. The counter may already be gone, so it is only compared against, while the
+// dependencies of parked jobs are alive until they start.
+static void ReleaseParkedJobs(const JobCounter* counter)
+{
+	if (s_ParkedCount.load() == 0)
+		return;
+
+	for (;;)
+	{
+		ParkedJobs released;
+		{
+			std::lock_guard<std::mutex> lock(s_ParkedMutex);
+			size_t i = 0;
+			while (i < s_Parked.size() && (s_Parked[i].Dependency != counter || s_Parked[i].Dependency->Value.load() != 0))
+			{
+				++i;
+			}
+			if (i == s_Parked.size())
+				return;
+
+			released = s_Parked[i];
+			s_Parked[i] = s_Parked.back();
+			s_Parked.pop_back();
+			s_ParkedCount.fetch_sub(1);
+		}
+		PushJobs(released.Function, released.Data, released.Count, released.Counter);
+	}
+}
+
+static void RunJob(const Job& job)
+{
+	job.Function(job.Data, job.Index);
+
+	JobCounter* counter = job.Counter;
+	if (counter != NULL && counter->Value.fetch_sub(1) == 1)
+	{
+		ReleaseParkedJobs(counter);
+	}
+}
+
+static bool TakeJob(Job& job)
+{
+	// Newest job of the own queue first, it is the most likely to find its data in cache
+	{
+		JobQueue& queue = s_Queues[s_WorkerIndex];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Count > 0)
+		{
+			--queue.Count;
+			job = queue.Jobs[(queue.Front + queue.Count) % JOB_QUEUE_CAPACITY];
+			s_QueuedJobCount.fetch_sub(1);
+			return true;
+		}
+	}
+
+	// Then the oldest job of another queue, which tends to be the root of the most remaining work
+	for (uint32_t i = 1; i < s_WorkerCount; ++i)
+	{
+		JobQueue& queue = s_Queues[(s_WorkerIndex + i) % s_WorkerCount];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Count > 0)
+		{
+			job = queue.Jobs[queue.Front];
+			queue.Front = (queue.Front + 1) % JOB_QUEUE_CAPACITY;
+			--queue.Count;
+			s_QueuedJobCount.fetch_sub(1);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void RunWorker(uint32_t worker_index)
+{
+	s_WorkerIndex = worker_index;
+
+	uint32_t spin_count = 0;
+	for (;;)
+	{
+		Job job;
+		if (TakeJob(job))
+		{
+			RunJob(job);
+			spin_count = 0;
+			continue;
+		}
+		if (++spin_count < JOB_SPIN_COUNT)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(s_SleepMutex);
+		s_SleepingWorkerCount.fetch_add(1);
+		s_Wake.wait(lock, [] { return s_Exit || s_QueuedJobCount.load() != 0; });
+		s_SleepingWorkerCount.fetch_sub(1);
+		if (s_Exit)
+			return;
+
+		spin_count = 0;
+	}
+}
+
+void JobInitialize(uint32_t worker_count)
+{
+	if (worker_count == UINT32_MAX)
+	{
+		worker_count = std::max(std::thread::hardware_concurrency(), 1U) - 1;
+	}
+	worker_count = std::min(worker_count, JOB_MAX_THREAD_COUNT - 1);
+
+	s_WorkerCount = worker_count + 1;
+	s_Queues.reset(new JobQueue[s_WorkerCount]);
+	s_QueuedJobCount = 0;
+	s_SleepingWorkerCount = 0;
+	s_Exit = false;
+	s_Parked.clear();
+	s_Parked.reserve(64);
+	s_ParkedCount = 0;
+
+	for (uint32_t i = 1; i < s_WorkerCount; ++i)
+	{
+		s_Workers.emplace_back(RunWorker, i);
+	}
+}
+
+void JobTerminate()
+{
+	// Jobs waiting on a counter that never drops to zero are dropped
+	Job job;
+	while (TakeJob(job))
+	{
+		RunJob(job);
+	}
+	while (s_QueuedJobCount.load() != 0)
+	{
+		std::this_thread::yield();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(s_SleepMutex);
+		s_Exit = true;
+	}
+	s_Wake.notify_all();
+	for (std::thread& worker : s_Workers)
+	{
+		worker.join();
+	}
+	s_Workers.clear();
+	s_Queues.reset();
+	s_WorkerCount = 1;
+}
+
+uint32_t JobGetWorkerCount()
+{
+	return s_WorkerCount;
+}
+
+uint32_t JobGetWorkerIndex()
+{
+	return s_WorkerIndex;
+}
+
+void JobRun(JobFunction function, void* data, uint32_t count, JobCounter* counter, JobCounter* dependency)
+{
+	if (count == 0)
+		return;
+
+	if (counter != NULL)
+	{
+		counter->Value.fetch_add(count);
+	}
+
+	if (dependency != NULL)
+	{
+		// Counted before the dependency is checked, so that whoever drops it to zero sees the jobs being parked
+		std::lock_guard<std::mutex> lock(s_ParkedMutex);
+		s_ParkedCount.fetch_add(1);
+		if (dependency->Value.load() != 0)
+		{
+			ParkedJobs parked;
+			parked.Function = function;
+			parked.Data = data;
+			parked.Count = count;
+			parked.Counter = counter;
+			parked.Dependency = dependency;
+			s_Parked.push_back(parked);
+			return;
+		}
+		s_ParkedCount.fetch_sub(1);
+	}
+
+	PushJobs(function, data, count, counter);
+}
+
+void JobWait(const JobCounter& counter)
+{
+	while (counter.Value.load() != 0)
+	{
+		Job job;
+		if (TakeJob(job))
+		{
+			RunJob(job);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
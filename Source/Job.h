@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Work-stealing job scheduler. Every thread owns a deque of jobs: jobs run from a thread are pushed to and popped from
+// the back of its own deque, and threads that run out of work steal from the front of the others'. The main thread is
+// worker 0, it runs no jobs on its own but helps while it waits on a counter.
+
+typedef void (*JobFunction)(void* data, uint32_t index);
+
+// Number of jobs that have not finished yet, jobs can wait on one before they start
+struct JobCounter
+{
+	std::atomic<uint32_t>	Value;
+
+	JobCounter() : Value(0) {}
+};
+
+static const uint32_t		JOB_MAX_THREAD_COUNT = 256;				// Including the main thread, more workers are clamped
+
+void						JobInitialize(uint32_t worker_count);	// Besides the main thread, UINT32_MAX for one per remaining core
+void						JobTerminate();							// Waits for every queued job
+
+uint32_t					JobGetWorkerCount();	// Including the main thread
+uint32_t					JobGetWorkerIndex();	// Of the calling thread, 0 on the main thread
+
+// Queues function(data, i) as its own job for every i below count. counter, if any, is raised by count right away and
+// lowered as the jobs finish. The jobs start once dependency, if any, has dropped to zero. data has to stay valid
+// until the jobs have run.
+void						JobRun(JobFunction function, void* data, uint32_t count, JobCounter* counter, JobCounter* dependency = NULL);
+
+// Runs queued jobs until counter drops to zero, so waiting never leaves a thread idle while there is work
+void						JobWait(const JobCounter& counter);
+
+// Runs function(i) for every i below count spread over all workers, and returns once every call has returned
+template<typename F>
+void						JobParallelFor(uint32_t count, F&& function);
+
+template<typename F>
+void JobParallelFor(uint32_t count, F&& function)
+{
+	typedef typename std::remove_reference<F>::type Function;
+
+	JobCounter counter;
+	JobRun([](void* data, uint32_t index) { (*static_cast<Function*>(data))(index); }, const_cast<void*>(static_cast<const void*>(&function)), count, &counter);
+	JobWait(counter);
+}
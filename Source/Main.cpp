@@ -1,11 +1,131 @@
 #include "App.h"
+#include "Benchmark.h"
+#include "Job.h"
+
+#include <cstdlib>
+#include <cstring>
 
 int main(int argc, char* argv[])
 {
+	AppInitializeParams params;
+	const char* job_benchmark_path = NULL;
+	uint32_t job_benchmark_thread_count = 64;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			params.Headless = true;
+		}
+		else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+		{
+			params.FramesInFlight = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--worker-threads") == 0 && i + 1 < argc)
+		{
+			params.WorkerThreadCount = static_cast<uint32_t>(VkMin(VkMax(atoi(argv[++i]), 0), static_cast<int>(JOB_MAX_THREAD_COUNT) - 1));
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			params.FrameCount = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc)
+		{
+			params.Width = static_cast<uint32_t>(atoi(argv[++i]));
+			params.Height = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--warm-up-frames") == 0 && i + 1 < argc)
+		{
+			params.WarmUpFrameCount = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--fixed-dt") == 0 && i + 1 < argc)
+		{
+			params.FixedDeltaTime = static_cast<float>(atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--settings") == 0 && i + 1 < argc)
+		{
+			params.SettingsPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--save-settings") == 0 && i + 1 < argc)
+		{
+			params.SaveSettingsPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc)
+		{
+			params.CameraPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--record-camera-path") == 0 && i + 1 < argc)
+		{
+			params.RecordCameraPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc)
+		{
+			params.BenchmarkPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			params.TracePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--memory-stats") == 0 && i + 1 < argc)
+		{
+			params.MemoryStatsPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--no-memory-pools") == 0)
+		{
+			params.UseMemoryPools = false;
+		}
+		else if (strcmp(argv[i], "--no-device-local-upload") == 0)
+		{
+			params.UseDeviceLocalUpload = false;
+		}
+		else if (strcmp(argv[i], "--no-async-compute") == 0)
+		{
+			params.UseAsyncCompute = false;
+		}
+		else if (strcmp(argv[i], "--stress-resizes") == 0 && i + 1 < argc)
+		{
+			params.StressResizeCount = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--defragment-budget") == 0 && i + 1 < argc)
+		{
+			params.DefragmentBudget = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--benchmark-jobs") == 0 && i + 1 < argc)
+		{
+			job_benchmark_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--benchmark-jobs-threads") == 0 && i + 1 < argc)
+		{
+			job_benchmark_thread_count = static_cast<uint32_t>(VkMin(VkMax(atoi(argv[++i]), 1), static_cast<int>(JOB_MAX_THREAD_COUNT)));
+		}
+		else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc)
+		{
+			params.PipelineCachePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--no-pipeline-cache") == 0)
+		{
+			params.PipelineCachePath.clear();
+		}
+		else if (strcmp(argv[i], "--assert-zero-allocations") == 0)
+		{
+			params.AssertZeroAllocations = true;
+		}
+		else if (strcmp(argv[i], "--serialize-barriers") == 0)
+		{
+			params.SerializeBarriers = true;
+		}
+	}
+
+	// Measures the job system on its own, without a device or window
+	if (job_benchmark_path != NULL)
+	{
+		BenchmarkJobs(job_benchmark_path, job_benchmark_thread_count);
+		return 0;
+	}
+
 	App app;
-	app.Initialize(1366, 768, "Vulkan Testbed");
+	app.Initialize(params);
 	app.Run();
 	app.Terminate();
 
     return 0;
-}
\ No newline at end of file
+}
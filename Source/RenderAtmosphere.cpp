@@ -103,6 +103,7 @@ void RenderAtmosphere::Create(const RenderContext& rc)
 		set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
 		set_layout_info.pBindings = set_layout_bindings;
 		VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_SkyDescriptorSetLayout));
+		m_SkyDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_SkyDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
 		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
 		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -110,8 +111,6 @@ void RenderAtmosphere::Create(const RenderContext& rc)
 		pipeline_layout_info.pSetLayouts = &m_SkyDescriptorSetLayout;
 		VK(vkCreatePipelineLayout(Vk.Device, &pipeline_layout_info, NULL, &m_SkyPipelineLayout));
 	}
-
-	CreatePipelines(rc);
 }
 
 void RenderAtmosphere::Destroy()
@@ -119,6 +118,7 @@ void RenderAtmosphere::Destroy()
 	DestroyPipelines();
 
 	vkDestroyPipelineLayout(Vk.Device, m_SkyPipelineLayout, NULL);
+	VkDestroyDescriptorSetTemplate(m_SkyDescriptorSetTemplate);
 	vkDestroyDescriptorSetLayout(Vk.Device, m_SkyDescriptorSetLayout, NULL);
 
 	vkDestroyPipelineLayout(Vk.Device, m_PrecomputeSkyLUTPipelineLayout, NULL);
@@ -173,14 +173,21 @@ void RenderAtmosphere::CreatePipelines(const RenderContext& rc)
 		pipeline_params.BlendAttachmentStates = { VkUtilGetDefaultBlendAttachmentState() };
 		m_SkyPipeline = VkUtilCreateGraphicsPipeline(pipeline_params);
 	}
+}
 
+void RenderAtmosphere::PrecomputeLUTs()
+{
 	VkRecordCommands(
         [=](VkCommandBuffer cmd) mutable
         {
-			VkUtilImageBarrier(cmd, m_AmbientLightLUT.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-			VkUtilImageBarrier(cmd, m_DirectionalLightLUT.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-			VkUtilImageBarrier(cmd, m_SkyLUTR.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-			VkUtilImageBarrier(cmd, m_SkyLUTM.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+			const VkTexture* luts[] = { &m_AmbientLightLUT, &m_DirectionalLightLUT, &m_SkyLUTR, &m_SkyLUTM };
+
+			VkUtilBarrierBatch barriers;
+			for (const VkTexture* lut : luts)
+			{
+				VkUtilAddImageBarrier(barriers, *lut, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR);
+			}
+			VkUtilFlushBarriers(barriers, cmd);
 
             // Precompute Ambient Light LUT
             {
@@ -222,12 +229,15 @@ void RenderAtmosphere::CreatePipelines(const RenderContext& rc)
                 vkCmdDispatch(cmd, (m_SkyLUTR.Width + 7) / 8, (m_SkyLUTR.Height + 7) / 8, 1);
             }
 
-            VkUtilImageBarrier(cmd, m_AmbientLightLUT.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-            VkUtilImageBarrier(cmd, m_DirectionalLightLUT.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-            VkUtilImageBarrier(cmd, m_SkyLUTR.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-            VkUtilImageBarrier(cmd, m_SkyLUTM.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+            // Only sampled by the sky and the color pass
+            for (const VkTexture* lut : luts)
+            {
+                VkUtilAddImageBarrier(barriers, *lut, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR);
+            }
+            VkUtilFlushBarriers(barriers, cmd);
         });
 }
+
 void RenderAtmosphere::DestroyPipelines()
 {
 	vkDestroyPipeline(Vk.Device, m_PrecomputeAmbientLightLUTPipeline, NULL);
@@ -240,58 +250,63 @@ void RenderAtmosphere::RecreatePipelines(const RenderContext& rc)
 {
 	DestroyPipelines();
 	CreatePipelines(rc);
+	PrecomputeLUTs();
 }
 
-void RenderAtmosphere::DrawSky(const RenderContext& rc, VkCommandBuffer cmd)
+void RenderAtmosphere::DrawSky(const RenderContext& rc, RenderGraph& graph)
 {
 	if (rc.DebugEnable)
 	{
 		return;
 	}
 
-	VkPushLabel(cmd, "Atmosphere Sky");
-
-    VkRenderPassBeginInfo render_pass_info = {};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_info.renderPass = rc.ColorRenderPass;
-    render_pass_info.framebuffer = rc.ColorFramebuffer;
-    render_pass_info.renderArea.offset = { 0, 0 };
-    render_pass_info.renderArea.extent = { rc.Width, rc.Height };
-    vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-
-    VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(rc.Width), static_cast<float>(rc.Height), 0.0f, 1.0f };
-    VkRect2D scissor = { { 0, 0 }, { rc.Width, rc.Height } };
-    vkCmdSetViewport(cmd, 0, 1, &viewport);
-    vkCmdSetScissor(cmd, 0, 1, &scissor);
-
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SkyPipeline);
-
-    glm::mat4 view = rc.CameraCurr.m_View;
-    view[3][0] = view[3][1] = view[3][2] = 0.0f; // Set translation to zero
-
-    struct Constants
-    {
-        glm::mat4	InvViewProjZeroTranslation;
-        glm::vec3	LightDirection;
-        float	    LightIntensity;
-    };
-    VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-    Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
-    constants->InvViewProjZeroTranslation = glm::inverse(rc.CameraCurr.m_Projection * view);
-    constants->LightDirection = glm::normalize(rc.SunDirection);
-    constants->LightIntensity = m_SkyLightIntensity;
-
-    VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_SkyDescriptorSetLayout,
-        {
-            { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-            { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_SkyLUTR.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
-            { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_SkyLUTM.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
-        });
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SkyPipelineLayout, 0, 1, &set, 0, NULL);
+	graph.AddPass("Atmosphere Sky", VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		{
+			{ &rc.ColorTexture, RENDER_GRAPH_USAGE_COLOR_ATTACHMENT },
+			{ &rc.DepthTexture, RENDER_GRAPH_USAGE_DEPTH_ATTACHMENT },
+		},
+		[this, &rc](VkCommandBuffer cmd)
+	{
+		VkRenderPassBeginInfo render_pass_info = {};
+		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		render_pass_info.renderPass = rc.ColorRenderPass;
+		render_pass_info.framebuffer = rc.ColorFramebuffer;
+		render_pass_info.renderArea.offset = { 0, 0 };
+		render_pass_info.renderArea.extent = { rc.Width, rc.Height };
+		vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
 
-    vkCmdDraw(cmd, 3, 1, 0, 0);
+		VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(rc.Width), static_cast<float>(rc.Height), 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, { rc.Width, rc.Height } };
+		vkCmdSetViewport(cmd, 0, 1, &viewport);
+		vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-    vkCmdEndRenderPass(cmd);
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SkyPipeline);
 
-	VkPopLabel(cmd);
+		glm::mat4 view = rc.CameraCurr.m_View;
+		view[3][0] = view[3][1] = view[3][2] = 0.0f; // Set translation to zero
+
+		struct Constants
+		{
+			glm::mat4	InvViewProjZeroTranslation;
+			glm::vec3	LightDirection;
+			float	    LightIntensity;
+		};
+		VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
+		Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
+		constants->InvViewProjZeroTranslation = glm::inverse(rc.CameraCurr.m_Projection * view);
+		constants->LightDirection = glm::normalize(rc.SunDirection);
+		constants->LightIntensity = m_SkyLightIntensity;
+
+		VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_SkyDescriptorSetTemplate,
+			{
+				{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+				{ m_SkyLUTR.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
+				{ m_SkyLUTM.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
+			});
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SkyPipelineLayout, 0, 1, &set, 0, NULL);
+
+		vkCmdDraw(cmd, 3, 1, 0, 0);
+
+		vkCmdEndRenderPass(cmd);
+	});
 }
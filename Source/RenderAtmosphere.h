@@ -24,6 +24,7 @@ public:
     VkPipeline              m_PrecomputeSkyLUTPipeline                          = VK_NULL_HANDLE;
 
     VkDescriptorSetLayout   m_SkyDescriptorSetLayout                            = VK_NULL_HANDLE;
+    VkDescriptorSetTemplate m_SkyDescriptorSetTemplate                          = {};
     VkPipelineLayout        m_SkyPipelineLayout                                 = VK_NULL_HANDLE;
     VkPipeline              m_SkyPipeline                                       = VK_NULL_HANDLE;
 
@@ -32,11 +33,11 @@ public:
     void                    Create(const RenderContext& rc);
     void                    Destroy();
 
-	void					RecreatePipelines(const RenderContext& rc);
-
-    void                    DrawSky(const RenderContext& rc, VkCommandBuffer cmd);
-
-private:
 	void					CreatePipelines(const RenderContext& rc);
+	void					PrecomputeLUTs();	// Runs the precompute pipelines
 	void					DestroyPipelines();
+
+	void					RecreatePipelines(const RenderContext& rc);
+
+    void                    DrawSky(const RenderContext& rc, RenderGraph& graph);
 };
@@ -2,6 +2,7 @@
 
 #include "Vk.h"
 #include "VkTexture.h"
+#include "RenderGraph.h"
 #include "Camera.h"
 
 struct RenderContext
@@ -37,6 +38,8 @@ struct RenderContext
 
     uint32_t                    Width;
     uint32_t                    Height;
+	uint32_t					TargetWidth;	// Render targets are allocated at this size and rendered into at Width and Height
+	uint32_t					TargetHeight;
 
     uint32_t                    FrameCounter;
 
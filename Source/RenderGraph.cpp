@@ -0,0 +1,532 @@
+#include "RenderGraph.h"
+
+#include <cstdio>
+
+static const VkAccessFlags2KHR WRITE_ACCESS_MASK = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR;
+
+static void GetUsageState(RenderGraphUsage usage, VkPipelineStageFlags2KHR shader_stages, VkImageLayout& layout, VkPipelineStageFlags2KHR& stages, VkAccessFlags2KHR& access)
+{
+	switch (usage)
+	{
+		case RENDER_GRAPH_USAGE_SAMPLED:
+			layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			stages = shader_stages;
+			access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR;
+			break;
+		case RENDER_GRAPH_USAGE_STORAGE:
+			layout = VK_IMAGE_LAYOUT_GENERAL;
+			stages = shader_stages;
+			access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR;
+			break;
+		case RENDER_GRAPH_USAGE_COLOR_ATTACHMENT:
+			layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
+			access = VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR;
+			break;
+		case RENDER_GRAPH_USAGE_DEPTH_ATTACHMENT:
+			layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR;
+			access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR;
+			break;
+	}
+}
+
+static bool IsWrite(RenderGraphUsage usage)
+{
+	return usage != RENDER_GRAPH_USAGE_SAMPLED;
+}
+
+// The semaphore the queue waited on already made every earlier access on the other queue available and visible, only
+// a layout change still needs a barrier
+static void ResetQueueState(VkTextureState& state, bool is_on_compute)
+{
+	state.WriteStages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+	state.WriteAccess = 0;
+	state.ReadStages = 0;
+	state.VisibleStages = ~0ULL;
+	state.VisibleAccess = ~0ULL;
+	state.IsOnCompute = is_on_compute;
+}
+
+static bool IsSameTexture(const VkTextureCreateParams& a, const VkTextureCreateParams& b)
+{
+	return a.Type == b.Type && a.ViewType == b.ViewType && a.Width == b.Width && a.Height == b.Height && a.Depth == b.Depth && a.Format == b.Format && a.Usage == b.Usage && a.IsSharedWithCompute == b.IsSharedWithCompute;
+}
+
+void RenderGraph::Destroy()
+{
+	for (const RenderGraphPhysicalTexture& physical_texture : m_PhysicalTextures)
+	{
+		vkDestroyImageView(Vk.Device, physical_texture.Texture.ImageView, NULL);
+		vkDestroyImage(Vk.Device, physical_texture.Texture.Image, NULL);
+	}
+	for (const RenderGraphMemoryBlock& block : m_MemoryBlocks)
+	{
+		VkFreeMemory(block.Allocation);
+	}
+	m_PhysicalTextures.clear();
+	m_MemoryBlocks.clear();
+}
+
+void RenderGraph::ImportTexture(const VkTexture& texture, VkImageAspectFlags aspect_mask, bool is_output)
+{
+	if (FindTexture(&texture) != UINT32_MAX)
+	{
+		return;
+	}
+
+	RenderGraphTexture graph_texture = {};
+	graph_texture.Texture = &texture;
+	graph_texture.AspectMask = aspect_mask;
+	graph_texture.IsOutput = is_output;
+	graph_texture.Transient = UINT32_MAX;
+	m_Textures.push_back(graph_texture);
+}
+
+void RenderGraph::CreateTexture(VkTexture& texture, const VkTextureCreateParams& params)
+{
+	assert(FindTexture(&texture) == UINT32_MAX && params.Data == NULL && !params.GenerateMipmaps);
+
+	RenderGraphTransientTexture transient = {};
+	transient.Texture = &texture;
+	transient.Params = params;
+	transient.Block = UINT32_MAX;
+
+	RenderGraphTexture graph_texture = {};
+	graph_texture.Texture = &texture;
+	graph_texture.AspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	graph_texture.Transient = static_cast<uint32_t>(m_Transients.size());
+
+	m_Transients.push_back(transient);
+	m_Textures.push_back(graph_texture);
+}
+
+void RenderGraph::AddPass(const RenderGraphPass& pass, std::initializer_list<RenderGraphAccess> accesses)
+{
+	m_Passes.push_back(pass);
+	m_Passes.back().AccessBegin = static_cast<uint32_t>(m_Accesses.size());
+	m_Passes.back().AccessEnd = static_cast<uint32_t>(m_Accesses.size() + accesses.size());
+	m_Passes.back().IsCulled = false;
+
+	for (const RenderGraphAccess& access : accesses)
+	{
+		const uint32_t texture_index = FindTexture(access.Texture);
+		if (texture_index == UINT32_MAX)
+		{
+			VkError(std::string("Render graph pass ") + pass.Name + " uses a texture that was neither imported nor created");
+		}
+
+		RenderGraphPassAccess pass_access;
+		pass_access.Texture = texture_index;
+		pass_access.Usage = access.Usage;
+		m_Accesses.push_back(pass_access);
+	}
+}
+
+void RenderGraph::Transition(VkCommandBuffer cmd, std::initializer_list<RenderGraphAccess> accesses)
+{
+	const RenderGraphPass& pass = m_Passes[m_CurrentPass];
+
+	for (const RenderGraphAccess& access : accesses)
+	{
+		const uint32_t texture_index = FindTexture(access.Texture);
+		assert(texture_index != UINT32_MAX);
+
+		AddBarrier(texture_index, access.Usage, pass.ShaderStages);
+	}
+
+	VkUtilFlushBarriers(m_Barriers, cmd);
+}
+
+uint32_t RenderGraph::FindTexture(const VkTexture* texture) const
+{
+	for (uint32_t i = 0; i < m_Textures.size(); ++i)
+	{
+		if (m_Textures[i].Texture == texture)
+			return i;
+	}
+	return UINT32_MAX;
+}
+
+void RenderGraph::Compile()
+{
+	// Walking back from the last pass, a pass is kept if it must be, or if it writes a texture read later on. Every
+	// usage reads the texture, since attachments are loaded as well.
+	for (RenderGraphTexture& texture : m_Textures)
+	{
+		texture.IsRead = texture.IsOutput;
+		texture.FirstPass = UINT32_MAX;
+		texture.LastPass = 0;
+		texture.Queues = 0;
+		texture.Submission = 0;
+	}
+
+	for (uint32_t pass_index = static_cast<uint32_t>(m_Passes.size()); pass_index-- > 0;)
+	{
+		RenderGraphPass& pass = m_Passes[pass_index];
+
+		bool is_needed = (pass.Flags & (RENDER_GRAPH_PASS_NEVER_CULL_BIT | RENDER_GRAPH_PASS_BACK_BUFFER_BIT)) != 0;
+		for (uint32_t i = pass.AccessBegin; i < pass.AccessEnd; ++i)
+		{
+			is_needed |= IsWrite(m_Accesses[i].Usage) && m_Textures[m_Accesses[i].Texture].IsRead;
+		}
+
+		pass.IsCulled = !is_needed;
+		if (pass.IsCulled)
+			continue;
+
+		for (uint32_t i = pass.AccessBegin; i < pass.AccessEnd; ++i)
+		{
+			RenderGraphTexture& texture = m_Textures[m_Accesses[i].Texture];
+			texture.IsRead = true;
+			texture.FirstPass = pass_index;
+			texture.LastPass = VkMax(texture.LastPass, pass_index);
+			texture.Queues |= IsAsyncCompute(pass) ? 0x2 : 0x1;
+		}
+	}
+
+	// Images stay exclusive to the queue that uses them where they can. Transient ones start out undefined every frame,
+	// so only those used on both queues are shared, imported ones keep their contents and are shared if compute uses them.
+	for (const RenderGraphTexture& texture : m_Textures)
+	{
+		if (texture.Transient != UINT32_MAX)
+		{
+			m_Transients[texture.Transient].Params.IsSharedWithCompute = texture.Queues == 0x3;
+		}
+		else if ((texture.Queues & 0x2) && !texture.Texture->IsSharedWithCompute)
+		{
+			VkError("Render graph texture used by an async compute pass was not created shared with the compute queue");
+		}
+	}
+
+	// Transient textures go into the first block of memory no other texture uses during their passes. The queues do not
+	// wait on each other between every pass, so only textures used on a single queue share memory, with those of the
+	// same queue.
+	m_BlockLastPasses.clear();
+	m_BlockQueues.clear();
+	for (RenderGraphTransientTexture& transient : m_Transients)
+	{
+		const RenderGraphTexture& texture = m_Textures[FindTexture(transient.Texture)];
+
+		transient.Block = UINT32_MAX;
+		if (texture.FirstPass == UINT32_MAX)
+			continue;
+
+		const bool is_single_queue = texture.Queues != 0x3;
+		for (uint32_t block = 0; block < m_BlockLastPasses.size() && transient.Block == UINT32_MAX && is_single_queue; ++block)
+		{
+			if (m_BlockLastPasses[block] < texture.FirstPass && m_BlockQueues[block] == texture.Queues)
+			{
+				transient.Block = block;
+			}
+		}
+		if (transient.Block == UINT32_MAX)
+		{
+			transient.Block = static_cast<uint32_t>(m_BlockLastPasses.size());
+			m_BlockLastPasses.push_back(0);
+			m_BlockQueues.push_back(texture.Queues);
+		}
+		m_BlockLastPasses[transient.Block] = texture.LastPass;
+	}
+
+	bool is_placement_unchanged = m_PhysicalTextures.size() == m_Transients.size() && m_MemoryBlocks.size() == m_BlockLastPasses.size();
+	for (uint32_t i = 0; i < m_Transients.size() && is_placement_unchanged; ++i)
+	{
+		is_placement_unchanged = IsSameTexture(m_Transients[i].Params, m_PhysicalTextures[i].Params) && m_Transients[i].Block == m_PhysicalTextures[i].Block;
+	}
+	if (!is_placement_unchanged)
+	{
+		DestroyTransientTextures();
+		CreateTransientTextures();
+	}
+
+	for (uint32_t i = 0; i < m_Transients.size(); ++i)
+	{
+		*m_Transients[i].Texture = m_PhysicalTextures[i].Texture;
+	}
+	for (RenderGraphMemoryBlock& block : m_MemoryBlocks)
+	{
+		block.Stages = 0;
+		block.WriteAccess = 0;
+	}
+}
+
+void RenderGraph::CreateTransientTextures()
+{
+	m_PhysicalTextures.resize(m_Transients.size());
+	m_MemoryBlocks.resize(m_BlockLastPasses.size());
+
+	std::vector<VkMemoryRequirements> block_requirements(m_MemoryBlocks.size());
+	for (VkMemoryRequirements& requirements : block_requirements)
+	{
+		requirements.size = 0;
+		requirements.alignment = 1;
+		requirements.memoryTypeBits = ~0U;
+	}
+
+	for (uint32_t i = 0; i < m_Transients.size(); ++i)
+	{
+		const RenderGraphTransientTexture& transient = m_Transients[i];
+		RenderGraphPhysicalTexture& physical_texture = m_PhysicalTextures[i];
+		physical_texture.Params = transient.Params;
+		physical_texture.Block = transient.Block;
+		physical_texture.Texture = {};
+
+		// Textures of culled passes are not created
+		if (transient.Block == UINT32_MAX)
+			continue;
+
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = transient.Params.Type;
+		image_info.extent.width = transient.Params.Width;
+		image_info.extent.height = transient.Params.Height;
+		image_info.extent.depth = transient.Params.Depth;
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.format = transient.Params.Format;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = transient.Params.Usage;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		if (transient.Params.IsSharedWithCompute)
+		{
+			VkShareWithComputeQueue(image_info);
+		}
+		VK(vkCreateImage(Vk.Device, &image_info, NULL, &physical_texture.Texture.Image));
+		physical_texture.Texture.IsSharedWithCompute = transient.Params.IsSharedWithCompute;
+		physical_texture.Texture.Width = transient.Params.Width;
+		physical_texture.Texture.Height = transient.Params.Height;
+		physical_texture.Texture.Depth = transient.Params.Depth;
+
+		VkMemoryRequirements image_requirements = {};
+		vkGetImageMemoryRequirements(Vk.Device, physical_texture.Texture.Image, &image_requirements);
+
+		VkMemoryRequirements& requirements = block_requirements[transient.Block];
+		requirements.size = VkMax(requirements.size, image_requirements.size);
+		requirements.alignment = VkMax(requirements.alignment, image_requirements.alignment);
+		requirements.memoryTypeBits &= image_requirements.memoryTypeBits;
+	}
+
+	for (uint32_t block = 0; block < m_MemoryBlocks.size(); ++block)
+	{
+		if (block_requirements[block].memoryTypeBits == 0)
+		{
+			VkError("Transient textures placed in the same memory have no memory type in common");
+		}
+
+		VmaAllocationCreateInfo allocation_info = {};
+		allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		VkAllocateMemory(block_requirements[block], allocation_info, VK_MEMORY_CATEGORY_RENDER_TARGETS, m_MemoryBlocks[block].Allocation);
+	}
+
+	for (uint32_t i = 0; i < m_Transients.size(); ++i)
+	{
+		const RenderGraphTransientTexture& transient = m_Transients[i];
+		VkTexture& texture = m_PhysicalTextures[i].Texture;
+		if (transient.Block == UINT32_MAX)
+			continue;
+
+		VK(vmaBindImageMemory(Vk.Allocator, m_MemoryBlocks[transient.Block].Allocation, texture.Image));
+
+		VkImageViewCreateInfo image_view_info = {};
+		image_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		image_view_info.image = texture.Image;
+		image_view_info.viewType = transient.Params.ViewType;
+		image_view_info.format = transient.Params.Format;
+		image_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		image_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		image_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		image_view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		image_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		image_view_info.subresourceRange.baseMipLevel = 0;
+		image_view_info.subresourceRange.levelCount = 1;
+		image_view_info.subresourceRange.baseArrayLayer = 0;
+		image_view_info.subresourceRange.layerCount = 1;
+		VK(vkCreateImageView(Vk.Device, &image_view_info, NULL, &texture.ImageView));
+	}
+
+	printf("Information: Placed %u transient textures in %u blocks of memory\n", static_cast<uint32_t>(m_Transients.size()), static_cast<uint32_t>(m_MemoryBlocks.size()));
+}
+
+void RenderGraph::DestroyTransientTextures()
+{
+	if (m_PhysicalTextures.empty() && m_MemoryBlocks.empty())
+		return;
+
+	// Frames in flight may still use the old textures
+	const std::vector<RenderGraphPhysicalTexture> physical_textures = m_PhysicalTextures;
+	const std::vector<RenderGraphMemoryBlock> memory_blocks = m_MemoryBlocks;
+	VkDestroyDeferred([physical_textures, memory_blocks]()
+	{
+		for (const RenderGraphPhysicalTexture& physical_texture : physical_textures)
+		{
+			vkDestroyImageView(Vk.Device, physical_texture.Texture.ImageView, NULL);
+			vkDestroyImage(Vk.Device, physical_texture.Texture.Image, NULL);
+		}
+		for (const RenderGraphMemoryBlock& block : memory_blocks)
+		{
+			VkFreeMemory(block.Allocation);
+		}
+	});
+
+	m_PhysicalTextures.clear();
+	m_MemoryBlocks.clear();
+}
+
+bool RenderGraph::IsAsyncCompute(const RenderGraphPass& pass) const
+{
+	return Vk.UseAsyncCompute && (pass.Flags & RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT);
+}
+
+void RenderGraph::ExecutePass(VkCommandBuffer& cmd, uint32_t pass_index)
+{
+	const RenderGraphPass& pass = m_Passes[pass_index];
+	if (pass.IsCulled || ((pass.Flags & RENDER_GRAPH_PASS_BACK_BUFFER_BIT) && !Vk.IsBackBufferAcquired))
+		return;
+
+	// A pass waits on the other queue if it uses a texture that queue touched since the submission last waited on. The
+	// first compute pass of the frame waits on the commands before the graph as well, which reset the timestamp queries.
+	const bool is_compute = IsAsyncCompute(pass);
+	bool is_wait_needed = is_compute && m_ComputeSubmission == 1 && m_ComputeCmd == VK_NULL_HANDLE;
+	for (uint32_t i = pass.AccessBegin; i < pass.AccessEnd && Vk.UseAsyncCompute; ++i)
+	{
+		const RenderGraphTexture& texture = m_Textures[m_Accesses[i].Texture];
+		if (texture.Texture->State.IsOnCompute != is_compute)
+		{
+			is_wait_needed |= texture.Submission > (is_compute ? m_GraphicsSubmissionWaited : m_ComputeSubmissionWaited);
+		}
+	}
+
+	// Semaphores are waited on when a submission begins, so the submission of the queue that waits is split as well
+	if (is_compute && (is_wait_needed || m_ComputeCmd == VK_NULL_HANDLE))
+	{
+		if (m_ComputeCmd != VK_NULL_HANDLE)
+		{
+			VkEndComputeCommands(m_ComputeCmd);
+			++m_ComputeSubmission;
+		}
+		if (is_wait_needed && !m_IsGraphicsSubmissionEmpty)
+		{
+			cmd = VkSubmitGraphicsCommands();
+			++m_GraphicsSubmission;
+			m_IsGraphicsSubmissionEmpty = true;
+		}
+
+		m_ComputeCmd = VkBeginComputeCommands();
+		m_GraphicsSubmissionWaited = m_GraphicsSubmission - 1;
+	}
+	if (!is_compute && is_wait_needed)
+	{
+		if (m_ComputeCmd != VK_NULL_HANDLE)
+		{
+			VkEndComputeCommands(m_ComputeCmd);
+			m_ComputeCmd = VK_NULL_HANDLE;
+			++m_ComputeSubmission;
+		}
+		if (!m_IsGraphicsSubmissionEmpty)
+		{
+			cmd = VkSubmitGraphicsCommands();
+			++m_GraphicsSubmission;
+		}
+
+		VkWaitComputeCommands();
+		m_ComputeSubmissionWaited = m_ComputeSubmission - 1;
+	}
+	m_IsGraphicsSubmissionEmpty &= is_compute;
+
+	const VkCommandBuffer pass_cmd = is_compute ? m_ComputeCmd : cmd;
+	VkPushLabel(pass_cmd, pass.Name);
+
+	// Textures enter the pass with the first usage they are declared with
+	for (uint32_t i = pass.AccessBegin; i < pass.AccessEnd; ++i)
+	{
+		bool is_declared_before = false;
+		for (uint32_t j = pass.AccessBegin; j < i; ++j)
+		{
+			is_declared_before |= m_Accesses[j].Texture == m_Accesses[i].Texture;
+		}
+
+		if (is_declared_before)
+			continue;
+
+		// Transient textures start out undefined in their first pass, after whatever used their memory before
+		RenderGraphTexture& texture = m_Textures[m_Accesses[i].Texture];
+		if (texture.Transient != UINT32_MAX && texture.FirstPass == pass_index)
+		{
+			const RenderGraphMemoryBlock& block = m_MemoryBlocks[m_Transients[texture.Transient].Block];
+			texture.Texture->State = {};
+			texture.Texture->State.WriteStages = block.Stages;
+			texture.Texture->State.WriteAccess = block.WriteAccess;
+			texture.Texture->State.IsOnCompute = is_compute;
+		}
+		else if (texture.Texture->State.IsOnCompute != is_compute)
+		{
+			ResetQueueState(texture.Texture->State, is_compute);
+		}
+		texture.Submission = is_compute ? m_ComputeSubmission : m_GraphicsSubmission;
+
+		AddBarrier(m_Accesses[i].Texture, m_Accesses[i].Usage, pass.ShaderStages);
+	}
+	VkUtilFlushBarriers(m_Barriers, pass_cmd);
+
+	m_CurrentPass = pass_index;
+	pass.Record.Execute(pass.Record.Commands, pass_cmd);
+
+	VkPopLabel(pass_cmd);
+}
+
+void RenderGraph::EndExecute()
+{
+	// The last submission of the frame waits on the compute queue, so textures go back to the graphics queue for
+	// whatever uses them outside the graph
+	if (m_ComputeCmd != VK_NULL_HANDLE)
+	{
+		VkEndComputeCommands(m_ComputeCmd);
+		m_ComputeCmd = VK_NULL_HANDLE;
+	}
+	for (const RenderGraphTexture& texture : m_Textures)
+	{
+		if (texture.Texture->State.IsOnCompute)
+		{
+			ResetQueueState(texture.Texture->State, false);
+		}
+	}
+	m_GraphicsSubmission = 1;
+	m_ComputeSubmission = 1;
+	m_GraphicsSubmissionWaited = 0;
+	m_ComputeSubmissionWaited = 0;
+	m_IsGraphicsSubmissionEmpty = false;
+
+	for (const RenderGraphPass& pass : m_Passes)
+	{
+		pass.Record.Destroy(pass.Record.Commands);
+	}
+	VkArenaReset(m_RecordArena);
+
+	m_Passes.clear();
+	m_Accesses.clear();
+	m_Textures.clear();
+	m_Transients.clear();
+}
+
+void RenderGraph::AddBarrier(uint32_t texture_index, RenderGraphUsage usage, VkPipelineStageFlags2KHR shader_stages)
+{
+	const RenderGraphTexture& texture = m_Textures[texture_index];
+
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkPipelineStageFlags2KHR stages = 0;
+	VkAccessFlags2KHR access = 0;
+	GetUsageState(usage, shader_stages, layout, stages, access);
+	assert(stages != 0);
+
+	VkUtilAddImageBarrier(m_Barriers, *texture.Texture, layout, stages, access, texture.AspectMask);
+
+	if (texture.Transient != UINT32_MAX)
+	{
+		RenderGraphMemoryBlock& block = m_MemoryBlocks[m_Transients[texture.Transient].Block];
+		block.Stages |= stages;
+		block.WriteAccess |= access & WRITE_ACCESS_MASK;
+	}
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "Vk.h"
+#include "VkTexture.h"
+#include "VkUtil.h"
+
+#include <initializer_list>
+
+// Passes of a frame declare the textures they use and how, and are recorded once the whole frame is known. The graph
+// puts all barriers a pass needs into one vkCmdPipelineBarrier2KHR in front of it, waiting only on the stages that last
+// touched each texture, leaves out passes whose results nothing reads, and lets transient textures whose passes do not
+// overlap share memory.
+//
+// Imported textures stay in whatever layout their last pass left them in, the state they track carries over into the
+// next frame. Transient textures only live within a frame, their contents are undefined when their first pass begins.
+//
+// With async compute, the passes flagged for it go to the compute queue. The frame's commands are split into several
+// submissions on both queues, wherever a pass uses a texture that the other queue touched in a submission it has not
+// waited on yet, and the frame only ends once the compute queue has finished.
+
+// How a pass uses a texture, which decides its layout and what barriers around it wait on
+enum RenderGraphUsage
+{
+	RENDER_GRAPH_USAGE_SAMPLED = 0,
+	RENDER_GRAPH_USAGE_STORAGE,				// Read and written
+	RENDER_GRAPH_USAGE_COLOR_ATTACHMENT,	// Attachments are loaded and stored, so read and written too
+	RENDER_GRAPH_USAGE_DEPTH_ATTACHMENT,
+};
+
+struct RenderGraphAccess
+{
+	const VkTexture*										Texture;
+	RenderGraphUsage										Usage;
+};
+
+enum RenderGraphPassFlagBits
+{
+	RENDER_GRAPH_PASS_NEVER_CULL_BIT						= 0x1,	// Has effects outside of the textures it declares
+	RENDER_GRAPH_PASS_BACK_BUFFER_BIT						= 0x2,	// The back buffer is acquired before the first of these, never culled, skipped if none was
+	RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT						= 0x4,	// Dispatches only, runs on the compute queue next to the graphics passes
+};
+
+struct RenderGraphPass
+{
+	const char*												Name;			// Also its label
+	VkPipelineStageFlags2KHR								ShaderStages;	// That sample or store into its textures
+	uint32_t												Flags;
+	uint32_t												AccessBegin;	// Into the accesses of the graph
+	uint32_t												AccessEnd;
+	VkRecordedCommand										Record;
+	bool													IsCulled;
+};
+
+struct RenderGraphPassAccess
+{
+	uint32_t												Texture;		// Into the textures of the graph
+	RenderGraphUsage										Usage;
+};
+
+struct RenderGraphTexture
+{
+	const VkTexture*										Texture;
+	VkImageAspectFlags										AspectMask;
+	bool													IsOutput;		// Read after the frame, so its passes are never culled
+	bool													IsRead;			// By a pass that is not culled, or after the frame
+	uint32_t												Transient;		// Into the transient textures of the graph, UINT32_MAX if imported
+	uint32_t												FirstPass;		// Of the passes that are not culled, UINT32_MAX if none uses it
+	uint32_t												LastPass;
+	uint32_t												Queues;			// Bits of the queues its passes run on, 0x1 graphics and 0x2 compute
+	uint32_t												Submission;		// Of the queue that last used it, 0 if none did this frame
+};
+
+struct RenderGraphTransientTexture
+{
+	VkTexture*												Texture;		// Filled in when the graph is compiled
+	VkTextureCreateParams									Params;
+	uint32_t												Block;			// Of memory it aliases, UINT32_MAX if no pass uses it
+};
+
+// Images of the transient textures, kept across frames until the textures or their placement change
+struct RenderGraphPhysicalTexture
+{
+	VkTextureCreateParams									Params;
+	uint32_t												Block;
+	VkTexture												Texture;
+};
+
+struct RenderGraphMemoryBlock
+{
+	VmaAllocation											Allocation;
+	VkPipelineStageFlags2KHR								Stages;			// Of this frame's accesses, that the next texture placed in it waits on
+	VkAccessFlags2KHR										WriteAccess;
+};
+
+class RenderGraph
+{
+public:
+	void													Destroy();
+
+	// Every frame, before the passes that use them. Outputs are read after the frame, like history for the next one.
+	void													ImportTexture(const VkTexture& texture, VkImageAspectFlags aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT, bool is_output = false);
+	void													CreateTexture(VkTexture& texture, const VkTextureCreateParams& params);
+
+	// Passes run in the order they are added. A texture whose usage changes within a pass is declared once per usage,
+	// in order, and Transition moves it on to the next one while the pass records. record(cmd) is called from Execute.
+	template<typename F>
+	void													AddPass(const char* name, VkPipelineStageFlags2KHR shader_stages, std::initializer_list<RenderGraphAccess> accesses, F&& record, uint32_t flags = 0);
+	void													Transition(VkCommandBuffer cmd, std::initializer_list<RenderGraphAccess> accesses);
+
+	// Culls, places the transient textures and records the passes. acquire_back_buffer() is called before the first
+	// pass that draws into the back buffer and returns the command buffer the frame continues in.
+	template<typename F>
+	void													Execute(VkCommandBuffer cmd, F&& acquire_back_buffer);
+
+private:
+	void													AddPass(const RenderGraphPass& pass, std::initializer_list<RenderGraphAccess> accesses);
+	uint32_t												FindTexture(const VkTexture* texture) const;
+
+	void													Compile();
+	void													CreateTransientTextures();
+	void													DestroyTransientTextures();
+
+	bool													IsAsyncCompute(const RenderGraphPass& pass) const;
+
+	void													ExecutePass(VkCommandBuffer& cmd, uint32_t pass_index);
+	void													EndExecute();
+
+	void													AddBarrier(uint32_t texture_index, RenderGraphUsage usage, VkPipelineStageFlags2KHR shader_stages);
+
+	// Declared this frame
+	std::vector<RenderGraphPass>							m_Passes;
+	std::vector<RenderGraphPassAccess>						m_Accesses;
+	std::vector<RenderGraphTexture>							m_Textures;
+	std::vector<RenderGraphTransientTexture>				m_Transients;
+	VkArena													m_RecordArena			= {};
+	uint32_t												m_CurrentPass			= 0;
+
+	std::vector<uint32_t>									m_BlockLastPasses;		// While placing the transient textures
+	std::vector<uint32_t>									m_BlockQueues;
+	std::vector<RenderGraphPhysicalTexture>					m_PhysicalTextures;
+	std::vector<RenderGraphMemoryBlock>						m_MemoryBlocks;
+
+	VkUtilBarrierBatch										m_Barriers;
+
+	// Submissions of this frame on either queue, counted from 1, and the last one of the other queue each has waited on
+	VkCommandBuffer											m_ComputeCmd				= VK_NULL_HANDLE;
+	uint32_t												m_GraphicsSubmission		= 1;
+	uint32_t												m_ComputeSubmission			= 1;
+	uint32_t												m_GraphicsSubmissionWaited	= 0;
+	uint32_t												m_ComputeSubmissionWaited	= 0;
+	bool													m_IsGraphicsSubmissionEmpty	= false;	// Commands recorded before the graph count too
+};
+
+template<typename F>
+void RenderGraph::AddPass(const char* name, VkPipelineStageFlags2KHR shader_stages, std::initializer_list<RenderGraphAccess> accesses, F&& record, uint32_t flags)
+{
+	assert(!(flags & RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT) || shader_stages == VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	typedef typename std::decay<F>::type Record;
+
+	void* memory = VkArenaAllocate(m_RecordArena, sizeof(Record), alignof(Record));
+	new (memory) Record(std::forward<F>(record));
+
+	RenderGraphPass pass;
+	pass.Name = name;
+	pass.ShaderStages = shader_stages;
+	pass.Flags = flags;
+	pass.Record.Execute = [](void* data, VkCommandBuffer cmd) { (*static_cast<Record*>(data))(cmd); };
+	pass.Record.Destroy = [](void* data) { static_cast<Record*>(data)->~Record(); };
+	pass.Record.Commands = memory;
+	AddPass(pass, accesses);
+}
+
+template<typename F>
+void RenderGraph::Execute(VkCommandBuffer cmd, F&& acquire_back_buffer)
+{
+	Compile();
+
+	uint32_t pass_index = 0;
+	for (; pass_index < m_Passes.size() && !(m_Passes[pass_index].Flags & RENDER_GRAPH_PASS_BACK_BUFFER_BIT); ++pass_index)
+	{
+		ExecutePass(cmd, pass_index);
+	}
+
+	if (pass_index < m_Passes.size())
+	{
+		cmd = acquire_back_buffer();
+		++m_GraphicsSubmission;
+		m_IsGraphicsSubmissionEmpty = true;
+
+		for (; pass_index < m_Passes.size(); ++pass_index)
+		{
+			ExecutePass(cmd, pass_index);
+		}
+	}
+
+	EndExecute();
+}
@@ -27,6 +27,9 @@ public:
     void                    Create(const RenderContext& rc, GLFWwindow* window);
     void                    Destroy();
 
+	void					CreatePipelines(const RenderContext& rc);
+	void					DestroyPipelines();
+
     void                    Update(GLFWwindow* window);
-    void                    Draw(const RenderContext& rc, VkCommandBuffer cmd);
+    void                    Draw(const RenderContext& rc, RenderGraph& graph);
 };
@@ -1,33 +1,115 @@
 #include "RenderModel.h"
 #include "VkUtil.h"
+#include "Trace.h"
+
+// Descriptor sets are split by update frequency: set 0 holds per frame constants, set 1 the inputs of the color pass,
+// set 2 is the global bindless set. Draws only push their transform and the index of their material.
+struct DrawConstants
+{
+	glm::mat4	World;
+	uint32_t	MaterialBufferIndex;	// Bindless slot of the model's material buffer
+	uint32_t	MaterialIndex;
+};
+
+// Draws of a pass are split into chunks of at least this many, recorded as jobs
+static const uint32_t DRAWS_PER_RECORD_TASK = 256;
+
+static uint32_t GetDrawCount(uint32_t model_count, const GltfModel* models)
+{
+	uint32_t draw_count = 0;
+	for (uint32_t i = 0; i < model_count; ++i)
+	{
+		for (const GltfInstance& instance : models[i].m_Instances)
+		{
+			draw_count += instance.MeshCount;
+		}
+	}
+	return draw_count;
+}
+
+// Calls record(cmd, draw_begin, draw_end, is_first) inside the render pass, once inline if the pass has few draws, or
+// once per chunk into secondary command buffers recorded in parallel. Secondary command buffers inherit no state,
+// so record binds everything it draws with, and clears the attachments when is_first is set.
+template<typename F>
+static void RecordRenderPass(VkCommandBuffer cmd, const VkRenderPassBeginInfo& render_pass_info, uint32_t draw_count, F&& record)
+{
+	const uint32_t task_count = VkMin((draw_count + DRAWS_PER_RECORD_TASK - 1) / DRAWS_PER_RECORD_TASK, VkGetRecordThreadCount());
+	if (task_count <= 1)
+	{
+		vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+		record(cmd, 0U, draw_count, true);
+		vkCmdEndRenderPass(cmd);
+		return;
+	}
+
+	VkCommandBuffer* secondary_cmds = static_cast<VkCommandBuffer*>(VkAllocateFrameMemory(sizeof(VkCommandBuffer) * task_count, alignof(VkCommandBuffer)));
+	VkRecordParallel(task_count, [&](uint32_t task)
+	{
+		VkCommandBuffer secondary_cmd = VkBeginSecondaryCommands(render_pass_info.renderPass, render_pass_info.framebuffer);
+		const uint32_t draw_begin = static_cast<uint32_t>(static_cast<uint64_t>(draw_count) * task / task_count);
+		const uint32_t draw_end = static_cast<uint32_t>(static_cast<uint64_t>(draw_count) * (task + 1) / task_count);
+		record(secondary_cmd, draw_begin, draw_end, task == 0);
+		VK(vkEndCommandBuffer(secondary_cmd));
+		secondary_cmds[task] = secondary_cmd;
+	});
+
+	vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	vkCmdExecuteCommands(cmd, task_count, secondary_cmds);
+	vkCmdEndRenderPass(cmd);
+}
+
+static VkDescriptorSetLayout CreateDescriptorSetLayout(const VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count)
+{
+	VkDescriptorSetLayoutCreateInfo set_layout_info = {};
+	set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_layout_info.bindingCount = binding_count;
+	set_layout_info.pBindings = bindings;
+
+	VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+	VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &set_layout));
+	return set_layout;
+}
 
 void RenderModel::Create(const RenderContext& rc)
 {
-    VkDescriptorSetLayoutBinding set_layout_bindings[] =
-    {
-        { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-        { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-        { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-        { 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-        { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-        { 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-        { 6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-		{ 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-		{ 8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
-    };
-    VkDescriptorSetLayoutCreateInfo set_layout_info = {};
-    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
-    set_layout_info.pBindings = set_layout_bindings;
-    VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_DescriptorSetLayout));
+	VkDescriptorSetLayoutBinding frame_set_layout_bindings[] =
+	{
+		{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+		{ 1, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+	};
+	m_FrameDescriptorSetLayout = CreateDescriptorSetLayout(frame_set_layout_bindings, static_cast<uint32_t>(sizeof(frame_set_layout_bindings) / sizeof(*frame_set_layout_bindings)));
+	m_FrameDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_FrameDescriptorSetLayout, frame_set_layout_bindings, static_cast<uint32_t>(sizeof(frame_set_layout_bindings) / sizeof(*frame_set_layout_bindings)));
+
+	VkDescriptorSetLayoutBinding pass_set_layout_bindings[] =
+	{
+		{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+		{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+		{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+		{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+		{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL },
+	};
+	m_PassDescriptorSetLayout = CreateDescriptorSetLayout(pass_set_layout_bindings, static_cast<uint32_t>(sizeof(pass_set_layout_bindings) / sizeof(*pass_set_layout_bindings)));
+	m_PassDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_PassDescriptorSetLayout, pass_set_layout_bindings, static_cast<uint32_t>(sizeof(pass_set_layout_bindings) / sizeof(*pass_set_layout_bindings)));
+
+	VkDescriptorSetLayout set_layouts[] =
+	{
+		m_FrameDescriptorSetLayout,
+		m_PassDescriptorSetLayout,
+		Vk.BindlessDescriptorSetLayout,
+	};
+
+	VkPushConstantRange push_constants = {};
+	push_constants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	push_constants.offset = 0;
+	push_constants.size = sizeof(DrawConstants);
 
     VkPipelineLayoutCreateInfo pipeline_layout_info = {};
     pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_info.setLayoutCount = 1;
-    pipeline_layout_info.pSetLayouts = &m_DescriptorSetLayout;
+    pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(sizeof(set_layouts) / sizeof(*set_layouts));
+    pipeline_layout_info.pSetLayouts = set_layouts;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constants;
     VK(vkCreatePipelineLayout(Vk.Device, &pipeline_layout_info, NULL, &m_PipelineLayout));
-
-	CreatePipelines(rc);
 }
 
 void RenderModel::Destroy()
@@ -35,7 +117,10 @@ void RenderModel::Destroy()
 	DestroyPipelines();
 
     vkDestroyPipelineLayout(Vk.Device, m_PipelineLayout, NULL);
-    vkDestroyDescriptorSetLayout(Vk.Device, m_DescriptorSetLayout, NULL);
+    VkDestroyDescriptorSetTemplate(m_PassDescriptorSetTemplate);
+    VkDestroyDescriptorSetTemplate(m_FrameDescriptorSetTemplate);
+    vkDestroyDescriptorSetLayout(Vk.Device, m_PassDescriptorSetLayout, NULL);
+    vkDestroyDescriptorSetLayout(Vk.Device, m_FrameDescriptorSetLayout, NULL);
 }
 
 void RenderModel::CreatePipelines(const RenderContext& rc)
@@ -110,225 +195,216 @@ void RenderModel::SetDirectionalLightLUT(VkImageView lut)
 	m_DirectionalLightLUT = lut;
 }
 
-void RenderModel::DrawDepth(const RenderContext& rc, VkCommandBuffer cmd, uint32_t model_count, const GltfModel* models)
+void RenderModel::BeginFrame(const RenderContext& rc)
 {
-	VkPushLabel(cmd, "Models Depth");
-
-	VkUtilImageBarrier(cmd, rc.NormalTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-	VkUtilImageBarrier(cmd, rc.LinearDepthTextures[rc.FrameCounter & 1].Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-	
-    VkRenderPassBeginInfo render_pass_info = {};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_info.renderPass = rc.DepthRenderPass;
-    render_pass_info.framebuffer = rc.DepthFramebuffers[rc.FrameCounter & 1];
-    render_pass_info.renderArea.offset = { 0, 0 };
-    render_pass_info.renderArea.extent = { rc.Width, rc.Height };
-    vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-
-    VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(rc.Width), static_cast<float>(rc.Height), 0.0f, 1.0f };
-    VkRect2D scissor = { { 0, 0 }, { rc.Width, rc.Height } };
-    vkCmdSetViewport(cmd, 0, 1, &viewport);
-    vkCmdSetScissor(cmd, 0, 1, &scissor);
-
-    VkClearRect clear_rect = {};
-    clear_rect.baseArrayLayer = 0;
-    clear_rect.layerCount = 1;
-    clear_rect.rect.offset.x = 0;
-    clear_rect.rect.offset.y = 0;
-    clear_rect.rect.extent.width = rc.Width;
-    clear_rect.rect.extent.height = rc.Height;
-
-    VkClearAttachment clear_attachments[] =
-    {
-		{ VK_IMAGE_ASPECT_COLOR_BIT, 0, { 0.5f, 0.5f, 0.5f, 0.0f } },
-		{ VK_IMAGE_ASPECT_COLOR_BIT, 1, { 1.0f, 0.0f, 0.0f, 0.0f } },
-        { VK_IMAGE_ASPECT_DEPTH_BIT, 0, { 0.0f, 0 } },
-    };
-    vkCmdClearAttachments(cmd, static_cast<uint32_t>(sizeof(clear_attachments) / sizeof(*clear_attachments)), clear_attachments, 1, &clear_rect);
-
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineDepth);
+	struct FrameConstants
+	{
+		glm::mat4	ViewProjection;
+		glm::vec3	ViewPosition;
+		float		AmbientLightIntensity;
+		glm::vec3	LightDirection;
+		float		DirectionalLightIntensity;
+		float		DepthParam;
+		uint32_t	EnableScreenSpaceAmbientOcclusion;
+		uint32_t	EnableRayTracedAmbientOcclusion;
+		uint32_t	EnableRayTracedShadows;
+		uint32_t	DebugEnable;
+		uint32_t	DebugIndex;
+	};
+	VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(FrameConstants));
+	FrameConstants* constants = reinterpret_cast<FrameConstants*>(constants_allocation.Data);
+	constants->ViewProjection = rc.CameraCurr.m_Projection * rc.CameraCurr.m_View;
+	constants->ViewPosition = rc.CameraCurr.m_Position;
+	constants->AmbientLightIntensity = m_AmbientLightIntensity;
+	constants->LightDirection = glm::normalize(rc.SunDirection);
+	constants->DirectionalLightIntensity = m_DirectionalLightIntensity;
+	constants->DepthParam = (rc.CameraCurr.m_FarZ - rc.CameraCurr.m_NearZ) / rc.CameraCurr.m_NearZ;
+	constants->EnableScreenSpaceAmbientOcclusion = rc.EnableScreenSpaceAmbientOcclusion;
+	constants->EnableRayTracedAmbientOcclusion = rc.EnableRayTracedAmbientOcclusion && Vk.IsRayTracingSupported;
+	constants->EnableRayTracedShadows = rc.EnableRayTracedShadows && Vk.IsRayTracingSupported;
+	constants->DebugEnable = rc.DebugEnable;
+	constants->DebugIndex = rc.DebugIndex;
+
+	m_FrameDescriptorSet = VkCreateDescriptorSetForCurrentFrame(m_FrameDescriptorSetTemplate,
+		{
+			{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(FrameConstants) },
+			{ static_cast<VkImageView>(VK_NULL_HANDLE), VK_IMAGE_LAYOUT_UNDEFINED, rc.AnisoWrap },
+		});
+}
 
-	const glm::mat4 view_projection = rc.CameraCurr.m_Projection * rc.CameraCurr.m_View;
+void RenderModel::DrawModels(VkCommandBuffer cmd, uint32_t model_count, const GltfModel* models, bool bind_tangents, uint32_t draw_begin, uint32_t draw_end)
+{
+	const VkShaderStageFlags push_constant_stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    for (uint32_t i = 0; i < model_count; ++i)
+	// Draws are numbered in the order they are issued, over the meshes of every instance of every model
+	uint32_t draw_index = 0;
+    for (uint32_t i = 0; i < model_count && draw_index < draw_end; ++i)
     {
         const GltfModel& model = models[i];
-
-        model.BindVertexBuffer(cmd, 0, VERTEX_ATTRIBUTE_POSITION);
-        model.BindVertexBuffer(cmd, 1, VERTEX_ATTRIBUTE_TEXCOORD);
-		model.BindVertexBuffer(cmd, 2, VERTEX_ATTRIBUTE_NORMAL);
-        model.BindIndexBuffer(cmd);
+		bool is_model_bound = false;
 
 		const uint32_t instance_count = static_cast<uint32_t>(model.m_Instances.size());
-		for (uint32_t j = 0; j < instance_count; ++j)
+		for (uint32_t j = 0; j < instance_count && draw_index < draw_end; ++j)
 		{
 			const GltfInstance& instance = model.m_Instances[j];
+			if (draw_index + instance.MeshCount <= draw_begin)
+			{
+				draw_index += instance.MeshCount;
+				continue;
+			}
 
-			for (uint32_t k = instance.MeshOffset; k < (instance.MeshOffset + instance.MeshCount); ++k)
+			if (!is_model_bound)
 			{
-				const uint32_t material_index = model.m_Meshes[k].MaterialIndex;
-				const GltfMaterial& material = model.m_Materials[material_index];
+				model.BindVertexBuffer(cmd, 0, VERTEX_ATTRIBUTE_POSITION);
+				model.BindVertexBuffer(cmd, 1, VERTEX_ATTRIBUTE_TEXCOORD);
+				model.BindVertexBuffer(cmd, 2, VERTEX_ATTRIBUTE_NORMAL);
+				if (bind_tangents)
+				{
+					model.BindVertexBuffer(cmd, 3, VERTEX_ATTRIBUTE_TANGENT);
+				}
+				model.BindIndexBuffer(cmd);
+				is_model_bound = true;
+			}
 
-				const VkTexture& base_color_texture = model.m_Textures[material.BaseColorTextureIndex];
-				const VkTexture& normal_texture = model.m_Textures[material.NormalTextureIndex];
-				const VkTexture& metallic_roughness_texture = model.m_Textures[material.MetallicRoughnessTextureIndex];
+			vkCmdPushConstants(cmd, m_PipelineLayout, push_constant_stages, offsetof(DrawConstants, World), sizeof(glm::mat4), &instance.Transform);
 
-				struct Constants
-				{
-					glm::mat4   World;
-					glm::mat4	WorldViewProjection;
-					float		DepthParam;
-				};
-				VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-				Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
-				constants->World = instance.Transform;
-				constants->WorldViewProjection = view_projection * instance.Transform;
-				constants->DepthParam = (rc.CameraCurr.m_FarZ - rc.CameraCurr.m_NearZ) / rc.CameraCurr.m_NearZ;
-
-				VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_DescriptorSetLayout,
-					{
-						{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-						{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, base_color_texture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.AnisoWrap },
-						{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, normal_texture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.AnisoWrap },
-						{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, metallic_roughness_texture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.AnisoWrap },
-						{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_AmbientLightLUT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
-						{ 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_DirectionalLightLUT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
-						{ 6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.ScreenSpaceAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-						{ 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.RayTracedAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-						{ 8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.ShadowTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					});
-				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &set, 0, NULL);
+			const uint32_t mesh_begin = instance.MeshOffset + (VkMax(draw_begin, draw_index) - draw_index);
+			const uint32_t mesh_end = instance.MeshOffset + VkMin(draw_end - draw_index, instance.MeshCount);
+			for (uint32_t k = mesh_begin; k < mesh_end; ++k)
+			{
+				const uint32_t material_indices[] = { model.m_BindlessMaterialBufferIndex, model.m_Meshes[k].MaterialIndex };
+				vkCmdPushConstants(cmd, m_PipelineLayout, push_constant_stages, offsetof(DrawConstants, MaterialBufferIndex), sizeof(material_indices), material_indices);
 
 				model.Draw(cmd, k);
 			}
+			draw_index += instance.MeshCount;
 		}
     }
-
-    vkCmdEndRenderPass(cmd);
-
-	VkUtilImageBarrier(cmd, rc.NormalTexture.Image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-	VkUtilImageBarrier(cmd, rc.LinearDepthTextures[rc.FrameCounter & 1].Image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-	
-	VkPopLabel(cmd);
 }
 
-void RenderModel::DrawColor(const RenderContext& rc, VkCommandBuffer cmd, uint32_t model_count, const GltfModel* models)
+void RenderModel::DrawDepth(const RenderContext& rc, RenderGraph& graph, uint32_t model_count, const GltfModel* models)
 {
-	VkPushLabel(cmd, "Models Color");
-
-    VkRenderPassBeginInfo render_pass_info = {};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_info.renderPass = rc.ColorRenderPass;
-    render_pass_info.framebuffer = rc.ColorFramebuffer;
-    render_pass_info.renderArea.offset = { 0, 0 };
-    render_pass_info.renderArea.extent = { rc.Width, rc.Height };
-    vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-
-    VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(rc.Width), static_cast<float>(rc.Height), 0.0f, 1.0f };
-    VkRect2D scissor = { { 0, 0 }, { rc.Width, rc.Height } };
-    vkCmdSetViewport(cmd, 0, 1, &viewport);
-    vkCmdSetScissor(cmd, 0, 1, &scissor);
-
-    VkClearRect clear_rect = {};
-    clear_rect.baseArrayLayer = 0;
-    clear_rect.layerCount = 1;
-    clear_rect.rect.offset.x = 0;
-    clear_rect.rect.offset.y = 0;
-    clear_rect.rect.extent.width = rc.Width;
-    clear_rect.rect.extent.height = rc.Height;
-
-    VkClearAttachment clear_attachments[] =
-    {
-        { VK_IMAGE_ASPECT_COLOR_BIT, 0, { 0.0f, 0.0f, 0.0f, 0.0f } },
-    };
-    vkCmdClearAttachments(cmd, static_cast<uint32_t>(sizeof(clear_attachments) / sizeof(*clear_attachments)), clear_attachments, 1, &clear_rect);
-
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineColor);
+	graph.AddPass("Models Depth", VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		{
+			{ &rc.NormalTexture, RENDER_GRAPH_USAGE_COLOR_ATTACHMENT },
+			{ &rc.LinearDepthTextures[rc.FrameCounter & 1], RENDER_GRAPH_USAGE_COLOR_ATTACHMENT },
+			{ &rc.DepthTexture, RENDER_GRAPH_USAGE_DEPTH_ATTACHMENT },
+		},
+		[this, &rc, model_count, models](VkCommandBuffer cmd)
+	{
+		VkRenderPassBeginInfo render_pass_info = {};
+		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		render_pass_info.renderPass = rc.DepthRenderPass;
+		render_pass_info.framebuffer = rc.DepthFramebuffers[rc.FrameCounter & 1];
+		render_pass_info.renderArea.offset = { 0, 0 };
+		render_pass_info.renderArea.extent = { rc.Width, rc.Height };
+
+		VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(rc.Width), static_cast<float>(rc.Height), 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, { rc.Width, rc.Height } };
+
+		VkClearRect clear_rect = {};
+		clear_rect.baseArrayLayer = 0;
+		clear_rect.layerCount = 1;
+		clear_rect.rect.offset.x = 0;
+		clear_rect.rect.offset.y = 0;
+		clear_rect.rect.extent.width = rc.Width;
+		clear_rect.rect.extent.height = rc.Height;
+
+		VkClearAttachment clear_attachments[] =
+		{
+			{ VK_IMAGE_ASPECT_COLOR_BIT, 0, { 0.5f, 0.5f, 0.5f, 0.0f } },
+			{ VK_IMAGE_ASPECT_COLOR_BIT, 1, { 1.0f, 0.0f, 0.0f, 0.0f } },
+			{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, { 0.0f, 0 } },
+		};
 
-	const glm::mat4 view_projection = rc.CameraCurr.m_Projection * rc.CameraCurr.m_View;
+		const size_t draw_zone = TraceBeginZone("RenderModel::DrawDepth Draws");
+		RecordRenderPass(cmd, render_pass_info, GetDrawCount(model_count, models), [&](VkCommandBuffer draw_cmd, uint32_t draw_begin, uint32_t draw_end, bool is_first)
+		{
+			vkCmdSetViewport(draw_cmd, 0, 1, &viewport);
+			vkCmdSetScissor(draw_cmd, 0, 1, &scissor);
 
-    for (uint32_t i = 0; i < model_count; ++i)
-    {
-        const GltfModel& model = models[i];
+			if (is_first)
+			{
+				vkCmdClearAttachments(draw_cmd, static_cast<uint32_t>(sizeof(clear_attachments) / sizeof(*clear_attachments)), clear_attachments, 1, &clear_rect);
+			}
 
-        model.BindVertexBuffer(cmd, 0, VERTEX_ATTRIBUTE_POSITION);
-        model.BindVertexBuffer(cmd, 1, VERTEX_ATTRIBUTE_TEXCOORD);
-		model.BindVertexBuffer(cmd, 2, VERTEX_ATTRIBUTE_NORMAL);
-		model.BindVertexBuffer(cmd, 3, VERTEX_ATTRIBUTE_TANGENT);
-        model.BindIndexBuffer(cmd);
+			vkCmdBindPipeline(draw_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineDepth);
 
-		const uint32_t instance_count = static_cast<uint32_t>(model.m_Instances.size());
-		for (uint32_t j = 0; j < instance_count; ++j)
-		{
-			const GltfInstance& instance = model.m_Instances[j];
+			vkCmdBindDescriptorSets(draw_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_FrameDescriptorSet, 0, NULL);
+			vkCmdBindDescriptorSets(draw_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 2, 1, &Vk.BindlessDescriptorSet, 0, NULL);
 
-			for (uint32_t k = instance.MeshOffset; k < (instance.MeshOffset + instance.MeshCount); ++k)
-			{
-				const uint32_t material_index = model.m_Meshes[k].MaterialIndex;
-				const GltfMaterial& material = model.m_Materials[material_index];
+			DrawModels(draw_cmd, model_count, models, false, draw_begin, draw_end);
+		});
+		TraceEndZone(draw_zone);
+	});
+}
 
-				const VkTexture& base_color_texture = model.m_Textures[material.BaseColorTextureIndex];
-				const VkTexture& normal_texture = model.m_Textures[material.NormalTextureIndex];
-				const VkTexture& metallic_roughness_texture = model.m_Textures[material.MetallicRoughnessTextureIndex];
+void RenderModel::DrawColor(const RenderContext& rc, RenderGraph& graph, uint32_t model_count, const GltfModel* models)
+{
+	graph.AddPass("Models Color", VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		{
+			{ &rc.ColorTexture, RENDER_GRAPH_USAGE_COLOR_ATTACHMENT },
+			{ &rc.DepthTexture, RENDER_GRAPH_USAGE_DEPTH_ATTACHMENT },
+			{ &rc.ScreenSpaceAmbientOcclusionTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.RayTracedAmbientOcclusionTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.ShadowTexture, RENDER_GRAPH_USAGE_SAMPLED },
+		},
+		[this, &rc, model_count, models](VkCommandBuffer cmd)
+	{
+		VkRenderPassBeginInfo render_pass_info = {};
+		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		render_pass_info.renderPass = rc.ColorRenderPass;
+		render_pass_info.framebuffer = rc.ColorFramebuffer;
+		render_pass_info.renderArea.offset = { 0, 0 };
+		render_pass_info.renderArea.extent = { rc.Width, rc.Height };
+
+		VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(rc.Width), static_cast<float>(rc.Height), 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, { rc.Width, rc.Height } };
+
+		VkClearRect clear_rect = {};
+		clear_rect.baseArrayLayer = 0;
+		clear_rect.layerCount = 1;
+		clear_rect.rect.offset.x = 0;
+		clear_rect.rect.offset.y = 0;
+		clear_rect.rect.extent.width = rc.Width;
+		clear_rect.rect.extent.height = rc.Height;
+
+		VkClearAttachment clear_attachments[] =
+		{
+			{ VK_IMAGE_ASPECT_COLOR_BIT, 0, { 0.0f, 0.0f, 0.0f, 0.0f } },
+		};
 
-				struct Constants
+		VkDescriptorSet sets[] =
+		{
+			m_FrameDescriptorSet,
+			VkCreateDescriptorSetForCurrentFrame(m_PassDescriptorSetTemplate,
 				{
-					glm::mat4   World;
-					glm::mat4	WorldViewProjection;
-					glm::vec3	ViewPosition;
-					float	    AmbientLightIntensity;
-					glm::vec3	LightDirection;
-					float	    DirectionalLightIntensity;
-					glm::vec4	BaseColorFactor;
-					glm::vec2	MetallicRoughnessFactor;
-					uint32_t	HasBaseColorTexture;
-					uint32_t	HasNormalTexture;
-					uint32_t	HasMetallicRoughnessTexture;
-					uint32_t	EnableScreenSpaceAmbientOcclusion;
-					uint32_t	EnableRayTracedAmbientOcclusion;
-					uint32_t	EnableRayTracedShadows;
-					uint32_t	DebugEnable;
-					uint32_t	DebugIndex;
-				};
-				VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-				Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
-				constants->World = instance.Transform;
-				constants->WorldViewProjection = view_projection * instance.Transform;
-				constants->ViewPosition = rc.CameraCurr.m_Position;
-				constants->AmbientLightIntensity = m_AmbientLightIntensity;
-				constants->LightDirection = glm::normalize(rc.SunDirection);
-				constants->DirectionalLightIntensity = m_DirectionalLightIntensity;
-				constants->BaseColorFactor = material.BaseColorFactor;
-				constants->MetallicRoughnessFactor = material.MetallicRoughnessFactor;
-				constants->HasBaseColorTexture = material.HasBaseColorTexture;
-				constants->HasNormalTexture = material.HasNormalTexture;
-				constants->HasMetallicRoughnessTexture = material.HasMetallicRoughnessTexture;
-				constants->EnableScreenSpaceAmbientOcclusion = rc.EnableScreenSpaceAmbientOcclusion;
-				constants->EnableRayTracedAmbientOcclusion = rc.EnableRayTracedAmbientOcclusion && Vk.IsRayTracingSupported;
-				constants->EnableRayTracedShadows = rc.EnableRayTracedShadows && Vk.IsRayTracingSupported;
-				constants->DebugEnable = rc.DebugEnable;
-				constants->DebugIndex = rc.DebugIndex;
-
-				VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_DescriptorSetLayout,
-					{
-						{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-						{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, base_color_texture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.AnisoWrap },
-						{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, normal_texture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.AnisoWrap },
-						{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, metallic_roughness_texture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.AnisoWrap },
-						{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_AmbientLightLUT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
-						{ 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_DirectionalLightLUT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
-						{ 6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.ScreenSpaceAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-						{ 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.RayTracedAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-						{ 8, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.ShadowTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					});
-				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &set, 0, NULL);
+					{ m_AmbientLightLUT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
+					{ m_DirectionalLightLUT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
+					{ rc.ScreenSpaceAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+					{ rc.RayTracedAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+					{ rc.ShadowTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				}),
+			Vk.BindlessDescriptorSet,
+		};
+
+		const size_t draw_zone = TraceBeginZone("RenderModel::DrawColor Draws");
+		RecordRenderPass(cmd, render_pass_info, GetDrawCount(model_count, models), [&](VkCommandBuffer draw_cmd, uint32_t draw_begin, uint32_t draw_end, bool is_first)
+		{
+			vkCmdSetViewport(draw_cmd, 0, 1, &viewport);
+			vkCmdSetScissor(draw_cmd, 0, 1, &scissor);
 
-				model.Draw(cmd, k);
+			if (is_first)
+			{
+				vkCmdClearAttachments(draw_cmd, static_cast<uint32_t>(sizeof(clear_attachments) / sizeof(*clear_attachments)), clear_attachments, 1, &clear_rect);
 			}
-		}
-    }
 
-    vkCmdEndRenderPass(cmd);
+			vkCmdBindPipeline(draw_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineColor);
+
+			vkCmdBindDescriptorSets(draw_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, static_cast<uint32_t>(sizeof(sets) / sizeof(*sets)), sets, 0, NULL);
 
-	VkPopLabel(cmd);
+			DrawModels(draw_cmd, model_count, models, true, draw_begin, draw_end);
+		});
+		TraceEndZone(draw_zone);
+	});
 }
\ No newline at end of file
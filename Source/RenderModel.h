@@ -6,7 +6,10 @@
 class RenderModel
 {
 public:
-    VkDescriptorSetLayout   m_DescriptorSetLayout		= VK_NULL_HANDLE;
+    VkDescriptorSetLayout   m_FrameDescriptorSetLayout		= VK_NULL_HANDLE;
+    VkDescriptorSetLayout   m_PassDescriptorSetLayout		= VK_NULL_HANDLE;
+    VkDescriptorSetTemplate m_FrameDescriptorSetTemplate	= {};
+    VkDescriptorSetTemplate m_PassDescriptorSetTemplate		= {};
     VkPipelineLayout        m_PipelineLayout			= VK_NULL_HANDLE;
     VkPipeline              m_PipelineDepth				= VK_NULL_HANDLE;
     VkPipeline              m_PipelineColor				= VK_NULL_HANDLE;
@@ -20,15 +23,21 @@ public:
     void                    Create(const RenderContext& rc);
     void                    Destroy();
 
+	void					CreatePipelines(const RenderContext& rc);
+	void					DestroyPipelines();
+
 	void					RecreatePipelines(const RenderContext& rc);
 
+	void					BeginFrame(const RenderContext& rc);
+
 	void					SetAmbientLightLUT(VkImageView lut);
 	void					SetDirectionalLightLUT(VkImageView lut);
 
-    void                    DrawDepth(const RenderContext& rc, VkCommandBuffer cmd, uint32_t model_count, const GltfModel* models);
-    void                    DrawColor(const RenderContext& rc, VkCommandBuffer cmd, uint32_t model_count, const GltfModel* models);
+    void                    DrawDepth(const RenderContext& rc, RenderGraph& graph, uint32_t model_count, const GltfModel* models);
+    void                    DrawColor(const RenderContext& rc, RenderGraph& graph, uint32_t model_count, const GltfModel* models);
 
 private:
-	void					CreatePipelines(const RenderContext& rc);
-	void					DestroyPipelines();
+	void					DrawModels(VkCommandBuffer cmd, uint32_t model_count, const GltfModel* models, bool bind_tangents, uint32_t draw_begin, uint32_t draw_end);
+
+	VkDescriptorSet			m_FrameDescriptorSet			= VK_NULL_HANDLE;
 };
@@ -17,6 +17,7 @@ void RenderMotion::Create(const RenderContext& rc)
         set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
         set_layout_info.pBindings = set_layout_bindings;
         VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_GenerateDescriptorSetLayout));
+        m_GenerateDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_GenerateDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
         VkPipelineLayoutCreateInfo pipeline_layout_info = {};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -24,8 +25,6 @@ void RenderMotion::Create(const RenderContext& rc)
         pipeline_layout_info.pSetLayouts = &m_GenerateDescriptorSetLayout;
         VK(vkCreatePipelineLayout(Vk.Device, &pipeline_layout_info, NULL, &m_GeneratePipelineLayout));
     }
-
-	CreatePipelines(rc);
 }
 
 void RenderMotion::Destroy()
@@ -33,6 +32,7 @@ void RenderMotion::Destroy()
 	DestroyPipelines();
 
     vkDestroyPipelineLayout(Vk.Device, m_GeneratePipelineLayout, NULL);
+    VkDestroyDescriptorSetTemplate(m_GenerateDescriptorSetTemplate);
     vkDestroyDescriptorSetLayout(Vk.Device, m_GenerateDescriptorSetLayout, NULL);
 }
 
@@ -58,54 +58,56 @@ void RenderMotion::RecreatePipelines(const RenderContext& rc)
 	CreatePipelines(rc);
 }
 
-void RenderMotion::Generate(const RenderContext& rc, VkCommandBuffer cmd)
+void RenderMotion::Generate(const RenderContext& rc, RenderGraph& graph)
 {
-	VkPushLabel(cmd, "Motion Generate");
-
-	VkUtilImageBarrier(cmd, rc.MotionTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_GeneratePipeline);
-
-	const glm::mat4 curr = rc.CameraCurr.m_ProjectionNoJitter * rc.CameraCurr.m_View;
-	const glm::mat4 prev = rc.CameraPrev.m_ProjectionNoJitter * rc.CameraPrev.m_View;
-	const glm::mat4 curr_to_prev = prev * glm::inverse(curr);
-
-	const float depth_param = (rc.CameraCurr.m_FarZ - rc.CameraCurr.m_NearZ) / rc.CameraCurr.m_NearZ;
-
-	const glm::mat4 pre =
-	{
-		2.0f, 0.0f, 0.0f, 0.0f,
-		0.0f, 2.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 1.0f / depth_param, 0.0f,
-		-1.0f, -1.0f, -1.0f / depth_param, 1.0f
-	};
-	const glm::mat4 post =
-	{
-		0.5f, 0.0f, 0.0f, 0.0f,
-		0.0f, 0.5f, 0.0f, 0.0f,
-		0.0f, 0.0f, 1.0f, 0.0f,
-		0.5f, 0.5f, 0.0f, 1.0f
-	};
-
-	struct Constants
+	graph.AddPass("Motion Generate", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		{
+			{ &rc.MotionTexture, RENDER_GRAPH_USAGE_STORAGE },
+			{ &rc.LinearDepthTextures[rc.FrameCounter & 1], RENDER_GRAPH_USAGE_SAMPLED },
+		},
+		[this, &rc](VkCommandBuffer cmd)
 	{
-		glm::mat4	CurrToPrev;
-	};
-	VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-	Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
-	constants->CurrToPrev = post * curr_to_prev * pre;
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_GeneratePipeline);
 
-	VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_GenerateDescriptorSetLayout,
-		{
-			{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, rc.MotionTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-			{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-		});
-	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_GeneratePipelineLayout, 0, 1, &set, 0, NULL);
+		const glm::mat4 curr = rc.CameraCurr.m_ProjectionNoJitter * rc.CameraCurr.m_View;
+		const glm::mat4 prev = rc.CameraPrev.m_ProjectionNoJitter * rc.CameraPrev.m_View;
+		const glm::mat4 curr_to_prev = prev * glm::inverse(curr);
 
-	vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+		const float depth_param = (rc.CameraCurr.m_FarZ - rc.CameraCurr.m_NearZ) / rc.CameraCurr.m_NearZ;
 
-	VkUtilImageBarrier(cmd, rc.MotionTexture.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+		const glm::mat4 pre =
+		{
+			2.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 2.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f / depth_param, 0.0f,
+			-1.0f, -1.0f, -1.0f / depth_param, 1.0f
+		};
+		const glm::mat4 post =
+		{
+			0.5f, 0.0f, 0.0f, 0.0f,
+			0.0f, 0.5f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.5f, 0.5f, 0.0f, 1.0f
+		};
 
-	VkPopLabel(cmd);
+		struct Constants
+		{
+			glm::mat4	CurrToPrev;
+			glm::ivec2	Size;
+		};
+		VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
+		Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
+		constants->CurrToPrev = post * curr_to_prev * pre;
+		constants->Size = glm::ivec2(rc.Width, rc.Height);
+
+		VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_GenerateDescriptorSetTemplate,
+			{
+				{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+				{ rc.MotionTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL },
+				{ rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+			});
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_GeneratePipelineLayout, 0, 1, &set, 0, NULL);
+
+		vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+	});
 }
\ No newline at end of file
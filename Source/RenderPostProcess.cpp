@@ -19,6 +19,7 @@ void RenderPostProcess::Create(const RenderContext& rc)
         set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
         set_layout_info.pBindings = set_layout_bindings;
         VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_TemporalBlendDescriptorSetLayout));
+        m_TemporalBlendDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_TemporalBlendDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
         VkPipelineLayoutCreateInfo pipeline_layout_info = {};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -31,14 +32,16 @@ void RenderPostProcess::Create(const RenderContext& rc)
     {
         VkDescriptorSetLayoutBinding set_layout_bindings[] =
         {
-            { 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL },
-            { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL },
+            { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL },
+            { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL },
+            { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL },
         };
         VkDescriptorSetLayoutCreateInfo set_layout_info = {};
         set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
         set_layout_info.pBindings = set_layout_bindings;
         VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_TemporalResolveDescriptorSetLayout));
+        m_TemporalResolveDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_TemporalResolveDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
         VkPipelineLayoutCreateInfo pipeline_layout_info = {};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -61,6 +64,7 @@ void RenderPostProcess::Create(const RenderContext& rc)
         set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
         set_layout_info.pBindings = set_layout_bindings;
         VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_ToneMappingDescriptorSetLayout));
+        m_ToneMappingDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_ToneMappingDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
         VkPipelineLayoutCreateInfo pipeline_layout_info = {};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -71,7 +75,6 @@ void RenderPostProcess::Create(const RenderContext& rc)
 
 	m_LuxoDoubleChecker = VkTextureLoadEXR("../Assets/Textures/LuxoDoubleChecker.exr");
 
-	CreatePipelines(rc);
 	CreateResolutionDependentResources(rc);
 }
 
@@ -83,12 +86,15 @@ void RenderPostProcess::Destroy()
 	VkTextureDestroy(m_LuxoDoubleChecker);
 
     vkDestroyPipelineLayout(Vk.Device, m_TemporalBlendPipelineLayout, NULL);
+    VkDestroyDescriptorSetTemplate(m_TemporalBlendDescriptorSetTemplate);
     vkDestroyDescriptorSetLayout(Vk.Device, m_TemporalBlendDescriptorSetLayout, NULL);
 
     vkDestroyPipelineLayout(Vk.Device, m_TemporalResolvePipelineLayout, NULL);
+    VkDestroyDescriptorSetTemplate(m_TemporalResolveDescriptorSetTemplate);
     vkDestroyDescriptorSetLayout(Vk.Device, m_TemporalResolveDescriptorSetLayout, NULL);
 
     vkDestroyPipelineLayout(Vk.Device, m_ToneMappingPipelineLayout, NULL);
+    VkDestroyDescriptorSetTemplate(m_ToneMappingDescriptorSetTemplate);
     vkDestroyDescriptorSetLayout(Vk.Device, m_ToneMappingDescriptorSetLayout, NULL);
 }
 
@@ -134,11 +140,13 @@ void RenderPostProcess::CreateResolutionDependentResources(const RenderContext&
 	VkTextureCreateParams temporal_texture_params;
 	temporal_texture_params.Type = VK_IMAGE_TYPE_2D;
 	temporal_texture_params.ViewType = VK_IMAGE_VIEW_TYPE_2D;
-	temporal_texture_params.Width = rc.Width;
-	temporal_texture_params.Height = rc.Height;
+	temporal_texture_params.Width = rc.TargetWidth;
+	temporal_texture_params.Height = rc.TargetHeight;
 	temporal_texture_params.Format = VK_FORMAT_R16G16B16A16_SFLOAT;
 	temporal_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	temporal_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	temporal_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+	temporal_texture_params.IsSharedWithCompute = true;
 	m_TemporalTextures[0] = VkTextureCreate(temporal_texture_params);
 	m_TemporalTextures[1] = VkTextureCreate(temporal_texture_params);
 }
@@ -157,7 +165,15 @@ void RenderPostProcess::RecreatePipelines(const RenderContext& rc)
 
 void RenderPostProcess::RecreateResolutionDependentResources(const RenderContext& rc)
 {
-	DestroyResolutionDependentResources();
+	// Frames in flight may still use the old textures
+	const VkTexture temporal_textures[2] = { m_TemporalTextures[0], m_TemporalTextures[1] };
+	VkDestroyDeferred(
+		[=]()
+		{
+			VkTextureDestroy(temporal_textures[0]);
+			VkTextureDestroy(temporal_textures[1]);
+		});
+
 	CreateResolutionDependentResources(rc);
 }
 
@@ -179,97 +195,119 @@ void RenderPostProcess::Jitter(RenderContext& rc)
 	rc.CameraCurr.Jitter(jitter);
 }
 
-void RenderPostProcess::Draw(const RenderContext& rc, VkCommandBuffer cmd)
+void RenderPostProcess::Resolve(const RenderContext& rc, RenderGraph& graph)
 {
-    if (m_TemporalAAEnable && !rc.DebugEnable)
-    {
-		VkPushLabel(cmd, "Post Process TAA");
-
-        VkUtilImageBarrier(cmd, rc.ColorTexture.Image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-		VkUtilImageBarrier(cmd, rc.DepthTexture.Image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
-        VkUtilImageBarrier(cmd, m_TemporalTextures[rc.FrameCounter & 1].Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-        // Temporal Blend
-        {
-            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_TemporalBlendPipeline);
-
-			static uint32_t last_frame = ~0U;
-			const bool is_hist_valid = last_frame == rc.FrameCounter;
-			last_frame = rc.FrameCounter + 1;
-
-            struct Constants
-            {
-				uint32_t	IsHistValid;
-				float		Exposure;
-            };
-            VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-            Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
-			constants->IsHistValid = is_hist_valid;
-			constants->Exposure = std::exp2f(m_Exposure);
-
-            VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_TemporalBlendDescriptorSetLayout,
-                {
-                    { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-                    { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, m_TemporalTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-                    { 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.ColorTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.DepthTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-                    { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.MotionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-                    { 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_TemporalTextures[(rc.FrameCounter + 1) & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
-                });
-            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_TemporalBlendPipelineLayout, 0, 1, &set, 0, NULL);
-
-            vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
-        }
-
-        VkUtilImageBarrier(cmd, rc.ColorTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-		VkUtilImageBarrier(cmd, rc.DepthTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
-        VkUtilImageBarrier(cmd, m_TemporalTextures[rc.FrameCounter & 1].Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-        // Temporal Resolve
-        {
-            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_TemporalResolvePipeline);
-
-            VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_TemporalResolveDescriptorSetLayout,
-                {
-                    { 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, rc.ColorTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-                    { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_TemporalTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-                });
-            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_TemporalResolvePipelineLayout, 0, 1, &set, 0, NULL);
-
-            vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
-        }
-
-        VkUtilImageBarrier(cmd, rc.ColorTexture.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-		VkPopLabel(cmd);
-    }
-    else
-    {
-        VkUtilImageBarrier(cmd, rc.ColorTexture.Image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-    }
-
-	VkUtilImageBarrier(cmd, rc.UiTexture.Image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-    {
-		VkPushLabel(cmd, "Post Process Tone Mapping");
-
-        VkRenderPassBeginInfo render_pass_info = {};
-        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        render_pass_info.renderPass = rc.BackBufferRenderPass;
-        render_pass_info.framebuffer = rc.BackBufferFramebuffers[Vk.SwapchainImageIndex];
-        render_pass_info.renderArea.offset = { 0, 0 };
-        render_pass_info.renderArea.extent = { rc.Width, rc.Height };
-        vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-
-        VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(rc.Width), static_cast<float>(rc.Height), 0.0f, 1.0f };
-        VkRect2D scissor = { { 0, 0 }, { rc.Width, rc.Height } };
-        vkCmdSetViewport(cmd, 0, 1, &viewport);
-        vkCmdSetScissor(cmd, 0, 1, &scissor);
-
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ToneMappingPipeline);
+	if (m_TemporalAAEnable && !rc.DebugEnable)
+	{
+		graph.ImportTexture(m_TemporalTextures[0], VK_IMAGE_ASPECT_COLOR_BIT, true);
+		graph.ImportTexture(m_TemporalTextures[1], VK_IMAGE_ASPECT_COLOR_BIT, true);
+
+		const VkTexture* temporal_texture = &m_TemporalTextures[rc.FrameCounter & 1];
+		const VkTexture* history_texture = &m_TemporalTextures[(rc.FrameCounter + 1) & 1];
+
+		static uint32_t last_frame = ~0U;
+		const bool is_hist_valid = last_frame == rc.FrameCounter;
+		last_frame = rc.FrameCounter + 1;
+
+		graph.AddPass("Post Process TAA", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			{
+				{ temporal_texture, RENDER_GRAPH_USAGE_STORAGE },
+				{ &rc.ColorTexture, RENDER_GRAPH_USAGE_SAMPLED },
+				{ &rc.DepthTexture, RENDER_GRAPH_USAGE_SAMPLED },
+				{ &rc.MotionTexture, RENDER_GRAPH_USAGE_SAMPLED },
+				{ history_texture, RENDER_GRAPH_USAGE_SAMPLED },
+				{ temporal_texture, RENDER_GRAPH_USAGE_SAMPLED },
+				{ &rc.ColorTexture, RENDER_GRAPH_USAGE_STORAGE },
+			},
+			[this, &rc, &graph, temporal_texture, history_texture, is_hist_valid](VkCommandBuffer cmd)
+		{
+			// Temporal Blend
+			{
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_TemporalBlendPipeline);
+
+				struct Constants
+				{
+					uint32_t	IsHistValid;
+					float		Exposure;
+					glm::ivec2	Size;
+				};
+				VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
+				Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
+				constants->IsHistValid = is_hist_valid;
+				constants->Exposure = std::exp2f(m_Exposure);
+				constants->Size = glm::ivec2(rc.Width, rc.Height);
+
+				VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_TemporalBlendDescriptorSetTemplate,
+					{
+						{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+						{ temporal_texture->ImageView, VK_IMAGE_LAYOUT_GENERAL },
+						{ rc.ColorTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+						{ rc.DepthTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+						{ rc.MotionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+						{ history_texture->ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
+					});
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_TemporalBlendPipelineLayout, 0, 1, &set, 0, NULL);
+
+				vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+			}
+
+			graph.Transition(cmd, { { temporal_texture, RENDER_GRAPH_USAGE_SAMPLED }, { &rc.ColorTexture, RENDER_GRAPH_USAGE_STORAGE } });
+
+			// Temporal Resolve
+			{
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_TemporalResolvePipeline);
+
+				struct Constants
+				{
+					glm::ivec2	Size;
+				};
+				VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
+				Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
+				constants->Size = glm::ivec2(rc.Width, rc.Height);
+
+				VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_TemporalResolveDescriptorSetTemplate,
+					{
+						{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+						{ rc.ColorTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL },
+						{ temporal_texture->ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+					});
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_TemporalResolvePipelineLayout, 0, 1, &set, 0, NULL);
+
+				vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+			}
+		}, RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT);
+	}
+}
 
-        struct Constants
-        {
+void RenderPostProcess::Draw(const RenderContext& rc, RenderGraph& graph)
+{
+	graph.AddPass("Post Process Tone Mapping", VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		{
+			{ &rc.ColorTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.UiTexture, RENDER_GRAPH_USAGE_SAMPLED },
+		},
+		[this, &rc](VkCommandBuffer cmd)
+	{
+		// The swapchain can differ from the render size for a frame when it is replaced while acquiring
+		const VkExtent2D extent = { VkMin(rc.Width, Vk.SwapchainImageExtent.width), VkMin(rc.Height, Vk.SwapchainImageExtent.height) };
+
+		VkRenderPassBeginInfo render_pass_info = {};
+		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		render_pass_info.renderPass = rc.BackBufferRenderPass;
+		render_pass_info.framebuffer = rc.BackBufferFramebuffers[Vk.SwapchainImageIndex];
+		render_pass_info.renderArea.offset = { 0, 0 };
+		render_pass_info.renderArea.extent = extent;
+		vkCmdBeginRenderPass(cmd, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(rc.Width), static_cast<float>(rc.Height), 0.0f, 1.0f };
+		VkRect2D scissor = { { 0, 0 }, extent };
+		vkCmdSetViewport(cmd, 0, 1, &viewport);
+		vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ToneMappingPipeline);
+
+		struct Constants
+		{
 			float		Exposure;
 			float		Saturation;
 			float		Contrast;
@@ -287,9 +325,9 @@ void RenderPostProcess::Draw(const RenderContext& rc, VkCommandBuffer cmd)
 			float		SdrWhiteLevel;
 			float		ACESMidPoint;
 			float		BT2390MidPoint;
-        };
-        VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-        Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
+		};
+		VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
+		Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
 		constants->Exposure = std::exp2f(m_Exposure);
 		constants->Saturation = m_Saturation;
 		constants->Contrast = m_Contrast;
@@ -308,22 +346,17 @@ void RenderPostProcess::Draw(const RenderContext& rc, VkCommandBuffer cmd)
 		constants->ACESMidPoint = m_ACESMidPoint;
 		constants->BT2390MidPoint = m_BT2390MidPoint;
 
-        VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_ToneMappingDescriptorSetLayout,
-            {
-                { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-                { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.ColorTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.UiTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_LuxoDoubleChecker.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
-            });
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ToneMappingPipelineLayout, 0, 1, &set, 0, NULL);
+		VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_ToneMappingDescriptorSetTemplate,
+			{
+				{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+				{ rc.ColorTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.UiTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ m_LuxoDoubleChecker.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.LinearClamp },
+			});
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ToneMappingPipelineLayout, 0, 1, &set, 0, NULL);
 
-        vkCmdDraw(cmd, 3, 1, 0, 0);
+		vkCmdDraw(cmd, 3, 1, 0, 0);
 
-        vkCmdEndRenderPass(cmd);
-
-		VkPopLabel(cmd);
-    }
-
-	VkUtilImageBarrier(cmd, rc.ColorTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-	VkUtilImageBarrier(cmd, rc.UiTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-}
\ No newline at end of file
+		vkCmdEndRenderPass(cmd);
+	}, RENDER_GRAPH_PASS_BACK_BUFFER_BIT);
+}
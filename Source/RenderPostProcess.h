@@ -6,14 +6,17 @@ class RenderPostProcess
 {
 public:
     VkDescriptorSetLayout   m_TemporalBlendDescriptorSetLayout      = VK_NULL_HANDLE;
+    VkDescriptorSetTemplate m_TemporalBlendDescriptorSetTemplate    = {};
     VkPipelineLayout        m_TemporalBlendPipelineLayout           = VK_NULL_HANDLE;
     VkPipeline              m_TemporalBlendPipeline                 = VK_NULL_HANDLE;
 
     VkDescriptorSetLayout   m_TemporalResolveDescriptorSetLayout    = VK_NULL_HANDLE;
+    VkDescriptorSetTemplate m_TemporalResolveDescriptorSetTemplate  = {};
     VkPipelineLayout        m_TemporalResolvePipelineLayout         = VK_NULL_HANDLE;
     VkPipeline              m_TemporalResolvePipeline               = VK_NULL_HANDLE;
 
     VkDescriptorSetLayout   m_ToneMappingDescriptorSetLayout        = VK_NULL_HANDLE;
+    VkDescriptorSetTemplate m_ToneMappingDescriptorSetTemplate      = {};
     VkPipelineLayout        m_ToneMappingPipelineLayout             = VK_NULL_HANDLE;
     VkPipeline              m_ToneMappingPipeline                   = VK_NULL_HANDLE;
 
@@ -55,17 +58,18 @@ public:
     void                    Create(const RenderContext& rc);
     void                    Destroy();
 
+	void					CreatePipelines(const RenderContext& rc);
+	void					DestroyPipelines();
+
 	void					RecreatePipelines(const RenderContext& rc);
 	void					RecreateResolutionDependentResources(const RenderContext& rc);
 
     void					Jitter(RenderContext& rc);
 
-    void                    Draw(const RenderContext& rc, VkCommandBuffer cmd);
+    void                    Resolve(const RenderContext& rc, RenderGraph& graph);	// Temporal AA, which can run next to the UI
+    void                    Draw(const RenderContext& rc, RenderGraph& graph);
 
 private:
-	void					CreatePipelines(const RenderContext& rc);
-	void					DestroyPipelines();
-
 	void					CreateResolutionDependentResources(const RenderContext& rc);
 	void					DestroyResolutionDependentResources();
 };
@@ -24,6 +24,7 @@ void RenderRayTracedAO::Create(const RenderContext& rc)
 		set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
 		set_layout_info.pBindings = set_layout_bindings;
 		VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_RayTraceDescriptorSetLayout));
+		m_RayTraceDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_RayTraceDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
 		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
 		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -46,6 +47,7 @@ void RenderRayTracedAO::Create(const RenderContext& rc)
 		set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
 		set_layout_info.pBindings = set_layout_bindings;
 		VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_FilterDescriptorSetLayout));
+		m_FilterDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_FilterDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
 		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
 		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -73,11 +75,8 @@ void RenderRayTracedAO::Create(const RenderContext& rc)
 
 	VmaAllocationCreateInfo buffer_allocation_create_info = {};
 	buffer_allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-	VK(vmaCreateBuffer(Vk.Allocator, &buffer_create_info, &buffer_allocation_create_info, &m_ShaderBindingTableBuffer, &m_ShaderBindingTableBufferAllocation, NULL));
+	VkCreateBuffer(buffer_create_info, buffer_allocation_create_info, VK_MEMORY_CATEGORY_OTHER, m_ShaderBindingTableBuffer, m_ShaderBindingTableBufferAllocation);
 	m_ShaderBindingTableBufferDeviceAddress = VkUtilGetDeviceAddress(m_ShaderBindingTableBuffer);
-
-	CreatePipelines(rc);
-	CreateResolutionDependentResources(rc);
 }
 
 void RenderRayTracedAO::Destroy()
@@ -87,20 +86,26 @@ void RenderRayTracedAO::Destroy()
         return;
     }
 
-	vmaDestroyBuffer(Vk.Allocator, m_ShaderBindingTableBuffer, m_ShaderBindingTableBufferAllocation);
+	VkDestroyBuffer(m_ShaderBindingTableBuffer, m_ShaderBindingTableBufferAllocation);
 
 	DestroyPipelines();
-	DestroyResolutionDependentResources();
 
 	vkDestroyPipelineLayout(Vk.Device, m_RayTracePipelineLayout, NULL);
+	VkDestroyDescriptorSetTemplate(m_RayTraceDescriptorSetTemplate);
 	vkDestroyDescriptorSetLayout(Vk.Device, m_RayTraceDescriptorSetLayout, NULL);
 
 	vkDestroyPipelineLayout(Vk.Device, m_FilterPipelineLayout, NULL);
+	VkDestroyDescriptorSetTemplate(m_FilterDescriptorSetTemplate);
 	vkDestroyDescriptorSetLayout(Vk.Device, m_FilterDescriptorSetLayout, NULL);
 }
 
 void RenderRayTracedAO::CreatePipelines(const RenderContext& rc)
 {
+	if (!Vk.IsRayTracingSupported)
+	{
+		return;
+	}
+
 	// Ray Trace
 	{
 		VkShaderModule rgen_shader = VkUtilLoadShaderModule("../Assets/Shaders/AO.rgen");
@@ -164,50 +169,11 @@ void RenderRayTracedAO::CreatePipelines(const RenderContext& rc)
 		pipeline_info.pStages = shader_stages;
 		pipeline_info.groupCount = static_cast<uint32_t>(sizeof(shader_groups) / sizeof(VkRayTracingShaderGroupCreateInfoKHR));
 		pipeline_info.pGroups = shader_groups;
-		VK(vkCreateRayTracingPipelinesKHR(Vk.Device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &m_RayTracePipeline));
+		m_RayTracePipeline = VkUtilCreateRayTracingPipeline(pipeline_info);
 
 		vkDestroyShaderModule(Vk.Device, rgen_shader, NULL);
 		vkDestroyShaderModule(Vk.Device, rmiss_shader, NULL);
 		vkDestroyShaderModule(Vk.Device, rchit_shader, NULL);
-
-		VkDeviceSize buffer_size = static_cast<VkDeviceSize>(m_ShaderGroupHandleAlignedSize) * 3;
-		VkAllocation buffer_allocation = VkAllocateUploadBuffer(buffer_size);
-
-		vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 0, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 0 * m_ShaderGroupHandleAlignedSize);
-		vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 1, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 1 * m_ShaderGroupHandleAlignedSize);
-		vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 2, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 2 * m_ShaderGroupHandleAlignedSize);
-
-		VkRecordCommands(
-			[=](VkCommandBuffer cmd)
-			{
-				VkBufferMemoryBarrier pre_transfer_barrier = {};
-				pre_transfer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-				pre_transfer_barrier.srcAccessMask = 0;
-				pre_transfer_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				pre_transfer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				pre_transfer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				pre_transfer_barrier.buffer = m_ShaderBindingTableBuffer;
-				pre_transfer_barrier.offset = 0;
-				pre_transfer_barrier.size = buffer_size;
-				vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &pre_transfer_barrier, 0, NULL);
-
-				VkBufferCopy buffer_copy_region;
-				buffer_copy_region.srcOffset = buffer_allocation.Offset;
-				buffer_copy_region.dstOffset = 0;
-				buffer_copy_region.size = buffer_size;
-				vkCmdCopyBuffer(cmd, buffer_allocation.Buffer, m_ShaderBindingTableBuffer, 1, &buffer_copy_region);
-
-				VkBufferMemoryBarrier post_transfer_barrier = {};
-				post_transfer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-				post_transfer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				post_transfer_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-				post_transfer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				post_transfer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				post_transfer_barrier.buffer = m_ShaderBindingTableBuffer;
-				post_transfer_barrier.offset = 0;
-				post_transfer_barrier.size = buffer_size;
-				vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, NULL, 1, &post_transfer_barrier, 0, NULL);
-			});
 	}
 
 	// Filter
@@ -219,65 +185,104 @@ void RenderRayTracedAO::CreatePipelines(const RenderContext& rc)
 	}
 }
 
-void RenderRayTracedAO::DestroyPipelines()
+void RenderRayTracedAO::UploadShaderBindingTable()
 {
-	vkDestroyPipeline(Vk.Device, m_RayTracePipeline, NULL);
-	vkDestroyPipeline(Vk.Device, m_FilterPipeline, NULL);
-}
+	if (!Vk.IsRayTracingSupported)
+	{
+		return;
+	}
 
-void RenderRayTracedAO::CreateResolutionDependentResources(const RenderContext& rc)
-{
-	VkTextureCreateParams raw_ambient_occlusion_texture_params;
-	raw_ambient_occlusion_texture_params.Type = VK_IMAGE_TYPE_2D;
-	raw_ambient_occlusion_texture_params.ViewType = VK_IMAGE_VIEW_TYPE_2D;
-	raw_ambient_occlusion_texture_params.Width = rc.Width;
-	raw_ambient_occlusion_texture_params.Height = rc.Height;
-	raw_ambient_occlusion_texture_params.Format = VK_FORMAT_R8_UNORM;
-	raw_ambient_occlusion_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-	raw_ambient_occlusion_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	m_RawAmbientOcclusionTexture = VkTextureCreate(raw_ambient_occlusion_texture_params);
-}
+	VkDeviceSize buffer_size = static_cast<VkDeviceSize>(m_ShaderGroupHandleAlignedSize) * 3;
+	VkAllocation buffer_allocation = VkAllocateUploadBuffer(buffer_size);
 
-void RenderRayTracedAO::DestroyResolutionDependentResources()
-{
-	VkTextureDestroy(m_RawAmbientOcclusionTexture);
+	vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 0, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 0 * m_ShaderGroupHandleAlignedSize);
+	vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 1, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 1 * m_ShaderGroupHandleAlignedSize);
+	vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 2, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 2 * m_ShaderGroupHandleAlignedSize);
+
+	VkRecordCommands(
+		[=](VkCommandBuffer cmd)
+		{
+			VkBufferMemoryBarrier pre_transfer_barrier = {};
+			pre_transfer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			pre_transfer_barrier.srcAccessMask = 0;
+			pre_transfer_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			pre_transfer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			pre_transfer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			pre_transfer_barrier.buffer = m_ShaderBindingTableBuffer;
+			pre_transfer_barrier.offset = 0;
+			pre_transfer_barrier.size = buffer_size;
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &pre_transfer_barrier, 0, NULL);
+
+			VkBufferCopy buffer_copy_region;
+			buffer_copy_region.srcOffset = buffer_allocation.Offset;
+			buffer_copy_region.dstOffset = 0;
+			buffer_copy_region.size = buffer_size;
+			vkCmdCopyBuffer(cmd, buffer_allocation.Buffer, m_ShaderBindingTableBuffer, 1, &buffer_copy_region);
+
+			VkBufferMemoryBarrier post_transfer_barrier = {};
+			post_transfer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			post_transfer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			post_transfer_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			post_transfer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			post_transfer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			post_transfer_barrier.buffer = m_ShaderBindingTableBuffer;
+			post_transfer_barrier.offset = 0;
+			post_transfer_barrier.size = buffer_size;
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, NULL, 1, &post_transfer_barrier, 0, NULL);
+		});
 }
 
-void RenderRayTracedAO::RecreatePipelines(const RenderContext& rc)
+void RenderRayTracedAO::DestroyPipelines()
 {
 	if (!Vk.IsRayTracingSupported)
 	{
 		return;
 	}
 
-	DestroyPipelines();
-	CreatePipelines(rc);
+	vkDestroyPipeline(Vk.Device, m_RayTracePipeline, NULL);
+	vkDestroyPipeline(Vk.Device, m_FilterPipeline, NULL);
 }
 
-void RenderRayTracedAO::RecreateResolutionDependentResources(const RenderContext& rc)
+void RenderRayTracedAO::RecreatePipelines(const RenderContext& rc)
 {
 	if (!Vk.IsRayTracingSupported)
 	{
 		return;
 	}
 
-	DestroyResolutionDependentResources();
-	CreateResolutionDependentResources(rc);
+	DestroyPipelines();
+	CreatePipelines(rc);
+	UploadShaderBindingTable();
 }
 
-void RenderRayTracedAO::RayTrace(const RenderContext& rc, VkCommandBuffer cmd, const AccelerationStructure& as)
+void RenderRayTracedAO::RayTrace(const RenderContext& rc, RenderGraph& graph, const AccelerationStructure& as)
 {
 	if (!Vk.IsRayTracingSupported || !rc.EnableRayTracedAmbientOcclusion)
 	{
 		return;
 	}
 
-	VkUtilImageBarrier(cmd, rc.DepthTexture.Image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
-	VkUtilImageBarrier(cmd, m_Filter ? m_RawAmbientOcclusionTexture.Image : rc.RayTracedAmbientOcclusionTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
+	if (m_Filter)
 	{
-		VkPushLabel(cmd, "AO Trace Rays");
+		VkTextureCreateParams raw_ambient_occlusion_texture_params;
+		raw_ambient_occlusion_texture_params.Type = VK_IMAGE_TYPE_2D;
+		raw_ambient_occlusion_texture_params.ViewType = VK_IMAGE_VIEW_TYPE_2D;
+		raw_ambient_occlusion_texture_params.Width = rc.TargetWidth;
+		raw_ambient_occlusion_texture_params.Height = rc.TargetHeight;
+		raw_ambient_occlusion_texture_params.Format = VK_FORMAT_R8_UNORM;
+		raw_ambient_occlusion_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		graph.CreateTexture(m_RawAmbientOcclusionTexture, raw_ambient_occlusion_texture_params);
+	}
 
+	const VkTexture* target_texture = m_Filter ? &m_RawAmbientOcclusionTexture : &rc.RayTracedAmbientOcclusionTexture;
+	graph.AddPass("AO Trace Rays", VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+		{
+			{ target_texture, RENDER_GRAPH_USAGE_STORAGE },
+			{ &rc.DepthTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.NormalTexture, RENDER_GRAPH_USAGE_SAMPLED },
+		},
+		[this, &rc, &as, target_texture](VkCommandBuffer cmd)
+	{
 		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_RayTracePipeline);
 
 		glm::mat4 view = rc.CameraCurr.m_View;
@@ -297,14 +302,14 @@ void RenderRayTracedAO::RayTrace(const RenderContext& rc, VkCommandBuffer cmd, c
 		constants->Radius = m_Radius;
 		constants->Falloff = std::exp2f(m_Falloff);
 
-		VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_RayTraceDescriptorSetLayout,
+		VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_RayTraceDescriptorSetTemplate,
 			{
-				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, m_Filter ? m_RawAmbientOcclusionTexture.ImageView : rc.RayTracedAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-				{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.DepthTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.NormalTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.BlueNoiseTextures[rc.DebugEnable ? 0 : (rc.FrameCounter % static_cast<uint32_t>(rc.BlueNoiseTextures.size()))].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestWrap },
-				{ 5, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 0, as.m_TopLevel.AccelerationStructure },
+				{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+				{ target_texture->ImageView, VK_IMAGE_LAYOUT_GENERAL },
+				{ rc.DepthTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.NormalTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.BlueNoiseTextures[rc.DebugEnable ? 0 : (rc.FrameCounter % static_cast<uint32_t>(rc.BlueNoiseTextures.size()))].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestWrap },
+				{ as.m_TopLevel.AccelerationStructure },
 			});
 		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_RayTracePipelineLayout, 0, 1, &set, 0, NULL);
 
@@ -325,55 +330,61 @@ void RenderRayTracedAO::RayTrace(const RenderContext& rc, VkCommandBuffer cmd, c
 		callable_shader_binding_table.stride = 0;
 		callable_shader_binding_table.size = 0;
 		vkCmdTraceRaysKHR(cmd, &raygen_shader_binding_table, &miss_shader_binding_table, &hit_shader_binding_table, &callable_shader_binding_table, rc.Width, rc.Height, 1);
+	});
 
-		VkPopLabel(cmd);
-	}
-
-	VkUtilImageBarrier(cmd, rc.DepthTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
-	VkUtilImageBarrier(cmd, m_Filter ? m_RawAmbientOcclusionTexture.Image : rc.RayTracedAmbientOcclusionTexture.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-	
 	if (m_Filter)
 	{
-		VkTexture filter_textures[2] = { m_RawAmbientOcclusionTexture, rc.RayTracedAmbientOcclusionTexture };
-
-		VkPushLabel(cmd, "AO Filter");
-
-		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_FilterPipeline);
-
-		const int32_t num_iterations = m_FilterIterations * 2 - 1;
-		for (int32_t i = 0; i < num_iterations; ++i)
+		graph.AddPass("AO Filter", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			{
+				{ &rc.RayTracedAmbientOcclusionTexture, RENDER_GRAPH_USAGE_STORAGE },
+				{ &m_RawAmbientOcclusionTexture, RENDER_GRAPH_USAGE_SAMPLED },
+				{ &rc.LinearDepthTextures[rc.FrameCounter & 1], RENDER_GRAPH_USAGE_SAMPLED },
+				{ &m_RawAmbientOcclusionTexture, RENDER_GRAPH_USAGE_STORAGE },
+				{ &rc.RayTracedAmbientOcclusionTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			},
+			[this, &rc, &graph](VkCommandBuffer cmd)
 		{
-			uint32_t src_index = i & 1;
-			uint32_t dst_index = 1 - src_index;
+			const VkTexture* filter_textures[2] = { &m_RawAmbientOcclusionTexture, &rc.RayTracedAmbientOcclusionTexture };
 
-			VkUtilImageBarrier(cmd, filter_textures[dst_index].Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_FilterPipeline);
 
-			struct Constants
+			const int32_t num_iterations = m_FilterIterations * 2 - 1;
+			for (int32_t i = 0; i < num_iterations; ++i)
 			{
-				int32_t StepSize;
-				float	KernelSigma;
-				float	DepthSigma;
-			};
-			VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-			Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
-			constants->StepSize = 1 << (num_iterations - i - 1);
-			constants->KernelSigma = m_FilterKernelSigma;
-			constants->DepthSigma = m_FilterDepthSigma;
-
-			VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_FilterDescriptorSetLayout,
-				{
-					{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-					{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, filter_textures[dst_index].ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-					{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, filter_textures[src_index].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				});
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_FilterPipelineLayout, 0, 1, &set, 0, NULL);
+				uint32_t src_index = i & 1;
+				uint32_t dst_index = 1 - src_index;
 
-			vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+				graph.Transition(cmd,
+					{
+						{ filter_textures[dst_index], RENDER_GRAPH_USAGE_STORAGE },
+						{ filter_textures[src_index], RENDER_GRAPH_USAGE_SAMPLED },
+					});
 
-			VkUtilImageBarrier(cmd, filter_textures[dst_index].Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-		}
-
-		VkPopLabel(cmd);
+				struct Constants
+				{
+					glm::ivec2 Size;
+					int32_t StepSize;
+					float	KernelSigma;
+					float	DepthSigma;
+				};
+				VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
+				Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
+				constants->Size = glm::ivec2(rc.Width, rc.Height);
+				constants->StepSize = 1 << (num_iterations - i - 1);
+				constants->KernelSigma = m_FilterKernelSigma;
+				constants->DepthSigma = m_FilterDepthSigma;
+
+				VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_FilterDescriptorSetTemplate,
+					{
+						{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+						{ filter_textures[dst_index]->ImageView, VK_IMAGE_LAYOUT_GENERAL },
+						{ filter_textures[src_index]->ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+						{ rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+					});
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_FilterPipelineLayout, 0, 1, &set, 0, NULL);
+
+				vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+			}
+		}, RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT);
 	}
-}
\ No newline at end of file
+}
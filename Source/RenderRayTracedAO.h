@@ -7,10 +7,12 @@ class RenderRayTracedAO
 {
 public:
 	VkDescriptorSetLayout							m_RayTraceDescriptorSetLayout						= VK_NULL_HANDLE;
+	VkDescriptorSetTemplate							m_RayTraceDescriptorSetTemplate						= {};
     VkPipelineLayout								m_RayTracePipelineLayout							= VK_NULL_HANDLE;
     VkPipeline										m_RayTracePipeline									= VK_NULL_HANDLE;
 
 	VkDescriptorSetLayout							m_FilterDescriptorSetLayout							= VK_NULL_HANDLE;
+	VkDescriptorSetTemplate							m_FilterDescriptorSetTemplate						= {};
     VkPipelineLayout								m_FilterPipelineLayout								= VK_NULL_HANDLE;
     VkPipeline										m_FilterPipeline									= VK_NULL_HANDLE;
 
@@ -20,7 +22,7 @@ public:
     uint32_t										m_ShaderGroupHandleSize								= 0;
     uint32_t										m_ShaderGroupHandleAlignedSize						= 0;
 
-	VkTexture										m_RawAmbientOcclusionTexture						= {};
+	VkTexture										m_RawAmbientOcclusionTexture						= {};	// Transient, owned by the render graph
 
 	float											m_Radius											= 10.0f;
 	float											m_Falloff											= 1.2f;
@@ -32,15 +34,11 @@ public:
 	void											Create(const RenderContext& rc);
     void											Destroy();
 
-	void											RecreatePipelines(const RenderContext& rc);
-	void											RecreateResolutionDependentResources(const RenderContext& rc);
-
-    void											RayTrace(const RenderContext& rc, VkCommandBuffer cmd, const AccelerationStructure& as);
-
-private:
 	void											CreatePipelines(const RenderContext& rc);
+	void											UploadShaderBindingTable();	// Reads the handles of the new ray tracing pipeline
 	void											DestroyPipelines();
 
-	void											CreateResolutionDependentResources(const RenderContext& rc);
-	void											DestroyResolutionDependentResources();
+	void											RecreatePipelines(const RenderContext& rc);
+
+    void											RayTrace(const RenderContext& rc, RenderGraph& graph, const AccelerationStructure& as);
 };
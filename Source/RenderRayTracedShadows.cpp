@@ -26,6 +26,7 @@ void RenderRayTracedShadows::Create(const RenderContext& rc)
 		set_layout_info_0.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings_0) / sizeof(*set_layout_bindings_0));
 		set_layout_info_0.pBindings = set_layout_bindings_0;
 		VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info_0, NULL, &m_RayTraceDescriptorSetLayouts[0]));
+		m_RayTraceDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_RayTraceDescriptorSetLayouts[0], set_layout_bindings_0, set_layout_info_0.bindingCount);
 
 		VkDescriptorBindingFlagsEXT set_layout_binding_flags_1[] =
 		{
@@ -78,6 +79,7 @@ void RenderRayTracedShadows::Create(const RenderContext& rc)
 		set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
 		set_layout_info.pBindings = set_layout_bindings;
 		VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_ReprojectDescriptorSetLayout));
+		m_ReprojectDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_ReprojectDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
 		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
 		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -100,6 +102,7 @@ void RenderRayTracedShadows::Create(const RenderContext& rc)
 		set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
 		set_layout_info.pBindings = set_layout_bindings;
 		VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_FilterDescriptorSetLayout));
+		m_FilterDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_FilterDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
 		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
 		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -120,6 +123,7 @@ void RenderRayTracedShadows::Create(const RenderContext& rc)
 		set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
 		set_layout_info.pBindings = set_layout_bindings;
 		VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_ResolveDescriptorSetLayout));
+		m_ResolveDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_ResolveDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
 		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
 		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -147,10 +151,9 @@ void RenderRayTracedShadows::Create(const RenderContext& rc)
 
 	VmaAllocationCreateInfo buffer_allocation_create_info = {};
 	buffer_allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-	VK(vmaCreateBuffer(Vk.Allocator, &buffer_create_info, &buffer_allocation_create_info, &m_ShaderBindingTableBuffer, &m_ShaderBindingTableBufferAllocation, NULL));
+	VkCreateBuffer(buffer_create_info, buffer_allocation_create_info, VK_MEMORY_CATEGORY_OTHER, m_ShaderBindingTableBuffer, m_ShaderBindingTableBufferAllocation);
 	m_ShaderBindingTableBufferDeviceAddress = VkUtilGetDeviceAddress(m_ShaderBindingTableBuffer);
 
-	CreatePipelines(rc);
 	CreateResolutionDependentResources(rc);
 }
 
@@ -161,27 +164,36 @@ void RenderRayTracedShadows::Destroy()
         return;
     }
 
-	vmaDestroyBuffer(Vk.Allocator, m_ShaderBindingTableBuffer, m_ShaderBindingTableBufferAllocation);
+	VkDestroyBuffer(m_ShaderBindingTableBuffer, m_ShaderBindingTableBufferAllocation);
 
 	DestroyPipelines();
 	DestroyResolutionDependentResources();
 
 	vkDestroyPipelineLayout(Vk.Device, m_RayTracePipelineLayout, NULL);
+	VkDestroyDescriptorSetTemplate(m_RayTraceDescriptorSetTemplate);
 	vkDestroyDescriptorSetLayout(Vk.Device, m_RayTraceDescriptorSetLayouts[0], NULL);
 	vkDestroyDescriptorSetLayout(Vk.Device, m_RayTraceDescriptorSetLayouts[1], NULL);
 
 	vkDestroyPipelineLayout(Vk.Device, m_ReprojectPipelineLayout, NULL);
+	VkDestroyDescriptorSetTemplate(m_ReprojectDescriptorSetTemplate);
 	vkDestroyDescriptorSetLayout(Vk.Device, m_ReprojectDescriptorSetLayout, NULL);
 
 	vkDestroyPipelineLayout(Vk.Device, m_FilterPipelineLayout, NULL);
+	VkDestroyDescriptorSetTemplate(m_FilterDescriptorSetTemplate);
 	vkDestroyDescriptorSetLayout(Vk.Device, m_FilterDescriptorSetLayout, NULL);
 
 	vkDestroyPipelineLayout(Vk.Device, m_ResolvePipelineLayout, NULL);
+	VkDestroyDescriptorSetTemplate(m_ResolveDescriptorSetTemplate);
 	vkDestroyDescriptorSetLayout(Vk.Device, m_ResolveDescriptorSetLayout, NULL);
 }
 
 void RenderRayTracedShadows::CreatePipelines(const RenderContext& rc)
 {
+	if (!Vk.IsRayTracingSupported)
+	{
+		return;
+	}
+
 	// Ray Trace
 	{
 		VkShaderModule rgen_shader = VkUtilLoadShaderModule("../Assets/Shaders/Shadows.rgen");
@@ -245,50 +257,11 @@ void RenderRayTracedShadows::CreatePipelines(const RenderContext& rc)
 		pipeline_info.pStages = shader_stages;
 		pipeline_info.groupCount = static_cast<uint32_t>(sizeof(shader_groups) / sizeof(VkRayTracingShaderGroupCreateInfoKHR));
 		pipeline_info.pGroups = shader_groups;
-		VK(vkCreateRayTracingPipelinesKHR(Vk.Device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &m_RayTracePipeline));
+		m_RayTracePipeline = VkUtilCreateRayTracingPipeline(pipeline_info);
 
 		vkDestroyShaderModule(Vk.Device, rgen_shader, NULL);
 		vkDestroyShaderModule(Vk.Device, rmiss_shader, NULL);
 		vkDestroyShaderModule(Vk.Device, rahit_shader, NULL);
-
-		VkDeviceSize buffer_size = static_cast<VkDeviceSize>(m_ShaderGroupHandleAlignedSize) * 3;
-		VkAllocation buffer_allocation = VkAllocateUploadBuffer(buffer_size);
-
-		vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 0, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 0 * m_ShaderGroupHandleAlignedSize);
-		vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 1, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 1 * m_ShaderGroupHandleAlignedSize);
-		vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 2, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 2 * m_ShaderGroupHandleAlignedSize);
-
-		VkRecordCommands(
-			[=](VkCommandBuffer cmd)
-			{
-				VkBufferMemoryBarrier pre_transfer_barrier = {};
-				pre_transfer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-				pre_transfer_barrier.srcAccessMask = 0;
-				pre_transfer_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				pre_transfer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				pre_transfer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				pre_transfer_barrier.buffer = m_ShaderBindingTableBuffer;
-				pre_transfer_barrier.offset = 0;
-				pre_transfer_barrier.size = buffer_size;
-				vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &pre_transfer_barrier, 0, NULL);
-
-				VkBufferCopy buffer_copy_region;
-				buffer_copy_region.srcOffset = buffer_allocation.Offset;
-				buffer_copy_region.dstOffset = 0;
-				buffer_copy_region.size = buffer_size;
-				vkCmdCopyBuffer(cmd, buffer_allocation.Buffer, m_ShaderBindingTableBuffer, 1, &buffer_copy_region);
-
-				VkBufferMemoryBarrier post_transfer_barrier = {};
-				post_transfer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-				post_transfer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				post_transfer_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-				post_transfer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				post_transfer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				post_transfer_barrier.buffer = m_ShaderBindingTableBuffer;
-				post_transfer_barrier.offset = 0;
-				post_transfer_barrier.size = buffer_size;
-				vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, NULL, 1, &post_transfer_barrier, 0, NULL);
-			});
 	}
 
 	// Reproject
@@ -316,8 +289,60 @@ void RenderRayTracedShadows::CreatePipelines(const RenderContext& rc)
 	}
 }
 
+void RenderRayTracedShadows::UploadShaderBindingTable()
+{
+	if (!Vk.IsRayTracingSupported)
+	{
+		return;
+	}
+
+	VkDeviceSize buffer_size = static_cast<VkDeviceSize>(m_ShaderGroupHandleAlignedSize) * 3;
+	VkAllocation buffer_allocation = VkAllocateUploadBuffer(buffer_size);
+
+	vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 0, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 0 * m_ShaderGroupHandleAlignedSize);
+	vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 1, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 1 * m_ShaderGroupHandleAlignedSize);
+	vkGetRayTracingShaderGroupHandlesKHR(Vk.Device, m_RayTracePipeline, 2, 1, m_ShaderGroupHandleSize, buffer_allocation.Data + 2 * m_ShaderGroupHandleAlignedSize);
+
+	VkRecordCommands(
+		[=](VkCommandBuffer cmd)
+		{
+			VkBufferMemoryBarrier pre_transfer_barrier = {};
+			pre_transfer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			pre_transfer_barrier.srcAccessMask = 0;
+			pre_transfer_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			pre_transfer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			pre_transfer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			pre_transfer_barrier.buffer = m_ShaderBindingTableBuffer;
+			pre_transfer_barrier.offset = 0;
+			pre_transfer_barrier.size = buffer_size;
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &pre_transfer_barrier, 0, NULL);
+
+			VkBufferCopy buffer_copy_region;
+			buffer_copy_region.srcOffset = buffer_allocation.Offset;
+			buffer_copy_region.dstOffset = 0;
+			buffer_copy_region.size = buffer_size;
+			vkCmdCopyBuffer(cmd, buffer_allocation.Buffer, m_ShaderBindingTableBuffer, 1, &buffer_copy_region);
+
+			VkBufferMemoryBarrier post_transfer_barrier = {};
+			post_transfer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			post_transfer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			post_transfer_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			post_transfer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			post_transfer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			post_transfer_barrier.buffer = m_ShaderBindingTableBuffer;
+			post_transfer_barrier.offset = 0;
+			post_transfer_barrier.size = buffer_size;
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, NULL, 1, &post_transfer_barrier, 0, NULL);
+		});
+}
+
 void RenderRayTracedShadows::DestroyPipelines()
 {
+	if (!Vk.IsRayTracingSupported)
+	{
+		return;
+	}
+
 	vkDestroyPipeline(Vk.Device, m_RayTracePipeline, NULL);
 	vkDestroyPipeline(Vk.Device, m_ReprojectPipeline, NULL);
 	vkDestroyPipeline(Vk.Device, m_FilterPipeline, NULL);
@@ -329,32 +354,21 @@ void RenderRayTracedShadows::CreateResolutionDependentResources(const RenderCont
 	VkTextureCreateParams temporal_texture_params;
 	temporal_texture_params.Type = VK_IMAGE_TYPE_2D;
 	temporal_texture_params.ViewType = VK_IMAGE_VIEW_TYPE_2D;
-	temporal_texture_params.Width = rc.Width;
-	temporal_texture_params.Height = rc.Height;
+	temporal_texture_params.Width = rc.TargetWidth;
+	temporal_texture_params.Height = rc.TargetHeight;
 	temporal_texture_params.Format = VK_FORMAT_R16G16B16A16_UNORM;
 	temporal_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	temporal_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	temporal_texture_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+	temporal_texture_params.IsSharedWithCompute = true;
 	m_TemporalTextures[0] = VkTextureCreate(temporal_texture_params);
 	m_TemporalTextures[1] = VkTextureCreate(temporal_texture_params);
-
-	VkTextureCreateParams variance_texture_params;
-	variance_texture_params.Type = VK_IMAGE_TYPE_2D;
-	variance_texture_params.ViewType = VK_IMAGE_VIEW_TYPE_2D;
-	variance_texture_params.Width = rc.Width;
-	variance_texture_params.Height = rc.Height;
-	variance_texture_params.Format = VK_FORMAT_R16G16_UNORM;
-	variance_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-	variance_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	m_VarianceTextures[0] = VkTextureCreate(variance_texture_params);
-	m_VarianceTextures[1] = VkTextureCreate(variance_texture_params);
 }
 
 void RenderRayTracedShadows::DestroyResolutionDependentResources()
 {
 	VkTextureDestroy(m_TemporalTextures[0]);
 	VkTextureDestroy(m_TemporalTextures[1]);
-	VkTextureDestroy(m_VarianceTextures[0]);
-	VkTextureDestroy(m_VarianceTextures[1]);
 }
 
 void RenderRayTracedShadows::RecreatePipelines(const RenderContext& rc)
@@ -366,6 +380,7 @@ void RenderRayTracedShadows::RecreatePipelines(const RenderContext& rc)
 
 	DestroyPipelines();
 	CreatePipelines(rc);
+	UploadShaderBindingTable();
 }
 
 void RenderRayTracedShadows::RecreateResolutionDependentResources(const RenderContext& rc)
@@ -375,23 +390,35 @@ void RenderRayTracedShadows::RecreateResolutionDependentResources(const RenderCo
 		return;
 	}
 
-	DestroyResolutionDependentResources();
+	// Frames in flight may still use the old textures
+	const VkTexture textures[2] = { m_TemporalTextures[0], m_TemporalTextures[1] };
+	VkDestroyDeferred(
+		[=]()
+		{
+			for (const VkTexture& texture : textures)
+			{
+				VkTextureDestroy(texture);
+			}
+		});
+
 	CreateResolutionDependentResources(rc);
 }
 
-void RenderRayTracedShadows::RayTrace(const RenderContext& rc, VkCommandBuffer cmd, const AccelerationStructure& as)
+void RenderRayTracedShadows::RayTrace(const RenderContext& rc, RenderGraph& graph, const AccelerationStructure& as)
 {
 	if (!Vk.IsRayTracingSupported || !rc.EnableRayTracedShadows)
 	{
 		return;
 	}
 
-	VkUtilImageBarrier(cmd, rc.DepthTexture.Image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
-	VkUtilImageBarrier(cmd, rc.ShadowTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
+	graph.AddPass("Shadows Trace Rays", VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+		{
+			{ &rc.ShadowTexture, RENDER_GRAPH_USAGE_STORAGE },
+			{ &rc.DepthTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.NormalTexture, RENDER_GRAPH_USAGE_SAMPLED },
+		},
+		[this, &rc, &as](VkCommandBuffer cmd)
 	{
-		VkPushLabel(cmd, "Shadows Trace Rays");
-
 		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_RayTracePipeline);
 
 		glm::mat4 view = rc.CameraCurr.m_View;
@@ -415,14 +442,14 @@ void RenderRayTracedShadows::RayTrace(const RenderContext& rc, VkCommandBuffer c
 
 		VkDescriptorSet sets[] =
 		{
-			VkCreateDescriptorSetForCurrentFrame(m_RayTraceDescriptorSetLayouts[0],
+			VkCreateDescriptorSetForCurrentFrame(m_RayTraceDescriptorSetTemplate,
 			{
-				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, rc.ShadowTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-				{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.DepthTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.NormalTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.BlueNoiseTextures[m_Reproject ? (rc.FrameCounter % static_cast<uint32_t>(rc.BlueNoiseTextures.size())) : 0].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestWrap },
-				{ 5, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 0, as.m_TopLevel.AccelerationStructure },
+				{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+				{ rc.ShadowTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL },
+				{ rc.DepthTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.NormalTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.BlueNoiseTextures[m_Reproject ? (rc.FrameCounter % static_cast<uint32_t>(rc.BlueNoiseTextures.size())) : 0].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestWrap },
+				{ as.m_TopLevel.AccelerationStructure },
 			}),
 			VkCreateDescriptorSetForCurrentFrame(m_RayTraceDescriptorSetLayouts[1],
 			{
@@ -451,64 +478,89 @@ void RenderRayTracedShadows::RayTrace(const RenderContext& rc, VkCommandBuffer c
 		callable_shader_binding_table.stride = 0;
 		callable_shader_binding_table.size = 0;
 		vkCmdTraceRaysKHR(cmd, &raygen_shader_binding_table, &miss_shader_binding_table, &hit_shader_binding_table, &callable_shader_binding_table, rc.Width, rc.Height, 1);
+	});
 
-		VkPopLabel(cmd);
+	if (!m_Reproject)
+	{
+		return;
 	}
 
-	VkUtilImageBarrier(cmd, rc.DepthTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
-	VkUtilImageBarrier(cmd, rc.ShadowTexture.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-	
-	if (m_Reproject)
+	graph.ImportTexture(m_TemporalTextures[0], VK_IMAGE_ASPECT_COLOR_BIT, true);
+	graph.ImportTexture(m_TemporalTextures[1], VK_IMAGE_ASPECT_COLOR_BIT, true);
+
+	VkTextureCreateParams variance_texture_params;
+	variance_texture_params.Type = VK_IMAGE_TYPE_2D;
+	variance_texture_params.ViewType = VK_IMAGE_VIEW_TYPE_2D;
+	variance_texture_params.Width = rc.TargetWidth;
+	variance_texture_params.Height = rc.TargetHeight;
+	variance_texture_params.Format = VK_FORMAT_R16G16_UNORM;
+	variance_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	graph.CreateTexture(m_VarianceTextures[0], variance_texture_params);
+	if (m_Filter)
 	{
-		VkUtilImageBarrier(cmd, m_TemporalTextures[rc.FrameCounter & 1].Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-		VkUtilImageBarrier(cmd, m_VarianceTextures[0].Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+		graph.CreateTexture(m_VarianceTextures[1], variance_texture_params);
+	}
+
+	static uint32_t last_frame= ~0U;
+	const bool is_hist_valid = last_frame == rc.FrameCounter;
+	last_frame = rc.FrameCounter + 1;
 
+	graph.AddPass("Shadows Reproject", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 		{
-			VkPushLabel(cmd, "Shadows Reproject");
+			{ &m_VarianceTextures[0], RENDER_GRAPH_USAGE_STORAGE },
+			{ &m_TemporalTextures[rc.FrameCounter & 1], RENDER_GRAPH_USAGE_STORAGE },
+			{ &m_TemporalTextures[(rc.FrameCounter + 1) & 1], RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.ShadowTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.MotionTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.LinearDepthTextures[rc.FrameCounter & 1], RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.LinearDepthTextures[(rc.FrameCounter + 1) & 1], RENDER_GRAPH_USAGE_SAMPLED },
+		},
+		[this, &rc, is_hist_valid](VkCommandBuffer cmd)
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_ReprojectPipeline);
+
+		struct Constants
+		{
+			glm::ivec2	Size;
+			float		AlphaShadow;
+			float		AlphaMoments;
+			uint32_t	IsHistValid;
+		};
+		VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
+		Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
+		constants->Size = glm::ivec2(rc.Width, rc.Height);
+		constants->AlphaShadow = m_ReprojectAlphaShadow;
+		constants->AlphaMoments = m_ReprojectAlphaMoments;
+		constants->IsHistValid = is_hist_valid;
 
-			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_ReprojectPipeline);
+		VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_ReprojectDescriptorSetTemplate,
+			{
+				{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+				{ m_VarianceTextures[0].ImageView, VK_IMAGE_LAYOUT_GENERAL },
+				{ m_TemporalTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_GENERAL },
+				{ m_TemporalTextures[(rc.FrameCounter + 1) & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.ShadowTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.MotionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.LinearDepthTextures[(rc.FrameCounter + 1) & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+			});
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_ReprojectPipelineLayout, 0, 1, &set, 0, NULL);
 
-			static uint32_t last_frame= ~0U;
-			const bool is_hist_valid = last_frame == rc.FrameCounter;
-			last_frame = rc.FrameCounter + 1;
+		vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+	}, RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT);
 
-			struct Constants
+	if (m_Filter)
+	{
+		graph.AddPass("Shadows Filter", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			{
-				float		AlphaShadow;
-				float		AlphaMoments;
-				uint32_t	IsHistValid;
-			};
-			VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-			Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
-			constants->AlphaShadow = m_ReprojectAlphaShadow;
-			constants->AlphaMoments = m_ReprojectAlphaMoments;
-			constants->IsHistValid = is_hist_valid;
-
-			VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_ReprojectDescriptorSetLayout,
-				{
-					{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-					{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, m_VarianceTextures[0].ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-					{ 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, m_TemporalTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-					{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_TemporalTextures[(rc.FrameCounter + 1) & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.ShadowTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					{ 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.MotionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					{ 6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					{ 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.LinearDepthTextures[(rc.FrameCounter + 1) & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				});
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_ReprojectPipelineLayout, 0, 1, &set, 0, NULL);
-
-			vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
-
-			VkPopLabel(cmd);
-		}
-
-		VkUtilImageBarrier(cmd, m_TemporalTextures[rc.FrameCounter & 1].Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-		VkUtilImageBarrier(cmd, m_VarianceTextures[0].Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-		if (m_Filter)
+				{ &m_VarianceTextures[1], RENDER_GRAPH_USAGE_STORAGE },
+				{ &m_VarianceTextures[0], RENDER_GRAPH_USAGE_SAMPLED },
+				{ &rc.LinearDepthTextures[rc.FrameCounter & 1], RENDER_GRAPH_USAGE_SAMPLED },
+				{ &m_VarianceTextures[0], RENDER_GRAPH_USAGE_STORAGE },
+				{ &m_VarianceTextures[1], RENDER_GRAPH_USAGE_SAMPLED },
+			},
+			[this, &rc, &graph](VkCommandBuffer cmd)
 		{
-			VkPushLabel(cmd, "Shadows Filter");
-
 			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_FilterPipeline);
 
 			for (int32_t i = 0; i < m_FilterIterations; ++i)
@@ -516,53 +568,55 @@ void RenderRayTracedShadows::RayTrace(const RenderContext& rc, VkCommandBuffer c
 				uint32_t src_index = i & 1;
 				uint32_t dst_index = 1 - src_index;
 
-				VkUtilImageBarrier(cmd, m_VarianceTextures[dst_index].Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+				graph.Transition(cmd,
+					{
+						{ &m_VarianceTextures[dst_index], RENDER_GRAPH_USAGE_STORAGE },
+						{ &m_VarianceTextures[src_index], RENDER_GRAPH_USAGE_SAMPLED },
+					});
 
 				struct Constants
 				{
 					int32_t	StepSize;
 					float	PhiVariance;
+					glm::ivec2 Size;
 				};
 				VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
 				Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
 				constants->StepSize = 1 << (m_FilterIterations - i - 1);
 				constants->PhiVariance = m_FilterPhiVariance;
+				constants->Size = glm::ivec2(rc.Width, rc.Height);
 
-				VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_FilterDescriptorSetLayout,
+				VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_FilterDescriptorSetTemplate,
 					{
-						{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-						{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, m_VarianceTextures[dst_index].ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-						{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_VarianceTextures[src_index].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-						{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+						{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+						{ m_VarianceTextures[dst_index].ImageView, VK_IMAGE_LAYOUT_GENERAL },
+						{ m_VarianceTextures[src_index].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+						{ rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
 					});
 				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_FilterPipelineLayout, 0, 1, &set, 0, NULL);
 
 				vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
-
-				VkUtilImageBarrier(cmd, m_VarianceTextures[dst_index].Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
 			}
+		}, RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT);
+	}
 
-			VkPopLabel(cmd);
-		}
-
-		VkUtilImageBarrier(cmd, rc.ShadowTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
+	const VkTexture* variance_texture = &m_VarianceTextures[m_Filter ? (m_FilterIterations & 1) : 0];
+	graph.AddPass("Shadows Resolve", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 		{
-			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_ResolvePipeline);
-
-			uint32_t variance_texture_index = m_Filter ? (m_FilterIterations & 1) : 0;
-			VkImageView variance_image_view = m_VarianceTextures[variance_texture_index].ImageView;
-
-			VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_ResolveDescriptorSetLayout,
-				{
-					{ 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, rc.ShadowTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-					{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, variance_image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				});
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_ResolvePipelineLayout, 0, 1, &set, 0, NULL);
+			{ &rc.ShadowTexture, RENDER_GRAPH_USAGE_STORAGE },
+			{ variance_texture, RENDER_GRAPH_USAGE_SAMPLED },
+		},
+		[this, &rc, variance_texture](VkCommandBuffer cmd)
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_ResolvePipeline);
 
-			vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
-		}
+		VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_ResolveDescriptorSetTemplate,
+			{
+				{ rc.ShadowTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL },
+				{ variance_texture->ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+			});
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_ResolvePipelineLayout, 0, 1, &set, 0, NULL);
 
-		VkUtilImageBarrier(cmd, rc.ShadowTexture.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-	}
-}
\ No newline at end of file
+		vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+	}, RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT);
+}
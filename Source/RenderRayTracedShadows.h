@@ -7,18 +7,22 @@ class RenderRayTracedShadows
 {
 public:
 	VkDescriptorSetLayout							m_RayTraceDescriptorSetLayouts[2]					= { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	VkDescriptorSetTemplate							m_RayTraceDescriptorSetTemplate						= {};	// Set 0, set 1 has partially bound arrays
     VkPipelineLayout								m_RayTracePipelineLayout							= VK_NULL_HANDLE;
     VkPipeline										m_RayTracePipeline									= VK_NULL_HANDLE;
 
 	VkDescriptorSetLayout							m_ReprojectDescriptorSetLayout						= VK_NULL_HANDLE;
+	VkDescriptorSetTemplate							m_ReprojectDescriptorSetTemplate					= {};
     VkPipelineLayout								m_ReprojectPipelineLayout							= VK_NULL_HANDLE;
     VkPipeline										m_ReprojectPipeline									= VK_NULL_HANDLE;
 
 	VkDescriptorSetLayout							m_FilterDescriptorSetLayout							= VK_NULL_HANDLE;
+	VkDescriptorSetTemplate							m_FilterDescriptorSetTemplate						= {};
     VkPipelineLayout								m_FilterPipelineLayout								= VK_NULL_HANDLE;
     VkPipeline										m_FilterPipeline									= VK_NULL_HANDLE;
 
 	VkDescriptorSetLayout							m_ResolveDescriptorSetLayout						= VK_NULL_HANDLE;
+	VkDescriptorSetTemplate							m_ResolveDescriptorSetTemplate						= {};
     VkPipelineLayout								m_ResolvePipelineLayout								= VK_NULL_HANDLE;
     VkPipeline										m_ResolvePipeline									= VK_NULL_HANDLE;
 
@@ -29,7 +33,7 @@ public:
     uint32_t										m_ShaderGroupHandleAlignedSize						= 0;
 
 	VkTexture										m_TemporalTextures[2]								= {};
-	VkTexture										m_VarianceTextures[2]								= {};
+	VkTexture										m_VarianceTextures[2]								= {};	// Transient, owned by the render graph
 
 	bool											m_AlphaTest											= true;
 	float											m_ConeAngle											= 0.2f;
@@ -43,15 +47,16 @@ public:
 	void											Create(const RenderContext& rc);
     void											Destroy();
 
+	void											CreatePipelines(const RenderContext& rc);
+	void											UploadShaderBindingTable();	// Reads the handles of the new ray tracing pipeline
+	void											DestroyPipelines();
+
 	void											RecreatePipelines(const RenderContext& rc);
 	void											RecreateResolutionDependentResources(const RenderContext& rc);
 
-    void											RayTrace(const RenderContext& rc, VkCommandBuffer cmd, const AccelerationStructure& as);
+    void											RayTrace(const RenderContext& rc, RenderGraph& graph, const AccelerationStructure& as);
 
 private:
-	void											CreatePipelines(const RenderContext& rc);
-	void											DestroyPipelines();
-
 	void											CreateResolutionDependentResources(const RenderContext& rc);
 	void											DestroyResolutionDependentResources();
 };
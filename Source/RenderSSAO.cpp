@@ -18,6 +18,7 @@ void RenderSSAO::Create(const RenderContext& rc)
         set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
         set_layout_info.pBindings = set_layout_bindings;
         VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_GenerateDescriptorSetLayout));
+        m_GenerateDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_GenerateDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
         VkPipelineLayoutCreateInfo pipeline_layout_info = {};
         pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -40,6 +41,7 @@ void RenderSSAO::Create(const RenderContext& rc)
 		set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
 		set_layout_info.pBindings = set_layout_bindings;
 		VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &m_BlurDescriptorSetLayout));
+		m_BlurDescriptorSetTemplate = VkCreateDescriptorSetTemplate(m_BlurDescriptorSetLayout, set_layout_bindings, set_layout_info.bindingCount);
 
 		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
 		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -47,20 +49,18 @@ void RenderSSAO::Create(const RenderContext& rc)
 		pipeline_layout_info.pSetLayouts = &m_BlurDescriptorSetLayout;
 		VK(vkCreatePipelineLayout(Vk.Device, &pipeline_layout_info, NULL, &m_BlurPipelineLayout));
 	}
-
-	CreatePipelines(rc);
-	CreateResolutionDependentResources(rc);
 }
 
 void RenderSSAO::Destroy()
 {
-	DestroyResolutionDependentResources();
 	DestroyPipelines();
 
     vkDestroyPipelineLayout(Vk.Device, m_GeneratePipelineLayout, NULL);
+    VkDestroyDescriptorSetTemplate(m_GenerateDescriptorSetTemplate);
     vkDestroyDescriptorSetLayout(Vk.Device, m_GenerateDescriptorSetLayout, NULL);
 
 	vkDestroyPipelineLayout(Vk.Device, m_BlurPipelineLayout, NULL);
+	VkDestroyDescriptorSetTemplate(m_BlurDescriptorSetTemplate);
 	vkDestroyDescriptorSetLayout(Vk.Device, m_BlurDescriptorSetLayout, NULL);
 }
 
@@ -89,55 +89,38 @@ void RenderSSAO::DestroyPipelines()
 	vkDestroyPipeline(Vk.Device, m_BlurPipeline, NULL);
 }
 
-void RenderSSAO::CreateResolutionDependentResources(const RenderContext& rc)
-{
-	VkTextureCreateParams intermediate_texture_params;
-	intermediate_texture_params.Type = VK_IMAGE_TYPE_2D;
-	intermediate_texture_params.ViewType = VK_IMAGE_VIEW_TYPE_2D;
-	intermediate_texture_params.Width = rc.Width;
-	intermediate_texture_params.Height = rc.Height;
-	intermediate_texture_params.Format = VK_FORMAT_R8_UNORM;
-	intermediate_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-	intermediate_texture_params.InitialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	m_IntermediateTexture = VkTextureCreate(intermediate_texture_params);
-}
-
-void RenderSSAO::DestroyResolutionDependentResources()
-{
-	VkTextureDestroy(m_IntermediateTexture);
-}
-
 void RenderSSAO::RecreatePipelines(const RenderContext& rc)
 {
 	DestroyPipelines();
 	CreatePipelines(rc);
 }
 
-void RenderSSAO::RecreateResolutionDependentResources(const RenderContext& rc)
-{
-	DestroyResolutionDependentResources();
-	CreateResolutionDependentResources(rc);
-}
-
-void RenderSSAO::Generate(const RenderContext& rc, VkCommandBuffer cmd)
+void RenderSSAO::Generate(const RenderContext& rc, RenderGraph& graph)
 {
 	if (!rc.EnableScreenSpaceAmbientOcclusion)
 	{
 		return;
 	}
 
-	{
-		VkPushLabel(cmd, "SSAO Generate");
+	const VkTexture* blue_noise_texture = &rc.BlueNoiseTextures[rc.FrameCounter % 8];
+	graph.ImportTexture(*blue_noise_texture);
 
+	graph.AddPass("SSAO Generate", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		{
+			{ &rc.ScreenSpaceAmbientOcclusionTexture, RENDER_GRAPH_USAGE_STORAGE },
+			{ &rc.DepthTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			{ &rc.NormalTexture, RENDER_GRAPH_USAGE_SAMPLED },
+			{ blue_noise_texture, RENDER_GRAPH_USAGE_SAMPLED },
+		},
+		[this, &rc, blue_noise_texture](VkCommandBuffer cmd)
+	{
 		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_GeneratePipeline);
 
-		VkUtilImageBarrier(cmd, rc.DepthTexture.Image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
-		VkUtilImageBarrier(cmd, rc.ScreenSpaceAmbientOcclusionTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
 		struct Constants
 		{
 			glm::mat4	InvProj;
 			glm::mat4	View;
+			glm::ivec2	Size;
 			float		ScreenRadius;
 			float		NegInvRadius;
 			float		Bias;
@@ -148,85 +131,100 @@ void RenderSSAO::Generate(const RenderContext& rc, VkCommandBuffer cmd)
 		Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
 		constants->InvProj = glm::inverse(rc.CameraCurr.m_Projection);
 		constants->View = rc.CameraCurr.m_View;
+		constants->Size = glm::ivec2(rc.Width, rc.Height);
 		constants->ScreenRadius = -m_Radius * 0.25f * static_cast<float>(rc.Height) / tanf(0.5f * rc.CameraCurr.m_FovY);
 		constants->NegInvRadius = -1.0f / m_Radius;
 		constants->Bias = fmaxf(0.0f, fminf(0.99f, m_Bias));
 		constants->Multiplier = 1.0f / (1.0f - constants->Bias);
 		constants->Intensity = m_Intensity;
 
-		VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_GenerateDescriptorSetLayout,
+		VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_GenerateDescriptorSetTemplate,
 			{
-				{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-				{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, rc.ScreenSpaceAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-				{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.DepthTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.NormalTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.BlueNoiseTextures[rc.FrameCounter % 8].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+				{ rc.ScreenSpaceAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL },
+				{ rc.DepthTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ rc.NormalTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+				{ blue_noise_texture->ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
 			});
 		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_GeneratePipelineLayout, 0, 1, &set, 0, NULL);
 
 		vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
-
-		VkUtilImageBarrier(cmd, rc.DepthTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
-		VkUtilImageBarrier(cmd, rc.ScreenSpaceAmbientOcclusionTexture.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-		VkPopLabel(cmd);
-	}
+	}, RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT);
 
 	if (m_Blur)
 	{
-		VkPushLabel(cmd, "SSAO Blur");
-
-		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_BlurPipeline);
-
-		VkUtilImageBarrier(cmd, m_IntermediateTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-		{
-			struct Constants
+		VkTextureCreateParams intermediate_texture_params;
+		intermediate_texture_params.Type = VK_IMAGE_TYPE_2D;
+		intermediate_texture_params.ViewType = VK_IMAGE_VIEW_TYPE_2D;
+		intermediate_texture_params.Width = rc.TargetWidth;
+		intermediate_texture_params.Height = rc.TargetHeight;
+		intermediate_texture_params.Format = VK_FORMAT_R8_UNORM;
+		intermediate_texture_params.Usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		graph.CreateTexture(m_IntermediateTexture, intermediate_texture_params);
+
+		graph.AddPass("SSAO Blur", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			{
-				glm::ivec2 Direction;
-			};
-			VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-			Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
-			constants->Direction = glm::ivec2(2, 0);
+				{ &m_IntermediateTexture, RENDER_GRAPH_USAGE_STORAGE },
+				{ &rc.ScreenSpaceAmbientOcclusionTexture, RENDER_GRAPH_USAGE_SAMPLED },
+				{ &rc.LinearDepthTextures[rc.FrameCounter & 1], RENDER_GRAPH_USAGE_SAMPLED },
+				{ &m_IntermediateTexture, RENDER_GRAPH_USAGE_SAMPLED },
+				{ &rc.ScreenSpaceAmbientOcclusionTexture, RENDER_GRAPH_USAGE_STORAGE },
+			},
+			[this, &rc, &graph](VkCommandBuffer cmd)
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_BlurPipeline);
 
-			VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_BlurDescriptorSetLayout,
+			{
+				struct Constants
 				{
-					{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-					{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, m_IntermediateTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-					{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.ScreenSpaceAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+					glm::ivec2 Direction;
+					glm::ivec2 Size;
+				};
+				VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
+				Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
+				constants->Direction = glm::ivec2(2, 0);
+				constants->Size = glm::ivec2(rc.Width, rc.Height);
+
+				VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_BlurDescriptorSetTemplate,
+					{
+						{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+						{ m_IntermediateTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL },
+						{ rc.ScreenSpaceAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+						{ rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+					});
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_BlurPipelineLayout, 0, 1, &set, 0, NULL);
+
+				vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+			}
+
+			graph.Transition(cmd,
+				{
+					{ &m_IntermediateTexture, RENDER_GRAPH_USAGE_SAMPLED },
+					{ &rc.ScreenSpaceAmbientOcclusionTexture, RENDER_GRAPH_USAGE_STORAGE },
 				});
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_BlurPipelineLayout, 0, 1, &set, 0, NULL);
-
-			vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
-		}
 
-		VkUtilImageBarrier(cmd, m_IntermediateTexture.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-		VkUtilImageBarrier(cmd, rc.ScreenSpaceAmbientOcclusionTexture.Image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-		{
-			struct Constants
 			{
-				glm::ivec2 Direction;
-			};
-			VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
-			Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
-			constants->Direction = glm::ivec2(0, 2);
-
-			VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_BlurDescriptorSetLayout,
+				struct Constants
 				{
-					{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
-					{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, rc.ScreenSpaceAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE },
-					{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, m_IntermediateTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-					{ 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
-				});
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_BlurPipelineLayout, 0, 1, &set, 0, NULL);
-
-			vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
-		}
-
-		VkUtilImageBarrier(cmd, rc.ScreenSpaceAmbientOcclusionTexture.Image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-		VkPopLabel(cmd);
+					glm::ivec2 Direction;
+					glm::ivec2 Size;
+				};
+				VkAllocation constants_allocation = VkAllocateUploadBuffer(sizeof(Constants));
+				Constants* constants = reinterpret_cast<Constants*>(constants_allocation.Data);
+				constants->Direction = glm::ivec2(0, 2);
+				constants->Size = glm::ivec2(rc.Width, rc.Height);
+
+				VkDescriptorSet set = VkCreateDescriptorSetForCurrentFrame(m_BlurDescriptorSetTemplate,
+					{
+						{ constants_allocation.Buffer, constants_allocation.Offset, sizeof(Constants) },
+						{ rc.ScreenSpaceAmbientOcclusionTexture.ImageView, VK_IMAGE_LAYOUT_GENERAL },
+						{ m_IntermediateTexture.ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+						{ rc.LinearDepthTextures[rc.FrameCounter & 1].ImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rc.NearestClamp },
+					});
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_BlurPipelineLayout, 0, 1, &set, 0, NULL);
+
+				vkCmdDispatch(cmd, (rc.Width + 7) / 8, (rc.Height + 7) / 8, 1);
+			}
+		}, RENDER_GRAPH_PASS_ASYNC_COMPUTE_BIT);
 	}
-}
\ No newline at end of file
+}
@@ -1,5 +1,6 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 #extension GL_GOOGLE_include_directive : require
 
 #include "AtmosphereCommon.glsl"
@@ -12,33 +13,48 @@ layout(location = 4) in vec3 InBitangent;
 
 layout(location = 0) out vec3 OutColor;
 
-layout(binding = 0) uniform Constants
+layout(set = 0, binding = 0) uniform FrameConstants
 {
-    mat4    World;
-	mat4	WorldViewProjection;
+	mat4	ViewProjection;
 	vec3	ViewPosition;
 	float	AmbientLightIntensity;
 	vec3	LightDirection;
 	float	DirectionalLightIntensity;
-	vec4	BaseColorFactor;
-	vec2	MetallicRoughnessFactor;
-	bool	HasBaseColorTexture;
-	bool	HasNormalTexture;
-	bool	HasMetallicRoughnessTexture;
+	float	DepthParam;
 	bool	EnableScreenSpaceAmbientOcclusion;
 	bool	EnableRayTracedAmbientOcclusion;
 	bool	EnableRayTracedShadows;
 	bool	DebugEnable;
 	uint	DebugIndex;
 };
-layout(binding = 1) uniform sampler2D BaseColor;
-layout(binding = 2) uniform sampler2D Normal;
-layout(binding = 3) uniform sampler2D MetallicRoughness;
-layout(binding = 4) uniform sampler1D AmbientLightLUT;
-layout(binding = 5) uniform sampler1D DirectionalLightLUT;
-layout(binding = 6) uniform sampler2D ScreenSpaceAmbientOcclusion;
-layout(binding = 7) uniform sampler2D RayTracedAmbientOcclusion;
-layout(binding = 8) uniform sampler2D Shadow;
+layout(set = 0, binding = 1) uniform sampler MaterialSampler;
+
+layout(set = 1, binding = 0) uniform sampler1D AmbientLightLUT;
+layout(set = 1, binding = 1) uniform sampler1D DirectionalLightLUT;
+layout(set = 1, binding = 2) uniform sampler2D ScreenSpaceAmbientOcclusion;
+layout(set = 1, binding = 3) uniform sampler2D RayTracedAmbientOcclusion;
+layout(set = 1, binding = 4) uniform sampler2D Shadow;
+
+struct Material
+{
+	vec4	BaseColorFactor;
+	vec2	MetallicRoughnessFactor;
+	uint	BaseColorTexture;
+	uint	NormalTexture;
+	uint	MetallicRoughnessTexture;
+	bool	HasBaseColorTexture;
+	bool	HasNormalTexture;
+	bool	HasMetallicRoughnessTexture;
+};
+layout(set = 2, binding = 0) uniform texture2D Textures[];
+layout(set = 2, binding = 1) readonly buffer MaterialBuffer { Material Materials[]; } MaterialBuffers[];
+
+layout(push_constant) uniform DrawConstants
+{
+	mat4	World;
+	uint	MaterialBufferIndex;
+	uint	MaterialIndex;
+};
 
 float MicrofacetDistribution(float n_dot_h, float roughness)
 {
@@ -60,10 +76,12 @@ vec3 SpecularReflection(vec3 f0, float v_dot_h)
 
 void main()
 {
-	vec4 base_color = BaseColorFactor;
-	if (HasBaseColorTexture)
+	Material material = MaterialBuffers[MaterialBufferIndex].Materials[MaterialIndex];
+
+	vec4 base_color = material.BaseColorFactor;
+	if (material.HasBaseColorTexture)
 	{
-		base_color *= texture(BaseColor, InTexCoord);
+		base_color *= texture(sampler2D(Textures[material.BaseColorTexture], MaterialSampler), InTexCoord);
 	}
 	if (base_color.a < 0.5)
 	{
@@ -74,9 +92,9 @@ void main()
     vec3 half_vec = normalize(LightDirection + view_vec);
 	
 	vec3 normal = normalize(InNormal);
-	if (HasNormalTexture)
+	if (material.HasNormalTexture)
 	{
-		vec3 normal_map = normalize(texture(Normal, InTexCoord).rgb * 2.0 - 1.0);
+		vec3 normal_map = normalize(texture(sampler2D(Textures[material.NormalTexture], MaterialSampler), InTexCoord).rgb * 2.0 - 1.0);
 		normal = normalize(normalize(InTangent) * normal_map.x + normalize(InBitangent) * normal_map.y + normal * normal_map.z);
 	}
 
@@ -85,10 +103,10 @@ void main()
 	float n_dot_h = max(dot(normal, half_vec), 0.0);
 	float v_dot_h = max(dot(view_vec, half_vec), 0.0);
 
-	vec2 metallic_roughness = MetallicRoughnessFactor;
-	if (HasMetallicRoughnessTexture)
+	vec2 metallic_roughness = material.MetallicRoughnessFactor;
+	if (material.HasMetallicRoughnessTexture)
 	{
-		metallic_roughness *= texture(MetallicRoughness, InTexCoord).bg;
+		metallic_roughness *= texture(sampler2D(Textures[material.MetallicRoughnessTexture], MaterialSampler), InTexCoord).bg;
 	}
 	float metallic = metallic_roughness.x;
 	float roughness = max(0.004, metallic_roughness.y * metallic_roughness.y);
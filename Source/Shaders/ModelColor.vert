@@ -12,16 +12,21 @@ layout(location = 2) out vec3 OutNormal;
 layout(location = 3) out vec3 OutTangent;
 layout(location = 4) out vec3 OutBitangent;
 
-layout(binding = 0) uniform Constants
+layout(set = 0, binding = 0) uniform FrameConstants
 {
-	mat4    World;
-	mat4	WorldViewProjection;
+	mat4	ViewProjection;
+};
+
+layout(push_constant) uniform DrawConstants
+{
+	mat4	World;
 };
 
 void main()
 {
-	gl_Position = WorldViewProjection * vec4(InPosition, 1.0);
-	OutWorldPos = (World * vec4(InPosition, 1.0)).xyz;
+	vec4 world_pos = World * vec4(InPosition, 1.0);
+	gl_Position = ViewProjection * world_pos;
+	OutWorldPos = world_pos.xyz;
     OutTexCoord = InTexCoord;
 	OutNormal = normalize(mat3(World) * InNormal);
 	OutTangent = normalize(mat3(World) * InTangent.xyz);
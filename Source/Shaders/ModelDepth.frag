@@ -1,5 +1,6 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec2 InTexCoord;
 layout(location = 1) in vec3 InNormal;
@@ -7,17 +8,43 @@ layout(location = 1) in vec3 InNormal;
 layout(location = 0) out vec4 OutNormal;
 layout(location = 1) out vec2 OutLinearDepth;
 
-layout(binding = 0) uniform Constants
+layout(set = 0, binding = 0) uniform FrameConstants
 {
-	mat4	World;
-	mat4	WorldViewProjection;
+	mat4	ViewProjection;
+	vec3	ViewPosition;
+	float	AmbientLightIntensity;
+	vec3	LightDirection;
+	float	DirectionalLightIntensity;
 	float	DepthParam;
 };
-layout(binding = 1) uniform sampler2D BaseColor;
+layout(set = 0, binding = 1) uniform sampler MaterialSampler;
+
+struct Material
+{
+	vec4	BaseColorFactor;
+	vec2	MetallicRoughnessFactor;
+	uint	BaseColorTexture;
+	uint	NormalTexture;
+	uint	MetallicRoughnessTexture;
+	bool	HasBaseColorTexture;
+	bool	HasNormalTexture;
+	bool	HasMetallicRoughnessTexture;
+};
+layout(set = 2, binding = 0) uniform texture2D Textures[];
+layout(set = 2, binding = 1) readonly buffer MaterialBuffer { Material Materials[]; } MaterialBuffers[];
+
+layout(push_constant) uniform DrawConstants
+{
+	mat4	World;
+	uint	MaterialBufferIndex;
+	uint	MaterialIndex;
+};
 
 void main()
 {
-	float alpha = texture(BaseColor, InTexCoord).a;
+	Material material = MaterialBuffers[MaterialBufferIndex].Materials[MaterialIndex];
+
+	float alpha = texture(sampler2D(Textures[material.BaseColorTexture], MaterialSampler), InTexCoord).a;
 	if (alpha < 0.5)
 	{
 		discard;
@@ -8,16 +8,19 @@ layout(location = 2) in vec3 InNormal;
 layout(location = 0) out vec2 OutTexCoord;
 layout(location = 1) out vec3 OutNormal;
 
-layout(binding = 0) uniform Constants
+layout(set = 0, binding = 0) uniform FrameConstants
+{
+	mat4	ViewProjection;
+};
+
+layout(push_constant) uniform DrawConstants
 {
 	mat4	World;
-	mat4	WorldViewProjection;
-	float	ObjectIndex;
 };
 
 void main()
 {
-	gl_Position = WorldViewProjection * vec4(InPosition, 1.0);
+	gl_Position = ViewProjection * (World * vec4(InPosition, 1.0));
 	OutTexCoord = InTexCoord;
 	OutNormal = normalize(mat3(World) * InNormal);
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "Trace.h"
+#include "Vk.h"
+
+#include <assert.h>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+struct TraceEvent
+{
+	std::string				Name;
+	TraceTrack				Track;
+	uint64_t				Begin;
+	uint64_t				End;
+};
+
+static bool					s_IsCapturing = false;
+static std::string			s_FilePath;
+static std::vector<TraceEvent>	s_Events;
+
+static const size_t			TRACE_ZONE_NONE = ~size_t(0);
+
+uint64_t TraceGetTime()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void TraceBeginCapture(const char* filepath)
+{
+	assert(!s_IsCapturing);
+	s_IsCapturing = true;
+	s_FilePath = filepath;
+	s_Events.clear();
+}
+void TraceEndCapture()
+{
+	assert(s_IsCapturing);
+	s_IsCapturing = false;
+
+	std::ofstream file(s_FilePath);
+	if (!file.is_open())
+	{
+		VkError("Failed to create trace " + s_FilePath);
+	}
+
+	// Timestamps are relative to the first event to keep the numbers small
+	uint64_t origin = UINT64_MAX;
+	for (const TraceEvent& event : s_Events)
+	{
+		origin = VkMin(origin, event.Begin);
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << TRACE_TRACK_CPU << ",\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << TRACE_TRACK_GPU << ",\"args\":{\"name\":\"GPU " << Vk.PhysicalDeviceProperties.deviceName << "\"}}";
+	for (const TraceEvent& event : s_Events)
+	{
+		// Zones that were still open when the capture ended are dropped
+		if (event.End < event.Begin)
+			continue;
+
+		file << ",\n{\"name\":\"" << event.Name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.Track;
+		file << ",\"ts\":" << static_cast<double>(event.Begin - origin) * 1e-3 << ",\"dur\":" << static_cast<double>(event.End - event.Begin) * 1e-3 << "}";
+	}
+	file << "\n]}\n";
+
+	s_Events.clear();
+}
+bool TraceIsCapturing()
+{
+	return s_IsCapturing;
+}
+
+size_t TraceBeginZone(const char* name)
+{
+	if (!s_IsCapturing)
+		return TRACE_ZONE_NONE;
+
+	s_Events.push_back({ name, TRACE_TRACK_CPU, TraceGetTime(), 0 });
+	return s_Events.size() - 1;
+}
+void TraceEndZone(size_t zone)
+{
+	// The capture may have ended or restarted since the zone began
+	if (!s_IsCapturing || zone >= s_Events.size())
+		return;
+
+	s_Events[zone].End = TraceGetTime();
+}
+void TraceAddZone(TraceTrack track, const std::string& name, uint64_t begin, uint64_t end)
+{
+	if (!s_IsCapturing)
+		return;
+
+	s_Events.push_back({ name, track, begin, end });
+}
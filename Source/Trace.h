@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Captures CPU zones and GPU labels into a single timeline written as Chrome trace JSON,
+// which can be opened in chrome://tracing or ui.perfetto.dev
+
+enum TraceTrack
+{
+	TRACE_TRACK_CPU = 0,
+	TRACE_TRACK_GPU,
+};
+
+uint64_t					TraceGetTime();		// Nanoseconds on the same clock as std::chrono::steady_clock
+
+void						TraceBeginCapture(const char* filepath);
+void						TraceEndCapture();	// Writes the capture to the file given to TraceBeginCapture
+bool						TraceIsCapturing();
+
+size_t						TraceBeginZone(const char* name);
+void						TraceEndZone(size_t zone);
+void						TraceAddZone(TraceTrack track, const std::string& name, uint64_t begin, uint64_t end);
+
+struct TraceZone
+{
+	size_t					Zone;
+
+	TraceZone(const char* name) : Zone(TraceBeginZone(name)) {}
+	~TraceZone() { TraceEndZone(Zone); }
+};
+#define TRACE_ZONE_CONCAT_INNER(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_ZONE_CONCAT(trace_zone_, __LINE__)(name)
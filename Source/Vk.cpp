@@ -1,17 +1,72 @@
 #include "Vk.h"
+#include "VkTexture.h"
+#include "Trace.h"
 
 #define VMA_IMPLEMENTATION
 #include <vk_mem_alloc.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#endif
+
 _Vk Vk;
 
-static const VkDeviceSize UPLOAD_BUFFER_SIZE = 1024 * 1024 * 1024;
-static const VkDeviceSize UPLOAD_BUFFER_MASK = UPLOAD_BUFFER_SIZE - 1;
-static_assert((UPLOAD_BUFFER_SIZE & UPLOAD_BUFFER_MASK) == 0, "UPLOAD_BUFFER_SIZE must be a power of two");
+static const VkDeviceSize UPLOAD_CHUNK_SIZE = 64 * 1024 * 1024;
+static const VkDeviceSize UPLOAD_BUFFER_BUDGET = 256 * 1024 * 1024;	// Above this, frames in flight are waited on before growing
+static const uint32_t UPLOAD_FREE_CHUNK_COUNT = 2;					// Free chunks kept around for reuse
+static const VkDeviceSize UPLOAD_DEVICE_LOCAL_MIN_HEAP_SIZE = 256 * 1024 * 1024;	// Heaps up to this are the BAR window of discrete GPUs
 
-static const uint32_t TIMESTAMP_QUERY_POOL_SIZE = 256;
+static const VkDeviceSize TRANSFER_BATCH_SIZE = 32 * 1024 * 1024;	// Upload bytes after which transfer commands are submitted
+
+static const uint32_t TIMESTAMP_QUERY_POOL_SIZE = 256; // Per frame
 static_assert((TIMESTAMP_QUERY_POOL_SIZE & 1) == 0, "TIMESTAMP_QUERY_POOL_SIZE must be an even number");
 
+static const uint32_t TIMESTAMP_HISTORY_SIZE = 256;
+
+static const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+static const uint32_t SWAPCHAIN_ACQUIRE_RETRY_COUNT = 2;	// Swapchains replaced while acquiring before the frame goes without a back buffer
+
+static const uint32_t DESCRIPTOR_POOL_MIN_SET_COUNT = 64;
+static const uint32_t DESCRIPTOR_POOL_MIN_DESCRIPTOR_COUNT = 64;	// Per descriptor type
+
+static const VkDeviceSize RECORD_THREAD_UPLOAD_BLOCK_SIZE = 256 * 1024;	// Taken from the shared upload chunks at a time
+
+// Fixed, so that a pool never allocates smaller blocks first. An allocation larger than a block goes to the default pools.
+static const VkDeviceSize MEMORY_POOL_BLOCK_SIZES[VK_MEMORY_POOL_COUNT] =
+{
+	256 * 1024 * 1024,	// Static
+	128 * 1024 * 1024,	// Resolution, a full set of targets at 1080p
+	UPLOAD_CHUNK_SIZE,	// Transient
+};
+
+static const uint32_t BINDLESS_TEXTURE_CAPACITY = 1024;
+static const uint32_t BINDLESS_BUFFER_CAPACITY = 64;
+
+static const VkDescriptorType DESCRIPTOR_POOL_TYPES[VK_DESCRIPTOR_POOL_TYPE_COUNT] =
+{
+	VK_DESCRIPTOR_TYPE_SAMPLER,
+	VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+	VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+	VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+	VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER,
+	VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER,
+	VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+};
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT, uint64_t, size_t, int32_t code, const char*, const char* message, void*)
 {
     if ((flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) != 0)
@@ -29,7 +84,506 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugReportFlagsEXT flags,
     return VK_FALSE;
 }
 
-static void CreateSwapchain(uint32_t width, uint32_t height, uint32_t image_count, VkDisplayMode display_mode)
+// Layout that back buffers are kept in between frames
+static VkImageLayout GetBackBufferIdleLayout()
+{
+    return Vk.IsHeadless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+static uint32_t CreateUploadChunk(VkDeviceSize size)
+{
+	uint32_t index = 0;
+	while (index < Vk.UploadChunks.size() && Vk.UploadChunks[index].Buffer != VK_NULL_HANDLE)
+	{
+		++index;
+	}
+	if (index == Vk.UploadChunks.size())
+	{
+		Vk.UploadChunks.push_back({});
+	}
+	VkUploadChunk& chunk = Vk.UploadChunks[index];
+
+	VkBufferCreateInfo buffer_info = {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (Vk.UseAsyncCompute)
+	{
+		// Async compute passes read their constants from the chunks as well, next to the staging copies of the transfer queue
+		buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		buffer_info.queueFamilyIndexCount = Vk.ComputeSharingQueueFamilyCount;
+		buffer_info.pQueueFamilyIndices = Vk.ComputeSharingQueueFamilies;
+	}
+
+	VmaAllocationCreateInfo allocation_create_info = {};
+	allocation_create_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+	allocation_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	if (Vk.IsUploadDeviceLocal)
+	{
+		allocation_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+		allocation_create_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		allocation_create_info.memoryTypeBits = Vk.UploadMemoryTypeBits;
+	}
+
+	VmaAllocationInfo allocation_info = {};
+	VkCreateBuffer(buffer_info, allocation_create_info, VK_MEMORY_CATEGORY_UPLOAD, chunk.Buffer, chunk.Allocation, &allocation_info);
+	chunk.MappedData = static_cast<uint8_t*>(allocation_info.pMappedData);
+	chunk.Size = size;
+	chunk.Head = 0;
+	chunk.FramesInFlight = 0;
+	chunk.IsPending = false;
+
+	Vk.UploadStats.Capacity += size;
+	++Vk.UploadStats.ChunkCount;
+	return index;
+}
+static void DestroyUploadChunk(uint32_t index)
+{
+	VkUploadChunk& chunk = Vk.UploadChunks[index];
+	VkDestroyBuffer(chunk.Buffer, chunk.Allocation);
+	Vk.UploadStats.Capacity -= chunk.Size;
+	--Vk.UploadStats.ChunkCount;
+	chunk = {};
+}
+static bool IsUploadChunkFree(uint32_t index)
+{
+	const VkUploadChunk& chunk = Vk.UploadChunks[index];
+	return chunk.Buffer != VK_NULL_HANDLE && chunk.FramesInFlight == 0 && !chunk.IsPending && index != Vk.UploadChunkCurr;
+}
+static uint32_t FindFreeUploadChunk(VkDeviceSize size)
+{
+	uint32_t best = UINT32_MAX;
+	for (uint32_t i = 0; i < static_cast<uint32_t>(Vk.UploadChunks.size()); ++i)
+	{
+		if (IsUploadChunkFree(i) && Vk.UploadChunks[i].Size >= size && (best == UINT32_MAX || Vk.UploadChunks[i].Size < Vk.UploadChunks[best].Size))
+		{
+			best = i;
+		}
+	}
+	return best;
+}
+// Called once the frame's fence is signaled
+static void ReleaseUploadChunks(uint32_t frame_index)
+{
+	for (uint32_t index : Vk.UploadChunksInFlight[frame_index])
+	{
+		--Vk.UploadChunks[index].FramesInFlight;
+		if (!IsUploadChunkFree(index))
+			continue;
+
+		// Oversized chunks are only kept for as long as they are in use, and only a few regular chunks are kept spare
+		uint32_t free_chunk_count = 0;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(Vk.UploadChunks.size()); ++i)
+		{
+			free_chunk_count += (i != index && IsUploadChunkFree(i) && Vk.UploadChunks[i].Size == UPLOAD_CHUNK_SIZE) ? 1 : 0;
+		}
+		if (Vk.UploadChunks[index].Size != UPLOAD_CHUNK_SIZE || free_chunk_count >= UPLOAD_FREE_CHUNK_COUNT)
+		{
+			DestroyUploadChunk(index);
+		}
+	}
+	Vk.UploadChunksInFlight[frame_index].clear();
+
+	Vk.UploadStats.Occupancy -= Vk.UploadBytesInFlight[frame_index];
+	Vk.UploadBytesInFlight[frame_index] = 0;
+}
+
+static VkDescriptorPoolType GetDescriptorPoolType(VkDescriptorType type)
+{
+	for (uint32_t i = 0; i < VK_DESCRIPTOR_POOL_TYPE_COUNT; ++i)
+	{
+		if (DESCRIPTOR_POOL_TYPES[i] == type)
+			return static_cast<VkDescriptorPoolType>(i);
+	}
+	VkError("Descriptor type " + std::to_string(static_cast<uint32_t>(type)) + " can not be allocated per frame");
+	return VK_DESCRIPTOR_POOL_TYPE_COUNT;
+}
+
+static VkDescriptorPool CreateDescriptorPool(const VkDescriptorPoolUsage& capacity)
+{
+	VkDescriptorPoolSize pool_sizes[VK_DESCRIPTOR_POOL_TYPE_COUNT];
+	uint32_t pool_size_count = 0;
+	for (uint32_t i = 0; i < VK_DESCRIPTOR_POOL_TYPE_COUNT; ++i)
+	{
+		if (DESCRIPTOR_POOL_TYPES[i] == VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR && !Vk.IsRayTracingSupported)
+			continue;
+
+		pool_sizes[pool_size_count].type = DESCRIPTOR_POOL_TYPES[i];
+		pool_sizes[pool_size_count].descriptorCount = VkMax(capacity.DescriptorCounts[i], DESCRIPTOR_POOL_MIN_DESCRIPTOR_COUNT);
+		++pool_size_count;
+	}
+
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = pool_size_count;
+	pool_info.pPoolSizes = pool_sizes;
+	pool_info.maxSets = VkMax(capacity.SetCount, DESCRIPTOR_POOL_MIN_SET_COUNT);
+
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VK(vkCreateDescriptorPool(Vk.Device, &pool_info, NULL, &pool));
+	return pool;
+}
+
+static void ResetDescriptorPools(uint32_t frame_index)
+{
+	VkDescriptorPoolUsage& usage = Vk.DescriptorPoolUsage[frame_index];
+	VkDescriptorPoolUsage& peak = Vk.DescriptorPoolUsagePeak;
+	peak.SetCount = VkMax(peak.SetCount, usage.SetCount);
+	for (uint32_t i = 0; i < VK_DESCRIPTOR_POOL_TYPE_COUNT; ++i)
+	{
+		peak.DescriptorCounts[i] = VkMax(peak.DescriptorCounts[i], usage.DescriptorCounts[i]);
+	}
+	usage = {};
+
+	std::vector<VkDescriptorPool>& pools = Vk.DescriptorPools[frame_index];
+	if (pools.size() == 1)
+	{
+		VK(vkResetDescriptorPool(Vk.Device, pools[0], 0));
+		return;
+	}
+
+	// The frame outgrew its pool, replace its pools by a single one with headroom over the peak usage
+	for (VkDescriptorPool pool : pools)
+	{
+		vkDestroyDescriptorPool(Vk.Device, pool, NULL);
+	}
+	pools.clear();
+
+	VkDescriptorPoolUsage& capacity = Vk.DescriptorPoolCapacity;
+	capacity.SetCount = VkMax(capacity.SetCount, peak.SetCount + peak.SetCount / 2);
+	for (uint32_t i = 0; i < VK_DESCRIPTOR_POOL_TYPE_COUNT; ++i)
+	{
+		capacity.DescriptorCounts[i] = VkMax(capacity.DescriptorCounts[i], peak.DescriptorCounts[i] + peak.DescriptorCounts[i] / 2);
+	}
+	pools.push_back(CreateDescriptorPool(capacity));
+}
+
+// Job workers do not count their usage, a thread that outgrew its pool keeps the doubled capacity it grew to
+static void ResetRecordThreadDescriptorPools(VkRecordThread& record_thread, uint32_t frame_index)
+{
+	std::vector<VkDescriptorPool>& pools = record_thread.DescriptorPools[frame_index];
+	if (pools.size() == 1)
+	{
+		VK(vkResetDescriptorPool(Vk.Device, pools[0], 0));
+		return;
+	}
+
+	for (VkDescriptorPool pool : pools)
+	{
+		vkDestroyDescriptorPool(Vk.Device, pool, NULL);
+	}
+	pools.clear();
+	pools.push_back(CreateDescriptorPool(record_thread.DescriptorPoolCapacity));
+}
+
+static void CreateBindlessDescriptorSet()
+{
+	VkDescriptorBindingFlags set_layout_binding_flags[] =
+	{
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+	};
+	VkDescriptorSetLayoutBindingFlagsCreateInfo set_layout_binding_flags_info = {};
+	set_layout_binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	set_layout_binding_flags_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_binding_flags) / sizeof(*set_layout_binding_flags));
+	set_layout_binding_flags_info.pBindingFlags = set_layout_binding_flags;
+
+	VkDescriptorSetLayoutBinding set_layout_bindings[] =
+	{
+		{ 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, BINDLESS_TEXTURE_CAPACITY, VK_SHADER_STAGE_ALL, NULL },
+		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDLESS_BUFFER_CAPACITY, VK_SHADER_STAGE_ALL, NULL },
+	};
+	VkDescriptorSetLayoutCreateInfo set_layout_info = {};
+	set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_layout_info.pNext = &set_layout_binding_flags_info;
+	set_layout_info.bindingCount = static_cast<uint32_t>(sizeof(set_layout_bindings) / sizeof(*set_layout_bindings));
+	set_layout_info.pBindings = set_layout_bindings;
+	VK(vkCreateDescriptorSetLayout(Vk.Device, &set_layout_info, NULL, &Vk.BindlessDescriptorSetLayout));
+
+	VkDescriptorPoolSize pool_sizes[] =
+	{
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, BINDLESS_TEXTURE_CAPACITY },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDLESS_BUFFER_CAPACITY },
+	};
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = static_cast<uint32_t>(sizeof(pool_sizes) / sizeof(*pool_sizes));
+	pool_info.pPoolSizes = pool_sizes;
+	pool_info.maxSets = 1;
+	VK(vkCreateDescriptorPool(Vk.Device, &pool_info, NULL, &Vk.BindlessDescriptorPool));
+
+	Vk.BindlessDescriptorSet = VkCreateDescriptorSet(Vk.BindlessDescriptorPool, Vk.BindlessDescriptorSetLayout, {});
+
+	// Handed out from the back, so the lowest slots are used first
+	Vk.BindlessTextureFreeList.resize(BINDLESS_TEXTURE_CAPACITY);
+	for (uint32_t i = 0; i < BINDLESS_TEXTURE_CAPACITY; ++i)
+	{
+		Vk.BindlessTextureFreeList[i] = BINDLESS_TEXTURE_CAPACITY - 1 - i;
+	}
+	Vk.BindlessBufferFreeList.resize(BINDLESS_BUFFER_CAPACITY);
+	for (uint32_t i = 0; i < BINDLESS_BUFFER_CAPACITY; ++i)
+	{
+		Vk.BindlessBufferFreeList[i] = BINDLESS_BUFFER_CAPACITY - 1 - i;
+	}
+}
+
+static void DestroyBindlessDescriptorSet()
+{
+	vkDestroyDescriptorPool(Vk.Device, Vk.BindlessDescriptorPool, NULL);
+	vkDestroyDescriptorSetLayout(Vk.Device, Vk.BindlessDescriptorSetLayout, NULL);
+	Vk.BindlessTextureFreeList.clear();
+	Vk.BindlessBufferFreeList.clear();
+}
+
+static float GetMillisecondsSince(uint64_t time)
+{
+    return static_cast<float>(static_cast<double>(TraceGetTime() - time) * 1e-6);
+}
+
+static void WaitForFrame(uint32_t frame_index)
+{
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &Vk.FrameSemaphore;
+    wait_info.pValues = &Vk.FrameSemaphoreValues[frame_index];
+    VK(vkWaitSemaphores(Vk.Device, &wait_info, UINT64_MAX));
+}
+
+static void CreateFrameResources()
+{
+    Vk.CommandBuffers.resize(Vk.FramesInFlight);
+    Vk.BackBufferCommandBuffers.resize(Vk.FramesInFlight);
+    Vk.SplitCommandBuffers.resize(Vk.FramesInFlight);
+    Vk.SplitCommandBuffersUsed.resize(Vk.FramesInFlight);
+    Vk.ComputeCommandBuffers.resize(Vk.FramesInFlight);
+    Vk.ComputeCommandBuffersUsed.resize(Vk.FramesInFlight);
+    Vk.AcquireSemaphores.resize(Vk.FramesInFlight);
+    Vk.FrameSemaphoreValues.resize(Vk.FramesInFlight);
+    Vk.DescriptorPools.resize(Vk.FramesInFlight);
+    Vk.DescriptorPoolUsage.resize(Vk.FramesInFlight);
+    Vk.UploadChunksInFlight.resize(Vk.FramesInFlight);
+    Vk.UploadBytesInFlight.resize(Vk.FramesInFlight);
+    Vk.TimestampQueryPools.resize(Vk.FramesInFlight);
+    Vk.TimestampLabelsInFlight.resize(Vk.FramesInFlight);
+    Vk.FrameArenas.resize(Vk.FramesInFlight);
+
+    for (uint32_t i = 0; i < Vk.FramesInFlight; ++i)
+    {
+        VkCommandBufferAllocateInfo command_buffer_info = {};
+        command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        command_buffer_info.commandPool = Vk.CommandPool;
+        command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        command_buffer_info.commandBufferCount = 1;
+        VK(vkAllocateCommandBuffers(Vk.Device, &command_buffer_info, &Vk.CommandBuffers[i]));
+        VK(vkAllocateCommandBuffers(Vk.Device, &command_buffer_info, &Vk.BackBufferCommandBuffers[i]));
+        Vk.SplitCommandBuffers[i].clear();
+        Vk.SplitCommandBuffersUsed[i] = 0;
+        Vk.ComputeCommandBuffers[i].clear();
+        Vk.ComputeCommandBuffersUsed[i] = 0;
+
+        VkSemaphoreCreateInfo semaphore_info = {};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VK(vkCreateSemaphore(Vk.Device, &semaphore_info, NULL, &Vk.AcquireSemaphores[i]));
+
+        // Nothing has been submitted from the slot yet, the semaphore never goes below its value
+        Vk.FrameSemaphoreValues[i] = Vk.FrameSemaphoreValue;
+
+        Vk.DescriptorPools[i].clear();
+        Vk.DescriptorPools[i].push_back(CreateDescriptorPool(Vk.DescriptorPoolCapacity));
+        Vk.DescriptorPoolUsage[i] = {};
+
+        Vk.UploadChunksInFlight[i].clear();
+        Vk.UploadBytesInFlight[i] = 0;
+
+        VkQueryPoolCreateInfo timestamp_query_pool_info = {};
+        timestamp_query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        timestamp_query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        timestamp_query_pool_info.queryCount = TIMESTAMP_QUERY_POOL_SIZE;
+        VK(vkCreateQueryPool(Vk.Device, &timestamp_query_pool_info, NULL, &Vk.TimestampQueryPools[i]));
+
+        Vk.TimestampLabelsInFlight[i].clear();
+
+        VkArenaReset(Vk.FrameArenas[i]);
+    }
+
+    for (uint32_t t = 0; t < static_cast<uint32_t>(Vk.RecordThreads.size()); ++t)
+    {
+        VkRecordThread& record_thread = Vk.RecordThreads[t];
+        record_thread.CommandPools.resize(Vk.FramesInFlight);
+        record_thread.SecondaryCommandBuffers.resize(Vk.FramesInFlight);
+        record_thread.SecondaryCommandBuffersUsed.resize(Vk.FramesInFlight);
+        record_thread.DescriptorPools.resize(Vk.FramesInFlight);
+        record_thread.FrameArenas.resize(Vk.FramesInFlight);
+
+        for (uint32_t i = 0; i < Vk.FramesInFlight; ++i)
+        {
+            // Reset as a whole once the frame has retired, so its buffers are never reset one by one
+            VkCommandPoolCreateInfo command_pool_info = {};
+            command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            command_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            command_pool_info.queueFamilyIndex = Vk.GraphicsQueueIndex;
+            VK(vkCreateCommandPool(Vk.Device, &command_pool_info, NULL, &record_thread.CommandPools[i]));
+            record_thread.SecondaryCommandBuffers[i].clear();
+            record_thread.SecondaryCommandBuffersUsed[i] = 0;
+
+            // The main thread allocates descriptor sets from the frame's pools
+            record_thread.DescriptorPools[i].clear();
+            if (t > 0)
+            {
+                record_thread.DescriptorPools[i].push_back(CreateDescriptorPool(record_thread.DescriptorPoolCapacity));
+            }
+
+            VkArenaReset(record_thread.FrameArenas[i]);
+        }
+        record_thread.UploadBlock = {};
+        record_thread.UploadBlockSize = 0;
+        record_thread.UploadBlockHead = 0;
+    }
+
+    Vk.FrameIndexCurr = 0;
+    Vk.FrameIndexNext = (Vk.FrameIndexCurr + 1) % Vk.FramesInFlight;
+}
+static void DestroyFrameResources()
+{
+    for (uint32_t i = 0; i < Vk.FramesInFlight; ++i)
+    {
+        WaitForFrame(i);
+
+        ReleaseUploadChunks(i);
+
+        vkDestroyQueryPool(Vk.Device, Vk.TimestampQueryPools[i], NULL);
+        for (VkDescriptorPool pool : Vk.DescriptorPools[i])
+        {
+            vkDestroyDescriptorPool(Vk.Device, pool, NULL);
+        }
+        Vk.DescriptorPools[i].clear();
+
+        vkDestroySemaphore(Vk.Device, Vk.AcquireSemaphores[i], NULL);
+        vkFreeCommandBuffers(Vk.Device, Vk.CommandPool, 1, &Vk.BackBufferCommandBuffers[i]);
+        vkFreeCommandBuffers(Vk.Device, Vk.CommandPool, 1, &Vk.CommandBuffers[i]);
+        if (!Vk.SplitCommandBuffers[i].empty())
+        {
+            vkFreeCommandBuffers(Vk.Device, Vk.CommandPool, static_cast<uint32_t>(Vk.SplitCommandBuffers[i].size()), Vk.SplitCommandBuffers[i].data());
+            Vk.SplitCommandBuffers[i].clear();
+        }
+        if (!Vk.ComputeCommandBuffers[i].empty())
+        {
+            vkFreeCommandBuffers(Vk.Device, Vk.ComputeCommandPool, static_cast<uint32_t>(Vk.ComputeCommandBuffers[i].size()), Vk.ComputeCommandBuffers[i].data());
+            Vk.ComputeCommandBuffers[i].clear();
+        }
+
+        // Destroying the pool frees its secondary command buffers
+        for (VkRecordThread& record_thread : Vk.RecordThreads)
+        {
+            vkDestroyCommandPool(Vk.Device, record_thread.CommandPools[i], NULL);
+            record_thread.SecondaryCommandBuffers[i].clear();
+            for (VkDescriptorPool pool : record_thread.DescriptorPools[i])
+            {
+                vkDestroyDescriptorPool(Vk.Device, pool, NULL);
+            }
+            record_thread.DescriptorPools[i].clear();
+        }
+    }
+}
+
+// The cache data is only reused if it was made by the same device and driver, drivers reject foreign data themselves
+// but a mismatch is better reported than silently compiled from scratch
+static void CreatePipelineCache(const char* filepath)
+{
+	std::vector<char> data;
+	if (filepath != NULL)
+	{
+		std::ifstream file(filepath, std::ios::binary);
+		if (file.is_open())
+		{
+			data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+	}
+
+	Vk.IsPipelineCacheWarm = false;
+	if (!data.empty())
+	{
+		VkPipelineCacheHeaderVersionOne header = {};
+		if (data.size() >= sizeof(header))
+		{
+			memcpy(&header, data.data(), sizeof(header));
+		}
+		Vk.IsPipelineCacheWarm = data.size() >= sizeof(header) && header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			header.vendorID == Vk.PhysicalDeviceProperties.vendorID && header.deviceID == Vk.PhysicalDeviceProperties.deviceID &&
+			memcmp(header.pipelineCacheUUID, Vk.PhysicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+		if (!Vk.IsPipelineCacheWarm)
+		{
+			printf("Information: Pipeline cache %s was made by another device or driver, starting cold\n", filepath);
+			data.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo pipeline_cache_info = {};
+	pipeline_cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipeline_cache_info.initialDataSize = data.size();
+	pipeline_cache_info.pInitialData = data.empty() ? NULL : data.data();
+	VK(vkCreatePipelineCache(Vk.Device, &pipeline_cache_info, NULL, &Vk.PipelineCache));
+
+	Vk.PipelineCachePath = filepath != NULL ? filepath : "";
+}
+
+static void DestroyPipelineCache()
+{
+	if (!Vk.PipelineCachePath.empty())
+	{
+		size_t data_size = 0;
+		VK(vkGetPipelineCacheData(Vk.Device, Vk.PipelineCache, &data_size, NULL));
+		std::vector<char> data(data_size);
+		VK(vkGetPipelineCacheData(Vk.Device, Vk.PipelineCache, &data_size, data.data()));
+
+		// Written next to the cache and moved over it in one step, so that a failed or interrupted write leaves the
+		// last good cache in place
+		const std::string temporary_path = Vk.PipelineCachePath + ".tmp";
+		bool is_written = false;
+		{
+			std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+			if (file.is_open())
+			{
+				file.write(data.data(), static_cast<std::streamsize>(data_size));
+				file.close();
+				is_written = file.good();
+			}
+		}
+
+		bool is_saved = false;
+		if (is_written)
+		{
+#ifdef _WIN32
+			is_saved = MoveFileExA(temporary_path.c_str(), Vk.PipelineCachePath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+			is_saved = std::rename(temporary_path.c_str(), Vk.PipelineCachePath.c_str()) == 0;
+#endif
+		}
+		if (!is_saved)
+		{
+			std::remove(temporary_path.c_str());
+			printf("Warning: Failed to save pipeline cache %s\n", Vk.PipelineCachePath.c_str());
+		}
+	}
+
+	vkDestroyPipelineCache(Vk.Device, Vk.PipelineCache, NULL);
+	Vk.PipelineCache = VK_NULL_HANDLE;
+}
+
+static VkPresentModeKHR GetPresentMode(VkPresentMode present_mode)
+{
+	switch (present_mode)
+	{
+	case VK_PRESENT_MODE_FIFO_RELAXED:	return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+	case VK_PRESENT_MODE_MAILBOX:		return VK_PRESENT_MODE_MAILBOX_KHR;
+	case VK_PRESENT_MODE_IMMEDIATE:		return VK_PRESENT_MODE_IMMEDIATE_KHR;
+	default:							return VK_PRESENT_MODE_FIFO_KHR;
+	}
+}
+
+static void CreateSwapchain(uint32_t width, uint32_t height, uint32_t image_count, VkDisplayMode display_mode, VkPresentMode present_mode)
 {
     VkSurfaceCapabilitiesKHR surface_capabilities = {};
     VK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(Vk.PhysicalDevice, Vk.Surface, &surface_capabilities));
@@ -86,10 +640,8 @@ static void CreateSwapchain(uint32_t width, uint32_t height, uint32_t image_coun
 		VkError("Surface format is not supported");
 	}
 
-    uint32_t present_mode_count = 0;
-    VK(vkGetPhysicalDeviceSurfacePresentModesKHR(Vk.PhysicalDevice, Vk.Surface, &present_mode_count, NULL));
-    std::vector<VkPresentModeKHR> present_modes(present_mode_count);
-    VK(vkGetPhysicalDeviceSurfacePresentModesKHR(Vk.PhysicalDevice, Vk.Surface, &present_mode_count, present_modes.data()));
+    // FIFO is the only mode every surface supports
+    Vk.PresentMode = Vk.IsPresentModeSupported[present_mode] ? present_mode : VK_PRESENT_MODE_FIFO;
 
     VkSwapchainCreateInfoKHR swapchain_info = {};
     swapchain_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -103,16 +655,11 @@ static void CreateSwapchain(uint32_t width, uint32_t height, uint32_t image_coun
     swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     swapchain_info.preTransform = surface_capabilities.currentTransform;
     swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchain_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    swapchain_info.presentMode = GetPresentMode(Vk.PresentMode);
     swapchain_info.clipped = VK_TRUE;
-	swapchain_info.oldSwapchain = Vk.Swapchain;
+	swapchain_info.oldSwapchain = Vk.Swapchain;		// Retired by DestroySwapchain, destroyed once the frames in flight are done with it
     VK(vkCreateSwapchainKHR(Vk.Device, &swapchain_info, NULL, &Vk.Swapchain));
 
-	if (swapchain_info.oldSwapchain != VK_NULL_HANDLE)
-	{
-		vkDestroySwapchainKHR(Vk.Device, swapchain_info.oldSwapchain, NULL);
-	}
-
 	if (Vk.DisplayMode == VK_DISPLAY_MODE_HDR10 || Vk.DisplayMode == VK_DISPLAY_MODE_SCRGB)
 	{
 		VkHdrMetadataEXT hdr_metadata = {};
@@ -154,122 +701,152 @@ static void CreateSwapchain(uint32_t width, uint32_t height, uint32_t image_coun
         image_view_info.subresourceRange.baseArrayLayer = 0;
         image_view_info.subresourceRange.layerCount = 1;
         VK(vkCreateImageView(Vk.Device, &image_view_info, NULL, &Vk.SwapchainImageViews[i]));
+    }
 
-        VkRecordCommands(
-            [=](VkCommandBuffer cmd)
-            {
-                VkImageMemoryBarrier barrier;
-                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                barrier.pNext = NULL;
-                barrier.srcAccessMask = 0;
-                barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-                barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                barrier.image = Vk.SwapchainImages[i];
-                barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                barrier.subresourceRange.baseMipLevel = 0;
-                barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-                barrier.subresourceRange.baseArrayLayer = 0;
-                barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
-            });
-    }
-
-    Vk.CommandBuffers.resize(Vk.SwapchainImageCount);
-    Vk.CommandBufferFences.resize(Vk.SwapchainImageCount);
-    Vk.CommandBufferSemaphores.resize(Vk.SwapchainImageCount);
+    // Presentation of an image has to be done with its semaphore before the image is acquired again, which is not
+    // true of a frame slot, so these are per image
     Vk.PresentSemaphores.resize(Vk.SwapchainImageCount);
-    Vk.DescriptorPools.resize(Vk.SwapchainImageCount);
-    Vk.UploadBufferTails.resize(Vk.SwapchainImageCount);
-
     for (uint32_t i = 0; i < Vk.SwapchainImageCount; ++i)
     {
-        VkCommandBufferAllocateInfo command_buffer_info = {};
-        command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        command_buffer_info.commandPool = Vk.CommandPool;
-        command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        command_buffer_info.commandBufferCount = 1;
-        VK(vkAllocateCommandBuffers(Vk.Device, &command_buffer_info, &Vk.CommandBuffers[i]));
-
-        VkFenceCreateInfo fence_info = {};
-        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-        VK(vkCreateFence(Vk.Device, &fence_info, NULL, &Vk.CommandBufferFences[i]));
-
         VkSemaphoreCreateInfo semaphore_info = {};
         semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        VK(vkCreateSemaphore(Vk.Device, &semaphore_info, NULL, &Vk.CommandBufferSemaphores[i]));
         VK(vkCreateSemaphore(Vk.Device, &semaphore_info, NULL, &Vk.PresentSemaphores[i]));
-
-        std::vector<VkDescriptorPoolSize> descriptor_pool_sizes =
-        {
-            { VK_DESCRIPTOR_TYPE_SAMPLER, 65535 },
-            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 65535 },
-            { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 65535 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 65535 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 65535 },
-            { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 65535 },
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 65535 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 65535 },
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 65535 },
-            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 65535 },
-        };
-        if (Vk.IsRayTracingSupported)
+    }
+}
+static void DestroySwapchain()
+{
+    // Frames in flight may still render into the images or wait to present them
+    const VkSwapchainKHR swapchain = Vk.Swapchain;
+    const std::vector<VkImageView> image_views = Vk.SwapchainImageViews;
+    const std::vector<VkSemaphore> present_semaphores = Vk.PresentSemaphores;
+    VkDestroyDeferred(
+        [=]()
         {
-            descriptor_pool_sizes.push_back({ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 65535 });
-        }
-        VkDescriptorPoolCreateInfo pool_info = {};
-        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        pool_info.poolSizeCount = static_cast<uint32_t>(descriptor_pool_sizes.size());
-        pool_info.pPoolSizes = descriptor_pool_sizes.data();
-        pool_info.maxSets = 65535;
-        VK(vkCreateDescriptorPool(Vk.Device, &pool_info, NULL, &Vk.DescriptorPools[i]));
+            for (size_t i = 0; i < image_views.size(); ++i)
+            {
+                vkDestroySemaphore(Vk.Device, present_semaphores[i], NULL);
+                vkDestroyImageView(Vk.Device, image_views[i], NULL);
+            }
+            vkDestroySwapchainKHR(Vk.Device, swapchain, NULL);
+        });
+}
 
-        Vk.UploadBufferTails[i] = 0;
-    }
+static void CreateOffscreenImages(uint32_t width, uint32_t height, uint32_t image_count)
+{
+    Vk.SwapchainImageExtent.width = width;
+    Vk.SwapchainImageExtent.height = height;
+    Vk.SwapchainImageCount = VkMax(image_count, 1U);
 
-	Vk.UploadBufferHead = 0;
+    Vk.DisplayMode = VK_DISPLAY_MODE_SDR;
+    Vk.PresentMode = VK_PRESENT_MODE_FIFO;
+    Vk.SwapchainSurfaceFormat.format = VK_FORMAT_B8G8R8A8_UNORM;
+    Vk.SwapchainSurfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
 
-    Vk.FrameIndexCurr = 0;
-    Vk.FrameIndexNext = (Vk.FrameIndexCurr + 1) % Vk.SwapchainImageCount;
+    Vk.SwapchainImageIndex = 0;
+    Vk.SwapchainImages.resize(Vk.SwapchainImageCount);
+    Vk.SwapchainImageViews.resize(Vk.SwapchainImageCount);
+    Vk.OffscreenImageAllocations.resize(Vk.SwapchainImageCount);
+    for (uint32_t i = 0; i < Vk.SwapchainImageCount; ++i)
+    {
+        VkTextureCreateParams image_params;
+        image_params.Type = VK_IMAGE_TYPE_2D;
+        image_params.ViewType = VK_IMAGE_VIEW_TYPE_2D;
+        image_params.Width = width;
+        image_params.Height = height;
+        image_params.Format = Vk.SwapchainSurfaceFormat.format;
+        image_params.Usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        image_params.InitialLayout = GetBackBufferIdleLayout();
+        image_params.Category = VK_MEMORY_CATEGORY_RENDER_TARGETS;
+        VkTexture image = VkTextureCreate(image_params);
+
+        Vk.SwapchainImages[i] = image.Image;
+        Vk.SwapchainImageViews[i] = image.ImageView;
+        Vk.OffscreenImageAllocations[i] = image.ImageAllocation;
+    }
 }
-static void DestroySwapchain()
+static void DestroyOffscreenImages()
 {
+    // Frames in flight may still render into the images
+    std::vector<VkTexture> images(Vk.SwapchainImageCount);
     for (uint32_t i = 0; i < Vk.SwapchainImageCount; ++i)
     {
-        vkDestroyDescriptorPool(Vk.Device, Vk.DescriptorPools[i], NULL);
+        images[i].Image = Vk.SwapchainImages[i];
+        images[i].ImageView = Vk.SwapchainImageViews[i];
+        images[i].ImageAllocation = Vk.OffscreenImageAllocations[i];
+    }
+    VkDestroyDeferred(
+        [images]()
+        {
+            for (const VkTexture& image : images)
+            {
+                VkTextureDestroy(image);
+            }
+        });
+}
 
-        vkDestroySemaphore(Vk.Device, Vk.PresentSemaphores[i], NULL);
-        vkDestroySemaphore(Vk.Device, Vk.CommandBufferSemaphores[i], NULL);
-        vkDestroyFence(Vk.Device, Vk.CommandBufferFences[i], NULL);
-        vkFreeCommandBuffers(Vk.Device, Vk.CommandPool, 1, &Vk.CommandBuffers[i]);
+static void RecreateSwapchain(uint32_t width, uint32_t height, VkDisplayMode display_mode, VkPresentMode present_mode)
+{
+    if (Vk.IsHeadless)
+    {
+        DestroyOffscreenImages();
+        CreateOffscreenImages(width, height, Vk.SwapchainImageCount);
+    }
+    else
+    {
+        DestroySwapchain();
+        CreateSwapchain(width, height, Vk.SwapchainImageCount, display_mode, present_mode);
+    }
+    Vk.IsSwapchainOutOfDate = false;
+    ++Vk.SwapchainGeneration;
+}
+
+// A minimized window has no extent, swapchains cannot be created for it
+static bool IsSurfaceVisible()
+{
+    VkSurfaceCapabilitiesKHR surface_capabilities = {};
+    VK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(Vk.PhysicalDevice, Vk.Surface, &surface_capabilities));
+    return surface_capabilities.maxImageExtent.width > 0 && surface_capabilities.maxImageExtent.height > 0;
+}
 
-        vkDestroyImageView(Vk.Device, Vk.SwapchainImageViews[i], NULL);
+static void RunDeferredDestructions(uint64_t frame_semaphore_value)
+{
+    size_t count = 0;
+    while (count < Vk.DeferredDestructions.size() && Vk.DeferredDestructions[count].FrameSemaphoreValue <= frame_semaphore_value)
+    {
+        Vk.DeferredDestructions[count].Destroy(Vk.DeferredDestructions[count].Destruction);
+        ++count;
     }
+    Vk.DeferredDestructions.erase(Vk.DeferredDestructions.begin(), Vk.DeferredDestructions.begin() + count);
 }
 
 void VkInitialize(const VkInitializeParams& params)
 {
     VK(volkInitialize());
 
+	Vk.IsHeadless = params.Headless;
+	Vk.SerializeBarriers = params.SerializeBarriers;
+	Vk.UseMemoryPools = params.UseMemoryPools;
+
 	std::vector<const char*> instance_extensions =
 	{
-		VK_KHR_SURFACE_EXTENSION_NAME,
-#if defined(VK_USE_PLATFORM_WIN32_KHR)
-		VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
-#elif defined(VK_USE_PLATFORM_XLIB_KHR)
-		VK_KHR_XLIB_SURFACE_EXTENSION_NAME,
-#endif
 		VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
 	};
     std::vector<const char*> device_extensions =
 	{
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME
+		VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,	// Barriers with exact stage and access masks
 	};
-	const char* validation_layer = "VK_LAYER_KHRONOS_validation";
-
+	if (!Vk.IsHeadless)
+	{
+		instance_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
+		instance_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+#elif defined(VK_USE_PLATFORM_XLIB_KHR)
+		instance_extensions.push_back(VK_KHR_XLIB_SURFACE_EXTENSION_NAME);
+#endif
+		device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
+	const char* validation_layer = "VK_LAYER_KHRONOS_validation";
+
 	uint32_t instance_extension_properties_count = 0;
 	VK(vkEnumerateInstanceExtensionProperties(NULL, &instance_extension_properties_count, NULL));
 	std::vector<VkExtensionProperties> instance_extension_properties(instance_extension_properties_count);
@@ -342,19 +919,23 @@ void VkInitialize(const VkInitializeParams& params)
         VK(vkCreateDebugReportCallbackEXT(Vk.Instance, &callback_info, NULL, &Vk.DebugCallback));
     }
 
+	Vk.Surface = VK_NULL_HANDLE;
+	if (!Vk.IsHeadless)
+	{
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
-	VkWin32SurfaceCreateInfoKHR surface_info = {};
-	surface_info.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-	surface_info.hwnd = static_cast<HWND>(params.WindowHandle);
-	surface_info.hinstance = static_cast<HINSTANCE>(params.DisplayHandle);
-	VK(vkCreateWin32SurfaceKHR(Vk.Instance, &surface_info, NULL, &Vk.Surface));
+		VkWin32SurfaceCreateInfoKHR surface_info = {};
+		surface_info.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+		surface_info.hwnd = static_cast<HWND>(params.WindowHandle);
+		surface_info.hinstance = static_cast<HINSTANCE>(params.DisplayHandle);
+		VK(vkCreateWin32SurfaceKHR(Vk.Instance, &surface_info, NULL, &Vk.Surface));
 #elif defined(VK_USE_PLATFORM_XLIB_KHR)
-	VkXlibSurfaceCreateInfoKHR surface_info = {};
-	surface_info.sType = VK_STRUCTURE_TYPE_XLIB_SURFACE_CREATE_INFO_KHR;
-	surface_info.window = reinterpret_cast<Window>(params.WindowHandle);
-	surface_info.dpy = static_cast<Display*>(params.DisplayHandle);
-	VK(vkCreateXlibSurfaceKHR(Vk.Instance, &surface_info, NULL, &Vk.Surface));
+		VkXlibSurfaceCreateInfoKHR surface_info = {};
+		surface_info.sType = VK_STRUCTURE_TYPE_XLIB_SURFACE_CREATE_INFO_KHR;
+		surface_info.window = reinterpret_cast<Window>(params.WindowHandle);
+		surface_info.dpy = static_cast<Display*>(params.DisplayHandle);
+		VK(vkCreateXlibSurfaceKHR(Vk.Instance, &surface_info, NULL, &Vk.Surface));
 #endif
+	}
 
 	uint32_t physical_device_count = 0;
 	VK(vkEnumeratePhysicalDevices(Vk.Instance, &physical_device_count, NULL));
@@ -420,8 +1001,11 @@ void VkInitialize(const VkInitializeParams& params)
 		{
 			VkBool32 queue_flags_supported = (queue_family_properties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
 
-			VkBool32 surface_supported = VK_FALSE;
-			VK(vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[i], j, Vk.Surface, &surface_supported));
+			VkBool32 surface_supported = Vk.IsHeadless ? VK_TRUE : VK_FALSE;
+			if (!Vk.IsHeadless)
+			{
+				VK(vkGetPhysicalDeviceSurfaceSupportKHR(physical_devices[i], j, Vk.Surface, &surface_supported));
+			}
 
 			if (queue_flags_supported && surface_supported)
 			{
@@ -453,6 +1037,15 @@ void VkInitialize(const VkInitializeParams& params)
     VK(vkEnumerateDeviceExtensionProperties(Vk.PhysicalDevice, NULL, &device_extension_properties_count, device_extension_properties.data()));
 
 	// Check if HDR display modes are supported
+	if (Vk.IsHeadless)
+	{
+		memset(Vk.IsDisplayModeSupported, 0, sizeof(Vk.IsDisplayModeSupported));
+		Vk.IsDisplayModeSupported[VK_DISPLAY_MODE_SDR] = true;
+
+		memset(Vk.IsPresentModeSupported, 0, sizeof(Vk.IsPresentModeSupported));
+		Vk.IsPresentModeSupported[VK_PRESENT_MODE_FIFO] = true;
+	}
+	else
 	{
 		std::vector<const char*> hdr_display_extensions =
 		{
@@ -500,6 +1093,125 @@ void VkInitialize(const VkInitializeParams& params)
 				Vk.IsDisplayModeSupported[VK_DISPLAY_MODE_SCRGB] |= ((surface_formats[i].format == VK_FORMAT_R16G16B16A16_SFLOAT) && surface_formats[i].colorSpace == VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT);
 			}
 		}
+
+		uint32_t present_mode_count = 0;
+		VK(vkGetPhysicalDeviceSurfacePresentModesKHR(Vk.PhysicalDevice, Vk.Surface, &present_mode_count, NULL));
+		std::vector<VkPresentModeKHR> present_modes(present_mode_count);
+		VK(vkGetPhysicalDeviceSurfacePresentModesKHR(Vk.PhysicalDevice, Vk.Surface, &present_mode_count, present_modes.data()));
+
+		memset(Vk.IsPresentModeSupported, 0, sizeof(Vk.IsPresentModeSupported));
+		for (uint32_t i = 0; i < VK_PRESENT_MODE_COUNT; ++i)
+		{
+			Vk.IsPresentModeSupported[i] = std::find(present_modes.begin(), present_modes.end(), GetPresentMode(static_cast<VkPresentMode>(i))) != present_modes.end();
+		}
+		Vk.IsPresentModeSupported[VK_PRESENT_MODE_FIFO] = true;
+	}
+
+	// Look for a dedicated transfer queue family, which is usually backed by a DMA engine
+	{
+		uint32_t queue_family_properties_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(Vk.PhysicalDevice, &queue_family_properties_count, NULL);
+		std::vector<VkQueueFamilyProperties> queue_family_properties(queue_family_properties_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(Vk.PhysicalDevice, &queue_family_properties_count, queue_family_properties.data());
+
+		Vk.TransferQueueIndex = Vk.GraphicsQueueIndex;
+		for (uint32_t i = 0; i < queue_family_properties_count; ++i)
+		{
+			const VkQueueFlags queue_flags = queue_family_properties[i].queueFlags;
+			if ((queue_flags & VK_QUEUE_TRANSFER_BIT) != 0 && (queue_flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0 && queue_family_properties[i].queueCount > 0)
+			{
+				Vk.TransferQueueIndex = i;
+				break;
+			}
+		}
+		Vk.IsTransferQueueSupported = Vk.TransferQueueIndex != Vk.GraphicsQueueIndex;
+
+		// And for a compute queue family without graphics, which runs next to the graphics queue. Its passes are timed
+		// like any other, so it has to write timestamps.
+		Vk.ComputeQueueIndex = Vk.GraphicsQueueIndex;
+		for (uint32_t i = 0; i < queue_family_properties_count; ++i)
+		{
+			const VkQueueFlags queue_flags = queue_family_properties[i].queueFlags;
+			if ((queue_flags & VK_QUEUE_COMPUTE_BIT) != 0 && (queue_flags & VK_QUEUE_GRAPHICS_BIT) == 0 && queue_family_properties[i].queueCount > 0 && queue_family_properties[i].timestampValidBits > 0)
+			{
+				Vk.ComputeQueueIndex = i;
+				break;
+			}
+		}
+		Vk.IsComputeQueueSupported = Vk.ComputeQueueIndex != Vk.GraphicsQueueIndex;
+		Vk.UseAsyncCompute = Vk.IsComputeQueueSupported && params.UseAsyncCompute;
+
+		Vk.ComputeSharingQueueFamilies[0] = Vk.GraphicsQueueIndex;
+		Vk.ComputeSharingQueueFamilies[1] = Vk.ComputeQueueIndex;
+		Vk.ComputeSharingQueueFamilies[2] = Vk.TransferQueueIndex;
+		Vk.ComputeSharingQueueFamilyCount = Vk.IsTransferQueueSupported ? 3 : 2;
+		if (Vk.UseAsyncCompute)
+		{
+			printf("Information: Async compute runs on queue family %u\n", Vk.ComputeQueueIndex);
+		}
+	}
+
+	// Check if calibrated timestamps are supported
+	{
+		Vk.IsCalibratedTimestampsSupported = false;
+		for (uint32_t i = 0; i < device_extension_properties_count; ++i)
+		{
+			if (strcmp(device_extension_properties[i].extensionName, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) == 0)
+			{
+				Vk.IsCalibratedTimestampsSupported = true;
+				break;
+			}
+		}
+		if (Vk.IsCalibratedTimestampsSupported)
+		{
+			uint32_t time_domain_count = 0;
+			VK(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(Vk.PhysicalDevice, &time_domain_count, NULL));
+			std::vector<VkTimeDomainEXT> time_domains(time_domain_count);
+			VK(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(Vk.PhysicalDevice, &time_domain_count, time_domains.data()));
+
+			Vk.IsCalibratedTimestampsSupported = std::find(time_domains.begin(), time_domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != time_domains.end();
+		}
+		if (Vk.IsCalibratedTimestampsSupported)
+		{
+			device_extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+		}
+	}
+
+	// Check if the memory budget is supported, so that budgets come from the driver rather than heap sizes
+	{
+		Vk.IsMemoryBudgetSupported = false;
+		for (uint32_t i = 0; i < device_extension_properties_count; ++i)
+		{
+			if (strcmp(device_extension_properties[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+			{
+				Vk.IsMemoryBudgetSupported = true;
+				break;
+			}
+		}
+		if (Vk.IsMemoryBudgetSupported)
+		{
+			device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+	}
+
+	// Raster materials are bindless, so descriptor indexing is required
+	{
+		VkPhysicalDeviceVulkan12Features supported_vulkan_1_2_features = {};
+		supported_vulkan_1_2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 supported_features = {};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &supported_vulkan_1_2_features;
+		vkGetPhysicalDeviceFeatures2(Vk.PhysicalDevice, &supported_features);
+
+		if (!supported_features.features.shaderSampledImageArrayDynamicIndexing ||
+			!supported_features.features.shaderStorageBufferArrayDynamicIndexing ||
+			!supported_vulkan_1_2_features.runtimeDescriptorArray ||
+			!supported_vulkan_1_2_features.descriptorBindingPartiallyBound ||
+			!supported_vulkan_1_2_features.descriptorBindingUpdateUnusedWhilePending)
+		{
+			VkError("Descriptor indexing is not supported");
+		}
 	}
 
 	// Check if ray tracing is supported
@@ -542,22 +1254,49 @@ void VkInitialize(const VkInitializeParams& params)
 	}
 
 	const float queue_priority = 1.0f;
-	VkDeviceQueueCreateInfo queue_info = {};
-	queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queue_info.queueFamilyIndex = Vk.GraphicsQueueIndex;
-	queue_info.queueCount = 1;
-	queue_info.pQueuePriorities = &queue_priority;
+	VkDeviceQueueCreateInfo queue_infos[3] = {};
+	uint32_t queue_info_count = 0;
+	queue_infos[queue_info_count].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queue_infos[queue_info_count].queueFamilyIndex = Vk.GraphicsQueueIndex;
+	queue_infos[queue_info_count].queueCount = 1;
+	queue_infos[queue_info_count].pQueuePriorities = &queue_priority;
+	++queue_info_count;
+	if (Vk.IsTransferQueueSupported)
+	{
+		queue_infos[queue_info_count].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queue_infos[queue_info_count].queueFamilyIndex = Vk.TransferQueueIndex;
+		queue_infos[queue_info_count].queueCount = 1;
+		queue_infos[queue_info_count].pQueuePriorities = &queue_priority;
+		++queue_info_count;
+	}
+	if (Vk.UseAsyncCompute)
+	{
+		queue_infos[queue_info_count].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queue_infos[queue_info_count].queueFamilyIndex = Vk.ComputeQueueIndex;
+		queue_infos[queue_info_count].queueCount = 1;
+		queue_infos[queue_info_count].pQueuePriorities = &queue_priority;
+		++queue_info_count;
+	}
 
     VkPhysicalDeviceFeatures device_features = {};
 	device_features.samplerAnisotropy = VK_TRUE;
     device_features.shaderStorageImageExtendedFormats = VK_TRUE;
+	device_features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+	device_features.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
 
 	VkPhysicalDeviceVulkan12Features device_vulkan_1_2_features = {};
 	device_vulkan_1_2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
-	device_vulkan_1_2_features.bufferDeviceAddress = VK_TRUE;
+	device_vulkan_1_2_features.bufferDeviceAddress = Vk.IsRayTracingSupported;
 	device_vulkan_1_2_features.runtimeDescriptorArray = VK_TRUE;
-	device_vulkan_1_2_features.descriptorIndexing = VK_TRUE;
+	device_vulkan_1_2_features.descriptorIndexing = Vk.IsRayTracingSupported;
 	device_vulkan_1_2_features.descriptorBindingPartiallyBound = VK_TRUE;
+	device_vulkan_1_2_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	device_vulkan_1_2_features.timelineSemaphore = VK_TRUE;
+
+	VkPhysicalDeviceSynchronization2FeaturesKHR device_synchronization_2_features = {};
+	device_synchronization_2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+	device_synchronization_2_features.synchronization2 = VK_TRUE;
+	device_vulkan_1_2_features.pNext = &device_synchronization_2_features;
 
 	VkPhysicalDeviceAccelerationStructureFeaturesKHR device_acceleration_structure_features = {};
 	device_acceleration_structure_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
@@ -571,9 +1310,9 @@ void VkInitialize(const VkInitializeParams& params)
 
 	VkDeviceCreateInfo device_info = {};
 	device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    device_info.pNext = Vk.IsRayTracingSupported ? &device_ray_tracing_pipeline_features : NULL;
-	device_info.queueCreateInfoCount = 1;
-	device_info.pQueueCreateInfos = &queue_info;
+    device_info.pNext = Vk.IsRayTracingSupported ? static_cast<void*>(&device_ray_tracing_pipeline_features) : static_cast<void*>(&device_vulkan_1_2_features);
+	device_info.queueCreateInfoCount = queue_info_count;
+	device_info.pQueueCreateInfos = queue_infos;
     device_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
 	device_info.ppEnabledExtensionNames = device_extensions.data();
     device_info.pEnabledFeatures = &device_features;
@@ -587,6 +1326,8 @@ void VkInitialize(const VkInitializeParams& params)
     volkLoadDevice(Vk.Device);
 
 	vkGetDeviceQueue(Vk.Device, Vk.GraphicsQueueIndex, 0, &Vk.GraphicsQueue);
+	vkGetDeviceQueue(Vk.Device, Vk.TransferQueueIndex, 0, &Vk.TransferQueue);
+	vkGetDeviceQueue(Vk.Device, Vk.UseAsyncCompute ? Vk.ComputeQueueIndex : Vk.GraphicsQueueIndex, 0, &Vk.ComputeQueue);
 
     VkCommandPoolCreateInfo command_pool_info = {};
     command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -594,102 +1335,1261 @@ void VkInitialize(const VkInitializeParams& params)
     command_pool_info.queueFamilyIndex = Vk.GraphicsQueueIndex;
     VK(vkCreateCommandPool(Vk.Device, &command_pool_info, NULL, &Vk.CommandPool));
 
+    Vk.TransferCommandPool = VK_NULL_HANDLE;
+    if (Vk.IsTransferQueueSupported)
+    {
+        command_pool_info.queueFamilyIndex = Vk.TransferQueueIndex;
+        VK(vkCreateCommandPool(Vk.Device, &command_pool_info, NULL, &Vk.TransferCommandPool));
+    }
+    Vk.TransferCommandBuffer = VK_NULL_HANDLE;
+    Vk.TransferCommandBuffersInFlight.clear();
+
+    Vk.ComputeCommandPool = VK_NULL_HANDLE;
+    if (Vk.UseAsyncCompute)
+    {
+        command_pool_info.queueFamilyIndex = Vk.ComputeQueueIndex;
+        VK(vkCreateCommandPool(Vk.Device, &command_pool_info, NULL, &Vk.ComputeCommandPool));
+    }
+    Vk.TransferBytesPending = 0;
+
+    VkSemaphoreTypeCreateInfo timeline_semaphore_type_info = {};
+    timeline_semaphore_type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timeline_semaphore_type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timeline_semaphore_type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo timeline_semaphore_info = {};
+    timeline_semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    timeline_semaphore_info.pNext = &timeline_semaphore_type_info;
+    VK(vkCreateSemaphore(Vk.Device, &timeline_semaphore_info, NULL, &Vk.TransferSemaphore));
+    Vk.TransferSemaphoreValue = 0;
+    Vk.TransferSemaphoreValueWaited = 0;
+
+    Vk.ComputeSemaphore = VK_NULL_HANDLE;
+    Vk.GraphicsSemaphore = VK_NULL_HANDLE;
+    if (Vk.UseAsyncCompute)
+    {
+        VK(vkCreateSemaphore(Vk.Device, &timeline_semaphore_info, NULL, &Vk.ComputeSemaphore));
+        VK(vkCreateSemaphore(Vk.Device, &timeline_semaphore_info, NULL, &Vk.GraphicsSemaphore));
+    }
+    Vk.ComputeSemaphoreValue = 0;
+    Vk.ComputeSemaphoreValueToWait = 0;
+    Vk.ComputeSemaphoreValueWaited = 0;
+    Vk.GraphicsSemaphoreValue = 0;
+    Vk.GraphicsSemaphoreValueToWait = 0;
+
+    VK(vkCreateSemaphore(Vk.Device, &timeline_semaphore_info, NULL, &Vk.FrameSemaphore));
+    Vk.FrameSemaphoreValue = 0;
+    Vk.FrameCommandBuffer = VK_NULL_HANDLE;
+    Vk.IsAcquireWaitPending = false;
+    Vk.FrameWaitTimePending = 0.0f;
+    Vk.LastPresentTime = 0;
+    Vk.FrameStats = {};
+
 	VmaAllocatorCreateInfo allocator_info = {};
-	allocator_info.flags = VMA_ALLOCATOR_CREATE_EXTERNALLY_SYNCHRONIZED_BIT | (Vk.IsRayTracingSupported ? VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT : 0);
+	allocator_info.flags = VMA_ALLOCATOR_CREATE_EXTERNALLY_SYNCHRONIZED_BIT | (Vk.IsRayTracingSupported ? VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT : 0) |
+		(Vk.IsMemoryBudgetSupported ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0);
 	allocator_info.physicalDevice = Vk.PhysicalDevice;
 	allocator_info.device = Vk.Device;
 	allocator_info.instance = Vk.Instance;
 	allocator_info.pAllocationCallbacks = NULL;
+	allocator_info.vulkanApiVersion = VK_API_VERSION_1_1;	// The memory budget is queried with the core vkGetPhysicalDeviceMemoryProperties2
 	VK(vmaCreateAllocator(&allocator_info, &Vk.Allocator));
+	memset(Vk.MemoryCategoryStats, 0, sizeof(Vk.MemoryCategoryStats));
+	memset(Vk.MemoryPools, 0, sizeof(Vk.MemoryPools));
+	Vk.Movables.clear();
+	Vk.DefragmentationContext = VK_NULL_HANDLE;
+	Vk.DefragmentationFrameSemaphoreValue = 0;
+	Vk.IsDefragmented = false;
+	Vk.DefragmentationStats = {};
+
+	// Integrated GPUs and software renderers have device-local memory the host can write, as do discrete GPUs with
+	// resizable BAR. Without it, discrete GPUs only map a small window that drivers keep for themselves, too small for
+	// the upload ring.
+	Vk.UploadMemoryTypeBits = 0;
+	if (params.UseDeviceLocalUpload)
+	{
+		const VkPhysicalDeviceMemoryProperties* memory_properties = NULL;
+		vmaGetMemoryProperties(Vk.Allocator, &memory_properties);
 
-	VkBufferCreateInfo upload_buffer_info = {};
-	upload_buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	upload_buffer_info.size = UPLOAD_BUFFER_SIZE;
-	upload_buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-	upload_buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	VmaAllocationCreateInfo upload_buffer_allocation_info = {};
-    upload_buffer_allocation_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
-    upload_buffer_allocation_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		const VkMemoryPropertyFlags upload_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		for (uint32_t i = 0; i < memory_properties->memoryTypeCount; ++i)
+		{
+			const VkMemoryType& memory_type = memory_properties->memoryTypes[i];
+			if ((memory_type.propertyFlags & upload_flags) == upload_flags && memory_properties->memoryHeaps[memory_type.heapIndex].size > UPLOAD_DEVICE_LOCAL_MIN_HEAP_SIZE)
+			{
+				Vk.UploadMemoryTypeBits |= 1U << i;
+			}
+		}
+	}
+	Vk.IsUploadDeviceLocal = Vk.UploadMemoryTypeBits != 0;
+	if (Vk.IsUploadDeviceLocal)
+	{
+		printf("Information: Upload memory is device local, per-frame vertices and indices are written in place\n");
+	}
 
-	VmaAllocationInfo allocation_info = {};
-	VK(vmaCreateBuffer(Vk.Allocator, &upload_buffer_info, &upload_buffer_allocation_info, &Vk.UploadBuffer, &Vk.UploadBufferAllocation, &allocation_info));
-	Vk.UploadBufferMemory = allocation_info.deviceMemory;
-	Vk.UploadBufferMemoryOffset = allocation_info.offset;
-	Vk.UploadBufferMappedData = (uint8_t*)allocation_info.pMappedData;
+	Vk.UploadChunks.clear();
+	Vk.UploadChunkCurr = UINT32_MAX;
+	Vk.UploadChunksPending.clear();
+	Vk.UploadBytesPending = 0;
+	Vk.UploadStallTimePending = 0.0f;
+	Vk.UploadDirectBytesPending = 0;
+	Vk.UploadStats = {};
 
 	Vk.Swapchain = VK_NULL_HANDLE;
-    CreateSwapchain(params.BackBufferWidth, params.BackBufferHeight, params.DesiredBackBufferCount, params.DisplayMode);
+	Vk.SwapchainGeneration = 0;
+	Vk.IsSwapchainOutOfDate = false;
+	Vk.IsBackBufferAcquired = false;
+	if (Vk.IsHeadless)
+	{
+		CreateOffscreenImages(params.BackBufferWidth, params.BackBufferHeight, params.DesiredBackBufferCount);
+	}
+	else
+	{
+		CreateSwapchain(params.BackBufferWidth, params.BackBufferHeight, params.DesiredBackBufferCount, params.DisplayMode, params.PresentMode);
+	}
+
+	Vk.FramesInFlight = VkMin(VkMax(params.FramesInFlight, 1U), VK_MAX_FRAMES_IN_FLIGHT);
 
-	VkQueryPoolCreateInfo timestamp_query_pool_info = {};
-	timestamp_query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-	timestamp_query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
-	timestamp_query_pool_info.queryCount = TIMESTAMP_QUERY_POOL_SIZE;
-	VK(vkCreateQueryPool(Vk.Device, &timestamp_query_pool_info, NULL, &Vk.TimestampQueryPool));
-	Vk.TimestampQueryPoolOffset = 0;
+	// Any job worker may run record tasks
+	Vk.RecordThreads.clear();
+	Vk.RecordThreads.resize(JobGetWorkerCount());
+	for (VkRecordThread& record_thread : Vk.RecordThreads)
+	{
+		record_thread.DescriptorPoolCapacity = {};
+	}
+
+	CreateFrameResources();
+
+	CreateBindlessDescriptorSet();
+
+	CreatePipelineCache(params.PipelineCachePath);
+
+	VkCalibrateTimestamps();
 }
 void VkTerminate()
 {
-	DestroySwapchain();
-	vkDestroySwapchainKHR(Vk.Device, Vk.Swapchain, NULL);
-    
-	vkDestroyQueryPool(Vk.Device, Vk.TimestampQueryPool, NULL);
-	vmaDestroyBuffer(Vk.Allocator, Vk.UploadBuffer, Vk.UploadBufferAllocation);
+	// Commands recorded after the last frame never run, but still own what they captured
+	for (const VkRecordedCommand& recorded_command : Vk.RecordedCommands)
+	{
+		recorded_command.Destroy(recorded_command.Commands);
+	}
+	Vk.RecordedCommands.clear();
+	VkArenaReset(Vk.RecordedCommandsArena);
+
+	DestroyPipelineCache();
+
+	DestroyBindlessDescriptorSet();
+
+	DestroyFrameResources();
+	Vk.RecordThreads.clear();
+
+	if (Vk.IsHeadless)
+	{
+		DestroyOffscreenImages();
+	}
+	else
+	{
+		DestroySwapchain();
+	}
+
+	// The device is idle, so nothing queued has to wait. Static allocations freed while a defragmentation pass was in
+	// flight are among them, and are only freed once it has ended.
+	if (Vk.DefragmentationContext != VK_NULL_HANDLE)
+	{
+		VK(vmaEndDefragmentationPass(Vk.Allocator, Vk.DefragmentationContext));
+		VK(vmaDefragmentationEnd(Vk.Allocator, Vk.DefragmentationContext));
+		Vk.DefragmentationContext = VK_NULL_HANDLE;
+	}
+	RunDeferredDestructions(UINT64_MAX);
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(Vk.UploadChunks.size()); ++i)
+	{
+		if (Vk.UploadChunks[i].Buffer != VK_NULL_HANDLE)
+		{
+			DestroyUploadChunk(i);
+		}
+	}
+	for (uint32_t i = 0; i < VK_MEMORY_POOL_COUNT; ++i)
+	{
+		for (VmaPool pool : Vk.MemoryPools[i])
+		{
+			if (pool != VK_NULL_HANDLE)
+			{
+				vmaDestroyPool(Vk.Allocator, pool);
+			}
+		}
+	}
 	vmaDestroyAllocator(Vk.Allocator);
+    vkDestroySemaphore(Vk.Device, Vk.FrameSemaphore, NULL);
+    vkDestroySemaphore(Vk.Device, Vk.TransferSemaphore, NULL);
+    if (Vk.TransferCommandPool != VK_NULL_HANDLE)
+    {
+        vkDestroyCommandPool(Vk.Device, Vk.TransferCommandPool, NULL);
+    }
+    vkDestroySemaphore(Vk.Device, Vk.ComputeSemaphore, NULL);
+    vkDestroySemaphore(Vk.Device, Vk.GraphicsSemaphore, NULL);
+    if (Vk.ComputeCommandPool != VK_NULL_HANDLE)
+    {
+        vkDestroyCommandPool(Vk.Device, Vk.ComputeCommandPool, NULL);
+    }
     vkDestroyCommandPool(Vk.Device, Vk.CommandPool, NULL);
 	vkDestroyDevice(Vk.Device, NULL);
-	vkDestroySurfaceKHR(Vk.Instance, Vk.Surface, NULL);
+	if (Vk.Surface != VK_NULL_HANDLE)
+	{
+		vkDestroySurfaceKHR(Vk.Instance, Vk.Surface, NULL);
+	}
     if (Vk.DebugCallback != VK_NULL_HANDLE)
     {
-        vkDestroyDebugReportCallbackEXT(Vk.Instance, Vk.DebugCallback, NULL);
+        vkDestroyDebugReportCallbackEXT(Vk.Instance, Vk.DebugCallback, NULL);
+    }
+	vkDestroyInstance(Vk.Instance, NULL);
+}
+
+void VkResize(uint32_t width, uint32_t height, VkDisplayMode display_mode, VkPresentMode present_mode)
+{
+	RecreateSwapchain(width, height, display_mode, present_mode);
+}
+
+void VkSetFramesInFlight(uint32_t frames_in_flight)
+{
+	DestroyFrameResources();
+	Vk.FramesInFlight = VkMin(VkMax(frames_in_flight, 1U), VK_MAX_FRAMES_IN_FLIGHT);
+	CreateFrameResources();
+}
+
+// Called with Vk.UploadMutex locked
+static VkAllocation AllocateUploadBuffer(VkDeviceSize size, VkDeviceSize alignment)
+{
+    if (Vk.UploadChunkCurr != UINT32_MAX)
+    {
+        const VkUploadChunk& chunk = Vk.UploadChunks[Vk.UploadChunkCurr];
+        if (VkAlignUp(chunk.Head, alignment) + size > chunk.Size)
+        {
+            Vk.UploadChunkCurr = UINT32_MAX;
+        }
+    }
+
+    if (Vk.UploadChunkCurr == UINT32_MAX)
+    {
+        Vk.UploadChunkCurr = FindFreeUploadChunk(size);
+
+        // Before growing past the budget, wait for the oldest frames in flight to give their chunks back
+        for (uint32_t i = 0; i < Vk.FramesInFlight && Vk.UploadChunkCurr == UINT32_MAX && Vk.UploadStats.Capacity + VkMax(size, UPLOAD_CHUNK_SIZE) > UPLOAD_BUFFER_BUDGET; ++i)
+        {
+            const uint32_t frame_index = (Vk.FrameIndexCurr + i) % Vk.FramesInFlight;
+            if (Vk.UploadChunksInFlight[frame_index].empty())
+                continue;
+
+            {
+                // Trace zones are only recorded on the main thread
+                const bool is_main_thread = JobGetWorkerIndex() == 0;
+                const size_t stall_zone = is_main_thread ? TraceBeginZone("Upload Buffer Stall") : 0;
+                const uint64_t stall_begin = TraceGetTime();
+                WaitForFrame(frame_index);
+                Vk.UploadStallTimePending += GetMillisecondsSince(stall_begin);
+                if (is_main_thread)
+                {
+                    TraceEndZone(stall_zone);
+                }
+            }
+            ReleaseUploadChunks(frame_index);
+
+            Vk.UploadChunkCurr = FindFreeUploadChunk(size);
+        }
+
+        // Nothing left to wait for, so grow
+        if (Vk.UploadChunkCurr == UINT32_MAX)
+        {
+            Vk.UploadChunkCurr = CreateUploadChunk(VkMax(size, UPLOAD_CHUNK_SIZE));
+        }
+        Vk.UploadChunks[Vk.UploadChunkCurr].Head = 0;
+    }
+
+    VkUploadChunk& chunk = Vk.UploadChunks[Vk.UploadChunkCurr];
+    const VkDeviceSize offset = VkAlignUp(chunk.Head, alignment);
+    chunk.Head = offset + size;
+    if (!chunk.IsPending)
+    {
+        chunk.IsPending = true;
+        Vk.UploadChunksPending.push_back(Vk.UploadChunkCurr);
+    }
+
+    Vk.UploadBytesPending += size;
+    Vk.UploadStats.Occupancy += size;
+    Vk.UploadStats.PeakOccupancy = VkMax(Vk.UploadStats.PeakOccupancy, Vk.UploadStats.Occupancy);
+
+    VkAllocation allocation;
+    allocation.Buffer = chunk.Buffer;
+    allocation.Offset = offset;
+    allocation.Data = chunk.MappedData + offset;
+    return allocation;
+}
+
+VkAllocation VkAllocateUploadBuffer(VkDeviceSize size, VkDeviceSize alignment)
+{
+	const uint32_t worker_index = JobGetWorkerIndex();
+	if (worker_index == 0)
+	{
+		std::lock_guard<std::mutex> lock(Vk.UploadMutex);
+		return AllocateUploadBuffer(size, alignment);
+	}
+
+	// Job workers carve allocations out of a block of their own, so they only lock to take the next block.
+	// Offsets are aligned within the buffer, not the block, as the block is only aligned to what it was taken with.
+	VkRecordThread& record_thread = Vk.RecordThreads[worker_index];
+	VkDeviceSize offset = VkAlignUp(record_thread.UploadBlock.Offset + record_thread.UploadBlockHead, alignment);
+	if (record_thread.UploadBlock.Buffer == VK_NULL_HANDLE || offset + size > record_thread.UploadBlock.Offset + record_thread.UploadBlockSize)
+	{
+		// The rest of the block is left unused until the frame retires
+		std::lock_guard<std::mutex> lock(Vk.UploadMutex);
+		record_thread.UploadBlockSize = VkMax(size, RECORD_THREAD_UPLOAD_BLOCK_SIZE);
+		record_thread.UploadBlock = AllocateUploadBuffer(record_thread.UploadBlockSize, alignment);
+		offset = record_thread.UploadBlock.Offset;
+	}
+	record_thread.UploadBlockHead = offset + size - record_thread.UploadBlock.Offset;
+
+	VkAllocation allocation;
+	allocation.Buffer = record_thread.UploadBlock.Buffer;
+	allocation.Offset = offset;
+	allocation.Data = record_thread.UploadBlock.Data + (offset - record_thread.UploadBlock.Offset);
+	return allocation;
+}
+
+VkAllocation VkAllocateDirectUploadBuffer(VkDeviceSize size, VkDeviceSize alignment)
+{
+	const VkAllocation allocation = VkAllocateUploadBuffer(size, alignment);
+	if (Vk.IsUploadDeviceLocal)
+	{
+		std::lock_guard<std::mutex> lock(Vk.UploadMutex);
+		Vk.UploadDirectBytesPending += size;
+	}
+	return allocation;
+}
+
+static const char* MEMORY_CATEGORY_NAMES[VK_MEMORY_CATEGORY_COUNT] =
+{
+	"Geometry",
+	"Textures",
+	"Acceleration Structures",
+	"Render Targets",
+	"Upload",
+	"Other",
+};
+
+static const VkMemoryPool MEMORY_CATEGORY_POOLS[VK_MEMORY_CATEGORY_COUNT] =
+{
+	VK_MEMORY_POOL_STATIC,		// Geometry
+	VK_MEMORY_POOL_STATIC,		// Textures
+	VK_MEMORY_POOL_STATIC,		// Acceleration Structures
+	VK_MEMORY_POOL_RESOLUTION,	// Render Targets
+	VK_MEMORY_POOL_TRANSIENT,	// Upload
+	VK_MEMORY_POOL_STATIC,		// Other
+};
+
+static const char* MEMORY_POOL_NAMES[VK_MEMORY_POOL_COUNT] =
+{
+	"Static",
+	"Resolution",
+	"Transient",
+};
+
+// The category is kept as the name of the allocation, which is how it is found again when the allocation is freed
+static VmaAllocationCreateInfo GetCategoryAllocationCreateInfo(const VmaAllocationCreateInfo& allocation_create_info, VkMemoryCategory category)
+{
+	VmaAllocationCreateInfo category_allocation_create_info = allocation_create_info;
+	category_allocation_create_info.flags |= VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
+	category_allocation_create_info.pUserData = const_cast<char*>(MEMORY_CATEGORY_NAMES[category]);
+	return category_allocation_create_info;
+}
+static void AddCategoryAllocation(VmaAllocation allocation, VkMemoryCategory category)
+{
+	VmaAllocationInfo allocation_info = {};
+	vmaGetAllocationInfo(Vk.Allocator, allocation, &allocation_info);
+	Vk.MemoryCategoryStats[category].Bytes += allocation_info.size;
+	++Vk.MemoryCategoryStats[category].AllocationCount;
+}
+static VkMemoryCategory GetAllocationCategory(VmaAllocation allocation, VkDeviceSize* size = NULL)
+{
+	VmaAllocationInfo allocation_info = {};
+	vmaGetAllocationInfo(Vk.Allocator, allocation, &allocation_info);
+	if (size != NULL)
+	{
+		*size = allocation_info.size;
+	}
+	if (allocation_info.pUserData == NULL)
+	{
+		return VK_MEMORY_CATEGORY_COUNT;
+	}
+	for (uint32_t i = 0; i < VK_MEMORY_CATEGORY_COUNT; ++i)
+	{
+		if (strcmp(static_cast<const char*>(allocation_info.pUserData), MEMORY_CATEGORY_NAMES[i]) == 0)
+		{
+			return static_cast<VkMemoryCategory>(i);
+		}
+	}
+	return VK_MEMORY_CATEGORY_COUNT;
+}
+static void RemoveCategoryAllocation(VmaAllocation allocation)
+{
+	VkDeviceSize size = 0;
+	const VkMemoryCategory category = GetAllocationCategory(allocation, &size);
+	if (category == VK_MEMORY_CATEGORY_COUNT)
+	{
+		return;
+	}
+	Vk.MemoryCategoryStats[category].Bytes -= size;
+	--Vk.MemoryCategoryStats[category].AllocationCount;
+
+	// Leaves a hole for defragmentation to fill
+	if (MEMORY_CATEGORY_POOLS[category] == VK_MEMORY_POOL_STATIC)
+	{
+		Vk.IsDefragmented = false;
+	}
+}
+
+// Pools only hold one memory type, so every lifetime gets a pool per memory type its allocations end up in
+static VmaAllocationCreateInfo GetPoolAllocationCreateInfo(const VmaAllocationCreateInfo& allocation_create_info, VkMemoryCategory category, uint32_t memory_type_index)
+{
+	const VkMemoryPool memory_pool = MEMORY_CATEGORY_POOLS[category];
+	VmaPool& pool = Vk.MemoryPools[memory_pool][memory_type_index];
+	if (pool == VK_NULL_HANDLE)
+	{
+		VmaPoolCreateInfo pool_info = {};
+		pool_info.memoryTypeIndex = memory_type_index;
+		pool_info.blockSize = MEMORY_POOL_BLOCK_SIZES[memory_pool];
+		VK(vmaCreatePool(Vk.Allocator, &pool_info, &pool));
+	}
+
+	VmaAllocationCreateInfo pool_allocation_create_info = allocation_create_info;
+	pool_allocation_create_info.pool = pool;
+	return pool_allocation_create_info;
+}
+
+// The static pool must not change under a defragmentation pass, so while one is in flight its allocations go elsewhere
+static bool IsMemoryPoolAvailable(VkMemoryCategory category)
+{
+	return Vk.UseMemoryPools && (Vk.DefragmentationContext == VK_NULL_HANDLE || MEMORY_CATEGORY_POOLS[category] != VK_MEMORY_POOL_STATIC);
+}
+
+// Nor are static allocations freed under it. Their destruction is deferred until the frame that copied the pass has
+// retired, which is when the pass ends.
+static bool IsFreeDeferred(VmaAllocation allocation)
+{
+	if (Vk.DefragmentationContext == VK_NULL_HANDLE || allocation == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+	const VkMemoryCategory category = GetAllocationCategory(allocation);
+	return category != VK_MEMORY_CATEGORY_COUNT && MEMORY_CATEGORY_POOLS[category] == VK_MEMORY_POOL_STATIC;
+}
+
+// Hands the moves of the pass over to the allocator, which frees where they were, once its copies have run
+static void EndDefragmentationPass()
+{
+	VK(vmaEndDefragmentationPass(Vk.Allocator, Vk.DefragmentationContext));
+	VK(vmaDefragmentationEnd(Vk.Allocator, Vk.DefragmentationContext));
+	Vk.DefragmentationContext = VK_NULL_HANDLE;
+}
+
+void VkCreateBuffer(const VkBufferCreateInfo& buffer_info, const VmaAllocationCreateInfo& allocation_create_info, VkMemoryCategory category, VkBuffer& buffer, VmaAllocation& allocation, VmaAllocationInfo* allocation_info)
+{
+	const VmaAllocationCreateInfo category_allocation_create_info = GetCategoryAllocationCreateInfo(allocation_create_info, category);
+
+	uint32_t memory_type_index = 0;
+	if (IsMemoryPoolAvailable(category) && vmaFindMemoryTypeIndexForBufferInfo(Vk.Allocator, &buffer_info, &category_allocation_create_info, &memory_type_index) == VK_SUCCESS)
+	{
+		const VmaAllocationCreateInfo pool_allocation_create_info = GetPoolAllocationCreateInfo(category_allocation_create_info, category, memory_type_index);
+		if (vmaCreateBuffer(Vk.Allocator, &buffer_info, &pool_allocation_create_info, &buffer, &allocation, allocation_info) == VK_SUCCESS)
+		{
+			AddCategoryAllocation(allocation, category);
+			return;
+		}
+	}
+
+	VK(vmaCreateBuffer(Vk.Allocator, &buffer_info, &category_allocation_create_info, &buffer, &allocation, allocation_info));
+	AddCategoryAllocation(allocation, category);
+}
+
+void VkCreateImage(const VkImageCreateInfo& image_info, const VmaAllocationCreateInfo& allocation_create_info, VkMemoryCategory category, VkImage& image, VmaAllocation& allocation)
+{
+	const VmaAllocationCreateInfo category_allocation_create_info = GetCategoryAllocationCreateInfo(allocation_create_info, category);
+
+	uint32_t memory_type_index = 0;
+	if (IsMemoryPoolAvailable(category) && vmaFindMemoryTypeIndexForImageInfo(Vk.Allocator, &image_info, &category_allocation_create_info, &memory_type_index) == VK_SUCCESS)
+	{
+		const VmaAllocationCreateInfo pool_allocation_create_info = GetPoolAllocationCreateInfo(category_allocation_create_info, category, memory_type_index);
+		if (vmaCreateImage(Vk.Allocator, &image_info, &pool_allocation_create_info, &image, &allocation, NULL) == VK_SUCCESS)
+		{
+			AddCategoryAllocation(allocation, category);
+			return;
+		}
+	}
+
+	VK(vmaCreateImage(Vk.Allocator, &image_info, &category_allocation_create_info, &image, &allocation, NULL));
+	AddCategoryAllocation(allocation, category);
+}
+
+void VkAllocateMemory(const VkMemoryRequirements& requirements, const VmaAllocationCreateInfo& allocation_create_info, VkMemoryCategory category, VmaAllocation& allocation)
+{
+	const VmaAllocationCreateInfo category_allocation_create_info = GetCategoryAllocationCreateInfo(allocation_create_info, category);
+
+	uint32_t memory_type_index = 0;
+	if (IsMemoryPoolAvailable(category) && vmaFindMemoryTypeIndex(Vk.Allocator, requirements.memoryTypeBits, &category_allocation_create_info, &memory_type_index) == VK_SUCCESS)
+	{
+		const VmaAllocationCreateInfo pool_allocation_create_info = GetPoolAllocationCreateInfo(category_allocation_create_info, category, memory_type_index);
+		if (vmaAllocateMemory(Vk.Allocator, &requirements, &pool_allocation_create_info, &allocation, NULL) == VK_SUCCESS)
+		{
+			AddCategoryAllocation(allocation, category);
+			return;
+		}
+	}
+
+	VK(vmaAllocateMemory(Vk.Allocator, &requirements, &category_allocation_create_info, &allocation, NULL));
+	AddCategoryAllocation(allocation, category);
+}
+
+void VkDestroyBuffer(VkBuffer buffer, VmaAllocation allocation)
+{
+	if (IsFreeDeferred(allocation))
+	{
+		VkDestroyDeferred([=]() { VkDestroyBuffer(buffer, allocation); });
+		return;
+	}
+	if (allocation != VK_NULL_HANDLE)
+	{
+		RemoveCategoryAllocation(allocation);
+	}
+	vmaDestroyBuffer(Vk.Allocator, buffer, allocation);
+}
+
+void VkDestroyImage(VkImage image, VmaAllocation allocation)
+{
+	if (IsFreeDeferred(allocation))
+	{
+		VkDestroyDeferred([=]() { VkDestroyImage(image, allocation); });
+		return;
+	}
+	if (allocation != VK_NULL_HANDLE)
+	{
+		RemoveCategoryAllocation(allocation);
+	}
+	vmaDestroyImage(Vk.Allocator, image, allocation);
+}
+
+void VkFreeMemory(VmaAllocation allocation)
+{
+	if (IsFreeDeferred(allocation))
+	{
+		VkDestroyDeferred([=]() { VkFreeMemory(allocation); });
+		return;
+	}
+	if (allocation != VK_NULL_HANDLE)
+	{
+		RemoveCategoryAllocation(allocation);
+	}
+	vmaFreeMemory(Vk.Allocator, allocation);
+}
+
+const char* VkGetMemoryCategoryName(VkMemoryCategory category)
+{
+	return MEMORY_CATEGORY_NAMES[category];
+}
+
+const char* VkGetMemoryPoolName(VkMemoryPool pool)
+{
+	return MEMORY_POOL_NAMES[pool];
+}
+
+VkMemoryPoolStats VkGetMemoryPoolStats(VkMemoryPool pool)
+{
+	VkMemoryPoolStats stats = {};
+	for (VmaPool memory_type_pool : Vk.MemoryPools[pool])
+	{
+		if (memory_type_pool == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+
+		VmaPoolStats pool_stats = {};
+		vmaGetPoolStats(Vk.Allocator, memory_type_pool, &pool_stats);
+		stats.BlockBytes += pool_stats.size;
+		stats.UsedBytes += pool_stats.size - pool_stats.unusedSize;
+		stats.LargestFreeRange = VkMax(stats.LargestFreeRange, pool_stats.unusedRangeSizeMax);
+		stats.BlockCount += static_cast<uint32_t>(pool_stats.blockCount);
+		stats.AllocationCount += static_cast<uint32_t>(pool_stats.allocationCount);
+		stats.FreeRangeCount += static_cast<uint32_t>(pool_stats.unusedRangeCount);
+	}
+	return stats;
+}
+
+VkMemoryPoolStats VkGetMemoryTotalStats()
+{
+	VmaStats vma_stats = {};
+	vmaCalculateStats(Vk.Allocator, &vma_stats);
+
+	VkMemoryPoolStats stats = {};
+	stats.BlockBytes = vma_stats.total.usedBytes + vma_stats.total.unusedBytes;
+	stats.UsedBytes = vma_stats.total.usedBytes;
+	stats.LargestFreeRange = vma_stats.total.unusedRangeSizeMax;
+	stats.BlockCount = vma_stats.total.blockCount;
+	stats.AllocationCount = vma_stats.total.allocationCount;
+	stats.FreeRangeCount = vma_stats.total.unusedRangeCount;
+	return stats;
+}
+
+float VkGetMemoryFragmentation(const VkMemoryPoolStats& stats)
+{
+	const VkDeviceSize free_bytes = stats.BlockBytes - stats.UsedBytes;
+	return free_bytes > 0 ? 1.0f - static_cast<float>(stats.LargestFreeRange) / static_cast<float>(free_bytes) : 0.0f;
+}
+
+void VkWriteMemoryStats(const char* filepath)
+{
+	char* stats = NULL;
+	vmaBuildStatsString(Vk.Allocator, &stats, VK_TRUE);
+	{
+		std::ofstream file(filepath, std::ios::trunc);
+		if (file.is_open())
+		{
+			file << stats;
+		}
+		else
+		{
+			printf("Warning: Failed to write memory statistics to %s\n", filepath);
+		}
+	}
+	vmaFreeStatsString(Vk.Allocator, stats);
+}
+
+void VkAddMovableBuffer(VkBuffer& buffer, VmaAllocation allocation, const VkBufferCreateInfo& buffer_info)
+{
+	assert((buffer_info.usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) && (buffer_info.usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT));
+
+	VkMovable movable = {};
+	movable.Allocation = allocation;
+	movable.Buffer = &buffer;
+	movable.BufferInfo = buffer_info;
+	movable.BufferInfo.pNext = NULL;
+	movable.BufferInfo.queueFamilyIndexCount = 0;
+	movable.BufferInfo.pQueueFamilyIndices = NULL;
+	Vk.Movables.push_back(movable);
+	Vk.IsDefragmented = false;
+}
+
+void VkAddMovableTexture(VkTexture& texture, VkImageAspectFlags aspect_mask)
+{
+	assert((texture.Usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) && (texture.Usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT));
+
+	VkMovable movable = {};
+	movable.Allocation = texture.ImageAllocation;
+	movable.Texture = &texture;
+	movable.AspectMask = aspect_mask;
+	Vk.Movables.push_back(movable);
+	Vk.IsDefragmented = false;
+}
+
+void VkRemoveMovable(VmaAllocation allocation)
+{
+	for (size_t i = 0; i < Vk.Movables.size(); ++i)
+	{
+		if (Vk.Movables[i].Allocation == allocation)
+		{
+			Vk.Movables[i] = Vk.Movables.back();
+			Vk.Movables.pop_back();
+			return;
+		}
+	}
+}
+
+static VkMovable& FindMovable(VmaAllocation allocation)
+{
+	for (VkMovable& movable : Vk.Movables)
+	{
+		if (movable.Allocation == allocation)
+		{
+			return movable;
+		}
+	}
+	VkError("Defragmentation moved an allocation that is not movable");
+	return Vk.Movables.front();
+}
+
+const std::vector<VkMove>& VkDefragment(VkCommandBuffer cmd, VkDeviceSize max_bytes)
+{
+	Vk.DefragmentationMoves.clear();
+
+	// One pass at a time, the next one starts once the frame that copied the last one has retired
+	if (!Vk.UseMemoryPools || max_bytes == 0 || Vk.IsDefragmented || Vk.DefragmentationContext != VK_NULL_HANDLE || Vk.Movables.empty())
+	{
+		return Vk.DefragmentationMoves;
+	}
+
+	TRACE_ZONE("Defragment");
+
+	const float fragmentation = VkGetMemoryFragmentation(VkGetMemoryPoolStats(VK_MEMORY_POOL_STATIC));
+
+	Vk.DefragmentationAllocations.clear();
+	for (const VkMovable& movable : Vk.Movables)
+	{
+		Vk.DefragmentationAllocations.push_back(movable.Allocation);
+	}
+
+	// Each context moves at most max_bytes, so every frame gets one of its own
+	VmaDefragmentationInfo2 defragmentation_info = {};
+	defragmentation_info.flags = VMA_DEFRAGMENTATION_FLAG_INCREMENTAL;
+	defragmentation_info.allocationCount = static_cast<uint32_t>(Vk.DefragmentationAllocations.size());
+	defragmentation_info.pAllocations = Vk.DefragmentationAllocations.data();
+	defragmentation_info.maxCpuBytesToMove = max_bytes;
+	defragmentation_info.maxCpuAllocationsToMove = UINT32_MAX;
+	defragmentation_info.maxGpuBytesToMove = max_bytes;
+	defragmentation_info.maxGpuAllocationsToMove = UINT32_MAX;
+	const VkResult begin_result = vmaDefragmentationBegin(Vk.Allocator, &defragmentation_info, NULL, &Vk.DefragmentationContext);
+	if (begin_result != VK_SUCCESS && begin_result != VK_NOT_READY)
+	{
+		VkError("vmaDefragmentationBegin returned with erroneous result code " + std::to_string(static_cast<uint32_t>(begin_result)));
+	}
+
+	Vk.DefragmentationPassMoves.resize(Vk.Movables.size());
+	VmaDefragmentationPassInfo pass_info = {};
+	pass_info.moveCount = static_cast<uint32_t>(Vk.DefragmentationPassMoves.size());
+	pass_info.pMoves = Vk.DefragmentationPassMoves.data();
+	vmaBeginDefragmentationPass(Vk.Allocator, Vk.DefragmentationContext, &pass_info);
+
+	// Allocations larger than max_bytes never move, so they end defragmentation too
+	if (pass_info.moveCount == 0)
+	{
+		EndDefragmentationPass();
+		Vk.IsDefragmented = true;
+		return Vk.DefragmentationMoves;
+	}
+
+	if (Vk.DefragmentationStats.PassCount == 0)
+	{
+		Vk.DefragmentationStats.FragmentationBefore = fragmentation;
+	}
+	++Vk.DefragmentationStats.PassCount;
+	Vk.DefragmentationStats.AllocationsMoved += pass_info.moveCount;
+	Vk.DefragmentationFrameSemaphoreValue = Vk.FrameSemaphoreValue + 1;
+
+	// Old and new image of every texture. The barriers after the copies reuse the front of the array, each of them
+	// only overwrites barriers that have already been read.
+	VkImageMemoryBarrier2KHR* image_barriers = static_cast<VkImageMemoryBarrier2KHR*>(VkAllocateFrameMemory(2 * pass_info.moveCount * sizeof(VkImageMemoryBarrier2KHR)));
+	uint32_t image_barrier_count = 0;
+
+	for (uint32_t i = 0; i < pass_info.moveCount; ++i)
+	{
+		const VmaDefragmentationPassMoveInfo& pass_move = pass_info.pMoves[i];
+		VkMovable& movable = FindMovable(pass_move.allocation);
+
+		VkMove move = {};
+		if (movable.Buffer != NULL)
+		{
+			move.OldBuffer = *movable.Buffer;
+			VK(vkCreateBuffer(Vk.Device, &movable.BufferInfo, NULL, &move.NewBuffer));
+			VK(vkBindBufferMemory(Vk.Device, move.NewBuffer, pass_move.memory, pass_move.offset));
+			if (movable.BufferInfo.usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+			{
+				VkBufferDeviceAddressInfoKHR device_address_info = {};
+				device_address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR;
+				device_address_info.buffer = move.OldBuffer;
+				move.OldAddress = vkGetBufferDeviceAddressKHR(Vk.Device, &device_address_info);
+				device_address_info.buffer = move.NewBuffer;
+				move.NewAddress = vkGetBufferDeviceAddressKHR(Vk.Device, &device_address_info);
+			}
+			Vk.DefragmentationStats.BytesMoved += movable.BufferInfo.size;
+		}
+		else
+		{
+			const VkTexture& texture = *movable.Texture;
+			const VkTexture moved_texture = VkTextureCreateAt(texture, pass_move.memory, pass_move.offset);
+			move.OldImageView = texture.ImageView;
+			move.NewImageView = moved_texture.ImageView;
+
+			VkMemoryRequirements memory_requirements = {};
+			vkGetImageMemoryRequirements(Vk.Device, moved_texture.Image, &memory_requirements);
+			Vk.DefragmentationStats.BytesMoved += memory_requirements.size;
+
+			VkImageMemoryBarrier2KHR barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+			barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+			barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT_KHR;
+			barrier.oldLayout = texture.State.Layout;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = texture.Image;
+			barrier.subresourceRange.aspectMask = movable.AspectMask;
+			barrier.subresourceRange.baseMipLevel = 0;
+			barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+			barrier.subresourceRange.baseArrayLayer = 0;
+			barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+			image_barriers[image_barrier_count++] = barrier;
+
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE_KHR;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.image = moved_texture.Image;
+			image_barriers[image_barrier_count++] = barrier;
+		}
+		Vk.DefragmentationMoves.push_back(move);
+	}
+
+	// Whatever the frames before wrote into the old places has to land before it is copied
+	VkMemoryBarrier2KHR memory_barrier = {};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+	memory_barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+	memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+	memory_barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+
+	VkDependencyInfoKHR dependency_info = {};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+	dependency_info.memoryBarrierCount = 1;
+	dependency_info.pMemoryBarriers = &memory_barrier;
+	dependency_info.imageMemoryBarrierCount = image_barrier_count;
+	dependency_info.pImageMemoryBarriers = image_barriers;
+	vkCmdPipelineBarrier2KHR(cmd, &dependency_info);
+
+	VkPushLabel(cmd, "Defragment");
+	image_barrier_count = 0;
+	for (uint32_t i = 0; i < pass_info.moveCount; ++i)
+	{
+		VkMovable& movable = FindMovable(pass_info.pMoves[i].allocation);
+		const VkMove& move = Vk.DefragmentationMoves[i];
+		if (movable.Buffer != NULL)
+		{
+			VkBufferCopy region = {};
+			region.size = movable.BufferInfo.size;
+			vkCmdCopyBuffer(cmd, move.OldBuffer, move.NewBuffer, 1, &region);
+
+			const VkBuffer old_buffer = move.OldBuffer;
+			VkDestroyDeferred([=]() { vkDestroyBuffer(Vk.Device, old_buffer, NULL); });
+			*movable.Buffer = move.NewBuffer;
+		}
+		else
+		{
+			VkTexture& texture = *movable.Texture;
+			const VkImage new_image = image_barriers[2 * image_barrier_count + 1].image;
+
+			VkImageCopy* regions = static_cast<VkImageCopy*>(VkAllocateFrameMemory(texture.MipLevels * sizeof(VkImageCopy)));
+			for (uint32_t mip = 0; mip < texture.MipLevels; ++mip)
+			{
+				VkImageCopy& region = regions[mip];
+				region = {};
+				region.srcSubresource.aspectMask = movable.AspectMask;
+				region.srcSubresource.mipLevel = mip;
+				region.srcSubresource.layerCount = 1;
+				region.dstSubresource = region.srcSubresource;
+				region.extent.width = VkMax(texture.Width >> mip, 1U);
+				region.extent.height = VkMax(texture.Height >> mip, 1U);
+				region.extent.depth = VkMax(texture.Depth >> mip, 1U);
+			}
+			vkCmdCopyImage(cmd, texture.Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, new_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.MipLevels, regions);
+
+			// Back into the layout the old image was in, the barrier waits on everything after it
+			VkImageMemoryBarrier2KHR& barrier = image_barriers[image_barrier_count];
+			barrier = image_barriers[2 * image_barrier_count + 1];
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+			barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+			barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT_KHR | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = texture.State.Layout;
+			++image_barrier_count;
+
+			const VkImage old_image = texture.Image;
+			const VkImageView old_image_view = texture.ImageView;
+			VkDestroyDeferred([=]()
+				{
+					vkDestroyImageView(Vk.Device, old_image_view, NULL);
+					vkDestroyImage(Vk.Device, old_image, NULL);
+				});
+
+			const VkImageLayout layout = texture.State.Layout;
+			texture.Image = new_image;
+			texture.ImageView = move.NewImageView;
+			texture.State = {};
+			texture.State.Layout = layout;
+		}
+	}
+	VkPopLabel(cmd);
+
+	memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+	memory_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+	memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+	memory_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT_KHR | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+	dependency_info.imageMemoryBarrierCount = image_barrier_count;
+	vkCmdPipelineBarrier2KHR(cmd, &dependency_info);
+
+	return Vk.DefragmentationMoves;
+}
+
+void* VkArenaAllocate(VkArena& arena, size_t size, size_t alignment)
+{
+	for (;;)
+	{
+		if (arena.BlockIndex < arena.Blocks.size())
+		{
+			std::vector<uint8_t>& block = arena.Blocks[arena.BlockIndex];
+			const uintptr_t base = reinterpret_cast<uintptr_t>(block.data());
+			const size_t offset = static_cast<size_t>(VkAlignUp<uintptr_t>(base + arena.Offset, alignment) - base);
+			if (offset + size <= block.size())
+			{
+				arena.Offset = offset + size;
+				return block.data() + offset;
+			}
+
+			// The rest of the block is left unused until the arena is reset
+			++arena.BlockIndex;
+			arena.Offset = 0;
+		}
+		else
+		{
+			arena.Blocks.emplace_back(VkMax(ARENA_BLOCK_SIZE, size + alignment));
+		}
+	}
+}
+void VkArenaReset(VkArena& arena)
+{
+	arena.BlockIndex = 0;
+	arena.Offset = 0;
+}
+
+void* VkAllocateFrameMemory(size_t size, size_t alignment)
+{
+	const uint32_t worker_index = JobGetWorkerIndex();
+	if (worker_index == 0)
+		return VkArenaAllocate(Vk.FrameArenas[Vk.FrameIndexCurr], size, alignment);
+
+	return VkArenaAllocate(Vk.RecordThreads[worker_index].FrameArenas[Vk.FrameIndexCurr], size, alignment);
+}
+
+uint32_t VkGetRecordThreadCount()
+{
+	return static_cast<uint32_t>(Vk.RecordThreads.size());
+}
+
+VkCommandBuffer VkBeginSecondaryCommands(VkRenderPass render_pass, VkFramebuffer framebuffer)
+{
+	VkRecordThread& record_thread = Vk.RecordThreads[JobGetWorkerIndex()];
+	std::vector<VkCommandBuffer>& command_buffers = record_thread.SecondaryCommandBuffers[Vk.FrameIndexCurr];
+	uint32_t& command_buffers_used = record_thread.SecondaryCommandBuffersUsed[Vk.FrameIndexCurr];
+	if (command_buffers_used == command_buffers.size())
+	{
+		VkCommandBufferAllocateInfo command_buffer_info = {};
+		command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_info.commandPool = record_thread.CommandPools[Vk.FrameIndexCurr];
+		command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		command_buffer_info.commandBufferCount = 1;
+		command_buffers.push_back(VK_NULL_HANDLE);
+		VK(vkAllocateCommandBuffers(Vk.Device, &command_buffer_info, &command_buffers.back()));
+	}
+	VkCommandBuffer cmd = command_buffers[command_buffers_used++];
+
+	VkCommandBufferInheritanceInfo inheritance_info = {};
+	inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance_info.renderPass = render_pass;
+	inheritance_info.subpass = 0;
+	inheritance_info.framebuffer = framebuffer;
+
+	VkCommandBufferBeginInfo cmd_begin_info = {};
+	cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | (render_pass != VK_NULL_HANDLE ? VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT : 0);
+	cmd_begin_info.pInheritanceInfo = &inheritance_info;
+	VK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+	return cmd;
+}
+
+// Called once the frame's fence is signaled, so every query of the frame is available
+static void ReadTimestampLabels(uint32_t frame_index)
+{
+	std::vector<VkTimestampLabel>& labels = Vk.TimestampLabelsInFlight[frame_index];
+	if (labels.empty())
+		return;
+
+	uint64_t timestamps[TIMESTAMP_QUERY_POOL_SIZE];
+	const uint32_t query_count = static_cast<uint32_t>(labels.size()) * 2;
+	VK(vkGetQueryPoolResults(Vk.Device, Vk.TimestampQueryPools[frame_index], 0, query_count, sizeof(uint64_t) * query_count, timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+	const double timestamp_period = static_cast<double>(Vk.PhysicalDeviceProperties.limits.timestampPeriod) * 1e-6;
+
+	const bool is_capturing = TraceIsCapturing();
+
+	for (const VkTimestampLabel& label : labels)
+	{
+		VkTimestampLabelHistory& history = Vk.TimestampLabelsResult[label.Label];
+
+		if (is_capturing)
+		{
+			auto to_cpu_time = [&](uint64_t timestamp) { return Vk.TimestampCalibrationCpu + static_cast<int64_t>(static_cast<double>(static_cast<int64_t>(timestamp - Vk.TimestampCalibrationGpu)) * Vk.PhysicalDeviceProperties.limits.timestampPeriod); };
+			TraceAddZone(TRACE_TRACK_GPU, history.Name, to_cpu_time(timestamps[label.Query]), to_cpu_time(timestamps[label.Query + 1]));
+		}
+
+		history.Samples[history.SampleCount % TIMESTAMP_HISTORY_SIZE] = static_cast<float>(static_cast<double>(timestamps[label.Query + 1] - timestamps[label.Query]) * timestamp_period);
+		++history.SampleCount;
+	}
+	labels.clear();
+}
+
+static VkCommandBuffer GetTransferCommandBuffer()
+{
+	if (Vk.TransferCommandBuffer != VK_NULL_HANDLE)
+		return Vk.TransferCommandBuffer;
+
+	// Reuse the oldest command buffer if the transfer queue is done with it
+	uint64_t completed_value = 0;
+	VK(vkGetSemaphoreCounterValue(Vk.Device, Vk.TransferSemaphore, &completed_value));
+	if (!Vk.TransferCommandBuffersInFlight.empty() && Vk.TransferCommandBuffersInFlight.front().second <= completed_value)
+	{
+		Vk.TransferCommandBuffer = Vk.TransferCommandBuffersInFlight.front().first;
+		Vk.TransferCommandBuffersInFlight.erase(Vk.TransferCommandBuffersInFlight.begin());
+		VK(vkResetCommandBuffer(Vk.TransferCommandBuffer, 0));
+	}
+	else
+	{
+		VkCommandBufferAllocateInfo command_buffer_info = {};
+		command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_info.commandPool = Vk.TransferCommandPool;
+		command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_buffer_info.commandBufferCount = 1;
+		VK(vkAllocateCommandBuffers(Vk.Device, &command_buffer_info, &Vk.TransferCommandBuffer));
+	}
+
+	VkCommandBufferBeginInfo cmd_begin_info = {};
+	cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK(vkBeginCommandBuffer(Vk.TransferCommandBuffer, &cmd_begin_info));
+
+	return Vk.TransferCommandBuffer;
+}
+
+VkCommandBuffer VkBeginTransferCommands()
+{
+	assert(Vk.IsTransferQueueSupported);
+	return GetTransferCommandBuffer();
+}
+void VkEndTransferCommands(VkDeviceSize upload_size)
+{
+	if (!Vk.IsTransferQueueSupported)
+		return;
+
+	// Submit in batches so that the copies start while more data is being loaded
+	Vk.TransferBytesPending += upload_size;
+	if (Vk.TransferBytesPending >= TRANSFER_BATCH_SIZE)
+	{
+		VkFlushTransferCommands();
+	}
+}
+void VkFlushTransferCommands()
+{
+	if (Vk.TransferCommandBuffer == VK_NULL_HANDLE)
+		return;
+
+	VK(vkEndCommandBuffer(Vk.TransferCommandBuffer));
+
+	++Vk.TransferSemaphoreValue;
+
+	VkTimelineSemaphoreSubmitInfo timeline_info = {};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues = &Vk.TransferSemaphoreValue;
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = &timeline_info;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &Vk.TransferCommandBuffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &Vk.TransferSemaphore;
+	VK(vkQueueSubmit(Vk.TransferQueue, 1, &submit_info, VK_NULL_HANDLE));
+
+	Vk.TransferCommandBuffersInFlight.push_back({ Vk.TransferCommandBuffer, Vk.TransferSemaphoreValue });
+	Vk.TransferCommandBuffer = VK_NULL_HANDLE;
+	Vk.TransferBytesPending = 0;
+}
+
+// Async compute splits the frame into more command buffers than the two it always has, which are kept for the next
+// frames that use the slot
+static VkCommandBuffer BeginSplitCommandBuffer(VkCommandPool pool, std::vector<VkCommandBuffer>& command_buffers, uint32_t& used)
+{
+    if (used == command_buffers.size())
+    {
+        VkCommandBufferAllocateInfo command_buffer_info = {};
+        command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        command_buffer_info.commandPool = pool;
+        command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        command_buffer_info.commandBufferCount = 1;
+        command_buffers.push_back(VK_NULL_HANDLE);
+        VK(vkAllocateCommandBuffers(Vk.Device, &command_buffer_info, &command_buffers.back()));
+    }
+    VkCommandBuffer cmd = command_buffers[used++];
+
+    VkCommandBufferBeginInfo cmd_begin_info = {};
+    cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+    return cmd;
+}
+
+static void SubmitFrameCommands(VkCommandBuffer cmd, bool is_last)
+{
+    // Transfers have to be submitted before the commands that acquire their resources, and before the frame takes
+    // ownership of the upload memory they read from
+    VkFlushTransferCommands();
+
+    VkSemaphore wait_semaphores[3];
+    uint64_t wait_values[3];
+    VkPipelineStageFlags wait_stage_flags[3];
+    uint32_t wait_semaphore_count = 0;
+    if (Vk.IsAcquireWaitPending)
+    {
+        wait_semaphores[wait_semaphore_count] = Vk.AcquireSemaphores[Vk.FrameIndexCurr];
+        wait_values[wait_semaphore_count] = 0;
+        wait_stage_flags[wait_semaphore_count] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        ++wait_semaphore_count;
+        Vk.IsAcquireWaitPending = false;
+    }
+    if (Vk.TransferSemaphoreValue > Vk.TransferSemaphoreValueWaited)
+    {
+        wait_semaphores[wait_semaphore_count] = Vk.TransferSemaphore;
+        wait_values[wait_semaphore_count] = Vk.TransferSemaphoreValue;
+        wait_stage_flags[wait_semaphore_count] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        ++wait_semaphore_count;
+        Vk.TransferSemaphoreValueWaited = Vk.TransferSemaphoreValue;
+    }
+
+    // The frame retires once its compute commands have run as well
+    if (is_last)
+    {
+        Vk.ComputeSemaphoreValueToWait = Vk.ComputeSemaphoreValue;
+    }
+    if (Vk.ComputeSemaphoreValueToWait > Vk.ComputeSemaphoreValueWaited)
+    {
+        wait_semaphores[wait_semaphore_count] = Vk.ComputeSemaphore;
+        wait_values[wait_semaphore_count] = Vk.ComputeSemaphoreValueToWait;
+        wait_stage_flags[wait_semaphore_count] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        ++wait_semaphore_count;
+        Vk.ComputeSemaphoreValueWaited = Vk.ComputeSemaphoreValueToWait;
+    }
+
+    VkSemaphore signal_semaphores[3];
+    uint64_t signal_values[3];
+    uint32_t signal_semaphore_count = 0;
+    if (Vk.UseAsyncCompute)
+    {
+        ++Vk.GraphicsSemaphoreValue;
+
+        signal_semaphores[signal_semaphore_count] = Vk.GraphicsSemaphore;
+        signal_values[signal_semaphore_count] = Vk.GraphicsSemaphoreValue;
+        ++signal_semaphore_count;
+    }
+    if (is_last)
+    {
+        ++Vk.FrameSemaphoreValue;
+        Vk.FrameSemaphoreValues[Vk.FrameIndexCurr] = Vk.FrameSemaphoreValue;
+
+        signal_semaphores[signal_semaphore_count] = Vk.FrameSemaphore;
+        signal_values[signal_semaphore_count] = Vk.FrameSemaphoreValue;
+        ++signal_semaphore_count;
+        if (!Vk.IsHeadless && Vk.IsBackBufferAcquired)
+        {
+            signal_semaphores[signal_semaphore_count] = Vk.PresentSemaphores[Vk.SwapchainImageIndex];
+            signal_values[signal_semaphore_count] = 0;
+            ++signal_semaphore_count;
+        }
     }
-	vkDestroyInstance(Vk.Instance, NULL);
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = wait_semaphore_count;
+    timeline_info.pWaitSemaphoreValues = wait_values;
+    timeline_info.signalSemaphoreValueCount = signal_semaphore_count;
+    timeline_info.pSignalSemaphoreValues = signal_values;
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = wait_semaphore_count;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stage_flags;
+    submit_info.signalSemaphoreCount = signal_semaphore_count;
+    submit_info.pSignalSemaphores = signal_semaphores;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd;
+    VK(vkQueueSubmit(Vk.GraphicsQueue, 1, &submit_info, VK_NULL_HANDLE));
 }
 
-void VkResize(uint32_t width, uint32_t height, VkDisplayMode display_mode)
+void VkWaitForFrameLatency(uint32_t max_queued_frames)
 {
-	DestroySwapchain();
-    CreateSwapchain(width, height, Vk.SwapchainImageCount, display_mode);
+    if (Vk.FrameSemaphoreValue <= max_queued_frames)
+        return;
+
+    TRACE_ZONE("Wait For Frame Latency");
+    const uint64_t wait_begin = TraceGetTime();
+
+    const uint64_t value = Vk.FrameSemaphoreValue - max_queued_frames;
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &Vk.FrameSemaphore;
+    wait_info.pValues = &value;
+    VK(vkWaitSemaphores(Vk.Device, &wait_info, UINT64_MAX));
+
+    Vk.FrameWaitTimePending += GetMillisecondsSince(wait_begin);
 }
 
-VkAllocation VkAllocateUploadBuffer(VkDeviceSize size, VkDeviceSize alignment)
+VkCommandBuffer VkBeginFrame()
 {
-    VkDeviceSize head = Vk.UploadBufferHead;
-    VkDeviceSize tail = Vk.UploadBufferTails[Vk.FrameIndexNext];
-
-    VkDeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
-    if (offset + size > UPLOAD_BUFFER_SIZE)
     {
-        offset = 0;
+        TRACE_ZONE("Wait For Frame");
+        const uint64_t wait_begin = TraceGetTime();
+        WaitForFrame(Vk.FrameIndexCurr);
+        Vk.FrameWaitTimePending += GetMillisecondsSince(wait_begin);
     }
 
-    if (offset + size > UPLOAD_BUFFER_SIZE || ((head - tail) & UPLOAD_BUFFER_MASK) > ((offset + size - tail) & UPLOAD_BUFFER_MASK))
+    uint64_t frame_semaphore_value = 0;
+    VK(vkGetSemaphoreCounterValue(Vk.Device, Vk.FrameSemaphore, &frame_semaphore_value));
+    if (Vk.DefragmentationContext != VK_NULL_HANDLE && frame_semaphore_value >= Vk.DefragmentationFrameSemaphoreValue)
     {
-        VkError("Upload buffer is out of memory");
+        EndDefragmentationPass();
     }
+    RunDeferredDestructions(frame_semaphore_value);
 
-    Vk.UploadBufferHead = offset + size;
+    // Lets the allocator refresh the budget it got from the driver
+    vmaSetCurrentFrameIndex(Vk.Allocator, static_cast<uint32_t>(Vk.FrameSemaphoreValue + 1));
 
-    VkAllocation allocation;
-    allocation.Buffer = Vk.UploadBuffer;
-    allocation.Offset = offset;
-    allocation.Data = Vk.UploadBufferMappedData + offset;
-    return allocation;
-}
+    ReleaseUploadChunks(Vk.FrameIndexCurr);
 
-void VkRecordCommands(const std::function<void(VkCommandBuffer)>& commands)
-{
-    Vk.RecordedCommands.emplace_back(commands);
-}
+    ResetDescriptorPools(Vk.FrameIndexCurr);
 
-VkCommandBuffer VkBeginFrame()
-{
-    VK(vkAcquireNextImageKHR(Vk.Device, Vk.Swapchain, UINT64_MAX, Vk.PresentSemaphores[Vk.FrameIndexCurr], VK_NULL_HANDLE, &Vk.SwapchainImageIndex));
+    VkArenaReset(Vk.FrameArenas[Vk.FrameIndexCurr]);
+
+    for (uint32_t t = 0; t < static_cast<uint32_t>(Vk.RecordThreads.size()); ++t)
+    {
+        VkRecordThread& record_thread = Vk.RecordThreads[t];
+        VK(vkResetCommandPool(Vk.Device, record_thread.CommandPools[Vk.FrameIndexCurr], 0));
+        record_thread.SecondaryCommandBuffersUsed[Vk.FrameIndexCurr] = 0;
+        if (t > 0)
+        {
+            ResetRecordThreadDescriptorPools(record_thread, Vk.FrameIndexCurr);
+            VkArenaReset(record_thread.FrameArenas[Vk.FrameIndexCurr]);
+        }
+
+        // The block belongs to a chunk that went in flight with the last frame
+        record_thread.UploadBlock = {};
+        record_thread.UploadBlockSize = 0;
+        record_thread.UploadBlockHead = 0;
+    }
 
-    VK(vkWaitForFences(Vk.Device, 1, &Vk.CommandBufferFences[Vk.FrameIndexCurr], VK_TRUE, UINT64_MAX));
-    VK(vkResetFences(Vk.Device, 1, &Vk.CommandBufferFences[Vk.FrameIndexCurr]));
+    Vk.SplitCommandBuffersUsed[Vk.FrameIndexCurr] = 0;
+    Vk.ComputeCommandBuffersUsed[Vk.FrameIndexCurr] = 0;
+    Vk.IsBackBufferAcquired = false;
 
-    VK(vkResetDescriptorPool(Vk.Device, Vk.DescriptorPools[Vk.FrameIndexCurr], 0));
+	ReadTimestampLabels(Vk.FrameIndexCurr);
 
     VkCommandBuffer cmd = Vk.CommandBuffers[Vk.FrameIndexCurr];
 
@@ -697,42 +2597,80 @@ VkCommandBuffer VkBeginFrame()
     cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     VK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+    Vk.FrameCommandBuffer = cmd;
 
-    for (const std::function<void(VkCommandBuffer)>& commands : Vk.RecordedCommands)
+	vkCmdResetQueryPool(cmd, Vk.TimestampQueryPools[Vk.FrameIndexCurr], 0, TIMESTAMP_QUERY_POOL_SIZE);
+	VkPushLabel(cmd, "Frame");
+
+    for (const VkRecordedCommand& recorded_command : Vk.RecordedCommands)
     {
-        commands(cmd);
+        recorded_command.Execute(recorded_command.Commands, cmd);
+        recorded_command.Destroy(recorded_command.Commands);
     }
     Vk.RecordedCommands.clear();
+    VkArenaReset(Vk.RecordedCommandsArena);
 
-	while (!Vk.TimestampLabelsInFlight.empty())
-	{
-		const std::pair<std::string, uint32_t>& label = Vk.TimestampLabelsInFlight.front();
+    return cmd;
+}
+VkCommandBuffer VkAcquireBackBuffer()
+{
+    // The GPU can start on the frame while the CPU waits for an image
+    VkCommandBuffer cmd = Vk.FrameCommandBuffer;
+    VK(vkEndCommandBuffer(cmd));
+    SubmitFrameCommands(cmd, false);
 
-		uint64_t timestamps[2];
-		VkResult result = vkGetQueryPoolResults(Vk.Device, Vk.TimestampQueryPool, label.second, 2, sizeof(uint64_t) * 2, timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
-		assert(result == VK_SUCCESS || result == VK_NOT_READY);
-		if (result == VK_NOT_READY)
-		{
-			break;
-		}
+    if (Vk.IsHeadless)
+    {
+        // Offscreen images are used in turn, the barrier below orders each use after the previous one
+        Vk.SwapchainImageIndex = (Vk.SwapchainImageIndex + 1) % Vk.SwapchainImageCount;
+        Vk.IsBackBufferAcquired = true;
+    }
+    else
+    {
+        TRACE_ZONE("vkAcquireNextImageKHR");
+        const uint64_t wait_begin = TraceGetTime();
+        VkResult acquire_result = vkAcquireNextImageKHR(Vk.Device, Vk.Swapchain, UINT64_MAX, Vk.AcquireSemaphores[Vk.FrameIndexCurr], VK_NULL_HANDLE, &Vk.SwapchainImageIndex);
+
+        // The frame is already underway, so rather than dropping it the swapchain is replaced in place, a bounded
+        // number of times and only while the window has an area to present to. Callers notice the new images through
+        // the generation. Otherwise the frame finishes without a back buffer, and the next resize replaces the
+        // swapchain once the window has a size again.
+        for (uint32_t retry = 0; acquire_result == VK_ERROR_OUT_OF_DATE_KHR && retry < SWAPCHAIN_ACQUIRE_RETRY_COUNT && IsSurfaceVisible(); ++retry)
+        {
+            RecreateSwapchain(Vk.SwapchainImageExtent.width, Vk.SwapchainImageExtent.height, Vk.DisplayMode, Vk.PresentMode);
+            acquire_result = vkAcquireNextImageKHR(Vk.Device, Vk.Swapchain, UINT64_MAX, Vk.AcquireSemaphores[Vk.FrameIndexCurr], VK_NULL_HANDLE, &Vk.SwapchainImageIndex);
+        }
+        if (acquire_result == VK_SUBOPTIMAL_KHR || acquire_result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            Vk.IsSwapchainOutOfDate = true;
+        }
+        else if (acquire_result != VK_SUCCESS)
+        {
+            VkError("vkAcquireNextImageKHR returned with erroneous result code " + std::to_string(static_cast<uint32_t>(acquire_result)));
+        }
+        Vk.FrameWaitTimePending += GetMillisecondsSince(wait_begin);
+        Vk.IsBackBufferAcquired = acquire_result != VK_ERROR_OUT_OF_DATE_KHR;
+        Vk.IsAcquireWaitPending = Vk.IsBackBufferAcquired;
+    }
 
-		const double timestamp_period = static_cast<double>(Vk.PhysicalDeviceProperties.limits.timestampPeriod) * 1e-6;
-		float duration = static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) * timestamp_period);
-		if (Vk.TimestampLabelsResult.find(label.first) == Vk.TimestampLabelsResult.end())
-		{
-			Vk.TimestampLabelsResult[label.first] = 0.0f;
-		}
-		Vk.TimestampLabelsResult[label.first] += (duration - Vk.TimestampLabelsResult[label.first]) * 0.25f;
+    cmd = Vk.BackBufferCommandBuffers[Vk.FrameIndexCurr];
 
-		Vk.TimestampLabelsInFlight.erase(Vk.TimestampLabelsInFlight.begin());
-	}
+    VkCommandBufferBeginInfo cmd_begin_info = {};
+    cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+    Vk.FrameCommandBuffer = cmd;
+
+    // The frame still finishes in this command buffer, only without drawing into a back buffer
+    if (!Vk.IsBackBufferAcquired)
+        return cmd;
 
     VkImageMemoryBarrier barrier;
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.pNext = NULL;
     barrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
     barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.oldLayout = Vk.IsHeadless ? GetBackBufferIdleLayout() : VK_IMAGE_LAYOUT_UNDEFINED;	// Swapchain images are overwritten every frame, which also covers the first use of new ones
     barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
@@ -748,68 +2686,150 @@ VkCommandBuffer VkBeginFrame()
 }
 void VkEndFrame()
 {
-    VkCommandBuffer cmd = Vk.CommandBuffers[Vk.FrameIndexCurr];
+    VkCommandBuffer cmd = Vk.FrameCommandBuffer;
 
-    VkImageMemoryBarrier barrier;
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.pNext = NULL;
-    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = Vk.SwapchainImages[Vk.SwapchainImageIndex];
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+	VkPopLabel(cmd);
 
-    VK(vkEndCommandBuffer(cmd));
+    if (Vk.IsBackBufferAcquired)
+    {
+        VkImageMemoryBarrier barrier;
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.pNext = NULL;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        barrier.newLayout = GetBackBufferIdleLayout();
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = Vk.SwapchainImages[Vk.SwapchainImageIndex];
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+    }
 
-    Vk.UploadBufferTails[Vk.FrameIndexCurr] = Vk.UploadBufferHead;
+    VK(vkEndCommandBuffer(cmd));
 
 	assert(Vk.TimestampLabelsPushed.empty());
 
-    VkPipelineStageFlags wait_stage_flags = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    SubmitFrameCommands(cmd, true);
+
+    // Upload memory allocated since the last frame is now owned by this frame
+    for (uint32_t index : Vk.UploadChunksPending)
+    {
+        ++Vk.UploadChunks[index].FramesInFlight;
+        Vk.UploadChunks[index].IsPending = false;
+    }
+    Vk.UploadChunksInFlight[Vk.FrameIndexCurr].swap(Vk.UploadChunksPending);
+    Vk.UploadChunksPending.clear();
+    Vk.UploadBytesInFlight[Vk.FrameIndexCurr] = Vk.UploadBytesPending;
+    Vk.UploadStats.BytesLastFrame = Vk.UploadBytesPending;
+    Vk.UploadBytesPending = 0;
+    Vk.UploadStats.StallTimeLastFrame = Vk.UploadStallTimePending;
+    Vk.UploadStats.StallTimeTotal += Vk.UploadStallTimePending;
+    Vk.UploadStallTimePending = 0.0f;
+    Vk.UploadStats.DirectBytesLastFrame = Vk.UploadDirectBytesPending;
+    Vk.UploadStats.DirectBytesTotal += Vk.UploadDirectBytesPending;
+    Vk.UploadDirectBytesPending = 0;
+
+    if (!Vk.IsHeadless && Vk.IsBackBufferAcquired)
+    {
+        VkPresentInfoKHR present_info = {};
+        present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        present_info.waitSemaphoreCount = 1;
+        present_info.pWaitSemaphores = &Vk.PresentSemaphores[Vk.SwapchainImageIndex];
+        present_info.swapchainCount = 1;
+        present_info.pSwapchains = &Vk.Swapchain;
+        present_info.pImageIndices = &Vk.SwapchainImageIndex;
+        TRACE_ZONE("vkQueuePresentKHR");
+        const uint64_t wait_begin = TraceGetTime();
+        const VkResult present_result = vkQueuePresentKHR(Vk.GraphicsQueue, &present_info);
+        if (present_result == VK_SUBOPTIMAL_KHR || present_result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            Vk.IsSwapchainOutOfDate = true;
+        }
+        else if (present_result != VK_SUCCESS)
+        {
+            VkError("vkQueuePresentKHR returned with erroneous result code " + std::to_string(static_cast<uint32_t>(present_result)));
+        }
+        Vk.FrameWaitTimePending += GetMillisecondsSince(wait_begin);
+    }
+
+    const uint64_t present_time = TraceGetTime();
+    Vk.FrameStats.PresentIntervalLastFrame = Vk.LastPresentTime == 0 ? 0.0f : static_cast<float>(static_cast<double>(present_time - Vk.LastPresentTime) * 1e-6);
+    Vk.LastPresentTime = present_time;
+    Vk.FrameStats.CpuWaitTimeLastFrame = Vk.FrameWaitTimePending;
+    Vk.FrameWaitTimePending = 0.0f;
+
+    Vk.FrameIndexCurr = Vk.FrameIndexNext;
+    Vk.FrameIndexNext = (Vk.FrameIndexCurr + 1) % Vk.FramesInFlight;
+}
+
+VkCommandBuffer VkSubmitGraphicsCommands()
+{
+    assert(Vk.UseAsyncCompute);
+
+    VK(vkEndCommandBuffer(Vk.FrameCommandBuffer));
+    SubmitFrameCommands(Vk.FrameCommandBuffer, false);
+
+    Vk.FrameCommandBuffer = BeginSplitCommandBuffer(Vk.CommandPool, Vk.SplitCommandBuffers[Vk.FrameIndexCurr], Vk.SplitCommandBuffersUsed[Vk.FrameIndexCurr]);
+    return Vk.FrameCommandBuffer;
+}
+VkCommandBuffer VkBeginComputeCommands()
+{
+    assert(Vk.UseAsyncCompute);
+
+    Vk.GraphicsSemaphoreValueToWait = Vk.GraphicsSemaphoreValue;
+    return BeginSplitCommandBuffer(Vk.ComputeCommandPool, Vk.ComputeCommandBuffers[Vk.FrameIndexCurr], Vk.ComputeCommandBuffersUsed[Vk.FrameIndexCurr]);
+}
+void VkEndComputeCommands(VkCommandBuffer cmd)
+{
+    VK(vkEndCommandBuffer(cmd));
+
+    // Transfers are not waited on here, the graphics commands waited on them before
+    ++Vk.ComputeSemaphoreValue;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = 1;
+    timeline_info.pWaitSemaphoreValues = &Vk.GraphicsSemaphoreValueToWait;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &Vk.ComputeSemaphoreValue;
+
+    const VkPipelineStageFlags wait_stage_flags = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
     VkSubmitInfo submit_info = {};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
     submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &Vk.PresentSemaphores[Vk.FrameIndexCurr];
+    submit_info.pWaitSemaphores = &Vk.GraphicsSemaphore;
     submit_info.pWaitDstStageMask = &wait_stage_flags;
     submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = &Vk.CommandBufferSemaphores[Vk.FrameIndexCurr];
+    submit_info.pSignalSemaphores = &Vk.ComputeSemaphore;
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &Vk.CommandBuffers[Vk.FrameIndexCurr];
-    VK(vkQueueSubmit(Vk.GraphicsQueue, 1, &submit_info, Vk.CommandBufferFences[Vk.FrameIndexCurr]));
-
-    VkPresentInfoKHR present_info = {};
-    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = &Vk.CommandBufferSemaphores[Vk.FrameIndexCurr];
-    present_info.swapchainCount = 1;
-    present_info.pSwapchains = &Vk.Swapchain;
-    present_info.pImageIndices = &Vk.SwapchainImageIndex;
-    VK(vkQueuePresentKHR(Vk.GraphicsQueue, &present_info));
-
-    Vk.FrameIndexCurr = Vk.FrameIndexNext;
-    Vk.FrameIndexNext = (Vk.FrameIndexCurr + 1) % Vk.SwapchainImageCount;
+    submit_info.pCommandBuffers = &cmd;
+    VK(vkQueueSubmit(Vk.ComputeQueue, 1, &submit_info, VK_NULL_HANDLE));
 }
-
-VkDescriptorSet VkCreateDescriptorSetForCurrentFrame(VkDescriptorSetLayout layout, std::initializer_list<VkDescriptorSetEntry> entries)
+void VkWaitComputeCommands()
 {
-    VkDescriptorSetAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = Vk.DescriptorPools[Vk.FrameIndexCurr];
-    alloc_info.descriptorSetCount = 1;
-    alloc_info.pSetLayouts = &layout;
+    Vk.ComputeSemaphoreValueToWait = Vk.ComputeSemaphoreValue;
+}
 
-    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
-    VK(vkAllocateDescriptorSets(Vk.Device, &alloc_info, &descriptor_set));
+void VkShareWithComputeQueue(VkImageCreateInfo& image_info, bool is_uploaded)
+{
+    if (Vk.UseAsyncCompute)
+    {
+        image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        image_info.queueFamilyIndexCount = is_uploaded ? Vk.ComputeSharingQueueFamilyCount : 2;
+        image_info.pQueueFamilyIndices = Vk.ComputeSharingQueueFamilies;
+    }
+}
 
-    std::vector<VkWriteDescriptorSet> write_info(entries.size());
+static void WriteDescriptorSet(VkDescriptorSet descriptor_set, std::initializer_list<VkDescriptorSetEntry> entries)
+{
+    VkWriteDescriptorSet* write_info = static_cast<VkWriteDescriptorSet*>(VkAllocateFrameMemory(sizeof(VkWriteDescriptorSet) * entries.size(), alignof(VkWriteDescriptorSet)));
+    memset(write_info, 0, sizeof(VkWriteDescriptorSet) * entries.size());
     for (size_t i = 0; i < entries.size(); ++i)
     {
         const VkDescriptorSetEntry& entry = *(entries.begin() + i);
@@ -843,11 +2863,199 @@ VkDescriptorSet VkCreateDescriptorSetForCurrentFrame(VkDescriptorSetLayout layou
                 break;
         }
     }
-    vkUpdateDescriptorSets(Vk.Device, static_cast<uint32_t>(write_info.size()), write_info.data(), 0, nullptr);
+    vkUpdateDescriptorSets(Vk.Device, static_cast<uint32_t>(entries.size()), write_info, 0, nullptr);
+}
+
+VkDescriptorSet VkCreateDescriptorSet(VkDescriptorPool pool, VkDescriptorSetLayout layout, std::initializer_list<VkDescriptorSetEntry> entries)
+{
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout;
+
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    VK(vkAllocateDescriptorSets(Vk.Device, &alloc_info, &descriptor_set));
+
+    WriteDescriptorSet(descriptor_set, entries);
+
+    return descriptor_set;
+}
+
+static VkDescriptorSet AllocateDescriptorSetForCurrentFrame(VkDescriptorSetLayout layout)
+{
+    const uint32_t worker_index = JobGetWorkerIndex();
+    VkRecordThread& record_thread = Vk.RecordThreads[worker_index];
+    std::vector<VkDescriptorPool>& pools = worker_index == 0 ? Vk.DescriptorPools[Vk.FrameIndexCurr] : record_thread.DescriptorPools[Vk.FrameIndexCurr];
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = pools.back();
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout;
+
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    VkResult alloc_result = vkAllocateDescriptorSets(Vk.Device, &alloc_info, &descriptor_set);
+    if (alloc_result == VK_ERROR_OUT_OF_POOL_MEMORY || alloc_result == VK_ERROR_FRAGMENTED_POOL)
+    {
+        // Continue in a larger pool, the frame's pools are merged into one once the frame has retired
+        VkDescriptorPoolUsage& capacity = worker_index == 0 ? Vk.DescriptorPoolCapacity : record_thread.DescriptorPoolCapacity;
+        capacity.SetCount = VkMax(capacity.SetCount, DESCRIPTOR_POOL_MIN_SET_COUNT) * 2;
+        for (uint32_t i = 0; i < VK_DESCRIPTOR_POOL_TYPE_COUNT; ++i)
+        {
+            capacity.DescriptorCounts[i] = VkMax(capacity.DescriptorCounts[i], DESCRIPTOR_POOL_MIN_DESCRIPTOR_COUNT) * 2;
+        }
+        pools.push_back(CreateDescriptorPool(capacity));
+
+        alloc_info.descriptorPool = pools.back();
+        alloc_result = vkAllocateDescriptorSets(Vk.Device, &alloc_info, &descriptor_set);
+    }
+    VK(alloc_result);
+
+    if (worker_index == 0)
+    {
+        ++Vk.DescriptorPoolUsage[Vk.FrameIndexCurr].SetCount;
+    }
+
+    return descriptor_set;
+}
+
+VkDescriptorSet VkCreateDescriptorSetForCurrentFrame(VkDescriptorSetLayout layout, std::initializer_list<VkDescriptorSetEntry> entries)
+{
+    VkDescriptorSet descriptor_set = AllocateDescriptorSetForCurrentFrame(layout);
+
+    // Pool usage is counted from the descriptors written, which matches the layout as long as every binding is written
+    if (JobGetWorkerIndex() == 0)
+    {
+        VkDescriptorPoolUsage& usage = Vk.DescriptorPoolUsage[Vk.FrameIndexCurr];
+        for (const VkDescriptorSetEntry& entry : entries)
+        {
+            usage.DescriptorCounts[GetDescriptorPoolType(entry.Type)] += entry.ArrayCount;
+        }
+    }
+
+    WriteDescriptorSet(descriptor_set, entries);
+
+    return descriptor_set;
+}
+
+VkDescriptorSetTemplate VkCreateDescriptorSetTemplate(VkDescriptorSetLayout layout, const VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count)
+{
+    VkDescriptorSetTemplate set_template = {};
+    set_template.Layout = layout;
+
+    VkDescriptorUpdateTemplateEntry* template_entries = static_cast<VkDescriptorUpdateTemplateEntry*>(VkAllocateFrameMemory(sizeof(VkDescriptorUpdateTemplateEntry) * binding_count, alignof(VkDescriptorUpdateTemplateEntry)));
+    for (uint32_t i = 0; i < binding_count; ++i)
+    {
+        template_entries[i].dstBinding = bindings[i].binding;
+        template_entries[i].dstArrayElement = 0;
+        template_entries[i].descriptorCount = bindings[i].descriptorCount;
+        template_entries[i].descriptorType = bindings[i].descriptorType;
+        template_entries[i].offset = sizeof(VkDescriptorData) * set_template.DescriptorCount;
+        template_entries[i].stride = sizeof(VkDescriptorData);
+
+        set_template.DescriptorCount += bindings[i].descriptorCount;
+        set_template.PoolUsage.DescriptorCounts[GetDescriptorPoolType(bindings[i].descriptorType)] += bindings[i].descriptorCount;
+    }
+    set_template.PoolUsage.SetCount = 1;
+
+    VkDescriptorUpdateTemplateCreateInfo template_info = {};
+    template_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    template_info.descriptorUpdateEntryCount = binding_count;
+    template_info.pDescriptorUpdateEntries = template_entries;
+    template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    template_info.descriptorSetLayout = layout;
+    VK(vkCreateDescriptorUpdateTemplate(Vk.Device, &template_info, NULL, &set_template.UpdateTemplate));
+
+    return set_template;
+}
+
+void VkDestroyDescriptorSetTemplate(const VkDescriptorSetTemplate& set_template)
+{
+    vkDestroyDescriptorUpdateTemplate(Vk.Device, set_template.UpdateTemplate, NULL);
+}
+
+VkDescriptorSet VkCreateDescriptorSetForCurrentFrame(const VkDescriptorSetTemplate& set_template, std::initializer_list<VkDescriptorData> descriptors)
+{
+    assert(descriptors.size() == set_template.DescriptorCount);
+
+    VkDescriptorSet descriptor_set = AllocateDescriptorSetForCurrentFrame(set_template.Layout);
+
+    if (JobGetWorkerIndex() == 0)
+    {
+        VkDescriptorPoolUsage& usage = Vk.DescriptorPoolUsage[Vk.FrameIndexCurr];
+        for (uint32_t i = 0; i < VK_DESCRIPTOR_POOL_TYPE_COUNT; ++i)
+        {
+            usage.DescriptorCounts[i] += set_template.PoolUsage.DescriptorCounts[i];
+        }
+    }
+
+    vkUpdateDescriptorSetWithTemplate(Vk.Device, descriptor_set, set_template.UpdateTemplate, descriptors.begin());
 
     return descriptor_set;
 }
 
+uint32_t VkAddBindlessTexture(VkImageView image_view)
+{
+	if (Vk.BindlessTextureFreeList.empty())
+	{
+		VkError("Out of bindless texture slots");
+	}
+	const uint32_t index = Vk.BindlessTextureFreeList.back();
+	Vk.BindlessTextureFreeList.pop_back();
+
+	WriteDescriptorSet(Vk.BindlessDescriptorSet,
+		{
+			{ 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, index, image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		});
+	return index;
+}
+
+uint32_t VkAddBindlessBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (Vk.BindlessBufferFreeList.empty())
+	{
+		VkError("Out of bindless buffer slots");
+	}
+	const uint32_t index = Vk.BindlessBufferFreeList.back();
+	Vk.BindlessBufferFreeList.pop_back();
+
+	WriteDescriptorSet(Vk.BindlessDescriptorSet,
+		{
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, index, buffer, offset, size },
+		});
+	return index;
+}
+
+void VkRemoveBindlessTexture(uint32_t index)
+{
+	assert(index < BINDLESS_TEXTURE_CAPACITY);
+	Vk.BindlessTextureFreeList.push_back(index);
+}
+
+void VkRemoveBindlessBuffer(uint32_t index)
+{
+	assert(index < BINDLESS_BUFFER_CAPACITY);
+	Vk.BindlessBufferFreeList.push_back(index);
+}
+
+VkDescriptorData::VkDescriptorData(VkImageView image_view, VkImageLayout image_layout, VkSampler sampler)
+{
+    ImageInfo.sampler = sampler;
+    ImageInfo.imageView = image_view;
+    ImageInfo.imageLayout = image_layout;
+}
+VkDescriptorData::VkDescriptorData(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+{
+    BufferInfo.buffer = buffer;
+    BufferInfo.offset = offset;
+    BufferInfo.range = size;
+}
+VkDescriptorData::VkDescriptorData(VkAccelerationStructureKHR acceleration_structure)
+{
+    AccelerationStructureInfo = acceleration_structure;
+}
+
 VkDescriptorSetEntry::VkDescriptorSetEntry(uint32_t binding, VkDescriptorType type, uint32_t array_index, VkImageView image_view, VkImageLayout image_layout, VkSampler sampler)
 {
     Binding = binding;
@@ -912,28 +3120,173 @@ VkDescriptorSetEntry::VkDescriptorSetEntry(uint32_t binding, VkDescriptorType ty
 	}
 }
 
-void VkPushLabel(VkCommandBuffer cmd, const std::string& label)
+// Labels are interned the first time they are pushed, so that pushing a known label does not allocate
+static uint32_t InternLabel(const char* label)
+{
+	for (uint32_t i = 0; i < static_cast<uint32_t>(Vk.TimestampLabelsResult.size()); ++i)
+	{
+		VkTimestampLabelHistory& history = Vk.TimestampLabelsResult[i];
+		if (history.NamePointer == label)
+			return i;
+		if (history.Name == label)
+		{
+			history.NamePointer = label;
+			return i;
+		}
+	}
+
+	VkTimestampLabelHistory history;
+	history.Name = label;
+	history.NamePointer = label;
+	history.Parent = Vk.TimestampLabelsPushed.empty() ? UINT32_MAX : Vk.TimestampLabelsInFlight[Vk.FrameIndexCurr][Vk.TimestampLabelsPushed.back()].Label;
+	history.Depth = static_cast<uint32_t>(Vk.TimestampLabelsPushed.size());
+	history.Samples.resize(TIMESTAMP_HISTORY_SIZE, 0.0f);
+	history.SampleCount = 0;
+	Vk.TimestampLabelsResult.push_back(history);
+
+	const uint32_t index = static_cast<uint32_t>(Vk.TimestampLabelsResult.size()) - 1;
+
+	// Insert after the last label in the parent's subtree
+	auto order_itr = Vk.TimestampLabelsOrder.end();
+	if (history.Parent != UINT32_MAX)
+	{
+		order_itr = std::find(Vk.TimestampLabelsOrder.begin(), Vk.TimestampLabelsOrder.end(), history.Parent) + 1;
+		while (order_itr != Vk.TimestampLabelsOrder.end() && Vk.TimestampLabelsResult[*order_itr].Depth >= history.Depth)
+		{
+			++order_itr;
+		}
+	}
+	Vk.TimestampLabelsOrder.insert(order_itr, index);
+
+	return index;
+}
+
+void VkPushLabel(VkCommandBuffer cmd, const char* label)
 {
-	const uint32_t query = Vk.TimestampQueryPoolOffset;
-	Vk.TimestampQueryPoolOffset += 2;
-	if (Vk.TimestampQueryPoolOffset >= TIMESTAMP_QUERY_POOL_SIZE)
-		Vk.TimestampQueryPoolOffset = 0;
-	Vk.TimestampLabelsPushed.push_back({ label, query });
-    vkCmdResetQueryPool(cmd, Vk.TimestampQueryPool, query, 2);
-	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Vk.TimestampQueryPool, query);
+	std::vector<VkTimestampLabel>& labels = Vk.TimestampLabelsInFlight[Vk.FrameIndexCurr];
+	const uint32_t query = static_cast<uint32_t>(labels.size()) * 2;
+	if (query + 2 > TIMESTAMP_QUERY_POOL_SIZE)
+	{
+		VkError("Timestamp query pool is out of queries");
+	}
+	labels.push_back({ InternLabel(label), query });
+	Vk.TimestampLabelsPushed.push_back(static_cast<uint32_t>(labels.size()) - 1);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Vk.TimestampQueryPools[Vk.FrameIndexCurr], query);
 }
 void VkPopLabel(VkCommandBuffer cmd)
 {
 	assert(!Vk.TimestampLabelsPushed.empty());
-	const std::pair<std::string, uint32_t>& label = Vk.TimestampLabelsPushed.back();
-	Vk.TimestampLabelsInFlight.emplace_back(label);
+	const VkTimestampLabel& label = Vk.TimestampLabelsInFlight[Vk.FrameIndexCurr][Vk.TimestampLabelsPushed.back()];
 	Vk.TimestampLabelsPushed.pop_back();
-	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Vk.TimestampQueryPool, label.second + 1);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Vk.TimestampQueryPools[Vk.FrameIndexCurr], label.Query + 1);
+}
+void VkFlushTimestampLabels()
+{
+	// The current frame index is the oldest frame in flight
+	for (uint32_t i = 0; i < Vk.FramesInFlight; ++i)
+	{
+		ReadTimestampLabels((Vk.FrameIndexCurr + i) % Vk.FramesInFlight);
+	}
+}
+uint32_t VkFindLabel(const char* label)
+{
+	for (uint32_t i = 0; i < static_cast<uint32_t>(Vk.TimestampLabelsResult.size()); ++i)
+	{
+		if (Vk.TimestampLabelsResult[i].Name == label)
+			return i;
+	}
+	return UINT32_MAX;
+}
+float VkGetLabel(const char* label)
+{
+	const uint32_t index = VkFindLabel(label);
+	return index == UINT32_MAX ? 0.0f : VkGetLabelStats(index).P50;
+}
+VkLabelStats VkGetLabelStats(uint32_t label)
+{
+	VkLabelStats stats = {};
+
+	const VkTimestampLabelHistory& history = Vk.TimestampLabelsResult[label];
+	if (history.SampleCount == 0)
+		return stats;
+
+	const uint32_t sample_count = static_cast<uint32_t>(VkMin<uint64_t>(history.SampleCount, TIMESTAMP_HISTORY_SIZE));
+
+	float samples[TIMESTAMP_HISTORY_SIZE];
+	std::copy(history.Samples.begin(), history.Samples.begin() + sample_count, samples);
+	std::sort(samples, samples + sample_count);
+
+	// Nearest rank percentiles
+	auto percentile = [&](float p) { return samples[VkMin(static_cast<uint32_t>(p * static_cast<float>(sample_count)), sample_count - 1)]; };
+
+	stats.Last = history.Samples[(history.SampleCount - 1) % TIMESTAMP_HISTORY_SIZE];
+	stats.Min = samples[0];
+	stats.Max = samples[sample_count - 1];
+	stats.P50 = percentile(0.50f);
+	stats.P95 = percentile(0.95f);
+	stats.P99 = percentile(0.99f);
+	return stats;
 }
-float VkGetLabel(const std::string& label)
+
+void VkCalibrateTimestamps()
 {
-	auto label_itr = Vk.TimestampLabelsResult.find(label);
-	if (label_itr != Vk.TimestampLabelsResult.end())
-		return label_itr->second;
-	return 0.0f;
-}
\ No newline at end of file
+	if (Vk.IsCalibratedTimestampsSupported)
+	{
+		// The host clock is sampled around the call rather than through a host time domain, since the
+		// host domains differ per platform. The error is bounded by the duration of the call.
+		VkCalibratedTimestampInfoEXT timestamp_info = {};
+		timestamp_info.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+		timestamp_info.timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+
+		uint64_t max_deviation = 0;
+		const uint64_t cpu_begin = TraceGetTime();
+		VK(vkGetCalibratedTimestampsEXT(Vk.Device, 1, &timestamp_info, &Vk.TimestampCalibrationGpu, &max_deviation));
+		const uint64_t cpu_end = TraceGetTime();
+		Vk.TimestampCalibrationCpu = cpu_begin + (cpu_end - cpu_begin) / 2;
+		return;
+	}
+
+	// Without the extension, write a timestamp on the queue and wait for it. The host time taken
+	// after the wait is late by the latency of the fence signal.
+	VkQueryPoolCreateInfo query_pool_info = {};
+	query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_pool_info.queryCount = 1;
+	VkQueryPool query_pool;
+	VK(vkCreateQueryPool(Vk.Device, &query_pool_info, NULL, &query_pool));
+
+	VkCommandBufferAllocateInfo command_buffer_info = {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.commandPool = Vk.CommandPool;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandBufferCount = 1;
+	VkCommandBuffer cmd;
+	VK(vkAllocateCommandBuffers(Vk.Device, &command_buffer_info, &cmd));
+
+	VkCommandBufferBeginInfo cmd_begin_info = {};
+	cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+	vkCmdResetQueryPool(cmd, query_pool, 0, 1);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
+	VK(vkEndCommandBuffer(cmd));
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkFence fence;
+	VK(vkCreateFence(Vk.Device, &fence_info, NULL, &fence));
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &cmd;
+	VK(vkQueueSubmit(Vk.GraphicsQueue, 1, &submit_info, fence));
+	VK(vkWaitForFences(Vk.Device, 1, &fence, VK_TRUE, UINT64_MAX));
+	Vk.TimestampCalibrationCpu = TraceGetTime();
+
+	VK(vkGetQueryPoolResults(Vk.Device, query_pool, 0, 1, sizeof(uint64_t), &Vk.TimestampCalibrationGpu, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+	vkDestroyFence(Vk.Device, fence, NULL);
+	vkFreeCommandBuffers(Vk.Device, Vk.CommandPool, 1, &cmd);
+	vkDestroyQueryPool(Vk.Device, query_pool, NULL);
+}
@@ -5,11 +5,18 @@
 #define VMA_STATIC_VULKAN_FUNCTIONS 1
 #include <vk_mem_alloc.h>
 
+#include "Job.h"
+
+#include <cassert>
+#include <cstddef>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <stdexcept>
-#include <functional>
+#include <utility>
+#include <new>
+#include <type_traits>
+#include <mutex>
 
 inline void VkError(const std::string& message)
 {
@@ -33,6 +40,200 @@ inline T VkAlignUp(T value, T alignment)
 	return (value + alignment - 1) / alignment * alignment;
 }
 
+// Linear allocator whose blocks are kept on reset, so that allocating the same amount every frame only
+// touches the heap until the arena has grown to fit
+struct VkArena
+{
+	std::vector<std::vector<uint8_t>>						Blocks;
+	uint32_t												BlockIndex;
+	size_t													Offset;			// Into the current block
+};
+void*														VkArenaAllocate(VkArena& arena, size_t size, size_t alignment);
+void														VkArenaReset(VkArena& arena);
+
+// Commands are stored in an arena and run, then destroyed, when the next frame begins
+struct VkRecordedCommand
+{
+	void													(*Execute)(void* commands, VkCommandBuffer cmd);
+	void													(*Destroy)(void* commands);
+	void*													Commands;
+};
+
+// Destroyed once every frame submitted before it was queued, and the one being recorded, has retired on the GPU
+struct VkDeferredDestruction
+{
+	void													(*Destroy)(void* destruction);	// Also frees it
+	void*													Destruction;
+	uint64_t												FrameSemaphoreValue;
+};
+
+enum VkDescriptorPoolType
+{
+	VK_DESCRIPTOR_POOL_TYPE_SAMPLER = 0,
+	VK_DESCRIPTOR_POOL_TYPE_COMBINED_IMAGE_SAMPLER,
+	VK_DESCRIPTOR_POOL_TYPE_SAMPLED_IMAGE,
+	VK_DESCRIPTOR_POOL_TYPE_STORAGE_IMAGE,
+	VK_DESCRIPTOR_POOL_TYPE_UNIFORM_TEXEL_BUFFER,
+	VK_DESCRIPTOR_POOL_TYPE_STORAGE_TEXEL_BUFFER,
+	VK_DESCRIPTOR_POOL_TYPE_UNIFORM_BUFFER,
+	VK_DESCRIPTOR_POOL_TYPE_STORAGE_BUFFER,
+	VK_DESCRIPTOR_POOL_TYPE_UNIFORM_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_POOL_TYPE_STORAGE_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_POOL_TYPE_ACCELERATION_STRUCTURE,
+	VK_DESCRIPTOR_POOL_TYPE_COUNT,
+};
+
+struct VkDescriptorPoolUsage
+{
+	uint32_t												SetCount;
+	uint32_t												DescriptorCounts[VK_DESCRIPTOR_POOL_TYPE_COUNT];
+};
+
+struct VkUploadChunk
+{
+	VkBuffer												Buffer;			// Null if the slot is unused
+	VmaAllocation											Allocation;
+	uint8_t*												MappedData;
+	VkDeviceSize											Size;
+	VkDeviceSize											Head;
+	uint32_t												FramesInFlight;	// Submitted frames that allocated from the chunk and have not retired yet
+	bool													IsPending;		// Allocated from since the last submitted frame
+};
+
+struct VkUploadStats
+{
+	VkDeviceSize											BytesLastFrame;
+	VkDeviceSize											Occupancy;		// Bytes allocated by frames that are pending or in flight
+	VkDeviceSize											PeakOccupancy;
+	VkDeviceSize											Capacity;		// Total size of all chunks
+	uint32_t												ChunkCount;
+	float													StallTimeLastFrame;	// Milliseconds spent waiting for frames to retire upload memory
+	float													StallTimeTotal;
+	VkDeviceSize											DirectBytesLastFrame;	// Read in place from device-local upload memory, instead of copied
+	VkDeviceSize											DirectBytesTotal;
+};
+
+// What device memory is spent on. Allocations are counted per category for the memory overlay, and named after it
+// in the statistics dump.
+enum VkMemoryCategory
+{
+	VK_MEMORY_CATEGORY_GEOMETRY = 0,						// Vertex, index and material buffers of models
+	VK_MEMORY_CATEGORY_TEXTURES,
+	VK_MEMORY_CATEGORY_ACCELERATION_STRUCTURES,				// With their scratch and instance buffers
+	VK_MEMORY_CATEGORY_RENDER_TARGETS,						// Recreated when the render size changes, and transient textures
+	VK_MEMORY_CATEGORY_UPLOAD,								// Chunks of the upload ring
+	VK_MEMORY_CATEGORY_OTHER,
+	VK_MEMORY_CATEGORY_COUNT,
+};
+
+struct VkMemoryCategoryStats
+{
+	VkDeviceSize											Bytes;
+	uint32_t												AllocationCount;
+};
+
+// How long allocations live. Each lifetime has pools of its own, so that allocations that come and go often do not
+// leave holes between the ones that stay.
+enum VkMemoryPool
+{
+	VK_MEMORY_POOL_STATIC = 0,								// Geometry, textures, acceleration structures and the rest
+	VK_MEMORY_POOL_RESOLUTION,								// Render targets, recreated when the render size changes
+	VK_MEMORY_POOL_TRANSIENT,								// Upload ring chunks, which come and go with the upload traffic
+	VK_MEMORY_POOL_COUNT,
+};
+
+struct VkMemoryPoolStats
+{
+	VkDeviceSize											BlockBytes;
+	VkDeviceSize											UsedBytes;
+	VkDeviceSize											LargestFreeRange;
+	uint32_t												BlockCount;
+	uint32_t												AllocationCount;
+	uint32_t												FreeRangeCount;
+};
+
+struct VkTexture;
+
+// A buffer or texture whose allocation defragmentation may move. The handles it is registered with are replaced in
+// place when it moves.
+struct VkMovable
+{
+	VmaAllocation											Allocation;
+	VkBuffer*												Buffer;			// NULL for textures
+	VkBufferCreateInfo										BufferInfo;		// To create the buffer again where it moves
+	VkTexture*												Texture;		// NULL for buffers
+	VkImageAspectFlags										AspectMask;
+};
+
+// A buffer or texture that was copied into another place. Whatever refers to the old handles, in descriptors or by
+// device address, has to switch over to the new ones, the old ones are destroyed once the frame that copied them has
+// retired.
+struct VkMove
+{
+	VkBuffer												OldBuffer;		// VK_NULL_HANDLE for textures
+	VkBuffer												NewBuffer;
+	VkDeviceAddress											OldAddress;		// 0 without SHADER_DEVICE_ADDRESS usage
+	VkDeviceAddress											NewAddress;
+	VkImageView												OldImageView;	// VK_NULL_HANDLE for buffers
+	VkImageView												NewImageView;
+};
+
+struct VkDefragmentationStats
+{
+	VkDeviceSize											BytesMoved;
+	uint32_t												AllocationsMoved;
+	uint32_t												PassCount;				// That moved anything
+	float													FragmentationBefore;	// Of the static pool, before the first pass moved anything
+};
+
+// Per job worker, so that recording on several threads at once needs no locks
+struct VkRecordThread
+{
+	std::vector<VkCommandPool>								CommandPools;				// Per frame
+	std::vector<std::vector<VkCommandBuffer>>				SecondaryCommandBuffers;	// Per frame, reused once the frame has retired
+	std::vector<uint32_t>									SecondaryCommandBuffersUsed;
+
+	// The main thread uses the shared pools, arenas and upload chunks instead
+	std::vector<std::vector<VkDescriptorPool>>				DescriptorPools;			// Per frame, more than one if the thread outgrew the first
+	VkDescriptorPoolUsage									DescriptorPoolCapacity;
+	std::vector<VkArena>									FrameArenas;
+	VkAllocation											UploadBlock;				// Carved out of the shared upload chunks for the current frame
+	VkDeviceSize											UploadBlockSize;
+	VkDeviceSize											UploadBlockHead;
+};
+
+struct VkFrameStats
+{
+	float													CpuWaitTimeLastFrame;	// Milliseconds the CPU spent blocked on the GPU or the presentation engine
+	float													PresentIntervalLastFrame;	// Milliseconds between the last two presents
+};
+
+struct VkTimestampLabel
+{
+	uint32_t												Label;			// Index into TimestampLabelsResult
+	uint32_t												Query;			// Begin query, end query follows
+};
+
+struct VkTimestampLabelHistory
+{
+	std::string												Name;
+	const char*												NamePointer;	// Pointer last pushed with, checked before comparing strings
+	uint32_t												Parent;			// Label that enclosed the first push, UINT32_MAX for top level labels
+	uint32_t												Depth;
+	std::vector<float>										Samples;		// Ring buffer of the most recent durations in milliseconds
+	uint64_t												SampleCount;	// Total number of samples ever written
+};
+
+struct VkLabelStats
+{
+	float													Last;
+	float													Min;
+	float													Max;
+	float													P50;
+	float													P95;
+	float													P99;
+};
+
 enum VkDisplayMode
 {
 	VK_DISPLAY_MODE_SDR = 0,
@@ -41,6 +242,15 @@ enum VkDisplayMode
 	VK_DISPLAY_MODE_COUNT,
 };
 
+enum VkPresentMode
+{
+	VK_PRESENT_MODE_FIFO = 0,
+	VK_PRESENT_MODE_FIFO_RELAXED,
+	VK_PRESENT_MODE_MAILBOX,
+	VK_PRESENT_MODE_IMMEDIATE,
+	VK_PRESENT_MODE_COUNT,
+};
+
 struct _Vk
 {
 	VkInstance												Instance;
@@ -49,59 +259,150 @@ struct _Vk
 
 	VkSurfaceKHR											Surface;
 
+	bool													IsHeadless;
+	bool													SerializeBarriers;			// Every barrier waits on all commands before it
+
 	VkPhysicalDevice										PhysicalDevice;
 	VkPhysicalDeviceProperties								PhysicalDeviceProperties;
 
 	VkDisplayMode											DisplayMode;
 	bool													IsDisplayModeSupported[VK_DISPLAY_MODE_COUNT];
 
+	VkPresentMode											PresentMode;				// In use, which is FIFO if the requested mode is not supported
+	bool													IsPresentModeSupported[VK_PRESENT_MODE_COUNT];
+
 	bool													IsRayTracingSupported;
+	bool													IsCalibratedTimestampsSupported;
+	bool													IsMemoryBudgetSupported;	// Otherwise budgets are estimated from heap sizes
+	bool													IsUploadDeviceLocal;		// Upload memory is device local and written by the host directly, ReBAR or UMA
+	uint32_t												UploadMemoryTypeBits;		// Device-local, host-visible types upload memory comes from, if so
 
 	VkDevice												Device;
 
 	VkQueue													GraphicsQueue;
 	uint32_t												GraphicsQueueIndex;
 
+	bool													IsTransferQueueSupported;	// Dedicated transfer queue family
+	VkQueue													TransferQueue;
+	uint32_t												TransferQueueIndex;			// Graphics queue family if there is no dedicated one
+	VkCommandPool											TransferCommandPool;
+	VkCommandBuffer											TransferCommandBuffer;		// Being recorded, null if nothing is pending
+	std::vector<std::pair<VkCommandBuffer, uint64_t>>		TransferCommandBuffersInFlight;	// With the semaphore value that signals completion
+	VkDeviceSize											TransferBytesPending;
+	VkSemaphore												TransferSemaphore;			// Timeline
+	uint64_t												TransferSemaphoreValue;		// Last value submitted
+	uint64_t												TransferSemaphoreValueWaited;	// Last value waited on by the graphics queue
+
+	bool													IsComputeQueueSupported;	// Compute queue family without graphics, that can time stamp
+	bool													UseAsyncCompute;			// Supported and not turned off
+	VkQueue													ComputeQueue;
+	uint32_t												ComputeQueueIndex;			// Graphics queue family if there is no compute-only one
+	VkCommandPool											ComputeCommandPool;
+	VkSemaphore												ComputeSemaphore;			// Timeline, signalled by every compute submission
+	uint64_t												ComputeSemaphoreValue;		// Last value submitted
+	uint64_t												ComputeSemaphoreValueToWait;	// By the next graphics submission
+	uint64_t												ComputeSemaphoreValueWaited;	// Last value waited on by the graphics queue
+	VkSemaphore												GraphicsSemaphore;			// Timeline, signalled by every graphics submission of a frame
+	uint64_t												GraphicsSemaphoreValue;		// Last value submitted
+	uint64_t												GraphicsSemaphoreValueToWait;	// By the compute commands being recorded
+	uint32_t												ComputeSharingQueueFamilies[3];	// Graphics, compute and transfer if there is a transfer queue, of the resources async compute passes use
+	uint32_t												ComputeSharingQueueFamilyCount;
+
 	VkSwapchainKHR											Swapchain;
+	uint32_t												SwapchainGeneration;		// Incremented every time the images are replaced
+	bool													IsSwapchainOutOfDate;		// No longer matches the surface, recreate on the next resize
 	VkExtent2D												SwapchainImageExtent;
 	uint32_t												SwapchainImageCount;
 	uint32_t												SwapchainImageIndex;
+	bool													IsBackBufferAcquired;		// This frame, false if the swapchain went out of date and could not be replaced
 	std::vector<VkImage>									SwapchainImages;
 	std::vector<VkImageView>								SwapchainImageViews;
+	std::vector<VkSemaphore>								PresentSemaphores;			// Per image, signalled when the frame that rendered into it has run
 	VkSurfaceFormatKHR										SwapchainSurfaceFormat;
+	std::vector<VmaAllocation>								OffscreenImageAllocations;	// Headless only
 
 	VmaAllocator											Allocator;
+	VkMemoryCategoryStats									MemoryCategoryStats[VK_MEMORY_CATEGORY_COUNT];
+	bool													UseMemoryPools;
+	VmaPool													MemoryPools[VK_MEMORY_POOL_COUNT][VK_MAX_MEMORY_TYPES];	// Created on first use
 
-	VkBuffer												UploadBuffer;
-	VmaAllocation											UploadBufferAllocation;
-	VkDeviceMemory											UploadBufferMemory;
-	VkDeviceSize											UploadBufferMemoryOffset;
-	uint8_t*												UploadBufferMappedData;
-	VkDeviceSize											UploadBufferHead;
-	std::vector<VkDeviceSize>								UploadBufferTails;
+	std::vector<VkMovable>									Movables;
+	std::vector<VmaAllocation>								DefragmentationAllocations;	// Of the movables, handed to the allocator
+	std::vector<VmaDefragmentationPassMoveInfo>				DefragmentationPassMoves;
+	std::vector<VkMove>										DefragmentationMoves;		// Of the last pass
+	VmaDefragmentationContext								DefragmentationContext;		// Of the pass whose copies are in flight, if any
+	uint64_t												DefragmentationFrameSemaphoreValue;	// Of the frame that copies them
+	bool													IsDefragmented;				// The last pass found nothing to move
+	VkDefragmentationStats									DefragmentationStats;
 
+	std::vector<VkUploadChunk>								UploadChunks;
+	uint32_t												UploadChunkCurr;			// UINT32_MAX if there is no current chunk
+	std::vector<uint32_t>									UploadChunksPending;
+	std::vector<std::vector<uint32_t>>						UploadChunksInFlight;
+	VkDeviceSize											UploadBytesPending;
+	std::mutex												UploadMutex;				// Job workers take upload blocks while the main thread allocates
+	std::vector<VkDeviceSize>								UploadBytesInFlight;
+	float													UploadStallTimePending;
+	VkDeviceSize											UploadDirectBytesPending;
+	VkUploadStats											UploadStats;
+
+	uint32_t												FramesInFlight;				// Independent of the swapchain image count
 	uint32_t												FrameIndexCurr;
 	uint32_t												FrameIndexNext;
 
+	VkSemaphore												FrameSemaphore;				// Timeline
+	uint64_t												FrameSemaphoreValue;		// Last value submitted
+	std::vector<uint64_t>									FrameSemaphoreValues;		// Signalled once the last frame recorded into each slot has run
+	float													FrameWaitTimePending;
+	uint64_t												LastPresentTime;			// On TraceGetTime's clock
+	VkFrameStats											FrameStats;
+
 	VkCommandPool											CommandPool;
 
-	std::vector<VkCommandBuffer>							CommandBuffers;
-	std::vector<VkFence>									CommandBufferFences;
-	std::vector<VkSemaphore>								CommandBufferSemaphores;
-	std::vector<VkSemaphore>								PresentSemaphores;
+	std::vector<VkCommandBuffer>							CommandBuffers;				// Everything up to the first use of the back buffer
+	std::vector<VkCommandBuffer>							BackBufferCommandBuffers;	// Everything after it
+	std::vector<std::vector<VkCommandBuffer>>				SplitCommandBuffers;		// Where async compute splits either of them, allocated on first use
+	std::vector<uint32_t>									SplitCommandBuffersUsed;
+	std::vector<std::vector<VkCommandBuffer>>				ComputeCommandBuffers;		// Allocated on first use
+	std::vector<uint32_t>									ComputeCommandBuffersUsed;
+	VkCommandBuffer											FrameCommandBuffer;			// The graphics commands of the frame are recorded into
+	bool													IsAcquireWaitPending;		// The next graphics submission waits for the back buffer
+	std::vector<VkSemaphore>								AcquireSemaphores;
+
+	std::vector<std::vector<VkDescriptorPool>>				DescriptorPools;			// More than one if the frame outgrew the first pool
+	std::vector<VkDescriptorPoolUsage>						DescriptorPoolUsage;		// Allocated from the frame's pools
+	VkDescriptorPoolUsage									DescriptorPoolUsagePeak;	// Over all frames that have retired
+	VkDescriptorPoolUsage									DescriptorPoolCapacity;		// Size of newly created pools
 
-	std::vector<VkDescriptorPool>							DescriptorPools;
+	VkDescriptorSetLayout									BindlessDescriptorSetLayout;	// Binding 0 sampled images, binding 1 storage buffers
+	VkDescriptorPool										BindlessDescriptorPool;
+	VkDescriptorSet											BindlessDescriptorSet;
+	std::vector<uint32_t>									BindlessTextureFreeList;
+	std::vector<uint32_t>									BindlessBufferFreeList;
 
-	std::vector<std::function<void(VkCommandBuffer)>>		RecordedCommands;
+	std::vector<VkArena>									FrameArenas;				// Reset once the frame has retired
+	VkArena													RecordedCommandsArena;		// Reset once the commands have run
+	std::vector<VkRecordedCommand>							RecordedCommands;
+	std::vector<VkDeferredDestruction>						DeferredDestructions;		// In the order they were queued
 
-	VkQueryPool												TimestampQueryPool;
-	uint32_t												TimestampQueryPoolOffset;
-	std::vector<std::pair<std::string, uint32_t>>			TimestampLabelsPushed;
-	std::vector<std::pair<std::string, uint32_t>>			TimestampLabelsInFlight;
-	std::unordered_map<std::string, float>					TimestampLabelsResult;
+	VkPipelineCache											PipelineCache;				// Passed to every pipeline creation
+	std::string												PipelineCachePath;			// Empty if the cache is not saved
+	bool													IsPipelineCacheWarm;		// Loaded from a file made on the same device and driver
+
+	std::vector<VkRecordThread>								RecordThreads;				// Indexed by job worker, the main thread first
+
+	std::vector<VkQueryPool>								TimestampQueryPools;
+	std::vector<std::vector<VkTimestampLabel>>				TimestampLabelsInFlight;
+	std::vector<uint32_t>									TimestampLabelsPushed;		// Indices into the current frame's labels
+	std::vector<VkTimestampLabelHistory>					TimestampLabelsResult;		// Indexed by interned label
+	std::vector<uint32_t>									TimestampLabelsOrder;		// Parents before children
+	uint64_t												TimestampCalibrationGpu;	// Device ticks
+	uint64_t												TimestampCalibrationCpu;	// Nanoseconds on TraceGetTime's clock, taken at the same moment
 };
 extern _Vk													Vk;
 
+static const uint32_t										VK_MAX_FRAMES_IN_FLIGHT = 4;	// Frames in flight are clamped to [1, VK_MAX_FRAMES_IN_FLIGHT]
+
 struct VkInitializeParams
 {
 	void*													WindowHandle;	// Platform specific
@@ -109,13 +410,23 @@ struct VkInitializeParams
 	uint32_t												BackBufferWidth;
 	uint32_t												BackBufferHeight;
 	uint32_t												DesiredBackBufferCount;
+	uint32_t												FramesInFlight;
 	VkDisplayMode											DisplayMode;
+	VkPresentMode											PresentMode;
 	bool													EnableValidationLayer;
+	bool													Headless;		// Render into offscreen images instead of a swapchain
+	const char*												PipelineCachePath;	// Loaded at startup and saved at exit, NULL to start cold and not save
+	bool													SerializeBarriers;	// Ignore tracked accesses, to measure what tracking them saves
+	bool													UseMemoryPools;		// Otherwise everything comes from the default pools of the allocator
+	bool													UseDeviceLocalUpload;	// Put upload memory into device-local memory the host can write, if there is any
+	bool													UseAsyncCompute;	// Let passes run on a compute queue family of its own, if there is one
 };
 void														VkInitialize(const VkInitializeParams& params);
 void														VkTerminate();
 
-void														VkResize(uint32_t width, uint32_t height, VkDisplayMode display_mode);
+// Does not wait for the GPU, the images the frames in flight still use are destroyed once they have retired
+void														VkResize(uint32_t width, uint32_t height, VkDisplayMode display_mode, VkPresentMode present_mode);
+void														VkSetFramesInFlight(uint32_t frames_in_flight);	// The device has to be idle
 
 struct VkAllocation
 {
@@ -125,11 +436,88 @@ struct VkAllocation
 };
 VkAllocation												VkAllocateUploadBuffer(VkDeviceSize size, VkDeviceSize alignment = 256);
 
-void														VkRecordCommands(const std::function<void(VkCommandBuffer)>& commands);
+// Upload memory that the GPU reads in place this frame, as vertices, indices or constants, rather than copying it into
+// a buffer of its own. Only worth it where the upload memory is device local, which counts it as a copy saved.
+VkAllocation												VkAllocateDirectUploadBuffer(VkDeviceSize size, VkDeviceSize alignment = 256);
+
+// Like their vma counterparts, and count the allocation towards category. Allocations come from the pools of the
+// lifetime of their category, or from the default pools if they do not fit into a block of those.
+void														VkCreateBuffer(const VkBufferCreateInfo& buffer_info, const VmaAllocationCreateInfo& allocation_create_info, VkMemoryCategory category, VkBuffer& buffer, VmaAllocation& allocation, VmaAllocationInfo* allocation_info = NULL);
+void														VkCreateImage(const VkImageCreateInfo& image_info, const VmaAllocationCreateInfo& allocation_create_info, VkMemoryCategory category, VkImage& image, VmaAllocation& allocation);
+void														VkAllocateMemory(const VkMemoryRequirements& requirements, const VmaAllocationCreateInfo& allocation_create_info, VkMemoryCategory category, VmaAllocation& allocation);
+void														VkDestroyBuffer(VkBuffer buffer, VmaAllocation allocation);
+void														VkDestroyImage(VkImage image, VmaAllocation allocation);
+void														VkFreeMemory(VmaAllocation allocation);
+
+const char*													VkGetMemoryCategoryName(VkMemoryCategory category);
+const char*													VkGetMemoryPoolName(VkMemoryPool pool);
+VkMemoryPoolStats											VkGetMemoryPoolStats(VkMemoryPool pool);	// Over all memory types it has blocks in
+VkMemoryPoolStats											VkGetMemoryTotalStats();	// Over all pools, default and custom
+float														VkGetMemoryFragmentation(const VkMemoryPoolStats& stats);	// 0 while the free memory is one range, towards 1 as it splits up
+void														VkWriteMemoryStats(const char* filepath);	// Every block and allocation as JSON, from vmaBuildStatsString
+
+// Defragmentation compacts the static pool a few allocations at a time. Each frame copies at most max_bytes worth of
+// movables into the holes, in cmd before anything else of the frame, and returns what moved so that their owners can
+// update what refers to them. While the copies are in flight static allocations come from the default pools. Needs the
+// memory pools, and movables need TRANSFER_SRC usage as well as TRANSFER_DST.
+void														VkAddMovableBuffer(VkBuffer& buffer, VmaAllocation allocation, const VkBufferCreateInfo& buffer_info);
+void														VkAddMovableTexture(VkTexture& texture, VkImageAspectFlags aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT);
+void														VkRemoveMovable(VmaAllocation allocation);	// Before it is destroyed
+const std::vector<VkMove>&									VkDefragment(VkCommandBuffer cmd, VkDeviceSize max_bytes);
+
+// Valid until the current frame has retired on the GPU
+void*														VkAllocateFrameMemory(size_t size, size_t alignment = alignof(std::max_align_t));
 
+template<typename F>
+void														VkRecordCommands(F&& commands);
+
+// For resources that frames in flight may still use, destroy is called once they have all retired
+template<typename F>
+void														VkDestroyDeferred(F&& destroy);
+
+// Runs record(task) for every task below task_count as jobs, and returns once all have run. Tasks may allocate upload
+// memory, frame memory and descriptor sets, and record into secondary command buffers. Labels, VkRecordCommands and
+// transfer commands stay on the main thread.
+template<typename F>
+void														VkRecordParallel(uint32_t task_count, F&& record);
+uint32_t													VkGetRecordThreadCount();	// Including the main thread
+
+// Valid until the current frame has retired. With a render pass, the commands continue its first subpass on framebuffer.
+VkCommandBuffer												VkBeginSecondaryCommands(VkRenderPass render_pass = VK_NULL_HANDLE, VkFramebuffer framebuffer = VK_NULL_HANDLE);
+
+// Records commands on the transfer queue right away, and graphics commands to run once the transfer has completed.
+// Falls back to recording both on the graphics queue if there is no dedicated transfer queue.
+template<typename T, typename G>
+void														VkRecordTransferCommands(VkDeviceSize upload_size, T&& transfer_commands, G&& graphics_commands);
+VkCommandBuffer												VkBeginTransferCommands();
+void														VkEndTransferCommands(VkDeviceSize upload_size);
+void														VkFlushTransferCommands();
+
+// Blocks until no more than max_queued_frames submitted frames are still running on the GPU. Called right before
+// input is sampled, it bounds the time from input to present at the cost of GPU idle time.
+void														VkWaitForFrameLatency(uint32_t max_queued_frames);
+
+// Commands recorded before VkAcquireBackBuffer are submitted without waiting for the presentation engine,
+// the back buffer may only be used from the command buffer it returns
 VkCommandBuffer												VkBeginFrame();
+VkCommandBuffer												VkAcquireBackBuffer();
 void														VkEndFrame();
 
+// Async compute, only with Vk.UseAsyncCompute. Compute commands run on the compute queue next to the graphics commands
+// of the frame, and the two are split into submissions wherever one waits on the other. Compute commands wait on the
+// graphics commands submitted before VkBeginComputeCommands, VkSubmitGraphicsCommands submits those recorded so far
+// and returns the command buffer the frame continues in. Graphics commands submitted after VkWaitComputeCommands wait
+// on the compute commands ended before it. The frame retires once both have run.
+VkCommandBuffer												VkSubmitGraphicsCommands();
+VkCommandBuffer												VkBeginComputeCommands();
+void														VkEndComputeCommands(VkCommandBuffer cmd);
+void														VkWaitComputeCommands();
+
+// With async compute, makes an image shared concurrently by the graphics and compute queue families, for the render
+// graph textures that async compute passes use. Everything else stays exclusive to the graphics queue. Images whose
+// contents are uploaded are shared with the transfer queue family too, concurrent images cannot change owner.
+void														VkShareWithComputeQueue(VkImageCreateInfo& image_info, bool is_uploaded = false);
+
 struct VkDescriptorSetEntry
 {
 	uint32_t												Binding;
@@ -156,8 +544,96 @@ struct VkDescriptorSetEntry
 	VkDescriptorSetEntry(uint32_t binding, VkDescriptorType type, uint32_t array_index, uint32_t array_count, const VkDescriptorImageInfo* infos);
 	VkDescriptorSetEntry(uint32_t binding, VkDescriptorType type, uint32_t array_index, uint32_t array_count, const VkDescriptorBufferInfo* infos);
 };
+VkDescriptorSet												VkCreateDescriptorSet(VkDescriptorPool pool, VkDescriptorSetLayout layout, std::initializer_list<VkDescriptorSetEntry> entries);
 VkDescriptorSet												VkCreateDescriptorSetForCurrentFrame(VkDescriptorSetLayout layout, std::initializer_list<VkDescriptorSetEntry> entries);
+
+// One per descriptor of a template, in the order of the bindings it was created from
+union VkDescriptorData
+{
+	VkDescriptorImageInfo									ImageInfo;
+	VkDescriptorBufferInfo									BufferInfo;
+	VkBufferView											TexelBufferInfo;
+	VkAccelerationStructureKHR								AccelerationStructureInfo;
+
+	VkDescriptorData(VkImageView image_view, VkImageLayout image_layout, VkSampler sampler = NULL);
+	VkDescriptorData(VkBuffer buffer, VkDeviceSize offset = 0ULL, VkDeviceSize size = VK_WHOLE_SIZE);
+	VkDescriptorData(VkAccelerationStructureKHR acceleration_structure);
+};
+
+struct VkDescriptorSetTemplate
+{
+	VkDescriptorSetLayout									Layout;			// Not owned by the template
+	VkDescriptorUpdateTemplate								UpdateTemplate;
+	uint32_t												DescriptorCount;
+	VkDescriptorPoolUsage									PoolUsage;		// Of one set
+};
+VkDescriptorSetTemplate										VkCreateDescriptorSetTemplate(VkDescriptorSetLayout layout, const VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count);
+void														VkDestroyDescriptorSetTemplate(const VkDescriptorSetTemplate& set_template);
+VkDescriptorSet												VkCreateDescriptorSetForCurrentFrame(const VkDescriptorSetTemplate& set_template, std::initializer_list<VkDescriptorData> descriptors);
+
+// Slots in the global bindless set, shaders index it directly. A slot must not be used by frames in flight when it is removed
+uint32_t													VkAddBindlessTexture(VkImageView image_view);
+uint32_t													VkAddBindlessBuffer(VkBuffer buffer, VkDeviceSize offset = 0ULL, VkDeviceSize size = VK_WHOLE_SIZE);
+void														VkRemoveBindlessTexture(uint32_t index);
+void														VkRemoveBindlessBuffer(uint32_t index);
 															
-void														VkPushLabel(VkCommandBuffer cmd, const std::string& label);
+// Labels are matched by pointer before they are compared, so the string must not change while the device lives
+void														VkPushLabel(VkCommandBuffer cmd, const char* label);
 void														VkPopLabel(VkCommandBuffer cmd);
-float														VkGetLabel(const std::string& label);
+void														VkFlushTimestampLabels();	// Device must be idle
+uint32_t													VkFindLabel(const char* label);	// UINT32_MAX if the label has never been pushed
+float														VkGetLabel(const char* label);
+VkLabelStats												VkGetLabelStats(uint32_t label);
+
+void														VkCalibrateTimestamps();
+
+template<typename F>
+void VkRecordCommands(F&& commands)
+{
+	typedef typename std::decay<F>::type Commands;
+
+	void* memory = VkArenaAllocate(Vk.RecordedCommandsArena, sizeof(Commands), alignof(Commands));
+	new (memory) Commands(std::forward<F>(commands));
+
+	VkRecordedCommand recorded_command;
+	recorded_command.Execute = [](void* data, VkCommandBuffer cmd) { (*static_cast<Commands*>(data))(cmd); };
+	recorded_command.Destroy = [](void* data) { static_cast<Commands*>(data)->~Commands(); };
+	recorded_command.Commands = memory;
+	Vk.RecordedCommands.push_back(recorded_command);
+}
+
+template<typename F>
+void VkDestroyDeferred(F&& destroy)
+{
+	typedef typename std::decay<F>::type Destruction;
+
+	// Unlike recorded commands these outlive several frames, so they cannot share an arena that is reset every frame
+	VkDeferredDestruction deferred_destruction;
+	deferred_destruction.Destroy = [](void* data) { Destruction* destruction = static_cast<Destruction*>(data); (*destruction)(); delete destruction; };
+	deferred_destruction.Destruction = new Destruction(std::forward<F>(destroy));
+	deferred_destruction.FrameSemaphoreValue = Vk.FrameSemaphoreValue + 1;
+	Vk.DeferredDestructions.push_back(deferred_destruction);
+}
+
+template<typename F>
+void VkRecordParallel(uint32_t task_count, F&& record)
+{
+	assert(JobGetWorkerIndex() == 0);
+
+	JobParallelFor(task_count, std::forward<F>(record));
+}
+
+template<typename T, typename G>
+void VkRecordTransferCommands(VkDeviceSize upload_size, T&& transfer_commands, G&& graphics_commands)
+{
+	if (Vk.IsTransferQueueSupported)
+	{
+		transfer_commands(VkBeginTransferCommands());
+	}
+	else
+	{
+		VkRecordCommands(std::forward<T>(transfer_commands));
+	}
+	VkRecordCommands(std::forward<G>(graphics_commands));
+	VkEndTransferCommands(upload_size);
+}
@@ -1,4 +1,5 @@
 #include "VkTexture.h"
+#include "VkUtil.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -47,44 +48,40 @@ static VkPipelineStageFlags ToVkPipelineStageMask(VkImageLayout layout)
     return VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 }
 
-VkTexture VkTextureCreate(const VkTextureCreateParams& params)
+static VkImageCreateInfo GetImageCreateInfo(const VkTexture& texture, bool is_uploaded = false)
 {
     VkImageCreateInfo image_info = {};
     image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    image_info.imageType = params.Type;
-    image_info.extent.width = params.Width;
-    image_info.extent.height = params.Height;
-    image_info.extent.depth = params.Depth;
-    image_info.mipLevels = params.GenerateMipmaps ? static_cast<uint32_t>(log(static_cast<double>(VkMax(params.Width, params.Height))) / log(2)) + 1 : 1;
+    image_info.imageType = texture.Type;
+    image_info.extent.width = texture.Width;
+    image_info.extent.height = texture.Height;
+    image_info.extent.depth = texture.Depth;
+    image_info.mipLevels = texture.MipLevels;
     image_info.arrayLayers = 1;
-    image_info.format = params.Format;
+    image_info.format = texture.Format;
     image_info.samples = VK_SAMPLE_COUNT_1_BIT;
     image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-    image_info.usage = params.Usage;
+    image_info.usage = texture.Usage;
     image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
-    VmaAllocationCreateInfo image_allocation_info = {};
-    image_allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-
-    VkImage image = VK_NULL_HANDLE;
-    VmaAllocation image_allocation = VK_NULL_HANDLE;
-    VK(vmaCreateImage(Vk.Allocator, &image_info, &image_allocation_info, &image, &image_allocation, NULL));
-
-    VkImageAspectFlags aspect_mask = ToVkImageAspectMask(params.Format);
-    VkImageAspectFlags access_mask = ToVkAccessMask(params.InitialLayout);
-    VkImageAspectFlags stage_mask = ToVkPipelineStageMask(params.InitialLayout);
-
+    if (texture.IsSharedWithCompute)
+    {
+        VkShareWithComputeQueue(image_info, is_uploaded);
+    }
+    return image_info;
+}
+static VkImageView CreateImageView(const VkTexture& texture)
+{
     VkImageViewCreateInfo image_view_info = {};
     image_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    image_view_info.image = image;
-    image_view_info.viewType = params.ViewType;
-    image_view_info.format = params.Format;
+    image_view_info.image = texture.Image;
+    image_view_info.viewType = texture.ViewType;
+    image_view_info.format = texture.Format;
     image_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
     image_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
     image_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
     image_view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-    image_view_info.subresourceRange.aspectMask = aspect_mask;
+    image_view_info.subresourceRange.aspectMask = ToVkImageAspectMask(texture.Format);
     image_view_info.subresourceRange.baseMipLevel = 0;
     image_view_info.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
     image_view_info.subresourceRange.baseArrayLayer = 0;
@@ -92,126 +89,139 @@ VkTexture VkTextureCreate(const VkTextureCreateParams& params)
 
     VkImageView image_view = VK_NULL_HANDLE;
     VK(vkCreateImageView(Vk.Device, &image_view_info, NULL, &image_view));
+    return image_view;
+}
+
+VkTexture VkTextureCreate(const VkTextureCreateParams& params)
+{
+	VkTexture texture;
+    texture.Width = params.Width;
+    texture.Height = params.Height;
+    texture.Depth = params.Depth;
+    texture.MipLevels = params.GenerateMipmaps ? static_cast<uint32_t>(log(static_cast<double>(VkMax(params.Width, params.Height))) / log(2)) + 1 : 1;
+    texture.Type = params.Type;
+    texture.ViewType = params.ViewType;
+    texture.Format = params.Format;
+    texture.Usage = params.Usage;
+    texture.IsSharedWithCompute = params.IsSharedWithCompute;
+
+    const VkImageCreateInfo image_info = GetImageCreateInfo(texture, params.Data != NULL);
+    const bool is_concurrent = image_info.sharingMode == VK_SHARING_MODE_CONCURRENT;
+
+    VmaAllocationCreateInfo image_allocation_info = {};
+    image_allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VkImage image = VK_NULL_HANDLE;
+    VmaAllocation image_allocation = VK_NULL_HANDLE;
+    VkCreateImage(image_info, image_allocation_info, params.Category, image, image_allocation);
+    texture.Image = image;
+
+    VkImageAspectFlags aspect_mask = ToVkImageAspectMask(params.Format);
+    VkImageAspectFlags access_mask = ToVkAccessMask(params.InitialLayout);
+    VkImageAspectFlags stage_mask = ToVkPipelineStageMask(params.InitialLayout);
+
+    VkImageView image_view = CreateImageView(texture);
 
     if (params.Data != NULL)
     {
         VkAllocation allocation = VkAllocateUploadBuffer(params.DataSize);
         memcpy(allocation.Data, params.Data, params.DataSize);
 
-        if (params.GenerateMipmaps)
-        {
-            VkRecordCommands(
-                [=](VkCommandBuffer cmd)
+        // The top mip is copied on the transfer queue, the rest of the mips are blitted on the graphics queue
+        const VkImageLayout transfer_layout = params.GenerateMipmaps ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : params.InitialLayout;
+        const VkAccessFlags transfer_access_mask = params.GenerateMipmaps ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : access_mask;
+        const VkPipelineStageFlags transfer_stage_mask = params.GenerateMipmaps ? VK_PIPELINE_STAGE_TRANSFER_BIT : stage_mask;
+
+        VkRecordTransferCommands(params.DataSize,
+            [=](VkCommandBuffer cmd)
+            {
+                VkImageMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = image;
+                barrier.subresourceRange.aspectMask = aspect_mask;
+                barrier.subresourceRange.baseMipLevel = 0;
+                barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+                barrier.subresourceRange.baseArrayLayer = 0;
+                barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+                VkBufferImageCopy copy_region = {};
+                copy_region.bufferOffset = allocation.Offset;
+                copy_region.imageSubresource.aspectMask = aspect_mask;
+                copy_region.imageSubresource.mipLevel = 0;
+                copy_region.imageSubresource.baseArrayLayer = 0;
+                copy_region.imageSubresource.layerCount = 1;
+                copy_region.imageExtent.width = image_info.extent.width;
+                copy_region.imageExtent.height = image_info.extent.height;
+                copy_region.imageExtent.depth = 1;
+                vkCmdCopyBufferToImage(cmd, allocation.Buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+
+                VkUtilTransferImageOwnership(cmd, false, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, transfer_layout, aspect_mask, transfer_access_mask, transfer_stage_mask, is_concurrent);
+            },
+            [=](VkCommandBuffer cmd)
+            {
+                VkUtilTransferImageOwnership(cmd, true, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, transfer_layout, aspect_mask, transfer_access_mask, transfer_stage_mask, is_concurrent);
+
+                if (!params.GenerateMipmaps)
+                    return;
+
+                VkImageMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = image;
+                barrier.subresourceRange.aspectMask = aspect_mask;
+                barrier.subresourceRange.baseArrayLayer = 0;
+                barrier.subresourceRange.layerCount = 1;
+
+                uint32_t mip_width = image_info.extent.width;
+                uint32_t mip_height = image_info.extent.height;
+                for (uint32_t mip = 1; mip < image_info.mipLevels; ++mip)
                 {
-                    VkImageMemoryBarrier barrier = {};
-                    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier.image = image;
-                    barrier.subresourceRange.aspectMask = aspect_mask;
-                    barrier.subresourceRange.baseMipLevel = 0;
-                    barrier.subresourceRange.levelCount = image_info.mipLevels;
-                    barrier.subresourceRange.baseArrayLayer = 0;
-                    barrier.subresourceRange.layerCount = 1;
-                    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    barrier.srcAccessMask = 0;
-                    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
-
-                    VkBufferImageCopy copy_region = {};
-                    copy_region.bufferOffset = allocation.Offset;
-                    copy_region.imageSubresource.aspectMask = aspect_mask;
-                    copy_region.imageSubresource.mipLevel = 0;
-                    copy_region.imageSubresource.baseArrayLayer = 0;
-                    copy_region.imageSubresource.layerCount = 1;
-                    copy_region.imageExtent.width = image_info.extent.width;
-                    copy_region.imageExtent.height = image_info.extent.height;
-                    copy_region.imageExtent.depth = 1;
-                    vkCmdCopyBufferToImage(cmd, allocation.Buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
-
-                    uint32_t mip_width = image_info.extent.width;
-                    uint32_t mip_height = image_info.extent.height;
-                    for (uint32_t mip = 1; mip < image_info.mipLevels; ++mip)
-                    {
-                        barrier.subresourceRange.baseMipLevel = mip - 1;
-                        barrier.subresourceRange.levelCount = 1;
-                        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-                        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
-
-                        VkImageBlit region = {};
-                        region.srcOffsets[1].x = mip_width;
-                        region.srcOffsets[1].y = mip_height;
-                        region.dstOffsets[1].x = VkMax(mip_width >> 1U, 1U);
-                        region.dstOffsets[1].y = VkMax(mip_height >> 1U, 1U);
-                        region.srcOffsets[1].z = region.dstOffsets[1].z = 1;
-                        region.srcSubresource.mipLevel = mip - 1;
-                        region.dstSubresource.mipLevel = mip;
-                        region.srcSubresource.aspectMask = region.dstSubresource.aspectMask = aspect_mask;
-                        region.srcSubresource.baseArrayLayer = region.dstSubresource.baseArrayLayer = 0;
-                        region.srcSubresource.layerCount = region.dstSubresource.layerCount = 1;
-                        vkCmdBlitImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
-
-                        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                        barrier.newLayout = params.InitialLayout;
-                        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-                        barrier.dstAccessMask = access_mask;
-                        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, stage_mask, 0, 0, NULL, 0, NULL, 1, &barrier);
-
-                        mip_width = VkMax(mip_width >> 1U, 1U);
-                        mip_height = VkMax(mip_height >> 1U, 1U);
-                    }
-
-                    barrier.subresourceRange.baseMipLevel = image_info.mipLevels - 1;
+                    barrier.subresourceRange.baseMipLevel = mip - 1;
+                    barrier.subresourceRange.levelCount = 1;
                     barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    barrier.newLayout = params.InitialLayout;
+                    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
                     barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    barrier.dstAccessMask = access_mask;
-                    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, stage_mask, 0, 0, NULL, 0, NULL, 1, &barrier);
-                });
-        }
-        else
-        {
-            VkRecordCommands(
-                [=](VkCommandBuffer cmd)
-                {
-                    VkImageMemoryBarrier barrier = {};
-                    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                    barrier.image = image;
-                    barrier.subresourceRange.aspectMask = aspect_mask;
-                    barrier.subresourceRange.baseMipLevel = 0;
-                    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-                    barrier.subresourceRange.baseArrayLayer = 0;
-                    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-                    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    barrier.srcAccessMask = 0;
-                    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-                    VkBufferImageCopy copy_region = {};
-                    copy_region.bufferOffset = allocation.Offset;
-                    copy_region.imageSubresource.aspectMask = aspect_mask;
-                    copy_region.imageSubresource.mipLevel = 0;
-                    copy_region.imageSubresource.baseArrayLayer = 0;
-                    copy_region.imageSubresource.layerCount = 1;
-                    copy_region.imageExtent.width = image_info.extent.width;
-                    copy_region.imageExtent.height = image_info.extent.height;
-                    copy_region.imageExtent.depth = 1;
-                    vkCmdCopyBufferToImage(cmd, allocation.Buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+                    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+                    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 
-                    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                    VkImageBlit region = {};
+                    region.srcOffsets[1].x = mip_width;
+                    region.srcOffsets[1].y = mip_height;
+                    region.dstOffsets[1].x = VkMax(mip_width >> 1U, 1U);
+                    region.dstOffsets[1].y = VkMax(mip_height >> 1U, 1U);
+                    region.srcOffsets[1].z = region.dstOffsets[1].z = 1;
+                    region.srcSubresource.mipLevel = mip - 1;
+                    region.dstSubresource.mipLevel = mip;
+                    region.srcSubresource.aspectMask = region.dstSubresource.aspectMask = aspect_mask;
+                    region.srcSubresource.baseArrayLayer = region.dstSubresource.baseArrayLayer = 0;
+                    region.srcSubresource.layerCount = region.dstSubresource.layerCount = 1;
+                    vkCmdBlitImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+
+                    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
                     barrier.newLayout = params.InitialLayout;
-                    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
                     barrier.dstAccessMask = access_mask;
-                    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, stage_mask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-                });
-        }
+                    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, stage_mask, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+                    mip_width = VkMax(mip_width >> 1U, 1U);
+                    mip_height = VkMax(mip_height >> 1U, 1U);
+                }
+
+                barrier.subresourceRange.baseMipLevel = image_info.mipLevels - 1;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.newLayout = params.InitialLayout;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = access_mask;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, stage_mask, 0, 0, NULL, 0, NULL, 1, &barrier);
+            });
     }
     else
     {
@@ -236,16 +246,13 @@ VkTexture VkTextureCreate(const VkTextureCreateParams& params)
             });
     }
 
-	VkTexture texture;
-    texture.Image = image;
     texture.ImageView = image_view;
     texture.ImageAllocation = image_allocation;
-    texture.Width = params.Width;
-    texture.Height = params.Height;
-    texture.Depth = params.Depth;
+    texture.State.Layout = params.InitialLayout;
+    texture.State.WriteStages = stage_mask;	// Of the barrier that moved it into its initial layout
 	return texture;
 }
-VkTexture VkTextureLoad(const char* filepath, bool srgb)
+VkTexture VkTextureLoad(const char* filepath, bool srgb, bool is_shared_with_compute)
 {
     int width, height, component_count;
     stbi_uc* data = stbi_load(filepath, &width, &height, &component_count, STBI_rgb_alpha);
@@ -266,6 +273,7 @@ VkTexture VkTextureLoad(const char* filepath, bool srgb)
     params.Data = data;
     params.DataSize = data_size;
     params.GenerateMipmaps = true;
+    params.IsSharedWithCompute = is_shared_with_compute;
 	VkTexture texture = VkTextureCreate(params);
 
     stbi_image_free(data);
@@ -310,5 +318,17 @@ VkTexture VkTextureLoadEXR(const char* filepath)
 void VkTextureDestroy(const VkTexture& texture)
 {
     vkDestroyImageView(Vk.Device, texture.ImageView, NULL);
-    vmaDestroyImage(Vk.Allocator, texture.Image, texture.ImageAllocation);
+    VkDestroyImage(texture.Image, texture.ImageAllocation);
+}
+
+VkTexture VkTextureCreateAt(const VkTexture& texture, VkDeviceMemory memory, VkDeviceSize offset)
+{
+    const VkImageCreateInfo image_info = GetImageCreateInfo(texture);
+
+    VkTexture moved_texture = texture;
+    VK(vkCreateImage(Vk.Device, &image_info, NULL, &moved_texture.Image));
+    VK(vkBindImageMemory(Vk.Device, moved_texture.Image, memory, offset));
+    moved_texture.ImageView = CreateImageView(moved_texture);
+    moved_texture.State = {};
+    return moved_texture;
 }
@@ -2,6 +2,19 @@
 
 #include "Vk.h"
 
+// What the barriers recorded through VkUtilBarrierBatch last left an image in, so that the next barrier waits on
+// exactly the accesses before it, across frames too
+struct VkTextureState
+{
+	VkImageLayout				Layout			= VK_IMAGE_LAYOUT_UNDEFINED;
+	VkPipelineStageFlags2KHR	WriteStages		= 0;	// Of the last write, or of the barrier that last changed the layout
+	VkAccessFlags2KHR			WriteAccess		= 0;
+	VkPipelineStageFlags2KHR	ReadStages		= 0;	// Since the last write
+	VkPipelineStageFlags2KHR	VisibleStages	= 0;	// The last write has been made visible to
+	VkAccessFlags2KHR			VisibleAccess	= 0;
+	bool						IsOnCompute		= false;	// Last used by an async compute pass of the render graph
+};
+
 struct VkTexture
 {
 	VkImage			    Image			= VK_NULL_HANDLE;
@@ -11,6 +24,14 @@ struct VkTexture
     uint32_t            Width			= 0;
     uint32_t            Height			= 0;
     uint32_t            Depth			= 0;
+    uint32_t            MipLevels		= 1;
+    VkImageType         Type			= VK_IMAGE_TYPE_2D;
+    VkImageViewType     ViewType		= VK_IMAGE_VIEW_TYPE_2D;
+    VkFormat            Format			= VK_FORMAT_UNDEFINED;
+    VkImageUsageFlags   Usage			= 0;
+    bool                IsSharedWithCompute	= false;
+
+	mutable VkTextureState	State			= {};	// Tracked while recording, not part of what the texture is
 };
 
 struct VkTextureCreateParams
@@ -26,8 +47,14 @@ struct VkTextureCreateParams
     const void*		    Data			= nullptr;
     size_t			    DataSize		= 0;
     bool                GenerateMipmaps	= false;
+    VkMemoryCategory    Category		= VK_MEMORY_CATEGORY_TEXTURES;
+    bool                IsSharedWithCompute	= false;	// Used by async compute passes of the render graph too
 };
 VkTexture				VkTextureCreate(const VkTextureCreateParams& params);
-VkTexture				VkTextureLoad(const char* filepath, bool srgb);
+VkTexture				VkTextureLoad(const char* filepath, bool srgb, bool is_shared_with_compute = false);
 VkTexture				VkTextureLoadEXR(const char* filepath);
 void					VkTextureDestroy(const VkTexture& texture);
+
+// Another image like texture's, bound to memory at offset instead of allocating its own, with undefined contents.
+// Takes texture's place when defragmentation moves it, so it keeps its allocation.
+VkTexture				VkTextureCreateAt(const VkTexture& texture, VkDeviceMemory memory, VkDeviceSize offset);
@@ -1,6 +1,7 @@
 #include "VkUtil.h"
 
 #include <fstream>
+#include <thread>
 
 VkRenderPass VkUtilCreateRenderPass(const VkUtilCreateRenderPassParams& params)
 {
@@ -244,7 +245,7 @@ VkPipeline VkUtilCreateGraphicsPipeline(const VkUtilCreateGraphicsPipelineParams
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 
     VkPipeline pipeline = VK_NULL_HANDLE;
-    VK(vkCreateGraphicsPipelines(Vk.Device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline));
+    VK(vkCreateGraphicsPipelines(Vk.Device, Vk.PipelineCache, 1, &pipeline_info, NULL, &pipeline));
 
     vkDestroyShaderModule(Vk.Device, vert_shader, NULL);
     vkDestroyShaderModule(Vk.Device, frag_shader, NULL);
@@ -269,45 +270,179 @@ VkPipeline VkUtilCreateComputePipeline(const VkUtilCreateComputePipelineParams&
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 
     VkPipeline pipeline = VK_NULL_HANDLE;
-    VK(vkCreateComputePipelines(Vk.Device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline));
+    VK(vkCreateComputePipelines(Vk.Device, Vk.PipelineCache, 1, &pipeline_info, NULL, &pipeline));
 
     vkDestroyShaderModule(Vk.Device, comp_shader, NULL);
 
     return pipeline;
 }
 
-static inline VkAccessFlags ToVkAccessMask(VkImageLayout layout)
+VkPipeline VkUtilCreateRayTracingPipeline(const VkRayTracingPipelineCreateInfoKHR& pipeline_info)
 {
-	switch (layout)
+	VkDeferredOperationKHR operation = VK_NULL_HANDLE;
+	VK(vkCreateDeferredOperationKHR(Vk.Device, NULL, &operation));
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult create_result = vkCreateRayTracingPipelinesKHR(Vk.Device, operation, Vk.PipelineCache, 1, &pipeline_info, NULL, &pipeline);
+	if (create_result == VK_OPERATION_DEFERRED_KHR)
+	{
+		// Every join returns once there is no work left for it, the last one to return completes the operation
+		const uint32_t join_count = VkMax(VkMin(vkGetDeferredOperationMaxConcurrencyKHR(Vk.Device, operation), JobGetWorkerCount()), 1u);
+		JobParallelFor(join_count,
+			[=](uint32_t)
+			{
+				while (vkDeferredOperationJoinKHR(Vk.Device, operation) == VK_THREAD_IDLE_KHR)
+				{
+					std::this_thread::yield();
+				}
+			});
+	}
+	if (create_result == VK_OPERATION_DEFERRED_KHR || create_result == VK_OPERATION_NOT_DEFERRED_KHR)
+	{
+		create_result = vkGetDeferredOperationResultKHR(Vk.Device, operation);
+	}
+	vkDestroyDeferredOperationKHR(Vk.Device, operation, NULL);
+
+	if (create_result != VK_SUCCESS)
+	{
+		VkError("vkCreateRayTracingPipelinesKHR returned with erroneous result code " + std::to_string(static_cast<uint32_t>(create_result)));
+	}
+	return pipeline;
+}
+
+static const VkAccessFlags2KHR WRITE_ACCESS_MASK = VK_ACCESS_2_SHADER_WRITE_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR |
+	VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+
+void VkUtilAddImageBarrier(VkUtilBarrierBatch& batch, const VkTexture& texture, VkImageLayout layout, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access, VkImageAspectFlags aspect_mask)
+{
+	VkTextureState& state = texture.State;
+
+	const bool is_write = (access & WRITE_ACCESS_MASK) != 0;
+	const bool is_layout_change = layout != state.Layout;
+
+	VkPipelineStageFlags2KHR src_stages = 0;
+	VkAccessFlags2KHR src_access = 0;
+	bool is_barrier_needed = false;
+	if (is_layout_change || is_write)
+	{
+		// Writes after reads only need to wait for them to finish
+		src_stages = state.WriteStages | state.ReadStages;
+		src_access = state.WriteAccess;
+		is_barrier_needed = is_layout_change || src_stages != 0;
+	}
+	else
+	{
+		// Reads only wait on a write that has not been made visible to them yet
+		src_stages = state.WriteStages;
+		src_access = state.WriteAccess;
+		is_barrier_needed = src_stages != 0 && ((stages & ~state.VisibleStages) != 0 || (access & ~state.VisibleAccess) != 0);
+	}
+
+	// Measures what tracking saves, every use waits on everything before it like a barrier without tracking would
+	if (Vk.SerializeBarriers)
+	{
+		src_stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+		src_access = VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+		is_barrier_needed = true;
+	}
+
+	if (is_barrier_needed)
+	{
+		VkImageMemoryBarrier2KHR barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+		barrier.srcStageMask = src_stages;
+		barrier.srcAccessMask = src_access;
+		barrier.dstStageMask = Vk.SerializeBarriers ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR : stages;
+		barrier.dstAccessMask = Vk.SerializeBarriers ? VK_ACCESS_2_MEMORY_READ_BIT_KHR | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR : access;
+		barrier.oldLayout = state.Layout;
+		barrier.newLayout = layout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = texture.Image;
+		barrier.subresourceRange.aspectMask = aspect_mask;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+		batch.ImageBarriers.push_back(barrier);
+	}
+
+	if (is_write || is_layout_change)
+	{
+		// A layout transition is a write of the barrier, that later accesses wait on like any other
+		state.WriteStages = stages;
+		state.WriteAccess = access & WRITE_ACCESS_MASK;
+		state.ReadStages = 0;
+		state.VisibleStages = 0;
+		state.VisibleAccess = 0;
+	}
+	if (!is_write)
 	{
-	case VK_IMAGE_LAYOUT_GENERAL:                           return VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
-	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:          return VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:  return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:   return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
-    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:          return VK_ACCESS_SHADER_READ_BIT;
-    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:              return VK_ACCESS_TRANSFER_READ_BIT;
-	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:              return VK_ACCESS_TRANSFER_WRITE_BIT;
-    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:                   return VK_ACCESS_MEMORY_READ_BIT;
+		if (is_barrier_needed)
+		{
+			state.VisibleStages |= stages;
+			state.VisibleAccess |= access;
+		}
+		state.ReadStages |= stages;
 	}
-	return 0;
+	state.Layout = layout;
 }
-void VkUtilImageBarrier(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout, VkImageAspectFlags aspect_mask, uint32_t base_mip, uint32_t mip_count, uint32_t base_layer, uint32_t layer_count)
+
+void VkUtilFlushBarriers(VkUtilBarrierBatch& batch, VkCommandBuffer cmd)
 {
+	if (batch.ImageBarriers.empty())
+		return;
+
+	VkDependencyInfoKHR dependency_info = {};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+	dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(batch.ImageBarriers.size());
+	dependency_info.pImageMemoryBarriers = batch.ImageBarriers.data();
+	vkCmdPipelineBarrier2KHR(cmd, &dependency_info);
+
+	batch.ImageBarriers.clear();
+}
+
+void VkUtilTransferImageOwnership(VkCommandBuffer cmd, bool acquire, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout, VkImageAspectFlags aspect_mask, VkAccessFlags dst_access_mask, VkPipelineStageFlags dst_stage_mask, bool is_concurrent)
+{
+    const bool is_transferred = Vk.IsTransferQueueSupported && !is_concurrent;
+    if (acquire && !is_transferred)
+        return;
+
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.image = image;
     barrier.oldLayout = old_layout;
     barrier.newLayout = new_layout;
-    barrier.srcAccessMask = ToVkAccessMask(old_layout);
-    barrier.dstAccessMask = ToVkAccessMask(new_layout);
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.srcAccessMask = acquire ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = acquire || !Vk.IsTransferQueueSupported ? dst_access_mask : 0;
+    barrier.srcQueueFamilyIndex = is_transferred ? Vk.TransferQueueIndex : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = is_transferred ? Vk.GraphicsQueueIndex : VK_QUEUE_FAMILY_IGNORED;
     barrier.subresourceRange.aspectMask = aspect_mask;
-    barrier.subresourceRange.baseMipLevel = base_mip;
-    barrier.subresourceRange.levelCount = mip_count;
-    barrier.subresourceRange.baseArrayLayer = base_layer;
-    barrier.subresourceRange.layerCount = layer_count;
-    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    const VkPipelineStageFlags src_stage_mask = acquire ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+    const VkPipelineStageFlags stage_mask = acquire || !Vk.IsTransferQueueSupported ? dst_stage_mask : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    vkCmdPipelineBarrier(cmd, src_stage_mask, stage_mask, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+void VkUtilTransferBufferOwnership(VkCommandBuffer cmd, bool acquire, VkBuffer buffer, VkDeviceSize size, VkAccessFlags dst_access_mask, VkPipelineStageFlags dst_stage_mask)
+{
+    if (acquire && !Vk.IsTransferQueueSupported)
+        return;
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = size;
+    barrier.srcAccessMask = acquire ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = acquire || !Vk.IsTransferQueueSupported ? dst_access_mask : 0;
+    barrier.srcQueueFamilyIndex = Vk.IsTransferQueueSupported ? Vk.TransferQueueIndex : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = Vk.IsTransferQueueSupported ? Vk.GraphicsQueueIndex : VK_QUEUE_FAMILY_IGNORED;
+    const VkPipelineStageFlags src_stage_mask = acquire ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+    const VkPipelineStageFlags stage_mask = acquire || !Vk.IsTransferQueueSupported ? dst_stage_mask : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    vkCmdPipelineBarrier(cmd, src_stage_mask, stage_mask, 0, 0, NULL, 1, &barrier, 0, NULL);
 }
 
 VkDeviceAddress VkUtilGetDeviceAddress(VkBuffer buffer)
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Vk.h"
+#include "VkTexture.h"
 
 struct VkUtilCreateRenderPassParams
 {
@@ -48,7 +49,25 @@ struct VkUtilCreateComputePipelineParams
 };
 VkPipeline                                              VkUtilCreateComputePipeline(const VkUtilCreateComputePipelineParams& params);
 
-void                                                    VkUtilImageBarrier(VkCommandBuffer cmd, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout, VkImageAspectFlags aspect_mask, uint32_t base_mip = 0, uint32_t mip_count = VK_REMAINING_MIP_LEVELS, uint32_t base_layer = 0, uint32_t layer_count = VK_REMAINING_ARRAY_LAYERS);
+// Compiles as a deferred host operation that idle job workers join, so one ray tracing pipeline is spread over cores
+VkPipeline                                              VkUtilCreateRayTracingPipeline(const VkRayTracingPipelineCreateInfoKHR& pipeline_info);
+
+// Collects the barriers that move textures on to their next use, and records them as one vkCmdPipelineBarrier2KHR.
+// Each waits only on the stages that last wrote the texture, plus the reads since then if it is written or changes
+// layout, and reads that an earlier barrier already made the write visible to get none.
+struct VkUtilBarrierBatch
+{
+	std::vector<VkImageMemoryBarrier2KHR>				ImageBarriers				= {};
+};
+void                                                    VkUtilAddImageBarrier(VkUtilBarrierBatch& batch, const VkTexture& texture, VkImageLayout layout, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access, VkImageAspectFlags aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT);
+void                                                    VkUtilFlushBarriers(VkUtilBarrierBatch& batch, VkCommandBuffer cmd);
+
+// Hands a resource written on the transfer queue over to the graphics queue. The release half is recorded on the
+// transfer queue and the acquire half on the graphics queue. Without a dedicated transfer queue, the release half
+// is a regular barrier and the acquire half does nothing. Concurrent images keep no owner, the release half only
+// changes the layout and the graphics queue sees the copy through the transfer semaphore it waits on.
+void                                                    VkUtilTransferImageOwnership(VkCommandBuffer cmd, bool acquire, VkImage image, VkImageLayout old_layout, VkImageLayout new_layout, VkImageAspectFlags aspect_mask, VkAccessFlags dst_access_mask, VkPipelineStageFlags dst_stage_mask, bool is_concurrent = false);
+void                                                    VkUtilTransferBufferOwnership(VkCommandBuffer cmd, bool acquire, VkBuffer buffer, VkDeviceSize size, VkAccessFlags dst_access_mask, VkPipelineStageFlags dst_stage_mask);
 
 VkDeviceAddress                                         VkUtilGetDeviceAddress(VkBuffer buffer);
 VkDeviceAddress                                         VkUtilGetDeviceAddress(VkAccelerationStructureKHR acceleration_structure);